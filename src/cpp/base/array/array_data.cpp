@@ -32,6 +32,7 @@
 #include <lib/system/gen/php/classes/stdclass.h>
 #include <cpp/base/variable_serializer.h>
 #include <cpp/base/array/zend_array.h>
+#include <cpp/base/array/dense_array.h>
 #include <cpp/base/runtime_option.h>
 
 using namespace std;
@@ -42,6 +43,9 @@ namespace HPHP {
 
 ArrayData *ArrayData::Create() {
   if (RuntimeOption::UseZendArray) {
+    if (RuntimeOption::UseDenseArray) {
+      return StaticEmptyDenseArray::Get();
+    }
     return StaticEmptyZendArray::Get();
   }
   return StaticEmptyArray::Get();
@@ -49,7 +53,7 @@ ArrayData *ArrayData::Create() {
 
 ArrayData *ArrayData::Create(CVarRef value) {
   if (RuntimeOption::UseZendArray) {
-    ArrayData *ret = NEW(ZendArray)(1);
+    ArrayData *ret = CreateHash(1);
     ret->append(value, false);
     return ret;
   }
@@ -74,7 +78,7 @@ ArrayData *ArrayData::Create(CVarRef value) {
 
 ArrayData *ArrayData::Create(CVarRef name, CVarRef value) {
   if (RuntimeOption::UseZendArray) {
-    ArrayData *ret = NEW(ZendArray)(1);
+    ArrayData *ret = CreateHash(1);
     ret->set(name, value, false);
     return ret;
   }
@@ -119,7 +123,7 @@ ArrayData *ArrayData::Create(const std::vector<ArrayElement *> &elems,
 
   if (RuntimeOption::UseZendArray) {
     uint size = elems.size();
-    ArrayData *ret = NEW(ZendArray)(size);
+    ArrayData *ret = CreateHash(size);
     for (unsigned int i = 0; i < size; i++) {
       ArrayElement *elem = elems[i];
       if (elem->hasName()) {
@@ -195,6 +199,14 @@ ArrayData *ArrayData::Create(const std::vector<ArrayElement *> &elems,
   return ret;
 }
 
+ArrayData *ArrayData::CreateHash(uint nSize) {
+  ASSERT(RuntimeOption::UseZendArray);
+  if (RuntimeOption::UseDenseArray) {
+    return NEW(DenseArray)(nSize);
+  }
+  return NEW(ZendArray)(nSize);
+}
+
 ArrayData::~ArrayData() {
 }
 
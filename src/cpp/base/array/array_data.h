@@ -56,6 +56,13 @@ class ArrayData : public Countable {
   static ArrayData *Create(const std::vector<ArrayElement *> &elems,
                            bool replace = true);
 
+  /**
+   * With RuntimeOption::UseZendArray, create an empty ZendArray, or a
+   * DenseArray when RuntimeOption::UseDenseArray is also on, with room for
+   * nSize elements.
+   */
+  static ArrayData *CreateHash(uint nSize);
+
   /**
    * Type conversion functions. All other types are handled inside Array class.
    */
@@ -28,18 +28,11 @@ namespace ArrayFuncs {
 ///////////////////////////////////////////////////////////////////////////////
 
 /**
- * Create a copy of an element.
+ * Create a copy of an element. Copying a Variant keeps its strong binding.
  */
-inline Variant *element(CVarRef v) {
-  return NEW(Variant)(v);
-}
-inline void element(Variant *&dest, Variant *src) {
-  if (src->isReferenced()) src->setContagious();
-  dest = NEW(Variant)(*src);
-}
-template<typename T>
-void element(Variant *&dest, const T &src) {
-  dest = NEW(Variant)(src);
+inline void element(Variant &dest, const Variant &src) {
+  if (src.isReferenced()) src.setContagious();
+  dest = src;
 }
 template<typename T1, typename T2>
 void element(T1 &dest, const T2 &src) {
@@ -47,18 +40,17 @@ void element(T1 &dest, const T2 &src) {
 }
 
 /**
- * Release an element, so we can conditionally call release() on Variant*.
+ * Append a copy of an element. A temporary from element() would drop the
+ * strong binding when copied into dest, so Variants are pushed directly.
  */
-inline void release(Variant *v) {
-  v->release();
+inline void push_back(HphpVector<Variant> &dest, const Variant &src) {
+  if (src.isReferenced()) src.setContagious();
+  dest.push_back(src);
 }
-template<typename T>
-void release(const T &v) {
-}
-
-inline void set(HphpVector<Variant*> &dest, int index, Variant* const v) {
-  dest[index]->assign(*v, true);
-  ArrayFuncs::release(v);
+template<typename T1, typename T2>
+void push_back(HphpVector<T1> &dest, const T2 &src) {
+  T1 elem; ArrayFuncs::element(elem, src);
+  dest.push_back(elem);
 }
 
 template<typename T>
@@ -71,33 +63,33 @@ void set(HphpVector<T> &dest, int index, const T &v) {
  * in vector.h and map.h.
  */
 template<typename T>
-void append(HphpVector<Variant*> &dest, const HphpVector<T> &src,
+void append(HphpVector<Variant> &dest, const HphpVector<T> &src,
             unsigned int pos = 0, int len = -1) {
   unsigned int size = src.size();
   if (len >= 0 && pos + len < size) {
     size = pos + len;
   }
   for (unsigned int i = pos; i < size; i++) {
-    Variant *elem;
-    ArrayFuncs::element(elem, src[i]);
-    dest.push_back(elem);
+    dest.push_back(src[i]);
   }
 }
 
-inline void append(HphpVector<Variant*> &dest,
-                   const HphpVector<Variant*> &src,
+inline void append(HphpVector<Variant> &dest,
+                   const HphpVector<Variant> &src,
                    unsigned int pos = 0, int len = -1) {
   unsigned int size = src.size();
   if (len >= 0 && pos + len < size) {
     size = pos + len;
   }
+  if (size <= pos) return;
+
+  // reserve up front, so src[i] stays put even when src is dest itself
+  dest.reserve(dest.size() + size - pos);
   for (unsigned int i = pos; i < size; i++) {
-    Variant *elem;
-    if (src[i]->isReferenced()) {
-      src[i]->setContagious();
+    if (src[i].isReferenced()) {
+      src[i].setContagious();
     }
-    ArrayFuncs::element(elem, src[i]);
-    dest.push_back(elem);
+    dest.push_back(src[i]);
   }
 }
 
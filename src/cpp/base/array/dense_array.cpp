@@ -0,0 +1,1028 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+
+#include <cpp/base/array/dense_array.h>
+#include <cpp/base/array/array_iterator.h>
+#include <cpp/base/type_string.h>
+#include <cpp/base/type_array.h>
+#include <util/hash.h>
+
+namespace HPHP {
+
+IMPLEMENT_SMART_ALLOCATION(DenseArray, SmartAllocatorImpl::NeedRestore);
+///////////////////////////////////////////////////////////////////////////////
+// static members
+
+StaticEmptyDenseArray StaticEmptyDenseArray::s_theEmptyArray;
+
+// key of an erased element
+static StringData *const s_erased = (StringData *)1;
+
+static const uint MinSlots = 16;
+static const uint MaxPositions = 1U << 30; // slots are int32
+
+static inline void release_key(StringData *key) {
+  if (key && key->decRefCount() == 0) {
+    DELETE(StringData)(key);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// construction/destruction
+
+DenseArray::DenseArray(uint nSize /* = 0 */) :
+  m_chunks(NULL), m_chunkBase(0), m_chunkCount(0), m_chunkCap(0),
+  m_slots(NULL), m_slotCount(0), m_filled(0), m_used(0), m_size(0),
+  m_nextFree(0) {
+  m_pos = ArrayData::invalid_index;
+  if (nSize) {
+    nSize = nSize < MaxPositions ? nSize : MaxPositions;
+    m_chunkCap = (nSize + ChunkMask) >> ChunkBits;
+    m_chunks = (Element **)malloc(m_chunkCap * sizeof(Element *));
+    while (m_chunkCount < m_chunkCap) {
+      addChunk();
+    }
+    rehash(nSize);
+  }
+}
+
+DenseArray::~DenseArray() {
+  for (ssize_t pos = firstPos(); pos != ArrayData::invalid_index;
+       pos = nextPos(pos)) {
+    Element &e = elem(pos);
+    release_key(e.key);
+    e.data.~Variant();
+  }
+  freeChunks();
+  free(m_slots);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// positions
+
+bool DenseArray::live(ssize_t pos) const {
+  if (pos < ((ssize_t)m_chunkBase << ChunkBits) || pos >= (ssize_t)m_used) {
+    return false;
+  }
+  Element *chunk = m_chunks[(pos >> ChunkBits) - m_chunkBase];
+  return chunk && chunk[pos & ChunkMask].key != s_erased;
+}
+
+ssize_t DenseArray::firstPos() const {
+  return nextPos(-1);
+}
+
+ssize_t DenseArray::lastPos() const {
+  return prevPos(m_used);
+}
+
+ssize_t DenseArray::nextPos(ssize_t pos) const {
+  ssize_t begin = (ssize_t)m_chunkBase << ChunkBits;
+  if (++pos < begin) pos = begin;
+  while (pos < (ssize_t)m_used) {
+    Element *chunk = m_chunks[(pos >> ChunkBits) - m_chunkBase];
+    if (!chunk) {
+      pos = (pos | ChunkMask) + 1; // freed, all of it erased
+      continue;
+    }
+    if (chunk[pos & ChunkMask].key != s_erased) return pos;
+    pos++;
+  }
+  return ArrayData::invalid_index;
+}
+
+ssize_t DenseArray::prevPos(ssize_t pos) const {
+  ssize_t begin = (ssize_t)m_chunkBase << ChunkBits;
+  if (--pos >= (ssize_t)m_used) pos = (ssize_t)m_used - 1;
+  while (pos >= begin) {
+    Element *chunk = m_chunks[(pos >> ChunkBits) - m_chunkBase];
+    if (!chunk) {
+      pos = (pos & ~(ssize_t)ChunkMask) - 1;
+      continue;
+    }
+    if (chunk[pos & ChunkMask].key != s_erased) return pos;
+    pos--;
+  }
+  return ArrayData::invalid_index;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// iterations
+
+ssize_t DenseArray::iter_begin() const {
+  return firstPos();
+}
+
+ssize_t DenseArray::iter_end() const {
+  return lastPos();
+}
+
+ssize_t DenseArray::iter_advance(ssize_t prev) const {
+  if (prev == ArrayData::invalid_index) {
+    return ArrayData::invalid_index;
+  }
+  return nextPos(prev);
+}
+
+ssize_t DenseArray::iter_rewind(ssize_t prev) const {
+  if (prev == ArrayData::invalid_index) {
+    return ArrayData::invalid_index;
+  }
+  return prevPos(prev);
+}
+
+Variant DenseArray::getKey(ssize_t pos) const {
+  ASSERT(live(pos));
+  const Element &e = elem(pos);
+  if (e.key) {
+    return e.key;
+  }
+  return e.h;
+}
+
+Variant DenseArray::getValue(ssize_t pos) const {
+  ASSERT(live(pos));
+  return elem(pos).data;
+}
+
+CVarRef DenseArray::getValueRef(ssize_t pos) const {
+  ASSERT(live(pos));
+  return elem(pos).data;
+}
+
+bool DenseArray::isVectorData() const {
+  int64 index = 0;
+  for (ssize_t pos = firstPos(); pos != ArrayData::invalid_index;
+       pos = nextPos(pos)) {
+    const Element &e = elem(pos);
+    if (e.key || e.h != index++) return false;
+  }
+  return true;
+}
+
+Variant DenseArray::reset() {
+  m_pos = firstPos();
+  if (m_pos != ArrayData::invalid_index) {
+    return elem(m_pos).data;
+  }
+  return false;
+}
+
+Variant DenseArray::prev() {
+  if (m_pos != ArrayData::invalid_index) {
+    m_pos = prevPos(m_pos);
+    if (m_pos != ArrayData::invalid_index) {
+      return elem(m_pos).data;
+    }
+  }
+  return false;
+}
+
+Variant DenseArray::next() {
+  if (m_pos != ArrayData::invalid_index) {
+    m_pos = nextPos(m_pos);
+    if (m_pos != ArrayData::invalid_index) {
+      return elem(m_pos).data;
+    }
+  }
+  return false;
+}
+
+Variant DenseArray::end() {
+  m_pos = lastPos();
+  if (m_pos != ArrayData::invalid_index) {
+    return elem(m_pos).data;
+  }
+  return false;
+}
+
+Variant DenseArray::key() const {
+  if (m_pos != ArrayData::invalid_index) {
+    return getKey(m_pos);
+  }
+  return null;
+}
+
+Variant DenseArray::value(ssize_t &pos) const {
+  if (live(pos)) {
+    return elem(pos).data;
+  }
+  return false;
+}
+
+Variant DenseArray::current() const {
+  if (m_pos != ArrayData::invalid_index) {
+    return elem(m_pos).data;
+  }
+  return false;
+}
+
+Variant DenseArray::each() {
+  if (m_pos != ArrayData::invalid_index) {
+    Array ret;
+    Variant key = getKey(m_pos);
+    Variant value = getValue(m_pos);
+    ret.set(1, value);
+    ret.set("value", value);
+    ret.set(0, key);
+    ret.set("key", key);
+    m_pos = nextPos(m_pos);
+    return ret;
+  }
+  return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// lookups
+
+ssize_t DenseArray::find(int64 h) const {
+  if (!m_slots) return ArrayData::invalid_index;
+  uint mask = m_slotCount - 1;
+  for (uint i = (uint)h & mask; ; i = (i + 1) & mask) {
+    int32 pos = m_slots[i];
+    if (pos < 0) return ArrayData::invalid_index;
+    const Element &e = elem(pos);
+    if (e.key == NULL && e.h == h) {
+      return pos;
+    }
+  }
+}
+
+ssize_t DenseArray::find(const char *k, int len,
+                         int64 prehash /* = -1 */,
+                         int64 *h /* = NULL */) const {
+  if (prehash < 0) {
+    prehash = hash_string(k, len);
+    if (h) {
+      *h = prehash;
+    }
+  }
+  if (!m_slots) return ArrayData::invalid_index;
+  uint mask = m_slotCount - 1;
+  for (uint i = (uint)prehash & mask; ; i = (i + 1) & mask) {
+    int32 pos = m_slots[i];
+    if (pos < 0) return ArrayData::invalid_index;
+    const Element &e = elem(pos);
+    if (e.h == prehash && e.key && e.key != s_erased &&
+        e.key->size() == len && memcmp(e.key->data(), k, len) == 0) {
+      return pos;
+    }
+  }
+}
+
+bool DenseArray::exists(int64 k, int64 prehash /* = -1 */) const {
+  return find(k) != ArrayData::invalid_index;
+}
+
+bool DenseArray::exists(litstr k, int64 prehash /* = -1 */) const {
+  return find(k, strlen(k), prehash) != ArrayData::invalid_index;
+}
+
+bool DenseArray::exists(CStrRef k, int64 prehash /* = -1 */) const {
+  return find(k.data(), k.size(), prehash) != ArrayData::invalid_index;
+}
+
+bool DenseArray::exists(CVarRef k, int64 prehash /* = -1 */) const {
+  return getIndex(k, prehash) != ArrayData::invalid_index;
+}
+
+bool DenseArray::idxExists(ssize_t idx) const {
+  return live(idx);
+}
+
+Variant DenseArray::get(int64 k, int64 prehash /* = -1 */) const {
+  ssize_t pos = find(k);
+  if (pos != ArrayData::invalid_index) {
+    return elem(pos).data;
+  }
+  return null;
+}
+
+Variant DenseArray::get(litstr k, int64 prehash /* = -1 */) const {
+  ssize_t pos = find(k, strlen(k), prehash);
+  if (pos != ArrayData::invalid_index) {
+    return elem(pos).data;
+  }
+  return null;
+}
+
+Variant DenseArray::get(CStrRef k, int64 prehash /* = -1 */) const {
+  ssize_t pos = find(k.data(), k.size(), prehash);
+  if (pos != ArrayData::invalid_index) {
+    return elem(pos).data;
+  }
+  return null;
+}
+
+Variant DenseArray::get(CVarRef k, int64 prehash /* = -1 */) const {
+  ssize_t pos = getIndex(k, prehash);
+  if (pos != ArrayData::invalid_index) {
+    return elem(pos).data;
+  }
+  return null;
+}
+
+ssize_t DenseArray::getIndex(int64 k, int64 prehash /* = -1 */) const {
+  return find(k);
+}
+
+ssize_t DenseArray::getIndex(litstr k, int64 prehash /* = -1 */) const {
+  return find(k, strlen(k), prehash);
+}
+
+ssize_t DenseArray::getIndex(CStrRef k, int64 prehash /* = -1 */) const {
+  return find(k.data(), k.size(), prehash);
+}
+
+ssize_t DenseArray::getIndex(CVarRef k, int64 prehash /* = -1 */) const {
+  if (k.isNumeric()) {
+    return find(k.toInt64());
+  }
+  String key = k.toString();
+  return find(key.data(), key.size(), prehash);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// append/insert/update
+
+void DenseArray::addChunk() {
+  if (m_chunkCount == m_chunkCap) {
+    m_chunkCap = m_chunkCap ? m_chunkCap * 2 : 1;
+    m_chunks = (Element **)realloc(m_chunks, m_chunkCap * sizeof(Element *));
+  }
+  Element *chunk = (Element *)malloc(ChunkSize * sizeof(Element));
+  memset(chunk, 0, ChunkSize * sizeof(Element));
+  m_chunks[m_chunkCount++] = chunk;
+}
+
+void DenseArray::freeChunks() {
+  for (uint c = 0; c < m_chunkCount; c++) {
+    free(m_chunks[c]);
+  }
+  free(m_chunks);
+  m_chunks = NULL;
+  m_chunkCount = m_chunkCap = 0;
+}
+
+void DenseArray::pack() {
+  uint chunkCount = (m_size + ChunkMask) >> ChunkBits;
+  Element **chunks = NULL;
+  if (chunkCount) {
+    chunks = (Element **)malloc(chunkCount * sizeof(Element *));
+    for (uint c = 0; c < chunkCount; c++) {
+      chunks[c] = (Element *)malloc(ChunkSize * sizeof(Element));
+      memset(chunks[c], 0, ChunkSize * sizeof(Element));
+    }
+  }
+  uint used = 0;
+  ssize_t pos = ArrayData::invalid_index;
+  for (ssize_t i = firstPos(); i != ArrayData::invalid_index;
+       i = nextPos(i)) {
+    if (i == m_pos) pos = used;
+    memcpy(&chunks[used >> ChunkBits][used & ChunkMask], &elem(i),
+           sizeof(Element));
+    used++;
+  }
+  freeChunks();
+
+  m_chunks = chunks;
+  m_chunkBase = 0;
+  m_chunkCount = m_chunkCap = chunkCount;
+  m_used = used;
+  if (m_pos != ArrayData::invalid_index) {
+    m_pos = pos;
+  }
+  rehash(m_size);
+}
+
+void DenseArray::rehash(uint room) {
+  uint count = MinSlots;
+  while (count < (room + 1) * 2) {
+    count <<= 1;
+  }
+  if (count != m_slotCount) {
+    free(m_slots);
+    m_slots = (int32 *)malloc(count * sizeof(int32));
+    m_slotCount = count;
+  }
+  memset(m_slots, 0xff, count * sizeof(int32));
+
+  // Slots of erased elements are dropped here, and so are chunks holding
+  // nothing but erased elements, now that no probe can reach them.
+  uint mask = count - 1;
+  for (uint c = 0; c < m_chunkCount; c++) {
+    Element *chunk = m_chunks[c];
+    if (!chunk) continue;
+    uint start = (m_chunkBase + c) << ChunkBits;
+    uint end = start + ChunkSize;
+    bool dead = end <= m_used;
+    if (end > m_used) end = m_used;
+    for (uint pos = start; pos < end; pos++) {
+      const Element &e = chunk[pos - start];
+      if (e.key == s_erased) continue;
+      dead = false;
+      uint i = (uint)e.h & mask;
+      while (m_slots[i] >= 0) {
+        i = (i + 1) & mask;
+      }
+      m_slots[i] = pos;
+    }
+    if (dead) {
+      free(chunk);
+      m_chunks[c] = NULL;
+    }
+  }
+  m_filled = m_size;
+
+  uint dropped = 0;
+  while (dropped < m_chunkCount && !m_chunks[dropped]) {
+    dropped++;
+  }
+  if (dropped) {
+    m_chunkCount -= dropped;
+    m_chunkBase += dropped;
+    memmove(m_chunks, m_chunks + dropped, m_chunkCount * sizeof(Element *));
+  }
+}
+
+Variant *DenseArray::add(int64 h, StringData *key, CVarRef data) {
+  if (m_used == (m_chunkBase + m_chunkCount) << ChunkBits) {
+    if (m_used == MaxPositions) {
+      // Out of positions: the only time elements move on an insert. data
+      // may be one of them.
+      Variant tmp(data);
+      if (tmp.isReferenced()) tmp.setContagious();
+      pack();
+      if (m_used == MaxPositions) {
+        throw FatalErrorException("array has too many elements");
+      }
+      return add(h, key, tmp);
+    }
+    addChunk();
+  }
+  if ((m_filled + 1) * 2 > m_slotCount) {
+    rehash(m_size * 2);
+  }
+
+  uint pos = m_used++;
+  Element &e = elem(pos);
+  e.h = h;
+  e.key = key;
+  e.data = data;
+
+  uint mask = m_slotCount - 1;
+  uint i = (uint)h & mask;
+  while (m_slots[i] >= 0) {
+    i = (i + 1) & mask;
+  }
+  m_slots[i] = pos;
+  m_filled++;
+
+  m_size++;
+  if (m_pos == ArrayData::invalid_index) {
+    m_pos = pos;
+  }
+  return &e.data;
+}
+
+bool DenseArray::update(OpFlag flag, int64 h, CVarRef data,
+                        Variant **pDest /* = NULL */) {
+  ssize_t pos = ArrayData::invalid_index;
+  if (flag & HASH_NEXT_INSERT) {
+    h = m_nextFree;
+  } else {
+    pos = find(h);
+  }
+
+  if (pos != ArrayData::invalid_index) {
+    Variant &d = elem(pos).data;
+    if (pDest) {
+      *pDest = &d;
+    }
+    if (flag & HASH_ADD) {
+      return false;
+    }
+    d = data;
+    if (h >= m_nextFree) {
+      m_nextFree = h + 1;
+    }
+    return true;
+  }
+
+  Variant *d = add(h, NULL, data);
+  if (pDest) {
+    *pDest = d;
+  }
+  if (h >= m_nextFree) {
+    m_nextFree = h + 1;
+  }
+  return true;
+}
+
+bool DenseArray::update(OpFlag flag, litstr key, int64 h, CVarRef data,
+                        Variant **pDest /* = NULL */) {
+  int len = strlen(key);
+  ssize_t pos = find(key, len, h, &h);
+  if (pos != ArrayData::invalid_index) {
+    Variant &d = elem(pos).data;
+    if (pDest) {
+      *pDest = &d;
+    }
+    if (flag & HASH_ADD) {
+      return false;
+    }
+    d = data;
+    return true;
+  }
+
+  StringData *sd = NEW(StringData)(key, len, AttachLiteral);
+  sd->incRefCount();
+  Variant *d = add(h, sd, data);
+  if (pDest) {
+    *pDest = d;
+  }
+  return true;
+}
+
+bool DenseArray::update(OpFlag flag, StringData *key, int64 h, CVarRef data,
+                        Variant **pDest /* = NULL */) {
+  ssize_t pos = find(key->data(), key->size(), h, &h);
+  if (pos != ArrayData::invalid_index) {
+    Variant &d = elem(pos).data;
+    if (pDest) {
+      *pDest = &d;
+    }
+    if (flag & HASH_ADD) {
+      return false;
+    }
+    d = data;
+    return true;
+  }
+
+  if (key->isShared()) {
+    key = NEW(StringData)(key->data(), key->size(), CopyString);
+  }
+  key->incRefCount();
+  Variant *d = add(h, key, data);
+  if (pDest) {
+    *pDest = d;
+  }
+  return true;
+}
+
+ArrayData *DenseArray::lval(Variant *&ret, bool copy) {
+  if (copy) {
+    DenseArray *a = copyImpl();
+    ASSERT(a->m_size);
+    ret = &a->elem(a->lastPos()).data;
+    return a;
+  }
+  ASSERT(m_size);
+  ret = &elem(lastPos()).data;
+  return NULL;
+}
+
+ArrayData *DenseArray::lval(int64 k, Variant *&ret, bool copy,
+                            int64 prehash /* = -1 */) {
+  if (copy) {
+    DenseArray *a = copyImpl();
+    a->update(HASH_ADD, k, null, &ret);
+    return a;
+  }
+  update(HASH_ADD, k, null, &ret);
+  return NULL;
+}
+
+ArrayData *DenseArray::lval(CStrRef k, Variant *&ret, bool copy,
+                            int64 prehash /* = -1 */) {
+  return lvalImpl(k.get(), ret, copy, prehash);
+}
+
+ArrayData *DenseArray::lval(litstr k, Variant *&ret, bool copy,
+                            int64 prehash /* = -1 */) {
+  return lvalImpl(k, ret, copy, prehash);
+}
+
+ArrayData *DenseArray::lval(CVarRef k, Variant *&ret, bool copy,
+                            int64 prehash /* = -1 */) {
+  if (k.isNumeric()) {
+    return lval(k.toInt64(), ret, copy, prehash);
+  } else {
+    String key = k.toString();
+    return lvalImpl(key.get(), ret, copy, prehash);
+  }
+}
+
+ArrayData *DenseArray::set(int64 k, CVarRef v, bool copy,
+                           int64 prehash /* = -1 */) {
+  if (copy) {
+    DenseArray *a = copyImpl();
+    a->update(HASH_UPDATE, k, v);
+    return a;
+  }
+  update(HASH_UPDATE, k, v);
+  return NULL;
+}
+
+ArrayData *DenseArray::set(CStrRef k, CVarRef v, bool copy,
+                           int64 prehash /* = -1 */) {
+  if (copy) {
+    DenseArray *a = copyImpl();
+    a->update(HASH_UPDATE, k.get(), prehash, v);
+    return a;
+  }
+  update(HASH_UPDATE, k.get(), prehash, v);
+  return NULL;
+}
+
+ArrayData *DenseArray::set(litstr k, CVarRef v, bool copy,
+                           int64 prehash /* = -1 */) {
+  if (copy) {
+    DenseArray *a = copyImpl();
+    a->update(HASH_UPDATE, k, prehash, v);
+    return a;
+  }
+  update(HASH_UPDATE, k, prehash, v);
+  return NULL;
+}
+
+ArrayData *DenseArray::set(CVarRef k, CVarRef v, bool copy,
+                           int64 prehash /* = -1 */) {
+  if (k.isNumeric()) {
+    return set(k.toInt64(), v, copy);
+  } else if (k.is(LiteralString)) {
+    return set(k.getLiteralString(), v, copy, prehash);
+  }
+  String sk = k.toString();
+  return set(sk, v, copy, prehash);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// delete
+
+void DenseArray::erase(ssize_t pos) {
+  if (pos == ArrayData::invalid_index) return;
+  ASSERT(live(pos));
+
+  Element &e = elem(pos);
+  release_key(e.key);
+  e.key = s_erased; // its slot stays, so later probes walk past it
+  e.data.~Variant();
+  memset(&e.data, 0, sizeof(Variant));
+  m_size--;
+
+  if (m_pos == pos) {
+    m_pos = nextPos(pos);
+  }
+}
+
+ArrayData *DenseArray::remove(int64 k, bool copy, int64 prehash /* = -1 */) {
+  if (copy) {
+    DenseArray *a = copyImpl();
+    a->erase(a->find(k));
+    return a;
+  }
+  erase(find(k));
+  return NULL;
+}
+
+ArrayData *DenseArray::remove(CStrRef k, bool copy, int64 prehash /* = -1 */) {
+  if (copy) {
+    DenseArray *a = copyImpl();
+    a->erase(a->find(k.data(), k.size(), prehash));
+    return a;
+  }
+  erase(find(k.data(), k.size(), prehash));
+  return NULL;
+}
+
+ArrayData *DenseArray::remove(litstr k, bool copy, int64 prehash /* = -1 */) {
+  if (copy) {
+    DenseArray *a = copyImpl();
+    a->erase(a->find(k, strlen(k), prehash));
+    return a;
+  }
+  erase(find(k, strlen(k), prehash));
+  return NULL;
+}
+
+ArrayData *DenseArray::remove(CVarRef k, bool copy, int64 prehash /* = -1 */) {
+  if (copy) {
+    DenseArray *a = copyImpl();
+    a->erase(a->getIndex(k, prehash));
+    return a;
+  }
+  erase(getIndex(k, prehash));
+  return NULL;
+}
+
+ArrayData *DenseArray::copy() const {
+  return copyImpl();
+}
+
+DenseArray *DenseArray::copyImpl() const {
+  DenseArray *target = NEW(DenseArray)(m_size);
+  for (ssize_t pos = firstPos(); pos != ArrayData::invalid_index;
+       pos = nextPos(pos)) {
+    const Element &e = elem(pos);
+    if (e.data.isReferenced()) {
+      e.data.setContagious();
+    }
+    // keys are unique and never shared, so there's nothing to look up
+    if (e.key) {
+      e.key->incRefCount();
+    } else if (e.h >= target->m_nextFree) {
+      target->m_nextFree = e.h + 1;
+    }
+    target->add(e.h, e.key, e.data);
+  }
+  target->m_pos = target->firstPos();
+  return target;
+}
+
+ArrayData *DenseArray::append(CVarRef v, bool copy) {
+  if (copy) {
+    DenseArray *a = copyImpl();
+    a->update(HASH_NEXT_INSERT, 0, v);
+    return a;
+  }
+  update(HASH_NEXT_INSERT, 0, v);
+  return NULL;
+}
+
+ArrayData *DenseArray::append(const ArrayData *elems, ArrayOp op, bool copy) {
+  if (copy) {
+    DenseArray *a = copyImpl();
+    a->append(elems, op, false);
+    return a;
+  }
+  if (elems == this) {
+    // positions of the array we iterate would move as we grow
+    Array snapshot(copyImpl());
+    return append(snapshot.get(), op, false);
+  }
+
+  if (elems->supportValueRef()) {
+    if (op == Plus) {
+      for (ArrayIter it(elems); !it.end(); it.next()) {
+        Variant key = it.first();
+        CVarRef value = it.secondRef();
+        if (value.isReferenced()) value.setContagious();
+        if (key.isNumeric()) {
+          update(HASH_ADD, key.toInt64(), value);
+        } else {
+          String skey = key.toString();
+          update(HASH_ADD, skey.get(), -1, value);
+        }
+      }
+    } else {
+      ASSERT(op == Merge);
+      for (ArrayIter it(elems); !it.end(); it.next()) {
+        Variant key = it.first();
+        CVarRef value = it.secondRef();
+        if (value.isReferenced()) value.setContagious();
+        if (key.isNumeric()) {
+          append(value, false);
+        } else {
+          set(key, value, false);
+        }
+      }
+    }
+  } else {
+    if (op == Plus) {
+      for (ArrayIter it(elems); !it.end(); it.next()) {
+        Variant key = it.first();
+        if (key.isNumeric()) {
+          update(HASH_ADD, key.toInt64(), it.second());
+        } else {
+          String skey = key.toString();
+          update(HASH_ADD, skey.get(), -1, it.second());
+        }
+      }
+    } else {
+      ASSERT(op == Merge);
+      for (ArrayIter it(elems); !it.end(); it.next()) {
+        Variant key = it.first();
+        if (key.isNumeric()) {
+          append(it.second(), false);
+        } else {
+          set(key, it.second(), false);
+        }
+      }
+    }
+  }
+  return NULL;
+}
+
+ArrayData *DenseArray::pop(Variant &value) {
+  if (getCount() > 1) {
+    DenseArray *a = copyImpl();
+    a->pop(value);
+    return a;
+  }
+  ssize_t pos = lastPos();
+  if (pos != ArrayData::invalid_index) {
+    Element &e = elem(pos);
+    value = e.data;
+    if (!e.key && e.h == m_nextFree - 1) {
+      m_nextFree--;
+    }
+    erase(pos);
+  } else {
+    value = null;
+  }
+  return NULL;
+}
+
+ArrayData *DenseArray::dequeue(Variant &value) {
+  if (getCount() > 1) {
+    DenseArray *a = copyImpl();
+    a->dequeue(value);
+    return a;
+  }
+  ssize_t pos = firstPos();
+  if (pos != ArrayData::invalid_index) {
+    value = elem(pos).data;
+    erase(pos);
+    renumber();
+  } else {
+    value = null;
+  }
+  return NULL;
+}
+
+ArrayData *DenseArray::insert(ssize_t pos, CVarRef v, bool copy) {
+  if (copy) {
+    DenseArray *a = copyImpl();
+    a->insert(pos, v, false);
+    return a;
+  }
+
+  // Elements get packed below, so remember the target by its rank among
+  // live elements rather than by position. An invalid position means the
+  // front, a position past the end leaves the new element at the end.
+  if (!live(pos)) {
+    pos = pos >= (ssize_t)m_used ? ArrayData::invalid_index : firstPos();
+  }
+  ssize_t rank = -1;
+  if (pos != ArrayData::invalid_index) {
+    rank = 0;
+    for (ssize_t i = firstPos(); i != pos; i = nextPos(i)) rank++;
+  }
+
+  update(HASH_NEXT_INSERT, 0, v);
+  if (rank < 0 || m_size == 1) {
+    return NULL;
+  }
+
+  // Move the newly inserted element from the end to the requested rank.
+  // Once packed, positions are ranks.
+  pack();
+  ssize_t target = rank;
+  ssize_t tail = m_used - 1;
+  char saved[sizeof(Element)];
+  memcpy(saved, &elem(tail), sizeof(Element));
+  for (ssize_t i = tail; i > target; i--) {
+    memcpy(&elem(i), &elem(i - 1), sizeof(Element));
+  }
+  memcpy(&elem(target), saved, sizeof(Element));
+  if (m_pos == tail) {
+    m_pos = target;
+  } else if (m_pos >= target && m_pos != ArrayData::invalid_index) {
+    m_pos++;
+  }
+
+  // Rewrite numeric keys to start from 0 and rehash
+  renumber();
+  return NULL;
+}
+
+void DenseArray::renumber() {
+  int64 i = 0;
+  for (ssize_t pos = firstPos(); pos != ArrayData::invalid_index;
+       pos = nextPos(pos)) {
+    Element &e = elem(pos);
+    if (e.key == NULL) {
+      e.h = i++;
+    }
+  }
+  m_nextFree = i;
+  rehash(m_size);
+}
+
+void DenseArray::onSetStatic() {
+  for (ssize_t pos = firstPos(); pos != ArrayData::invalid_index;
+       pos = nextPos(pos)) {
+    Element &e = elem(pos);
+    if (e.key) {
+      e.key->setStatic();
+    }
+    e.data.setStatic();
+  }
+}
+
+void DenseArray::getFullPos(FullPos &pos) {
+  pos.primary = m_pos;
+  if (m_pos != ArrayData::invalid_index) {
+    pos.secondary = elem(m_pos).h;
+  }
+}
+
+bool DenseArray::setFullPos(const FullPos &pos) {
+  // Only set if pos hasn't been invalidated. insert() may have moved the
+  // element, in which case we look for it by its hash.
+  if (pos.primary != ArrayData::invalid_index) {
+    if (live(pos.primary) && elem(pos.primary).h == pos.secondary) {
+      m_pos = pos.primary;
+    } else {
+      for (ssize_t i = firstPos(); i != ArrayData::invalid_index;
+           i = nextPos(i)) {
+        if (elem(i).h == pos.secondary) {
+          m_pos = i;
+          break;
+        }
+      }
+    }
+  }
+  return m_pos != ArrayData::invalid_index;
+}
+
+CVarRef DenseArray::currentRef() {
+  ASSERT(live(m_pos));
+  return elem(m_pos).data;
+}
+
+CVarRef DenseArray::endRef() {
+  ASSERT(m_size);
+  return elem(lastPos()).data;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// memory allocator methods.
+
+bool DenseArray::calculate(int &size) {
+  size += m_chunkCount * sizeof(int);
+  for (uint c = 0; c < m_chunkCount; c++) {
+    if (m_chunks[c]) size += ChunkSize * sizeof(Element);
+  }
+  size += m_slotCount * sizeof(int32);
+  return true;
+}
+
+void DenseArray::backup(LinearAllocator &allocator) {
+  for (uint c = 0; c < m_chunkCount; c++) {
+    allocator.backup(m_chunks[c] ? 1 : 0);
+    if (m_chunks[c]) {
+      allocator.backup((const char *)m_chunks[c], ChunkSize * sizeof(Element));
+    }
+  }
+  if (m_slotCount) {
+    allocator.backup((const char *)m_slots, m_slotCount * sizeof(int32));
+  }
+}
+
+void DenseArray::restore(const char *&data) {
+  m_chunks = NULL;
+  if (m_chunkCap) {
+    m_chunks = (Element **)malloc(m_chunkCap * sizeof(Element *));
+  }
+  for (uint c = 0; c < m_chunkCount; c++) {
+    int present = *(int*)data;
+    data += sizeof(int);
+    m_chunks[c] = NULL;
+    if (present) {
+      m_chunks[c] = (Element *)malloc(ChunkSize * sizeof(Element));
+      memcpy(m_chunks[c], data, ChunkSize * sizeof(Element));
+      data += ChunkSize * sizeof(Element);
+    }
+  }
+  m_slots = NULL;
+  if (m_slotCount) {
+    m_slots = (int32 *)malloc(m_slotCount * sizeof(int32));
+    memcpy(m_slots, data, m_slotCount * sizeof(int32));
+    data += m_slotCount * sizeof(int32);
+  }
+}
+
+void DenseArray::sweep() {
+  freeChunks();
+  free(m_slots);
+  m_slots = NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
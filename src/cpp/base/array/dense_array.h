@@ -0,0 +1,215 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+
+#ifndef __HPHP_DENSE_ARRAY_H__
+#define __HPHP_DENSE_ARRAY_H__
+
+#include <cpp/base/types.h>
+#include <cpp/base/type_variant.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * An ordered hash with ZendArray's semantics but without its per-element
+ * Buckets: elements are kept in insertion order in fixed-size chunks, and a
+ * separate open-addressed table of int32 slots maps hashes to element
+ * positions. An element costs 32 bytes plus two to four slots, iteration is
+ * a scan and a lookup touches one slot and one element.
+ *
+ * Positions (iter_begin(), getIndex(), m_pos...) are element indices, and
+ * chunks never move, so like ZendArray's Buckets an element stays where it
+ * is for as long as it lives: lval() returns the element's own address, and
+ * it stays good while other keys are added. Erased elements stay behind as
+ * tombstones; a chunk holding nothing else is freed the next time the slots
+ * are rebuilt. Only insert(), and an array that has run out of int32
+ * positions, pack live elements to the front and so move them.
+ *
+ * Used in place of ZendArray when RuntimeOption::UseDenseArray is on.
+ */
+class DenseArray : public ArrayData {
+public:
+  DenseArray(uint nSize = 0);
+  virtual ~DenseArray();
+
+  virtual ssize_t size() const { return m_size;}
+
+  virtual Variant getKey(ssize_t pos) const;
+  virtual Variant getValue(ssize_t pos) const;
+  virtual CVarRef getValueRef(ssize_t pos) const;
+  virtual bool isVectorData() const;
+  virtual bool supportValueRef() const { return true; }
+
+  virtual ssize_t iter_begin() const;
+  virtual ssize_t iter_end() const;
+  virtual ssize_t iter_advance(ssize_t prev) const;
+  virtual ssize_t iter_rewind(ssize_t prev) const;
+
+  virtual Variant reset();
+  virtual Variant prev();
+  virtual Variant current() const;
+  virtual Variant next();
+  virtual Variant end();
+  virtual Variant key() const;
+  virtual Variant value(ssize_t &pos) const;
+  virtual Variant each();
+
+  virtual bool exists(int64   k, int64 prehash = -1) const;
+  virtual bool exists(litstr  k, int64 prehash = -1) const;
+  virtual bool exists(CStrRef k, int64 prehash = -1) const;
+  virtual bool exists(CVarRef k, int64 prehash = -1) const;
+
+  virtual bool idxExists(ssize_t idx) const;
+
+  virtual Variant get(int64   k, int64 prehash = -1) const;
+  virtual Variant get(litstr  k, int64 prehash = -1) const;
+  virtual Variant get(CStrRef k, int64 prehash = -1) const;
+  virtual Variant get(CVarRef k, int64 prehash = -1) const;
+
+  virtual ssize_t getIndex(int64 k, int64 prehash = -1) const;
+  virtual ssize_t getIndex(litstr k, int64 prehash = -1) const;
+  virtual ssize_t getIndex(CStrRef k, int64 prehash = -1) const;
+  virtual ssize_t getIndex(CVarRef k, int64 prehash = -1) const;
+
+  virtual ArrayData *lval(Variant *&ret, bool copy);
+  virtual ArrayData *lval(int64   k, Variant *&ret, bool copy,
+                          int64 prehash = -1);
+  virtual ArrayData *lval(litstr  k, Variant *&ret, bool copy,
+                          int64 prehash = -1);
+  virtual ArrayData *lval(CStrRef k, Variant *&ret, bool copy,
+                          int64 prehash = -1);
+  virtual ArrayData *lval(CVarRef k, Variant *&ret, bool copy,
+                          int64 prehash = -1);
+
+  virtual ArrayData *set(int64   k, CVarRef v, bool copy, int64 prehash = -1);
+  virtual ArrayData *set(litstr  k, CVarRef v, bool copy, int64 prehash = -1);
+  virtual ArrayData *set(CStrRef k, CVarRef v, bool copy, int64 prehash = -1);
+  virtual ArrayData *set(CVarRef k, CVarRef v, bool copy, int64 prehash = -1);
+
+  virtual ArrayData *remove(int64   k, bool copy, int64 prehash = -1);
+  virtual ArrayData *remove(litstr  k, bool copy, int64 prehash = -1);
+  virtual ArrayData *remove(CStrRef k, bool copy, int64 prehash = -1);
+  virtual ArrayData *remove(CVarRef k, bool copy, int64 prehash = -1);
+
+  virtual ArrayData *copy() const;
+  virtual ArrayData *append(CVarRef v, bool copy);
+  virtual ArrayData *append(const ArrayData *elems, ArrayOp op, bool copy);
+  virtual ArrayData *pop(Variant &value);
+  virtual ArrayData *dequeue(Variant &value);
+  virtual ArrayData *insert(ssize_t pos, CVarRef v, bool copy);
+  virtual void renumber();
+  virtual void onSetStatic();
+
+  virtual void getFullPos(FullPos &pos);
+  virtual bool setFullPos(const FullPos &pos);
+  virtual CVarRef currentRef();
+  virtual CVarRef endRef();
+
+  /**
+   * Memory allocator methods.
+   */
+  DECLARE_SMART_ALLOCATION(DenseArray, SmartAllocatorImpl::NeedRestore);
+  bool calculate(int &size);
+  void backup(LinearAllocator &allocator);
+  void restore(const char *&data);
+  void sweep();
+
+private:
+  enum OpFlag {
+    HASH_UPDATE       =  (1<<0),
+    HASH_ADD          =  (1<<1),
+    HASH_NEXT_INSERT  =  (1<<2)
+  };
+
+  enum {
+    ChunkBits = 3,
+    ChunkSize = 1 << ChunkBits,
+    ChunkMask = ChunkSize - 1
+  };
+
+  struct Element {
+    int64       h;    // integer key, or hash of the string key
+    StringData *key;  // NULL for integer keys
+    Variant     data;
+  };
+
+  Element **m_chunks;     // m_chunks[i] holds positions starting from
+  uint      m_chunkBase;  // (m_chunkBase + i) * ChunkSize, NULL once freed
+  uint      m_chunkCount;
+  uint      m_chunkCap;   // room in m_chunks
+  int32    *m_slots;      // m_slotCount of them, -1 if empty
+  uint      m_slotCount;  // a power of 2
+  uint      m_filled;     // slots in use, erased elements' included
+  uint      m_used;       // positions handed out, tombstones included
+  uint      m_size;       // live elements
+  int64     m_nextFree;
+
+  Element &elem(ssize_t pos) const {
+    return m_chunks[(pos >> ChunkBits) - m_chunkBase][pos & ChunkMask];
+  }
+
+  bool live(ssize_t pos) const;
+  ssize_t firstPos() const;
+  ssize_t lastPos() const;
+  ssize_t nextPos(ssize_t pos) const;
+  ssize_t prevPos(ssize_t pos) const;
+
+  ssize_t find(int64 h) const;
+  ssize_t find(const char *k, int len, int64 prehash = -1,
+               int64 *h = NULL) const;
+
+  bool update(OpFlag flag, int64 h, CVarRef data, Variant **pDest = NULL);
+  bool update(OpFlag flag, litstr key, int64 h, CVarRef data,
+              Variant **pDest = NULL);
+  bool update(OpFlag flag, StringData *key, int64 h, CVarRef data,
+              Variant **pDest = NULL);
+  Variant *add(int64 h, StringData *key, CVarRef data);
+
+  void erase(ssize_t pos);
+  DenseArray *copyImpl() const;
+
+  void addChunk();
+  void freeChunks();
+  void pack();
+  void rehash(uint room);
+
+  template<class T>
+  ArrayData *lvalImpl(const T& k, Variant *&ret, bool copy, int64 prehash) {
+    if (copy) {
+      DenseArray *a = copyImpl();
+      a->update(HASH_ADD, k, prehash, null, &ret);
+      return a;
+    }
+    update(HASH_ADD, k, prehash, null, &ret);
+    return NULL;
+  }
+};
+
+class StaticEmptyDenseArray : public DenseArray {
+public:
+  StaticEmptyDenseArray() { setStatic();}
+
+  static DenseArray *Get() { return &s_theEmptyArray; }
+
+private:
+  static StaticEmptyDenseArray s_theEmptyArray;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // __HPHP_DENSE_ARRAY_H__
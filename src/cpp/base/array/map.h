@@ -198,8 +198,7 @@ class Map : public ArrayData {
         int index = getIndex(key);
         if (index < 0) {
           insertKey(key);
-          T1 elem; ArrayFuncs::element(elem, elems[i]);
-          dest.push_back(elem);
+          ArrayFuncs::push_back(dest, elems[i]);
         }
       }
       break;
@@ -231,20 +230,20 @@ class Map : public ArrayData {
         int index = getIndex(key);
         if (index < 0) {
           insertKey(key);
-          T1 elem; ArrayFuncs::element(elem, elems[i]);
-          dest.push_back(elem);
+          ArrayFuncs::push_back(dest, elems[i]);
         }
       }
       break;
     case Merge:
+      dest.reserve(dest.size() + elems.size());
       for (unsigned int i = 0; i < size; i++) {
         CVarRef key = keys[i];
         int index = getIndex(key);
-        T1 elem; ArrayFuncs::element(elem, elems[i]);
         if (index < 0) {
           insertKey(key);
-          dest.push_back(elem);
+          ArrayFuncs::push_back(dest, elems[i]);
         } else {
+          T1 elem; ArrayFuncs::element(elem, elems[i]);
           ArrayFuncs::set(dest, index, elem);
         }
       }
@@ -303,8 +302,8 @@ class Map : public ArrayData {
   /**
    * Copy all elements in src except the one at erase index.
    */
-  template<typename T>
-  void appendImpl(HphpVector<T> &dest, const HphpVector<T> &src,
+  template<typename T1, typename T2>
+  void appendImpl(HphpVector<T1> &dest, const HphpVector<T2> &src,
                   int eraseIndex) {
     m_nextIndex = src.size();
     for (int i = 0; i < m_nextIndex; i++) {
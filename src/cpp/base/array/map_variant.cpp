@@ -32,7 +32,7 @@ IMPLEMENT_SMART_ALLOCATION(MapVariant, SmartAllocatorImpl::NeedRestore);
 
 MapVariant::MapVariant(CVarRef k, CVarRef v) {
   insertKey(k);
-  m_elems.push_back(ArrayFuncs::element(v));
+  m_elems.push_back(v);
 }
 
 MapVariant::MapVariant(const std::vector<ArrayElement *> &elems,
@@ -45,18 +45,14 @@ MapVariant::MapVariant(const std::vector<ArrayElement *> &elems,
       uint idx = insertKey(elem->getName(), elem->getHash());
       if (idx < m_elems.size()) {
         if (replace) {
-          Variant *&v = m_elems[idx];
-          if (v) {
-            ArrayFuncs::release(v);
-          }
-          v = ArrayFuncs::element(elem->getVariant());
+          m_elems[idx] = elem->getVariant();
         }
         continue;
       }
     } else {
       appendKey();
     }
-    m_elems.push_back(ArrayFuncs::element(elem->getVariant()));
+    m_elems.push_back(elem->getVariant());
   }
 }
 
@@ -91,36 +87,19 @@ MapVariant::MapVariant(const VectorVariant *src) {
 MapVariant::MapVariant(const VectorLong *src, CVarRef k, CVarRef v) {
   ASSERT(src);
   ASSERT(src->getIndex(k) < 0);
-  appendImpl(m_elems, src->getElems(), k, ArrayFuncs::element(v));
+  appendImpl(m_elems, src->getElems(), k, v);
 }
 
 MapVariant::MapVariant(const VectorString *src, CVarRef k, CVarRef v) {
   ASSERT(src);
   ASSERT(src->getIndex(k) < 0);
-  appendImpl(m_elems, src->getElems(), k, ArrayFuncs::element(v));
+  appendImpl(m_elems, src->getElems(), k, v);
 }
 
-MapVariant::MapVariant(const VectorVariant *src, CVarRef k, CVarRef v,
-                       bool copy) {
+MapVariant::MapVariant(const VectorVariant *src, CVarRef k, CVarRef v) {
   ASSERT(src);
   ASSERT(src->getIndex(k) < 0);
-
-  const HphpVector<Variant *> &srcElems = src->getElems();
-  m_nextIndex = srcElems.size();
-  for (int i = 0; i < m_nextIndex; i++) {
-    m_map[Variant((int64)i)] = i;
-  }
-
-  // Called by VectorVariant::setImpl(): special escalation that will NOT
-  // make a copy of array elements if copy is not requested
-  m_elems.reserve(m_nextIndex + 1);
-  if (copy) {
-    appendImpl(m_elems, src->getElems(), k, ArrayFuncs::element(v));
-  } else {
-    m_elems.append(srcElems);
-    insertKey(k);
-    m_elems.push_back(ArrayFuncs::element(v));
-  }
+  appendImpl(m_elems, src->getElems(), k, v);
 }
 
 MapVariant::MapVariant(const VectorLong *src, const MapString *elems,
@@ -162,32 +141,32 @@ MapVariant::MapVariant(const VectorVariant *src, const Map *elems,
 
 MapVariant::MapVariant(const MapLong *src, CVarRef v) {
   ASSERT(src);
-  appendImpl(m_elems, src, src->getElems(), ArrayFuncs::element(v));
+  appendImpl(m_elems, src, src->getElems(), v);
 }
 
 MapVariant::MapVariant(const MapString *src, CVarRef v) {
   ASSERT(src);
-  appendImpl(m_elems, src, src->getElems(), ArrayFuncs::element(v));
+  appendImpl(m_elems, src, src->getElems(), v);
 }
 
 MapVariant::MapVariant(const MapVariant *src, CVarRef v) {
   ASSERT(src);
-  appendImpl(m_elems, src, src->getElems(), ArrayFuncs::element(v));
+  appendImpl(m_elems, src, src->getElems(), v);
 }
 
 MapVariant::MapVariant(const MapLong *src, CVarRef k, CVarRef v) {
   ASSERT(src);
-  appendImpl(m_elems, src, src->getElems(), k, ArrayFuncs::element(v));
+  appendImpl(m_elems, src, src->getElems(), k, v);
 }
 
 MapVariant::MapVariant(const MapString *src, CVarRef k, CVarRef v) {
   ASSERT(src);
-  appendImpl(m_elems, src, src->getElems(), k, ArrayFuncs::element(v));
+  appendImpl(m_elems, src, src->getElems(), k, v);
 }
 
 MapVariant::MapVariant(const MapVariant *src, CVarRef k, CVarRef v) {
   ASSERT(src);
-  appendImpl(m_elems, src, src->getElems(), k, ArrayFuncs::element(v));
+  appendImpl(m_elems, src, src->getElems(), k, v);
 }
 
 MapVariant::MapVariant(const VectorLong *src, const MapVariant *elems,
@@ -342,16 +321,7 @@ MapVariant::MapVariant(const MapVariant *src, const ArrayData *elems,
 
 MapVariant::MapVariant(const VectorVariant *src, int eraseIndex) {
   ASSERT(src);
-
-  int iMax = src->getElems().size();
-  if (iMax > 0) {
-    HphpVector<Variant*> elems;
-    elems.reserve(iMax);
-    for (int i = 0; i < iMax; i++) {
-      elems.push_back(src->getElems()[i]);
-    }
-    appendImpl(m_elems, elems, eraseIndex);
-  }
+  appendImpl(m_elems, src->getElems(), eraseIndex);
 }
 
 MapVariant::MapVariant(const MapVariant *src, int eraseIndex) {
@@ -360,9 +330,7 @@ MapVariant::MapVariant(const MapVariant *src, int eraseIndex) {
 }
 
 MapVariant::~MapVariant() {
-  for (int i = m_elems.size() - 1; i >= 0; --i) {
-    ArrayFuncs::release(m_elems[i]);
-  }
+  // inline elements are destructed by m_elems
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -374,12 +342,12 @@ ssize_t MapVariant::size() const {
 
 Variant MapVariant::getValue(ssize_t pos) const {
   ASSERT(pos >= 0 && pos < size());
-  return *m_elems[pos];
+  return m_elems[pos];
 }
 
 CVarRef MapVariant::getValueRef(ssize_t pos) const {
   ASSERT(pos >= 0 && pos < size());
-  return *m_elems[pos];
+  return m_elems[pos];
 }
 
 ArrayData *MapVariant::lval(Variant *&ret, bool copy) {
@@ -387,11 +355,11 @@ ArrayData *MapVariant::lval(Variant *&ret, bool copy) {
 
   if (copy) {
     MapVariant* data = NEW(MapVariant)(this);
-    ret = data->m_elems.back();
+    ret = &data->m_elems.back();
     return data;
   }
 
-  ret = m_elems.back();
+  ret = &m_elems.back();
   return NULL;
 }
 
@@ -424,11 +392,9 @@ ArrayData *MapVariant::lval(CVarRef k, Variant *&ret, bool copy,
 
   ssize_t index = insertKey(k, prehash);
   if (index >= m_elems.size()) {
-    ret = NEW(Variant)();
-    m_elems.push_back(ret);
-  } else {
-    ret = m_elems[index];
+    m_elems.push_back(Variant());
   }
+  ret = &m_elems[index];
   return NULL;
 }
 
@@ -439,9 +405,9 @@ ArrayData *MapVariant::setImpl(CVarRef k, CVarRef v,
   }
   uint index = insertKey(k, prehash);
   if (index < m_elems.size()) {
-    *m_elems[index] = v;
+    m_elems[index] = v;
   } else {
-    m_elems.push_back(ArrayFuncs::element(v));
+    appendValue(v);
   }
   return NULL;
 }
@@ -467,7 +433,6 @@ ArrayData *MapVariant::remove(CVarRef k, bool copy, int64 prehash /* = -1 */) {
     if (copy) {
       return NEW(MapVariant)(this, index);
     }
-    m_elems[index]->release();
     m_elems.remove(index);
     removeKey(k, index, prehash);
     if (index < m_pos) m_pos--;
@@ -485,7 +450,7 @@ ArrayData *MapVariant::append(CVarRef v, bool copy) {
   }
 
   appendKey();
-  m_elems.push_back(ArrayFuncs::element(v));
+  appendValue(v);
   return NULL;
 }
 
@@ -567,14 +532,21 @@ ArrayData *MapVariant::insert(ssize_t pos, CVarRef v, bool copy) {
   }
 
   insertKey(pos);
-  m_elems.insert(pos, ArrayFuncs::element(v));
+  if (&v >= &m_elems[0] && &v < &m_elems[0] + m_elems.size()) {
+    // v is one of our own elements, which insert() may move
+    Variant tmp(v);
+    if (tmp.isReferenced()) tmp.setContagious();
+    m_elems.insert(pos, tmp);
+  } else {
+    m_elems.insert(pos, v);
+  }
   return NULL;
 }
 
 void MapVariant::onSetStatic() {
   Map::onSetStatic();
   for (unsigned int i = 0; i < m_elems.size(); i++) {
-    m_elems[i]->setStatic();
+    m_elems[i].setStatic();
   }
 }
 
@@ -597,5 +569,21 @@ bool MapVariant::setFullPos(const FullPos &pos) {
   return true;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// helpers
+
+void MapVariant::appendValue(CVarRef v) {
+  int size = m_elems.size();
+  if (size && &v >= &m_elems[0] && &v < &m_elems[0] + size) {
+    // v is one of our own elements ($a[] = $a['k']), so grow the buffer
+    // before reading it
+    int index = &v - &m_elems[0];
+    m_elems.reserve(size + 1);
+    m_elems.push_back(m_elems[index]);
+  } else {
+    m_elems.push_back(v);
+  }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 }
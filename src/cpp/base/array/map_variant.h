@@ -49,7 +49,7 @@ class MapVariant : public Map {
 
   MapVariant(const VectorLong *src, CVarRef k, CVarRef v);
   MapVariant(const VectorString *src, CVarRef k, CVarRef v);
-  MapVariant(const VectorVariant *src, CVarRef k, CVarRef v, bool copy);
+  MapVariant(const VectorVariant *src, CVarRef k, CVarRef v);
 
   MapVariant(const VectorLong *src, const MapString *elems, ArrayOp op);
   MapVariant(const VectorString *src, const MapLong *elems, ArrayOp op);
@@ -83,6 +83,12 @@ class MapVariant : public Map {
   virtual CVarRef getValueRef(ssize_t pos) const;
   virtual bool supportValueRef() const { return true;}
 
+  /**
+   * Unlike ZendArray's Buckets, the slot ret points at is only good until
+   * the array next adds or removes an element: growing m_elems moves every
+   * value, and removing one shifts the values after it. Finish with ret
+   * before taking another lval() that may append.
+   */
   virtual ArrayData *lval(Variant *&ret, bool copy);
   virtual ArrayData *lval(int64   k, Variant *&ret, bool copy,
                           int64 prehash = -1);
@@ -114,7 +120,7 @@ class MapVariant : public Map {
   /**
    * Low level access to underlying data. Should be limited in use.
    */
-  const HphpVector<Variant*> &getElems() const { return m_elems;}
+  const HphpVector<Variant> &getElems() const { return m_elems;}
 
   /**
    * Memory allocator methods.
@@ -138,15 +144,17 @@ class MapVariant : public Map {
   }
 
  protected:
-  virtual Variant getImpl(int index) const { return *m_elems[index]; }
+  virtual Variant getImpl(int index) const { return m_elems[index]; }
 
  private:
   /**
-   * We have to use pointers so to avoid object copying during resizing. This
-   * also makes lval() safer. It does require those appendImpl() to be re-
-   * implemented for this class.
+   * Values are stored inline, the same way VectorVariant stores them. lval()
+   * returns a slot's address, which moves when m_elems grows; a strong
+   * binding lives in its own heap Variant, so it survives the move.
    */
-  HphpVector<Variant*> m_elems;
+  HphpVector<Variant> m_elems;
+
+  void appendValue(CVarRef v);
 };
 
 ///////////////////////////////////////////////////////////////////////////////
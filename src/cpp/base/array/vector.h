@@ -73,7 +73,7 @@ class Vector : public ArrayData {
    * Copy src to dest. This is escalating vector<int64|String>.
    */
   template<typename T>
-  static void appendImpl(HphpVector<Variant*> &dest,
+  static void appendImpl(HphpVector<Variant> &dest,
                          const HphpVector<T> &src) {
     dest.reserve(dest.size() + src.size());
     ArrayFuncs::append(dest, src);
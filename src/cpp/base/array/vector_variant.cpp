@@ -33,14 +33,14 @@ IMPLEMENT_SMART_ALLOCATION(VectorVariant, SmartAllocatorImpl::NeedRestore);
 // constructors
 
 VectorVariant::VectorVariant(CVarRef v) {
-  m_elems.push_back(ArrayFuncs::element(v));
+  m_elems.push_back(v);
 }
 
 VectorVariant::VectorVariant(const std::vector<ArrayElement *> &elems) {
   unsigned int size = elems.size();
   m_elems.reserve(size);
   for (unsigned int i = 0; i < size; i++) {
-    m_elems.push_back(ArrayFuncs::element(elems[i]->getVariant()));
+    m_elems.push_back(elems[i]->getVariant());
   }
 }
 
@@ -51,12 +51,12 @@ VectorVariant::VectorVariant(const VectorLong *src) {
 
 VectorVariant::VectorVariant(const VectorLong *src, CVarRef v) {
   ASSERT(src);
-  appendImpl(m_elems, src->getElems(), ArrayFuncs::element(v));
+  appendImpl(m_elems, src->getElems(), v);
 }
 
 VectorVariant::VectorVariant(const VectorLong *src, int index, CVarRef v) {
   ASSERT(src);
-  appendImpl(m_elems, src->getElems(), index, ArrayFuncs::element(v));
+  appendImpl(m_elems, src->getElems(), index, v);
 }
 
 VectorVariant::VectorVariant(const VectorLong *src, const Vector *vec,
@@ -79,12 +79,12 @@ VectorVariant::VectorVariant(const VectorString *src) {
 
 VectorVariant::VectorVariant(const VectorString *src, CVarRef v) {
   ASSERT(src);
-  appendImpl(m_elems, src->getElems(), ArrayFuncs::element(v));
+  appendImpl(m_elems, src->getElems(), v);
 }
 
 VectorVariant::VectorVariant(const VectorString *src, int index, CVarRef v) {
   ASSERT(src);
-  appendImpl(m_elems, src->getElems(), index, ArrayFuncs::element(v));
+  appendImpl(m_elems, src->getElems(), index, v);
 }
 
 VectorVariant::VectorVariant(const VectorString *src, const Vector *vec,
@@ -107,12 +107,12 @@ VectorVariant::VectorVariant(const VectorVariant *src) : Vector(src) {
 
 VectorVariant::VectorVariant(const VectorVariant *src, CVarRef v) {
   ASSERT(src);
-  appendImpl(m_elems, src->getElems(), ArrayFuncs::element(v));
+  appendImpl(m_elems, src->getElems(), v);
 }
 
 VectorVariant::VectorVariant(const VectorVariant *src, int index, CVarRef v) {
   ASSERT(src);
-  appendImpl(m_elems, src->getElems(), index, ArrayFuncs::element(v));
+  appendImpl(m_elems, src->getElems(), index, v);
 }
 
 VectorVariant::VectorVariant(const VectorVariant *src, const Vector *vec,
@@ -141,9 +141,7 @@ VectorVariant::VectorVariant(const VectorVariant *src, const Vector *vec,
 }
 
 VectorVariant::~VectorVariant() {
-  for (int i = m_elems.size() - 1; i >= 0; --i) {
-    ArrayFuncs::release(m_elems[i]);
-  }
+  // inline elements are destructed by m_elems
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -155,12 +153,12 @@ ssize_t VectorVariant::size() const {
 
 Variant VectorVariant::getValue(ssize_t pos) const {
   ASSERT(pos >= 0 && pos < size());
-  return *m_elems[pos];
+  return m_elems[pos];
 }
 
 CVarRef VectorVariant::getValueRef(ssize_t pos) const {
   ASSERT(pos >= 0 && pos < size());
-  return *m_elems[pos];
+  return m_elems[pos];
 }
 
 ArrayData *VectorVariant::lval(Variant *&ret, bool copy) {
@@ -168,11 +166,11 @@ ArrayData *VectorVariant::lval(Variant *&ret, bool copy) {
 
   if (copy) {
     VectorVariant *data = NEW(VectorVariant)(this);
-    ret = data->m_elems.back();
+    ret = &data->m_elems.back();
     return data;
   }
 
-  ret = m_elems.back();
+  ret = &m_elems.back();
   return NULL;
 }
 
@@ -260,7 +258,7 @@ ArrayData *VectorVariant::append(CVarRef v, bool copy) {
   if (copy) {
     return NEW(VectorVariant)(this, v);
   }
-  m_elems.push_back(ArrayFuncs::element(v));
+  appendValue(v);
   return NULL;
 }
 
@@ -326,13 +324,20 @@ ArrayData *VectorVariant::insert(ssize_t pos, CVarRef v, bool copy) {
 
   if (pos == ArrayData::invalid_index) pos = 0;
 
-  m_elems.insert(pos, ArrayFuncs::element(v));
+  if (&v >= &m_elems[0] && &v < &m_elems[0] + m_elems.size()) {
+    // v is one of our own elements, which insert() may move
+    Variant tmp(v);
+    if (tmp.isReferenced()) tmp.setContagious();
+    m_elems.insert(pos, tmp);
+  } else {
+    m_elems.insert(pos, v);
+  }
   return NULL;
 }
 
 void VectorVariant::onSetStatic() {
   for (unsigned int i = 0; i < m_elems.size(); i++) {
-    m_elems[i]->setStatic();
+    m_elems[i].setStatic();
   }
 }
 
@@ -341,31 +346,42 @@ void VectorVariant::onSetStatic() {
 
 Variant VectorVariant::getImpl(int index) const {
   if (index >= 0) {
-    return *m_elems[index];
+    return m_elems[index];
   }
   return null;
 }
 
+void VectorVariant::appendValue(CVarRef v) {
+  int size = m_elems.size();
+  if (size && &v >= &m_elems[0] && &v < &m_elems[0] + size) {
+    // v is one of our own elements ($a[] = $a[0]), so grow the buffer before
+    // reading it
+    int index = &v - &m_elems[0];
+    m_elems.reserve(size + 1);
+    m_elems.push_back(m_elems[index]);
+  } else {
+    m_elems.push_back(v);
+  }
+}
+
 ArrayData *VectorVariant::lvalImpl(int index, Variant *&ret, bool copy,
                                    int64 prehash) {
   bool append = index < 0;
   if (copy) {
     VectorVariant *data = NEW(VectorVariant)(this);
     if (append) {
-      Variant *v = NEW(Variant)();
-      data->m_elems.push_back(v);
-      ret = v;
+      data->m_elems.push_back(Variant());
+      ret = &data->m_elems.back();
     } else {
-      ret = data->m_elems[index];
+      ret = &data->m_elems[index];
     }
     return data;
   }
   if (append) {
-    Variant *v = NEW(Variant)();
-    m_elems.push_back(v);
-    ret = v;
+    m_elems.push_back(Variant());
+    ret = &m_elems.back();
   } else {
-    ret = m_elems[index];
+    ret = &m_elems[index];
   }
   return NULL;
 }
@@ -386,10 +402,10 @@ bool VectorVariant::setImpl(int index, CVarRef v, bool copy, ArrayData *&ret) {
 
   if ((ssize_t)index < size()) {
     ASSERT(index >= 0);
-    *m_elems[index] = v;
+    m_elems[index] = v;
   } else {
     ASSERT((ssize_t)index == size());
-    m_elems.push_back(ArrayFuncs::element(v));
+    appendValue(v);
   }
   ret = NULL;
   return true;
@@ -403,7 +419,6 @@ ArrayData *VectorVariant::removeImpl(int index, bool copy) {
     if (copy || (ssize_t)index < size() - 1) {
       return NEW(MapVariant)(this, index);
     }
-    m_elems[index]->release();
     m_elems.remove(index);
   }
   return NULL;
@@ -58,6 +58,11 @@ class VectorVariant : public Vector {
   virtual CVarRef getValueRef(ssize_t pos) const;
   virtual bool supportValueRef() const { return true;}
 
+  /**
+   * Unlike ZendArray's Buckets, the slot ret points at is only good until
+   * the array next grows: appending can reallocate m_elems and move every
+   * value. Finish with ret before taking another lval() that may append.
+   */
   virtual ArrayData *lval(Variant *&ret, bool copy);
   virtual ArrayData *lval(int64   k, Variant *&ret, bool copy,
                           int64 prehash = -1);
@@ -88,7 +93,7 @@ class VectorVariant : public Vector {
   /**
    * Low level access to underlying data. Should be limited in use.
    */
-  const HphpVector<Variant*> &getElems() const { return m_elems;}
+  const HphpVector<Variant> &getElems() const { return m_elems;}
 
   /**
    * Memory allocator methods.
@@ -112,12 +117,14 @@ class VectorVariant : public Vector {
 
  private:
   /**
-   * We have to use pointers so to avoid object copying during resizing. This
-   * also makes lval() safer. It does require those appendImpl() to be re-
-   * implemented for this class.
+   * Values are stored inline, so iterating, sorting or copying the vector
+   * walks one contiguous buffer instead of chasing a pointer per element.
+   * lval() returns a slot's address, which moves when the buffer grows; a
+   * strong binding lives in its own heap Variant, so it survives the move.
    */
-  HphpVector<Variant*> m_elems;
+  HphpVector<Variant> m_elems;
 
+  void appendValue(CVarRef v);
   ArrayData *lvalImpl(int index, Variant *&ret, bool copy, int64 prehash);
   bool setImpl(int index, CVarRef v, bool copy, ArrayData *&ret);
   ArrayData *removeImpl(int index, bool copy);
@@ -132,17 +139,10 @@ class VectorVariant : public Vector {
 
     /**
      * This is the ONLY place that should escalate from VectorVariant to
-     * MapVariant. We will not make copies of those elements but transfer them
-     * from vector to map when copy is not needed.
+     * MapVariant. Elements are always copied into the map's own buffer;
+     * strong bindings are carried over.
      */
-    ret = NEW(MapVariant)(this, Variant(k), v, copy);
-    if (copy) {
-      ASSERT(getCount() > 1);
-    } else {
-      ASSERT(getCount() == 1);
-      m_elems.clear(); //...because we have transferred all items to the map
-    }
-    return ret;
+    return NEW(MapVariant)(this, Variant(k), v);
   }
 };
 
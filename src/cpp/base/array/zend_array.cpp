@@ -23,7 +23,10 @@
 
 namespace HPHP {
 
-IMPLEMENT_SMART_ALLOCATION_NOCALLBACKS_CLS(ZendArray, Bucket);
+// we need lots of Buckets
+IMPLEMENT_SMART_ALLOCATION_NOCALLBACKS_ITEMS_CLS(
+  ZendArray, Bucket,
+  4 * SizeClassAllocatorBase::DefaultSlabItems(sizeof(ZendArray::Bucket)));
 IMPLEMENT_SMART_ALLOCATION(ZendArray, SmartAllocatorImpl::NeedRestoreOnce);
 ///////////////////////////////////////////////////////////////////////////////
 // static members
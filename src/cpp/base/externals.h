@@ -26,6 +26,7 @@
  */
 
 #include <cpp/base/types.h>
+#include <cpp/base/macros.h>
 
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
@@ -37,6 +38,23 @@ namespace HPHP {
 extern Variant invoke(const char *function, CArrRef params, int64 hash = -1,
                       bool tryInterp = true, bool fatal = true);
 
+/**
+ * Looking up the proxy that invokes a user-defined function with its
+ * arguments passed one by one instead of in an Array. Returns NULL when the
+ * function has to go through invoke(), e.g. a redeclared or system function.
+ */
+typedef Variant (*InvokeFewArgsFunc)(int count, CVarRef a0, CVarRef a1,
+                                     CVarRef a2
+#if INVOKE_FEW_ARGS_COUNT > 3
+                                     ,CVarRef a3, CVarRef a4, CVarRef a5
+#endif
+#if INVOKE_FEW_ARGS_COUNT > 6
+                                     ,CVarRef a6, CVarRef a7, CVarRef a8,
+                                     CVarRef a9
+#endif
+);
+extern InvokeFewArgsFunc get_invoke_few_args(const char *s, int64 hash);
+
 /**
  * Invoking an arbitrary system function. This is the fallback for invoke.
  */
@@ -132,6 +150,17 @@ extern StaticString literalStrings[];
 
 extern unsigned int *getRTTICounter(int id);
 
+/**
+ * Counting if-branch outcomes for RTTI_BRANCH().
+ */
+inline bool rtti_branch(int id, bool taken) {
+  unsigned int *counter = getRTTICounter(id);
+  if (counter) {
+    counter[taken ? 0 : 1]++;
+  }
+  return taken;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 }
 
@@ -40,6 +40,7 @@
 #include <cpp/base/file/plain_file.h>
 #include <cpp/base/class_info.h>
 #include <cpp/base/externals.h>
+#include <cpp/base/invoke_cache.h>
 #include <cpp/base/class_statics.h>
 #include <cpp/base/dynamic_object_data.h>
 
@@ -0,0 +1,100 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#include <cpp/base/invoke_cache.h>
+#include <cpp/base/type_array.h>
+#include <util/atomic.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+InvokeCache::InvokeCache() {
+  memset(m_entries, 0, sizeof(m_entries));
+}
+
+int InvokeCache::size() const {
+  int i = 0;
+  while (i < Size && m_entries[i]) i++;
+  return i;
+}
+
+InvokeFewArgsFunc InvokeCache::lookup(CStrRef name) {
+  const char *s = name.data();
+  int len = name.size();
+  for (int i = 0; i < Size; i++) {
+    Entry *entry = m_entries[i];
+    if (!entry) {
+      entry = new Entry(s, len, get_invoke_few_args(s, -1));
+      if (atomic_cas(m_entries[i], (Entry *)NULL, entry)) {
+        return entry->func;
+      }
+      // another thread took this slot first, so check its name instead
+      delete entry;
+      entry = m_entries[i];
+    }
+    if ((int)entry->name.size() == len &&
+        memcmp(entry->name.data(), s, len) == 0) {
+      return entry->func;
+    }
+  }
+  return get_invoke_few_args(s, -1);
+}
+
+Variant InvokeCache::invoke(CStrRef name, int count,
+                            CVarRef a0 /* = null_variant */,
+                            CVarRef a1 /* = null_variant */,
+                            CVarRef a2 /* = null_variant */
+#if INVOKE_FEW_ARGS_COUNT > 3
+                            ,CVarRef a3 /* = null_variant */,
+                            CVarRef a4 /* = null_variant */,
+                            CVarRef a5 /* = null_variant */
+#endif
+#if INVOKE_FEW_ARGS_COUNT > 6
+                            ,CVarRef a6 /* = null_variant */,
+                            CVarRef a7 /* = null_variant */,
+                            CVarRef a8 /* = null_variant */,
+                            CVarRef a9 /* = null_variant */
+#endif
+) {
+  InvokeFewArgsFunc func = lookup(name);
+  if (func) {
+    return func(count, a0, a1, a2
+#if INVOKE_FEW_ARGS_COUNT > 3
+                , a3, a4, a5
+#endif
+#if INVOKE_FEW_ARGS_COUNT > 6
+                , a6, a7, a8, a9
+#endif
+                );
+  }
+
+  const Variant *args[] = { &a0, &a1, &a2
+#if INVOKE_FEW_ARGS_COUNT > 3
+                            , &a3, &a4, &a5
+#endif
+#if INVOKE_FEW_ARGS_COUNT > 6
+                            , &a6, &a7, &a8, &a9
+#endif
+  };
+  Array params;
+  for (int i = 0; i < count; i++) {
+    params.append(*args[i]);
+  }
+  return HPHP::invoke(name.c_str(), params, -1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
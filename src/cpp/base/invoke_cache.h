@@ -0,0 +1,84 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef __HPHP_INVOKE_CACHE_H__
+#define __HPHP_INVOKE_CACHE_H__
+
+#include <cpp/base/externals.h>
+#include <cpp/base/type_variant.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Inline cache of one $f(...) call site. It remembers the first few function
+ * names the site calls, together with their get_invoke_few_args() proxies,
+ * so a repeated call skips the function table and passes its arguments
+ * without packing them into an Array. Names without a proxy are remembered
+ * as well, and keep going through invoke().
+ *
+ * Entries never change once they are in, so one cache is shared by all
+ * threads without locking.
+ */
+class InvokeCache {
+public:
+  static const int Size = 4; // names remembered before a site is megamorphic
+
+  InvokeCache();
+
+  Variant invoke(CStrRef name, int count,
+                 CVarRef a0 = null_variant,
+                 CVarRef a1 = null_variant,
+                 CVarRef a2 = null_variant
+#if INVOKE_FEW_ARGS_COUNT > 3
+                 ,CVarRef a3 = null_variant,
+                 CVarRef a4 = null_variant,
+                 CVarRef a5 = null_variant
+#endif
+#if INVOKE_FEW_ARGS_COUNT > 6
+                 ,CVarRef a6 = null_variant,
+                 CVarRef a7 = null_variant,
+                 CVarRef a8 = null_variant,
+                 CVarRef a9 = null_variant
+#endif
+);
+
+  /**
+   * Number of names remembered so far.
+   */
+  int size() const;
+
+private:
+  struct Entry {
+    Entry(const char *s, int len, InvokeFewArgsFunc f)
+      : name(s, len), func(f) {}
+    std::string name;
+    InvokeFewArgsFunc func;
+  };
+  Entry *m_entries[Size];
+
+  InvokeFewArgsFunc lookup(CStrRef name);
+};
+
+/**
+ * One per $f(...) call site, indexed by the ids the compiler assigned.
+ */
+extern InvokeCache invokeCaches[];
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // __HPHP_INVOKE_CACHE_H__
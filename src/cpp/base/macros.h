@@ -345,6 +345,25 @@ namespace HPHP {
     }                                           \
   } while (0)
 
+// for collecting function call counts and if-branch outcomes at runtime,
+// in the same counters: slot 0 counts calls or taken branches, slot 1
+// branches not taken
+#define RTTI_CALL_INJECTION(id)                 \
+  do {                                          \
+    unsigned int *counter = getRTTICounter(id); \
+    if (counter) {                              \
+      counter[0]++;                             \
+    }                                           \
+  } while (0)
+
+#define RTTI_BRANCH(id, cond) rtti_branch(id, (bool)(cond))
+
+// for code generated with profile data
+#define HOT_FUNCTION __attribute__((hot))
+#define COLD_FUNCTION __attribute__((cold))
+#define LIKELY(cond) __builtin_expect((bool)(cond), 1)
+#define UNLIKELY(cond) __builtin_expect((bool)(cond), 0)
+
 ///////////////////////////////////////////////////////////////////////////////
 }
 
@@ -17,10 +17,19 @@
 #include <cpp/base/memory/memory_manager.h>
 #include <cpp/base/memory/leak_detectable.h>
 #include <cpp/base/runtime_option.h>
+#include <cpp/base/server/server_stats.h>
+#include <sys/mman.h>
+#include <signal.h>
+#ifdef GOOGLE_TCMALLOC
+#include <google/malloc_extension.h>
+#endif
 
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 
+static int s_memRollbackDirtyPages =
+  ServerStats::RegisterKey("mem.rollback.dirty_pages");
+
 ThreadLocal<MemoryManager> *MemoryManager::s_singleton = NULL;
 
 static class MemoryManagerInitializer {
@@ -37,11 +46,80 @@ ThreadLocal<MemoryManager> &MemoryManager::TheMemoryManager() {
   return *s_singleton;
 }
 
-MemoryManager::MemoryManager() : m_enabled(false), m_checkpoint(false) {
+///////////////////////////////////////////////////////////////////////////////
+// dirty page tracking
+
+static __thread std::vector<ProtectedRange> *s_protectedRanges = NULL;
+static struct sigaction s_oldSegvAction;
+
+static bool ProtectedRangeLess(const ProtectedRange &r1,
+                               const ProtectedRange &r2) {
+  return r1.start < r2.start;
+}
+
+/**
+ * First write to a read-only page of checkpointed memory: flag it as dirty
+ * and make it writable again. Any other fault is passed on to whoever was
+ * handling SIGSEGV before us, and we stay installed for the next one.
+ */
+static void on_checkpoint_write(int sig, siginfo_t *info, void *context) {
+  std::vector<ProtectedRange> *ranges = s_protectedRanges;
+  char *addr = (char *)info->si_addr;
+  if (ranges && !ranges->empty()) {
+    int lo = 0;
+    int hi = ranges->size() - 1;
+    while (lo < hi) {
+      int mid = (lo + hi + 1) / 2;
+      if ((*ranges)[mid].start <= addr) {
+        lo = mid;
+      } else {
+        hi = mid - 1;
+      }
+    }
+    const ProtectedRange &range = (*ranges)[lo];
+    if (addr >= range.start && addr < range.end) {
+      int pageSize = SmartAllocatorImpl::PageSize();
+      int page = (addr - range.start) / pageSize;
+      range.dirty[page] = 1;
+      mprotect(range.start + page * pageSize, pageSize,
+               PROT_READ | PROT_WRITE);
+      return;
+    }
+  }
+
+  if (s_oldSegvAction.sa_flags & SA_SIGINFO) {
+    if (s_oldSegvAction.sa_sigaction) {
+      s_oldSegvAction.sa_sigaction(sig, info, context);
+      return;
+    }
+  } else if (s_oldSegvAction.sa_handler != SIG_DFL &&
+             s_oldSegvAction.sa_handler != SIG_IGN) {
+    s_oldSegvAction.sa_handler(sig);
+    return;
+  }
+  // a real crash nobody else handles: retrying the instruction under the
+  // default action dumps core right where it happened
+  signal(SIGSEGV, SIG_DFL);
+}
+
+static void install_checkpoint_handler() {
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = on_checkpoint_write;
+  action.sa_flags = SA_SIGINFO;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGSEGV, &action, &s_oldSegvAction);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+MemoryManager::MemoryManager()
+  : m_enabled(false), m_checkpoint(false), m_protected(false) {
   if (RuntimeOption::EnableMemoryManager) {
     m_enabled = true;
   }
   resetStats();
+  m_arena.registerStats(&m_stats);
 }
 
 void MemoryManager::resetStats() {
@@ -49,6 +127,9 @@ void MemoryManager::resetStats() {
   m_stats.alloc = 0;
   m_stats.peakUsage = 0;
   m_stats.peakAlloc = 0;
+  for (int i = 0; i < SMART_SIZE_CLASS_COUNT; i++) {
+    m_stats.sizeClassUsage[i] = 0;
+  }
 }
 
 void MemoryManager::add(SmartAllocatorImpl *allocator) {
@@ -106,12 +187,36 @@ void MemoryManager::checkpoint() {
 }
 
 void MemoryManager::rollback() {
+  int restoredPages = 0;
   m_linearAllocator.beginRestore();
   for (unsigned int i = 0; i < m_smartAllocators.size(); i++) {
     m_smartAllocators[i]->rollbackObjects(m_linearAllocator);
+    restoredPages += m_smartAllocators[i]->getRestoredPages();
   }
   m_linearAllocator.endRestore();
+  m_arena.reset();
   protectUnsafePointers();
+
+  if (RuntimeOption::RollbackDirtyPagesOnly) {
+    if (!m_protected) {
+      protectCheckpoint();
+    } else if (RuntimeOption::EnableStats) {
+      ServerStats::Log(s_memRollbackDirtyPages, restoredPages);
+    }
+  }
+}
+
+void MemoryManager::protectCheckpoint() {
+  static pthread_once_t s_once = PTHREAD_ONCE_INIT;
+  pthread_once(&s_once, install_checkpoint_handler);
+
+  m_protected = true;
+  for (unsigned int i = 0; i < m_smartAllocators.size(); i++) {
+    m_smartAllocators[i]->protectCheckpoint(m_protectedRanges);
+  }
+  sort(m_protectedRanges.begin(), m_protectedRanges.end(),
+       ProtectedRangeLess);
+  s_protectedRanges = &m_protectedRanges;
 }
 
 void MemoryManager::disableDealloc() {
@@ -123,6 +228,13 @@ void MemoryManager::disableDealloc() {
 void MemoryManager::cleanup() {
 }
 
+void MemoryManager::trim() {
+  m_arena.trim();
+#ifdef GOOGLE_TCMALLOC
+  MallocExtension::instance()->MarkThreadIdle();
+#endif
+}
+
 void MemoryManager::logStats() {
   for (unsigned int i = 0; i < m_smartAllocators.size(); i++) {
     m_smartAllocators[i]->logStats();
@@ -137,11 +249,18 @@ void MemoryManager::checkMemory(bool detailed) {
   printf("Current Alloc: %lld bytes\n", m_stats.alloc);
   printf("Peak Usage: %lld bytes\t", m_stats.peakUsage);
   printf("Peak Alloc: %lld bytes\n", m_stats.peakAlloc);
+  for (int i = 0; i < SMART_SIZE_CLASS_COUNT; i++) {
+    if (m_stats.sizeClassUsage[i]) {
+      printf("Size Class %2d Usage: %lld bytes\n", i,
+             m_stats.sizeClassUsage[i]);
+    }
+  }
 
   for (unsigned int i = 0; i < m_smartAllocators.size(); i++) {
     m_smartAllocators[i]->checkMemory(detailed);
   }
   m_linearAllocator.checkMemory(detailed);
+  m_arena.checkMemory(detailed);
   printf("Unsafe pointers: %d\n", (int)m_unsafePointers.size());
 }
 
@@ -19,6 +19,7 @@
 
 #include <cpp/base/memory/smart_allocator.h>
 #include <cpp/base/memory/linear_allocator.h>
+#include <cpp/base/memory/request_arena.h>
 #include <cpp/base/memory/unsafe_pointer.h>
 
 namespace HPHP {
@@ -32,7 +33,9 @@ namespace HPHP {
  *     exactly the same size. For example, EmptyArray.
  *  2. Interally malloc-ed and variable sized memory held by fixed size
  *     objects, for example, StringData's m_data. These memory can be backed up
- *     and restored by LinearAllocator.
+ *     and restored by LinearAllocator. After checkpoint, such memory of new
+ *     objects comes from RequestArena whenever possible, and it's released
+ *     all at once at rollback time.
  *  3. Unsafe pointers held by fixed size objects, for example, ObjectData*
  *     held by Object. These pointers point to some external memory that's out
  *     of the control of MemoryManager, and therefore they are only interfaced
@@ -78,6 +81,14 @@ public:
     return m_enabled && m_checkpoint;
   }
 
+  /**
+   * Request-scoped memory for variable sized data, like StringData's m_data.
+   * It's only available after checkpoint, since rollback() releases it.
+   */
+  RequestArena *getArena() {
+    return afterCheckpoint() ? &m_arena : NULL;
+  }
+
   /**
    * Mark current allocator's position as starting point of a new generation.
    */
@@ -92,6 +103,9 @@ public:
   /**
    * Mark current allocator's position as ending point of a generation and
    * sweep all memory that has allocated since the previous check point.
+   * With RuntimeOption::RollbackDirtyPagesOnly, checkpointed memory is made
+   * read-only after the first rollback, and later rollbacks only copy back
+   * pages that were written to.
    */
   void rollback();
 
@@ -100,6 +114,12 @@ public:
    */
   void cleanup();
 
+  /**
+   * Called between requests on a thread that has been idle for a while, to
+   * give back memory it only keeps around to make next request faster.
+   */
+  void trim();
+
   /**
    * Protect the unsafe pointers.
    */
@@ -128,12 +148,17 @@ public:
 private:
   static ThreadLocal<MemoryManager> *s_singleton;
 
+  void protectCheckpoint();
+
   bool m_enabled;
   bool m_checkpoint;
 
   std::vector<SmartAllocatorImpl*> m_smartAllocators;
   LinearAllocator m_linearAllocator;
+  RequestArena m_arena;
   std::set<UnsafePointer*> m_unsafePointers;
+  std::vector<ProtectedRange> m_protectedRanges; // sorted by start
+  bool m_protected;
 
   MemoryUsageStats m_stats;
 };
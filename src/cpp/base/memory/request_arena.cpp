@@ -0,0 +1,125 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#include <cpp/base/memory/request_arena.h>
+#include <cpp/base/memory/smart_allocator.h>
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_MAX_SIZE (ARENA_CHUNK_SIZE / 8)
+#define ARENA_ALIGN(p) ((char *)(((uintptr_t)(p) + 7) & ~(uintptr_t)7))
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+RequestArena::RequestArena()
+  : m_pos(NULL), m_end(NULL), m_last(NULL), m_usage(0), m_stats(NULL) {
+}
+
+RequestArena::~RequestArena() {
+  for (unsigned int i = 0; i < m_chunks.size(); i++) {
+    free(m_chunks[i]);
+  }
+}
+
+void RequestArena::newChunk() {
+  char *chunk = (char *)malloc(ARENA_CHUNK_SIZE);
+  m_chunks.push_back(chunk);
+  m_pos = chunk;
+  m_end = chunk + ARENA_CHUNK_SIZE;
+  m_last = NULL;
+
+  if (m_stats) {
+    m_stats->alloc += ARENA_CHUNK_SIZE;
+    if (m_stats->alloc > m_stats->peakAlloc) {
+      m_stats->peakAlloc = m_stats->alloc;
+    }
+  }
+}
+
+void RequestArena::freeChunks(unsigned int from) {
+  for (unsigned int i = from; i < m_chunks.size(); i++) {
+    free(m_chunks[i]);
+  }
+  if (m_stats && from < m_chunks.size()) {
+    // stats may have been reset since these chunks were counted
+    int64 size = (int64)(m_chunks.size() - from) * ARENA_CHUNK_SIZE;
+    m_stats->alloc -= size < m_stats->alloc ? size : m_stats->alloc;
+  }
+  m_chunks.resize(from);
+}
+
+char *RequestArena::alloc(int size) {
+  ASSERT(size > 0);
+  if (size > ARENA_MAX_SIZE) {
+    return NULL;
+  }
+
+  char *p = ARENA_ALIGN(m_pos);
+  if (m_pos == NULL || p + size > m_end) {
+    newChunk();
+    p = m_pos;
+  }
+  m_pos = p + size;
+  m_last = p;
+  m_usage += size;
+  return p;
+}
+
+char *RequestArena::realloc(char *p, int oldSize, int newSize) {
+  ASSERT(p);
+  ASSERT(oldSize > 0 && oldSize <= newSize);
+  if (newSize > ARENA_MAX_SIZE) {
+    return NULL;
+  }
+
+  if (p == m_last && p + newSize <= m_end) {
+    // the owner may have shrunk it in place since (StringData::removeChar()),
+    // so go by where the allocation really ends rather than by oldSize
+    ASSERT(m_pos >= p + oldSize);
+    m_usage += p + newSize - m_pos;
+    m_pos = p + newSize;
+    return p;
+  }
+
+  char *ret = alloc(newSize);
+  ASSERT(ret);
+  memcpy(ret, p, oldSize);
+  return ret;
+}
+
+void RequestArena::reset() {
+  if (m_chunks.empty()) return;
+
+  freeChunks(1);
+  m_pos = m_chunks[0];
+  m_end = m_pos + ARENA_CHUNK_SIZE;
+  m_last = NULL;
+  m_usage = 0;
+}
+
+void RequestArena::trim() {
+  freeChunks(0);
+  m_pos = m_end = m_last = NULL;
+  m_usage = 0;
+}
+
+void RequestArena::checkMemory(bool detailed) {
+  printf("RequestArena: %lld bytes in %d chunks\n", m_usage,
+         (int)m_chunks.size());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,91 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef __HPHP_REQUEST_ARENA_H__
+#define __HPHP_REQUEST_ARENA_H__
+
+#include <util/base.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+struct MemoryUsageStats;
+
+/**
+ * A bump-pointer allocator for variable sized memory that dies with the
+ * request, like StringData's m_data. Nothing is freed individually; reset()
+ * releases everything at once when MemoryManager rolls back. Sizes too big
+ * for a chunk are refused, and callers are expected to malloc() them.
+ */
+class RequestArena {
+public:
+  RequestArena();
+  ~RequestArena();
+
+  /**
+   * Called by MemoryManager to have chunk mallocs counted in its stats.
+   */
+  void registerStats(MemoryUsageStats *stats) { m_stats = stats;}
+
+  /**
+   * Returns NULL if size is too big for this arena.
+   */
+  char *alloc(int size);
+
+  /**
+   * Grows p in place if it is the last allocation and there is room left in
+   * its chunk, otherwise moves it into a new allocation. Old memory is never
+   * released, so it's safe for caller to keep reading from it. oldSize may
+   * be less than what was allocated, if the caller shrank p in place. Returns
+   * NULL if newSize is too big for this arena.
+   */
+  char *realloc(char *p, int oldSize, int newSize);
+
+  /**
+   * Release all allocations, keeping the first chunk for next request.
+   */
+  void reset();
+
+  /**
+   * Same as reset(), except the first chunk is released too. Only for when a
+   * thread expects to stay idle for a while.
+   */
+  void trim();
+
+  /**
+   * How many bytes have been dispensed since last reset().
+   */
+  int64 getUsage() const { return m_usage;}
+
+  void checkMemory(bool detailed);
+
+private:
+  std::vector<char *> m_chunks;
+  char *m_pos;   // next free byte of last chunk
+  char *m_end;   // end of last chunk
+  char *m_last;  // last allocation, the only one that can grow in place
+  int64 m_usage;
+
+  MemoryUsageStats *m_stats;
+
+  void newChunk();
+  void freeChunks(unsigned int from);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // __HPHP_REQUEST_ARENA_H__
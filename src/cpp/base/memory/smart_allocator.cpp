@@ -20,6 +20,7 @@
 #include <cpp/base/server/server_stats.h>
 #include <cpp/base/runtime_option.h>
 #include <util/logger.h>
+#include <sys/mman.h>
 
 using namespace std;
 using namespace boost;
@@ -42,34 +43,55 @@ static int calculate_item_count(int itemSize) {
   return itemCount;
 }
 
+int SmartAllocatorImpl::PageSize() {
+  static int s_pageSize = sysconf(_SC_PAGESIZE);
+  return s_pageSize;
+}
+
+static int round_to_page(int size) {
+  int pageSize = SmartAllocatorImpl::PageSize();
+  return (size + pageSize - 1) / pageSize * pageSize;
+}
+
+int SmartAllocatorImpl::SizeClassIndex(int itemSize) {
+  ASSERT(itemSize > 0);
+  if (itemSize <= SMART_SIZE_CLASS_SMALL) {
+    return (itemSize - 1) / 8;
+  }
+  if (itemSize <= SMART_SIZE_CLASS_MEDIUM) {
+    return SMART_SIZE_CLASS_SMALL / 8 +
+      (itemSize - SMART_SIZE_CLASS_SMALL - 1) / 32;
+  }
+  return SMART_SIZE_CLASS_COUNT - 1;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // constructor and destructor
 
 SmartAllocatorImpl::SmartAllocatorImpl(int nameEnum, int itemCount,
                                        int itemSize, int flag)
-  : m_itemCount(itemCount), m_itemSize(itemSize), m_flag(flag),
+  : m_itemCount(itemCount), m_itemSize(itemSize),
+    m_sizeClass(SizeClassIndex(itemSize)), m_flag(flag),
     m_row(0), m_col(0), m_pos(-1),
     m_rowChecked(0), m_colChecked(0), m_posChecked(-1), m_linearSize(0),
-    m_linearCount(0), m_iter(this), m_dealloc(true), m_linearized(false),
-    m_stats(NULL) {
+    m_linearCount(0),
+    m_pageAligned(RuntimeOption::RollbackDirtyPagesOnly),
+    m_protected(false), m_restoredPages(0),
+    m_iter(this), m_dealloc(true), m_linearized(false), m_stats(NULL) {
 
   // automatically pick a good per slab item count
   if (m_itemCount <= 0) {
     m_itemCount = SLAB_SIZE / m_itemSize;
     switch (nameEnum) {
-    case GlobalVariables:
-      m_itemCount = 1;
-      break;
-    case Variant:
-    case Array:
     case SharedMap:
       m_itemCount = 128; // rarely used items belong to this group
       break;
     case ObjectData:
       m_itemCount = calculate_item_count(m_itemSize);
       break;
-    case Bucket:
-      m_itemCount *= 4; //  we need lots of Buckets
+    case SizeClass:
+      // normally picked by SizeClassAllocator::RequestSlabItems() instead
+      m_itemCount = SizeClassAllocatorBase::DefaultSlabItems(m_itemSize);
       break;
     }
   }
@@ -78,7 +100,7 @@ SmartAllocatorImpl::SmartAllocatorImpl(int nameEnum, int itemCount,
   ASSERT(itemSize);
 
   m_colMax = m_itemSize * m_itemCount;
-  m_blocks.push_back((char *)malloc(m_colMax));
+  m_blocks.push_back(mallocBlock(m_colMax));
   m_freelist.resize(m_itemCount);
   if (m_stats) {
     m_stats->alloc += m_colMax;
@@ -104,6 +126,11 @@ SmartAllocatorImpl::SmartAllocatorImpl(int nameEnum, int itemCount,
 
 SmartAllocatorImpl::~SmartAllocatorImpl() {
   unsigned int size = m_blocks.size();
+  if (m_protected) {
+    for (unsigned int i = 0; i < m_backupBlocks.size(); i++) {
+      mprotect(m_blocks[i], round_to_page(m_colMax), PROT_READ | PROT_WRITE);
+    }
+  }
   for (unsigned int i = 0; i < size; i++) {
     free(m_blocks[i]);
   }
@@ -119,6 +146,7 @@ SmartAllocatorImpl::~SmartAllocatorImpl() {
 void *SmartAllocatorImpl::alloc() {
   if (m_stats) {
     m_stats->usage += m_itemSize;
+    m_stats->sizeClassUsage[m_sizeClass] += m_itemSize;
     if (m_stats->usage > m_stats->peakUsage) {
       int64 prevPeakUsage = m_stats->peakUsage;
       m_stats->peakUsage = m_stats->usage;
@@ -137,7 +165,7 @@ void *SmartAllocatorImpl::alloc() {
     return m_freelist[m_pos--];
   }
   if (m_col >= m_colMax) {
-    m_blocks.push_back((char *)malloc(m_colMax));
+    m_blocks.push_back(mallocBlock(m_colMax));
     if (m_stats) {
       m_stats->alloc += m_colMax;
       if (m_stats->alloc > m_stats->peakAlloc) {
@@ -171,6 +199,7 @@ void SmartAllocatorImpl::dealloc(void *obj) {
 
     if (m_stats) {
       m_stats->usage -= m_itemSize;
+      m_stats->sizeClassUsage[m_sizeClass] -= m_itemSize;
     }
   }
 }
@@ -192,6 +221,18 @@ bool SmartAllocatorImpl::isValid(void *obj) const {
 ///////////////////////////////////////////////////////////////////////////////
 // SmartAllocatorManager methods
 
+char *SmartAllocatorImpl::mallocBlock(int size) {
+  if (m_pageAligned) {
+    // whole pages, so protecting them never affects any other memory
+    void *p = NULL;
+    if (posix_memalign(&p, PageSize(), round_to_page(size))) {
+      return NULL;
+    }
+    return (char *)p;
+  }
+  return (char *)malloc(size);
+}
+
 /**
  * When we restore, destination's size is always bigger, therefore, we can
  * fully restore destination's old contents WITHOUT malloc-ing new memory. This
@@ -306,7 +347,11 @@ void SmartAllocatorImpl::rollbackObjects(LinearAllocator &allocator) {
     }
     m_blocks.resize(1);
   } else {
-    copyMemoryBlocks(m_blocks, m_backupBlocks, m_colChecked, m_colMax);
+    if (m_protected) {
+      restoreDirtyPages();
+    } else {
+      copyMemoryBlocks(m_blocks, m_backupBlocks, m_colChecked, m_colMax);
+    }
 
     // restore variable sized memory
     if (((m_flag & RestoreDisabled) == 0)) {
@@ -328,6 +373,62 @@ void SmartAllocatorImpl::rollbackObjects(LinearAllocator &allocator) {
   }
 }
 
+void SmartAllocatorImpl::protectCheckpoint
+(std::vector<ProtectedRange> &ranges) {
+  if (!m_pageAligned || m_protected || m_backupBlocks.empty() ||
+      (m_flag & (NeedRestore | RestoreDisabled)) ||
+      ((m_flag & NeedRestoreOnce) && !m_linearized)) {
+    return; // these objects are written into by every rollback
+  }
+
+  int pageSize = PageSize();
+  int blockPages = round_to_page(m_colMax) / pageSize;
+  int rows = m_backupBlocks.size();
+  m_dirtyPages.assign(rows * blockPages, 0);
+  for (int i = 0; i < rows; i++) {
+    int used = (i == rows - 1) ? m_colChecked : m_colMax;
+    if (used == 0) continue;
+
+    ProtectedRange range;
+    range.start = m_blocks[i];
+    range.end = m_blocks[i] + round_to_page(used);
+    range.dirty = &m_dirtyPages[i * blockPages];
+    mprotect(range.start, range.end - range.start, PROT_READ);
+    ranges.push_back(range);
+  }
+  m_protected = true;
+}
+
+/**
+ * Same as copyMemoryBlocks(m_blocks, m_backupBlocks, ...), except clean pages
+ * are known to be identical already.
+ */
+void SmartAllocatorImpl::restoreDirtyPages() {
+  int rows = m_backupBlocks.size();
+  for (unsigned int i = rows; i < m_blocks.size(); i++) {
+    free(m_blocks[i]);
+  }
+  m_blocks.resize(rows);
+
+  int pageSize = PageSize();
+  int blockPages = round_to_page(m_colMax) / pageSize;
+  m_restoredPages = 0;
+  for (int i = 0; i < rows; i++) {
+    int used = (i == rows - 1) ? m_colChecked : m_colMax;
+    unsigned char *dirty = &m_dirtyPages[i * blockPages];
+    for (int offset = 0, page = 0; offset < used;
+         offset += pageSize, page++) {
+      if (dirty[page]) {
+        int size = used - offset < pageSize ? used - offset : pageSize;
+        memcpy(m_blocks[i] + offset, m_backupBlocks[i] + offset, size);
+        mprotect(m_blocks[i] + offset, pageSize, PROT_READ);
+        dirty[page] = 0;
+        m_restoredPages++;
+      }
+    }
+  }
+}
+
 void SmartAllocatorImpl::logStats() {
   int allocated = m_itemCount * m_row + (m_col / m_itemSize);
   int freed = m_pos + 1;
@@ -525,6 +626,40 @@ void ObjectAllocatorBase::dump(void *p) {
   printf("%p", p);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// SizeClassAllocator classes
+
+SizeClassAllocatorBase::SizeClassAllocatorBase(int itemSize, int itemCount)
+  : SmartAllocatorImpl(SmartAllocatorImpl::SizeClass, itemCount, itemSize,
+                       SmartAllocatorImpl::NoCallbacks) { }
+
+int SizeClassAllocatorBase::DefaultSlabItems(int itemSize) {
+  int count = SLAB_SIZE / itemSize;
+  return count > 0 ? count : 1;
+}
+
+int SizeClassAllocatorBase::calculate(void *p, int &size) {
+  return false;
+}
+
+void SizeClassAllocatorBase::backup(void *p, LinearAllocator &allocator) {
+  // do nothing
+}
+
+void SizeClassAllocatorBase::restore(void *p, const char *&data) {
+  // do nothing
+}
+
+void SizeClassAllocatorBase::sweep(void *p) {
+  // do nothing
+}
+
+void SizeClassAllocatorBase::dump(void *p) {
+  printf("%p", p);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 int ObjectAllocatorWrapper::getAllocatorSeqno(int size) {
   int r = 0;
   int s = sizeof(ObjectData);
@@ -90,8 +90,16 @@ namespace HPHP {
     DELETE(T)(this);                                                    \
   }                                                                     \
 
+/**
+ * Classes that need nothing from checkpoint and rollback share size-class
+ * allocators (see SizeClassAllocator below) instead of each owning a
+ * per-type SmartAllocator.
+ */
 #define DECLARE_SMART_ALLOCATION_NOCALLBACKS(T)                         \
-  DECLARE_SMART_ALLOCATION(T, SmartAllocatorImpl::NoCallbacks);         \
+  public:                                                               \
+  typedef SizeClassAllocatorWrapper<T> AllocatorType;                   \
+  static AllocatorType Allocator;                                       \
+  void release();                                                       \
   bool calculate(int &size) {                                           \
     ASSERT(false);                                                      \
     return false;                                                       \
@@ -106,10 +114,54 @@ namespace HPHP {
   }                                                                     \
 
 #define IMPLEMENT_SMART_ALLOCATION_NOCALLBACKS(T)                       \
-  IMPLEMENT_SMART_ALLOCATION(T, SmartAllocatorImpl::NoCallbacks)        \
+  T::AllocatorType T::Allocator;                                        \
+  void T::release() {                                                   \
+    DELETE(T)(this);                                                    \
+  }                                                                     \
 
 #define IMPLEMENT_SMART_ALLOCATION_NOCALLBACKS_CLS(C, T)                \
-  IMPLEMENT_SMART_ALLOCATION_CLS(C, T, SmartAllocatorImpl::NoCallbacks) \
+  C::T::AllocatorType C::T::Allocator;                                  \
+  void C::T::release() {                                                \
+    DELETE(T)(this);                                                    \
+  }                                                                     \
+
+/**
+ * Same, for a type that wants a different number of items per slab than
+ * the usual SLAB_SIZE worth, like the way more numerous ZendArray::Bucket or
+ * GlobalVariables, which has one instance per thread.
+ */
+#define IMPLEMENT_SMART_ALLOCATION_NOCALLBACKS_ITEMS(T, items)          \
+  T::AllocatorType T::Allocator(items);                                 \
+  void T::release() {                                                   \
+    DELETE(T)(this);                                                    \
+  }                                                                     \
+
+#define IMPLEMENT_SMART_ALLOCATION_NOCALLBACKS_ITEMS_CLS(C, T, items)   \
+  C::T::AllocatorType C::T::Allocator(items);                           \
+  void C::T::release() {                                                \
+    DELETE(T)(this);                                                    \
+  }                                                                     \
+
+///////////////////////////////////////////////////////////////////////////////
+// Size classes: item sizes are rounded up to 8 bytes below 128 bytes and to
+// 32 bytes below 512 bytes. Anything bigger is only word aligned and shares
+// the last statistics slot.
+
+#define SMART_SIZE_CLASS_SMALL 128
+#define SMART_SIZE_CLASS_MEDIUM 512
+#define SMART_SIZE_CLASS_COUNT                                          \
+  (SMART_SIZE_CLASS_SMALL / 8 +                                         \
+   (SMART_SIZE_CLASS_MEDIUM - SMART_SIZE_CLASS_SMALL) / 32 + 1)
+
+template<int S>
+class SizeClass {
+public:
+  enum {
+    value = (S <= SMART_SIZE_CLASS_SMALL ? ((S + 7) & ~7) :
+             S <= SMART_SIZE_CLASS_MEDIUM ? ((S + 31) & ~31) :
+             ((S + 7) & ~7))
+  };
+};
 
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -121,6 +173,19 @@ struct MemoryUsageStats {
   int64 alloc;     // how many bytes are currently malloc-ed
   int64 peakUsage; // how many bytes have been dispensed at maximum
   int64 peakAlloc; // how many bytes malloc-ed at maximum
+
+  // how many bytes are currently being used, by size class
+  int64 sizeClassUsage[SMART_SIZE_CLASS_COUNT];
+};
+
+/**
+ * Checkpointed memory that's made read-only, so writes to it can be tracked
+ * by pages. See RuntimeOption::RollbackDirtyPagesOnly.
+ */
+struct ProtectedRange {
+  char *start;
+  char *end;
+  unsigned char *dirty; // one flag per page
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -155,6 +220,12 @@ public:
   void registerStats(MemoryUsageStats *stats) { m_stats = stats;}
 
   int getItemSize() const { return m_itemSize;}
+  int getItemCount() const { return m_itemCount;}
+
+  /**
+   * Which slot of MemoryUsageStats::sizeClassUsage an item size belongs to.
+   */
+  static int SizeClassIndex(int itemSize);
 
   /**
    * Allocation/deallocation of object memory.
@@ -172,6 +243,15 @@ public:
   void logStats();
   void checkMemory(bool detailed);
 
+  /**
+   * Make checkpointed memory read-only, so next rollbackObjects() only needs
+   * to copy back pages that were written to. Only done after first rollback,
+   * and only for types that don't need restore() every time.
+   */
+  void protectCheckpoint(std::vector<ProtectedRange> &ranges);
+  int getRestoredPages() const { return m_restoredPages;}
+  static int PageSize();
+
   void disableDealloc() { m_dealloc = false;}
   void disableRestore() { m_flag |= RestoreDisabled;}
 
@@ -188,6 +268,7 @@ public:
   const char *m_name;
   int m_itemCount;
   int m_itemSize;
+  int m_sizeClass;
   int m_flag;
 
   std::vector<char *> m_blocks;
@@ -207,6 +288,12 @@ public:
   int m_linearSize;
   int m_linearCount;
 
+  // dirty page tracking members
+  bool m_pageAligned; // all blocks are whole pages
+  bool m_protected;
+  std::vector<unsigned char> m_dirtyPages;
+  int m_restoredPages;
+
   class PointerIterator {
   public:
     PointerIterator(SmartAllocatorImpl *allocator);
@@ -234,9 +321,11 @@ public:
 
   PointerIterator m_iter;
 
+  char *mallocBlock(int size);
   void copyMemoryBlocks(std::vector<char *> &dest,
                         const std::vector<char *> &src,
                         int lastCol, int lastBlockSize);
+  void restoreDirtyPages();
 
 protected:
   bool m_dealloc;
@@ -405,6 +494,96 @@ private:
   ObjectAllocatorBase *(*m_get)(void);
 };
 
+///////////////////////////////////////////////////////////////////////////////
+// This allocator is for fixed sized classes that need no callbacks during
+// checkpoint and rollback, like Variant or ZendArray::Bucket. All such classes
+// whose sizes fall into the same size class share one allocator per thread,
+// so one request doesn't spread its memory over a slab for every type.
+
+class SizeClassAllocatorBase : public SmartAllocatorImpl {
+public:
+  SizeClassAllocatorBase(int itemSize, int itemCount);
+
+  /**
+   * How many items of itemSize fit in a SLAB_SIZE slab, at least one.
+   */
+  static int DefaultSlabItems(int itemSize);
+
+  void release(void *p) {
+    if (p && m_dealloc) {
+      dealloc(p);
+    }
+  }
+
+  virtual int calculate(void *p, int &size);
+  virtual void backup(void *p, LinearAllocator &allocator);
+  virtual void restore(void *p, const char *&data);
+  virtual void sweep(void *p);
+  virtual void dump(void *p);
+};
+
+template<int S>
+class SizeClassAllocator : public SizeClassAllocatorBase {
+public:
+  static SizeClassAllocator<S> *Create() {
+    return new SizeClassAllocator<S>();
+  }
+  static void Delete(SizeClassAllocator *p) {
+    delete p;
+  }
+
+  SizeClassAllocator() : SizeClassAllocatorBase(S, s_slabItems) { }
+
+  /**
+   * Each type sharing this allocator asks for its per slab item count, or
+   * the default one with 0, at static initialization time, before any
+   * thread creates the allocator. The biggest count asked for wins, so a
+   * numerous type never gets small slabs for sharing them with a rare one.
+   */
+  static void RequestSlabItems(int count) {
+    if (count <= 0) count = DefaultSlabItems(S);
+    if (count > s_slabItems) s_slabItems = count;
+  }
+
+private:
+  static int s_slabItems; // zero-initialized before static constructors run
+};
+
+template<int S>
+int SizeClassAllocator<S>::s_slabItems;
+
+/**
+ * What DECLARE_SMART_ALLOCATION_NOCALLBACKS(T) declares as T::Allocator, so
+ * NEW(T) and DELETE(T) work the same way as with a per-type SmartAllocator.
+ */
+template<typename T>
+class SizeClassAllocatorWrapper {
+public:
+  typedef SizeClassAllocator<SizeClass<sizeof(T)>::value> AllocatorImpl;
+
+  explicit SizeClassAllocatorWrapper(int slabItems = 0) {
+    AllocatorImpl::RequestSlabItems(slabItems);
+  }
+
+  AllocatorImpl *get() const {
+    return m_allocator.get();
+  }
+
+  const SizeClassAllocatorWrapper *operator->() const {
+    return this;
+  }
+
+  void release(T *p) const {
+    if (p) {
+      p->~T();
+      m_allocator->release(p);
+    }
+  }
+
+private:
+  ThreadLocalSingleton<AllocatorImpl> m_allocator;
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 }
 
@@ -418,6 +597,10 @@ inline void *operator new(size_t sizeT, HPHP::ObjectAllocatorBase *a) {
   return a->alloc();
 }
 
+inline void *operator new(size_t sizeT, HPHP::SizeClassAllocatorBase *a) {
+  return a->alloc();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 #endif // __HPHP_SMART_ALLOCATOR_H__
@@ -652,7 +652,10 @@ bool hphp_warmup(ExecutionContext *context, const std::string &warmupDoc,
         return ret;
       }
       s_warmup_state->done = true;
-      mm->checkpoint();
+      {
+        ServerStatsHelper ssh("checkpoint");
+        mm->checkpoint();
+      }
       s_warmup_state->atCheckpoint = true;
     }
   }
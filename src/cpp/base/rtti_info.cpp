@@ -42,7 +42,18 @@ void RTTIInfo::translate_rtti(const char *rttiDirectory) {
     int total = 0;
     for (int j = 0; j < KindOfLast; j++) total += m_profData[i][j];
     if (!total) continue;
-    printf("%s(%d):", m_id2name[i].c_str(), total);
+    const string &name = m_id2name[i];
+    size_t pos = name.rfind("::");
+    if (pos != string::npos && name.compare(pos, 4, "::()") == 0) {
+      printf("%s(%d): calls\n", name.substr(0, pos).c_str(), total);
+      continue;
+    }
+    if (pos != string::npos && name.compare(pos, 3, "::@") == 0) {
+      printf("%s(%d): taken/%u not/%u\n", name.c_str(), total,
+             m_profData[i][0], m_profData[i][1]);
+      continue;
+    }
+    printf("%s(%d):", name.c_str(), total);
     if (m_profData[i][KindOfNull]) {
       printf(" n/%u", m_profData[i][KindOfNull]);
     }
@@ -147,11 +158,16 @@ void RTTIInfo::loadMetaData(const char *filename) {
   if (fgets(line, sizeof(line), f)) {
     sscanf(line, "%d", &m_count);
   }
-  while (fgets(line, sizeof(line), f)) {
+  // entry names in id order, then functions with parameter entries
+  for (int i = 0; fgets(line, sizeof(line), f); i++) {
     int len = strlen(line);
     ASSERT(len > 0);
     if (line[len-1] == '\n') line[len-1] = 0;
-    m_functions.insert(line);
+    if (i < m_count) {
+      m_id2name.push_back(line);
+    } else {
+      m_functions.insert(line);
+    }
   }
   fclose(f);
 }
@@ -214,5 +230,17 @@ bool RTTIInfo::exists(const char *funcName) {
   return m_functions.find(funcName) != m_functions.end();
 }
 
+const unsigned int *RTTIInfo::getProfData(const char *name) {
+  if (!m_profData) return NULL;
+  if (m_name2id.empty()) {
+    for (unsigned int i = 0; i < m_id2name.size(); i++) {
+      m_name2id[m_id2name[i]] = i;
+    }
+  }
+  map<string, int>::const_iterator iter = m_name2id.find(name);
+  if (iter == m_name2id.end()) return NULL;
+  return m_profData[iter->second];
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 }
@@ -19,6 +19,7 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include <util/mutex.h>
 #include <cpp/base/types.h>
 
@@ -35,6 +36,12 @@ public:
   bool loadProfData(const char *rttiDir);
   bool exists(const char *funcName);
 
+  /**
+   * Summed up counters of one entry by its name, or NULL if it wasn't
+   * profiled.
+   */
+  const unsigned int *getProfData(const char *name);
+
 public:
   RTTIInfo();
   ~RTTIInfo() { if (m_profData) free(m_profData);}
@@ -47,6 +54,7 @@ private:
   bool m_loaded;
   int m_count;
   std::vector<std::string> m_id2name;
+  std::map<std::string, int> m_name2id;
   std::set<std::string> m_functions;
   RTTICounter *m_profData;
 
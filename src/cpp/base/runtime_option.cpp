@@ -52,6 +52,8 @@ bool RuntimeOption::AssertWarning = false;
 
 std::string RuntimeOption::AccessLogDefaultFormat;
 std::vector<std::pair<std::string, std::string> >  RuntimeOption::AccessLogs;
+int RuntimeOption::AccessLogFlushInterval = 1000;
+int RuntimeOption::AccessLogBufferSize = 1 << 20;
 
 std::string RuntimeOption::AdminLogFormat;
 std::string RuntimeOption::AdminLogFile;
@@ -64,15 +66,22 @@ std::string RuntimeOption::ServerIP;
 std::string RuntimeOption::ServerPrimaryIP;
 int RuntimeOption::ServerPort;
 int RuntimeOption::ServerThreadCount = 50;
+int RuntimeOption::ServerMinThreadCount = 0;
+int RuntimeOption::ServerThreadIdleTimeoutSeconds = 10;
+int RuntimeOption::ServerQueueTimeoutMilliSeconds = 0;
+bool RuntimeOption::ServerThreadJobLIFO = false;
+int RuntimeOption::ServerThreadDropCacheTimeoutSeconds = 0;
 int RuntimeOption::PageletServerThreadCount = 0;
 int RuntimeOption::RequestTimeoutSeconds = -1;
 int RuntimeOption::RequestMemoryMaxBytes = -1;
 int RuntimeOption::ResponseQueueCount;
+int RuntimeOption::ServerEventLoopCount = 1;
 int RuntimeOption::ServerGracefulShutdownWait;
 bool RuntimeOption::ServerHarshShutdown = true;
 bool RuntimeOption::ServerEvilShutdown = true;
 int RuntimeOption::ServerDanglingWait;
 int RuntimeOption::GzipCompressionLevel = 3;
+int64 RuntimeOption::GzipCacheSize = 64 * 1024 * 1024;
 bool RuntimeOption::EnableKeepAlive = true;
 bool RuntimeOption::EnableEarlyFlush = true;
 bool RuntimeOption::ForceChunkedEncoding = false;
@@ -109,6 +118,12 @@ std::string RuntimeOption::FatalErrorMessage;
 std::string RuntimeOption::FontPath;
 bool RuntimeOption::EnableStaticContentCache = true;
 bool RuntimeOption::EnableStaticContentFromDisk = true;
+bool RuntimeOption::EnableStaticContentMmap = false;
+int RuntimeOption::StaticContentMmapCacheSize = 4096;
+int64 RuntimeOption::StaticContentMmapCacheBytes = 256 * 1024 * 1024;
+int RuntimeOption::StaticContentLoadThread = 4;
+bool RuntimeOption::StaticContentLazyLoad = false;
+std::string RuntimeOption::StaticContentGzipCache;
 
 std::string RuntimeOption::RTTIDirectory;
 bool RuntimeOption::EnableCliRTTI = false;
@@ -177,11 +192,14 @@ int RuntimeOption::StatsMaxSlot = 12 * 6; // 12 hours
 int64 RuntimeOption::MaxRSS = 0;
 bool RuntimeOption::EnableMemoryManager = false;
 bool RuntimeOption::CheckMemory = false;
+bool RuntimeOption::RollbackDirtyPagesOnly = false;
 bool RuntimeOption::UseZendArray = true;
+bool RuntimeOption::UseDenseArray = false;
 bool RuntimeOption::EnableApc = true;
 bool RuntimeOption::ApcUseSharedMemory = false;
 int RuntimeOption::ApcSharedMemorySize = 1024; // 1GB
 std::string RuntimeOption::ApcPrimeLibrary;
+std::string RuntimeOption::ApcPrimeSnapshot;
 int RuntimeOption::ApcLoadThread = 1;
 std::set<std::string> RuntimeOption::ApcCompletionKeys;
 RuntimeOption::ApcTableTypes RuntimeOption::ApcTableType = ApcHashTable;
@@ -193,6 +211,7 @@ int RuntimeOption::ApcKeyFrequencyUpdatePeriod = 1000;
 bool RuntimeOption::ApcUseLockedRefs = false;
 bool RuntimeOption::ApcExpireOnSets = false;
 int RuntimeOption::ApcPurgeFrequency = 4096;
+int RuntimeOption::ApcShardCount = 64;
 
 bool RuntimeOption::EnableDnsCache = false;
 int RuntimeOption::DnsCacheTTL = 10 * 60; // 10 minutes
@@ -340,6 +359,8 @@ void RuntimeOption::Load(Hdf &config) {
                                          getString(AccessLogDefaultFormat)));
       }
     }
+    AccessLogFlushInterval = logger["AccessLogFlushInterval"].getInt32(1000);
+    AccessLogBufferSize = logger["AccessLogBufferSize"].getInt32(1 << 20);
 
     AdminLogFormat = logger["AdminLogFormat"].getString("%h %t %s %U");
     AdminLogFile = logger["AdminLogFile"].getString();
@@ -369,6 +390,14 @@ void RuntimeOption::Load(Hdf &config) {
     ServerPrimaryIP = Util::GetPrimaryIP();
     ServerPort = server["Port"].getInt16(80);
     ServerThreadCount = server["ThreadCount"].getInt32(50);
+    ServerMinThreadCount = server["MinThreadCount"].getInt32(0);
+    ServerThreadIdleTimeoutSeconds =
+      server["ThreadIdleTimeoutSeconds"].getInt32(10);
+    ServerQueueTimeoutMilliSeconds =
+      server["QueueTimeoutMilliSeconds"].getInt32(0);
+    ServerThreadJobLIFO = server["ThreadJobLIFO"].getBool(false);
+    ServerThreadDropCacheTimeoutSeconds =
+      server["ThreadDropCacheTimeoutSeconds"].getInt32(0);
     PageletServerThreadCount = server["PageletServerThreadCount"].getInt32(0);
     RequestTimeoutSeconds = server["RequestTimeoutSeconds"].getInt32(-1);
     RequestMemoryMaxBytes = server["RequestMemoryMaxBytes"].getInt64(-1);
@@ -377,6 +406,8 @@ void RuntimeOption::Load(Hdf &config) {
       ResponseQueueCount = ServerThreadCount / 10;
       if (ResponseQueueCount <= 0) ResponseQueueCount = 1;
     }
+    ServerEventLoopCount = server["EventLoopCount"].getInt32(1);
+    if (ServerEventLoopCount <= 0) ServerEventLoopCount = 1;
     ServerGracefulShutdownWait = server["GracefulShutdownWait"].getInt16(0);
     ServerHarshShutdown = server["HarshShutdown"].getBool(true);
     ServerEvilShutdown = server["EvilShutdown"].getBool(true);
@@ -385,6 +416,7 @@ void RuntimeOption::Load(Hdf &config) {
       ServerGracefulShutdownWait = ServerDanglingWait;
     }
     GzipCompressionLevel = server["GzipCompressionLevel"].getInt16(3);
+    GzipCacheSize = server["GzipCacheSize"].getInt64(64 * 1024 * 1024);
     EnableKeepAlive = server["EnableKeepAlive"].getBool(true);
     EnableEarlyFlush = server["EnableEarlyFlush"].getBool(true);
     ForceChunkedEncoding = server["ForceChunkedEncoding"].getBool();
@@ -429,6 +461,14 @@ void RuntimeOption::Load(Hdf &config) {
       server["EnableStaticContentCache"].getBool(true);
     EnableStaticContentFromDisk =
       server["EnableStaticContentFromDisk"].getBool(true);
+    EnableStaticContentMmap = server["EnableStaticContentMmap"].getBool();
+    StaticContentMmapCacheSize =
+      server["StaticContentMmapCacheSize"].getInt32(4096);
+    StaticContentMmapCacheBytes =
+      server["StaticContentMmapCacheBytes"].getInt64(256 * 1024 * 1024);
+    StaticContentLoadThread = server["StaticContentLoadThread"].getInt32(4);
+    StaticContentLazyLoad = server["StaticContentLazyLoad"].getBool();
+    StaticContentGzipCache = server["StaticContentGzipCache"].getString();
 
     RTTIDirectory = server["RTTIDirectory"].getString("/tmp/");
     if (!RTTIDirectory.empty() &&
@@ -460,13 +500,16 @@ void RuntimeOption::Load(Hdf &config) {
 
     EnableMemoryManager = server["EnableMemoryManager"].getBool();
     CheckMemory = server["CheckMemory"].getBool();
+    RollbackDirtyPagesOnly = server["RollbackDirtyPagesOnly"].getBool();
     UseZendArray = server["UseZendArray"].getBool(true);
+    UseDenseArray = server["UseDenseArray"].getBool();
 
     Hdf apc = server["APC"];
     EnableApc = apc["EnableApc"].getBool(true);
     ApcUseSharedMemory = apc["UseSharedMemory"].getBool();
     ApcSharedMemorySize = apc["SharedMemorySize"].getInt32(1024 /* 1GB */);
     ApcPrimeLibrary = apc["PrimeLibrary"].getString();
+    ApcPrimeSnapshot = apc["PrimeSnapshot"].getString();
     ApcLoadThread = apc["LoadThread"].getInt16(2);
     apc["CompletionKeys"].get(ApcCompletionKeys);
 
@@ -477,6 +520,8 @@ void RuntimeOption::Load(Hdf &config) {
       ApcTableType = ApcLfuTable;
     } else if (strcasecmp(apcTableType.c_str(), "concurrent") == 0) {
       ApcTableType = ApcConcurrentTable;
+    } else if (strcasecmp(apcTableType.c_str(), "sharded") == 0) {
+      ApcTableType = ApcShardedTable;
     } else {
       throw InvalidArgumentException("apc table type",
                                      "Invalid table type");
@@ -494,6 +539,11 @@ void RuntimeOption::Load(Hdf &config) {
     ApcUseLockedRefs = apc["UseLockedRefs"].getBool();
     ApcExpireOnSets = apc["ExpireOnSets"].getBool();
     ApcPurgeFrequency = apc["PurgeFrequency"].getInt32(4096);
+    ApcShardCount = apc["ShardCount"].getInt32(64);
+    if (ApcShardCount <= 0) {
+      throw InvalidArgumentException("apc shard count",
+                                     "Shard count must be positive");
+    }
 
     ApcKeyMaturityThreshold = apc["KeyMaturityThreshold"].getInt32(20);
     ApcMaximumCapacity = apc["MaximumCapacity"].getInt64(0);
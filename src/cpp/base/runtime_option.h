@@ -52,6 +52,8 @@ public:
 
   static std::string AccessLogDefaultFormat;
   static std::vector<std::pair<std::string, std::string> > AccessLogs;
+  static int AccessLogFlushInterval;
+  static int AccessLogBufferSize;
 
   static std::string AdminLogFormat;
   static std::string AdminLogFile;
@@ -63,15 +65,22 @@ public:
   static std::string ServerPrimaryIP;
   static int ServerPort;
   static int ServerThreadCount;
+  static int ServerMinThreadCount;
+  static int ServerThreadIdleTimeoutSeconds;
+  static int ServerQueueTimeoutMilliSeconds;
+  static bool ServerThreadJobLIFO;
+  static int ServerThreadDropCacheTimeoutSeconds;
   static int PageletServerThreadCount;
   static int RequestTimeoutSeconds;
   static int RequestMemoryMaxBytes;
   static int ResponseQueueCount;
+  static int ServerEventLoopCount;
   static int ServerGracefulShutdownWait;
   static int ServerDanglingWait;
   static bool ServerHarshShutdown;
   static bool ServerEvilShutdown;
   static int GzipCompressionLevel;
+  static int64 GzipCacheSize;
   static bool EnableKeepAlive;
   static bool EnableEarlyFlush;
   static bool ForceChunkedEncoding;
@@ -107,6 +116,12 @@ public:
   static std::string FontPath;
   static bool EnableStaticContentCache;
   static bool EnableStaticContentFromDisk;
+  static bool EnableStaticContentMmap;
+  static int StaticContentMmapCacheSize;
+  static int64 StaticContentMmapCacheBytes;
+  static int StaticContentLoadThread;
+  static bool StaticContentLazyLoad;
+  static std::string StaticContentGzipCache;
 
   static std::string RTTIDirectory;
   static bool EnableCliRTTI;
@@ -175,17 +190,21 @@ public:
   static int64 MaxRSS;
   static bool EnableMemoryManager;
   static bool CheckMemory;
+  static bool RollbackDirtyPagesOnly;
   static bool UseZendArray;
+  static bool UseDenseArray;
   static bool EnableApc;
   static bool ApcUseSharedMemory;
   static int ApcSharedMemorySize;
   static std::string ApcPrimeLibrary;
+  static std::string ApcPrimeSnapshot;
   static int ApcLoadThread;
   static std::set<std::string> ApcCompletionKeys;
   enum ApcTableTypes {
     ApcHashTable,
     ApcLfuTable,
-    ApcConcurrentTable
+    ApcConcurrentTable,
+    ApcShardedTable
   };
   static ApcTableTypes ApcTableType;
   enum ApcTableLockTypes {
@@ -199,6 +218,7 @@ public:
   static bool ApcUseLockedRefs;
   static bool ApcExpireOnSets;
   static int ApcPurgeFrequency;
+  static int ApcShardCount;
 
   static bool EnableDnsCache;
   static int DnsCacheTTL;
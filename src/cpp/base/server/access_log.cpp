@@ -27,12 +27,21 @@ using namespace std;
 ///////////////////////////////////////////////////////////////////////////////
 
 AccessLog::~AccessLog() {
+  {
+    Lock lock(this);
+    m_stopped = true;
+    notify();
+  }
+  m_flusher.waitForEnd();
+  flush();
+
   for (uint i = 0; i < m_output.size(); ++i) {
-    if (m_output[i]) {
-      if (m_files[i].first[0] == '|') {
-        pclose(m_output[i]);
+    Output &output = *m_output[i];
+    if (output.file) {
+      if (output.pipe) {
+        pclose(output.file);
       } else {
-        fclose(m_output[i]);
+        fclose(output.file);
       }
     }
   }
@@ -44,6 +53,7 @@ bool AccessLog::init(const string &defaultFormat,
   if (m_initialized) return false;
   m_initialized = true;
   m_defaultFormat = defaultFormat;
+  Compile(m_defaultFormat.c_str(), m_defaultFields);
   m_files = files;
   return openFiles();
 }
@@ -54,6 +64,7 @@ bool AccessLog::init(const string &format,
   if (m_initialized) return false;
   m_initialized = true;
   m_defaultFormat = format;
+  Compile(m_defaultFormat.c_str(), m_defaultFields);
   if (!file.empty() && !format.empty()) {
     m_files.push_back(pair<string, string>(file, format));
   }
@@ -68,7 +79,8 @@ bool AccessLog::openFiles() {
     const string &file = it->first;
     ASSERT(!file.empty());
     FILE *fp = NULL;
-    if (file[0] == '|') {
+    bool pipe = file[0] == '|';
+    if (pipe) {
       string plog = file.substr(1);
       fp = popen(plog.c_str(), "w");
     } else {
@@ -77,7 +89,12 @@ bool AccessLog::openFiles() {
     if (!fp) {
       Logger::Error("Could not open access log file %s", file.c_str());
     }
-    m_output.push_back(fp);
+    OutputPtr output(new Output(fp, pipe));
+    Compile(it->second.c_str(), output->format);
+    m_output.push_back(output);
+  }
+  if (RuntimeOption::AccessLogFlushInterval > 0) {
+    m_flusher.start();
   }
   return !m_output.empty();
 }
@@ -86,122 +103,189 @@ void AccessLog::log(Transport *transport) {
   ASSERT(transport);
   if (!m_initialized) return;
 
-  FILE *threadLog = m_threadData->log;
+  ThreadData *threadData = m_threadData.get();
+  string &line = threadData->line;
+  FILE *threadLog = threadData->log;
   if (threadLog) {
-    writeLog(transport, threadLog,
-             m_defaultFormat.c_str());
+    render(line, transport, m_defaultFields);
+    fwrite(line.data(), 1, line.size(), threadLog);
+    fflush(threadLog);
+  }
+  for (uint i = 0; i < m_output.size(); ++i) {
+    Output &output = *m_output[i];
+    if (!output.file) continue;
+    render(line, transport, output.format);
+    output.append(line);
   }
+}
+
+void AccessLog::flush() {
   for (uint i = 0; i < m_output.size(); ++i) {
-    FILE *outFile = m_output[i];
-    if (!outFile) continue;
-    const char *format = m_files[i].second.c_str();
-    writeLog(transport, outFile, format);
+    Output &output = *m_output[i];
+    if (output.file) {
+      output.flush();
+    }
+  }
+}
+
+void AccessLog::flushLoop() {
+  Lock lock(this);
+  while (!m_stopped) {
+    int ms = RuntimeOption::AccessLogFlushInterval;
+    wait(ms / 1000, (ms % 1000) * 1000000LL);
+    flush();
   }
 }
 
-void AccessLog::writeLog(Transport *transport, FILE *outFile,
-                         const char *format) {
-   char c;
-   ostringstream out;
-   while (c = *format++) {
-     if (c != '%') {
-       out << c;
-       continue;
-     }
+///////////////////////////////////////////////////////////////////////////////
+// buffered output
+
+void AccessLog::Output::append(const string &line) {
+  bool full;
+  {
+    Lock lock(m_lock, false);
+    m_pending += line;
+    full = RuntimeOption::AccessLogFlushInterval <= 0 ||
+      (int)m_pending.size() >= RuntimeOption::AccessLogBufferSize;
+  }
+  if (full) {
+    // Writing it out ourselves, so a slow disk holds up requests instead of
+    // letting the buffer grow without bound.
+    flush();
+  }
+}
+
+void AccessLog::Output::flush() {
+  Lock writeLock(m_writeLock, false);
+  m_writing.clear();
+  {
+    Lock lock(m_lock, false);
+    m_writing.swap(m_pending);
+  }
+  if (!m_writing.empty()) {
+    fwrite(m_writing.data(), 1, m_writing.size(), file);
+    fflush(file);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// format compilation
+
+void AccessLog::Compile(const char *format, FieldVec &fields) {
+  fields.clear();
+  Field literal;
+  char c;
+  while ((c = *format++)) {
+    if (c != '%') {
+      literal.text += c;
+      continue;
+    }
+    if (!literal.text.empty()) {
+      fields.push_back(literal);
+      literal.text.clear();
+    }
 
-     if (parseConditions(format, transport->getResponseCode())) {
-       string arg = parseArgument(format);
-       if (!genField(out, format, transport, arg)) {
-         out << "-";
-       }
-     } else {
-       skipField(format);
-       out << "-";
-     }
-   }
-   out << endl;
-   string output = out.str();
-   fprintf(outFile, "%s", output.c_str());
-   fflush(outFile);
+    Field field;
+    ParseConditions(format, field);
+    if (*format == '{') {
+      const char *start = ++format;
+      while (*format && *format != '}') { format++; }
+      field.text.assign(start, format - start);
+      if (*format) format++;
+    }
+    while (*format && !isalpha(*format)) { format++; }
+    if (*format) {
+      field.type = *format++;
+    } else {
+      field.type = '-'; // dangling '%', always logged as "-"
+    }
+    fields.push_back(field);
+  }
+  if (!literal.text.empty()) {
+    fields.push_back(literal);
+  }
 }
 
-bool AccessLog::parseConditions(const char* &format, int code) {
-  bool wantMatch = true;
+void AccessLog::ParseConditions(const char* &format, Field &field) {
   if (*format == '!') {
-    wantMatch = false;
+    field.wantMatch = false;
     format++;
   } else if (!isdigit(*format)) {
     // No conditions
-    return true;
+    return;
   }
-  char buf[4];
-  buf[3] = '\0';
+  field.hasConditions = true;
 
-  bool matched = false;
-  while(isdigit(*format)) {
+  while (isdigit(format[0]) && isdigit(format[1]) && isdigit(format[2])) {
+    char buf[4];
     buf[0] = format[0];
     buf[1] = format[1];
     buf[2] = format[2];
-    int c = atoi(buf);
-    if (c == code) {
+    buf[3] = '\0';
+    field.codes.push_back(atoi(buf));
+    format += 3;
+    if (*format == ',') format++;
+  }
+  while (*format && !(*format == '{' || isalpha(*format))) {
+    format++;
+  }
+}
+
+bool AccessLog::Field::matches(int code) const {
+  if (!hasConditions) return true;
+  bool matched = false;
+  for (unsigned int i = 0; i < codes.size(); i++) {
+    if (codes[i] == code) {
       matched = true;
       break;
     }
-    format+=4;
-  }
-  while (!(*format == '{' || isalpha(*format))) {
-    format++;
   }
   return wantMatch == matched;
 }
 
-string AccessLog::parseArgument(const char* &format) {
-  if (*format != '{') return string();
-  format++;
-  const char *start = format;
-  while (*format != '}') { format++; }
-  string res(start, format - start);
-  format++;
-  return res;
-}
+///////////////////////////////////////////////////////////////////////////////
+// rendering
 
-void AccessLog::skipField(const char* &format) {
-  // Skip argument
-  if (*format == '{') {
-    while (*format != '}') { format++; }
-    format++;
-  }
-  // Find control letter
-  while (!isalpha(*format)) { format++; }
-  // Skip it
-  format++;
+static void append_int(string &out, int64 n) {
+  char buf[24];
+  int len = snprintf(buf, sizeof(buf), "%lld", (long long)n);
+  out.append(buf, len);
 }
 
-bool AccessLog::genField(ostringstream &out, const char* &format,
-                         Transport *transport, const string &arg) {
-  int responseSize = transport->getResponseSize();
+void AccessLog::render(string &out, Transport *transport,
+                       const FieldVec &format) {
   int code = transport->getResponseCode();
+  out.clear();
+  for (unsigned int i = 0; i < format.size(); i++) {
+    const Field &field = format[i];
+    if (field.type == 0) {
+      out += field.text;
+    } else if (!field.matches(code) || !genField(out, field, transport)) {
+      out += '-';
+    }
+  }
+  out += '\n';
+}
 
-  while (!isalpha(*format)) { format++; }
-  char type = *format;
-  format++;
-
-  switch (type) {
+bool AccessLog::genField(string &out, const Field &field,
+                         Transport *transport) {
+  const string &arg = field.text;
+  switch (field.type) {
   case 'b':
-    if (responseSize == 0) return false;
+    if (transport->getResponseSize() == 0) return false;
     // Fall through
   case 'B':
-    out << responseSize;
+    append_int(out, transport->getResponseSize());
     break;
   case 'h':
-    out << transport->getRemoteHost();
+    out += transport->getRemoteHost();
     break;
   case 'i':
     if (arg.empty()) return false;
     {
       string header = transport->getHeader(arg.c_str());
       if (header.empty()) return false;
-      out << header;
+      out += header;
     }
     break;
   case 'n':
@@ -209,11 +293,11 @@ bool AccessLog::genField(ostringstream &out, const char* &format,
     {
       String note = ServerNote::Get(arg);
       if (note.isNull()) return false;
-      out << note.c_str();
+      out.append(note.data(), note.size());
     }
     break;
   case 's':
-    out << code;
+    append_int(out, transport->getResponseCode());
     break;
   case 't':
     {
@@ -225,15 +309,14 @@ bool AccessLog::genField(ostringstream &out, const char* &format,
       }
       char buf[256];
       time_t rawtime;
-      struct tm * timeinfo;
+      struct tm timeinfo;
       time(&rawtime);
-      timeinfo = localtime(&rawtime);
-      strftime(buf, 256, format, timeinfo);
-      out << buf;
+      localtime_r(&rawtime, &timeinfo);
+      out.append(buf, strftime(buf, 256, format, &timeinfo));
     }
     break;
   case 'T':
-    out << TimeStamp::Current() - m_threadData->startTime;
+    append_int(out, TimeStamp::Current() - m_threadData->startTime);
     break;
   case 'r':
     {
@@ -245,25 +328,27 @@ bool AccessLog::genField(ostringstream &out, const char* &format,
       default: break;
       }
       if (!method) return false;
-      const char *url = transport->getUrl();
-      string httpVersion = transport->getHTTPVersion();
-      out << method << " " << url << " HTTP/" << httpVersion;
+      out += method;
+      out += ' ';
+      out += transport->getUrl();
+      out += " HTTP/";
+      out += transport->getHTTPVersion();
     }
     break;
   case 'U':
     {
       String b, q;
       RequestURI::splitURL(transport->getUrl(), b, q);
-      out << b;
+      out.append(b.data(), b.size());
     }
     break;
   case 'v':
     {
       const string &sname = VirtualHost::GetCurrent()->serverName();
       if (sname.empty() || RuntimeOption::ForceServerNameToHeader) {
-        out << transport->getHeader("Host");
+        out += transport->getHeader("Host");
       } else {
-        out << sname;
+        out += sname;
       }
     }
     break;
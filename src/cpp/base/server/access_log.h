@@ -19,13 +19,24 @@
 #include <cpp/base/base_includes.h>
 #include <util/thread_local.h>
 #include <util/lock.h>
+#include <util/synchronizable.h>
+#include <util/async_func.h>
 
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 
-class AccessLog {
+/**
+ * Apache-style access logs. Formats are compiled into field lists once at
+ * init() time. Each line is rendered into a buffer owned by the thread that
+ * served the request, then appended to its file's pending buffer. A flusher
+ * thread writes those buffers out every Log.AccessLogFlushInterval
+ * milliseconds. A buffer that reaches Log.AccessLogBufferSize bytes is
+ * written out right away by whichever thread filled it.
+ */
+class AccessLog : public Synchronizable {
 public:
- AccessLog() : m_initialized(false) {}
+  AccessLog() : m_initialized(false), m_stopped(false),
+                m_flusher(this, &AccessLog::flushLoop) {}
   ~AccessLog();
   bool init(const std::string &defaultFormat,
             std::vector<std::pair<std::string, std::string> > &files);
@@ -38,21 +49,64 @@ public:
   std::vector<std::pair<std::string, std::string> > &files() {
     return m_files;
   }
+
+  /**
+   * Writes out everything still buffered.
+   */
+  void flush();
+
 private:
-  bool parseConditions(const char* &format, int code);
-  std::string parseArgument(const char* &format);
-  bool genField(std::ostringstream &out, const char* &format,
-                       Transport *transport, const std::string &arg);
-  void skipField(const char* &format);
-  void writeLog(Transport *transport, FILE *outFile,
-                       const char *format);
+  /**
+   * One element of a compiled format: either literal text, or a %-directive
+   * with its optional status code conditions and {argument}.
+   */
+  class Field {
+  public:
+    Field() : type(0), hasConditions(false), wantMatch(true) {}
+    char type;        // directive letter, 0 for literal text
+    std::string text; // the literal text, or the directive's argument
+    bool hasConditions;
+    bool wantMatch;
+    std::vector<int> codes;
+
+    bool matches(int code) const;
+  };
+  typedef std::vector<Field> FieldVec;
+
+  /**
+   * An output file, with the lines queued up for it.
+   */
+  class Output {
+  public:
+    Output(FILE *f, bool p) : file(f), pipe(p) {}
+    FILE *file;
+    bool pipe;
+    FieldVec format;
+
+    void append(const std::string &line);
+    void flush();
+
+  private:
+    Mutex m_lock;      // guards m_pending
+    Mutex m_writeLock; // keeps lines in order across concurrent flushes
+    std::string m_pending;
+    std::string m_writing;
+  };
+  DECLARE_BOOST_TYPES(Output);
+
+  static void Compile(const char *format, FieldVec &fields);
+  static void ParseConditions(const char* &format, Field &field);
+  bool genField(std::string &out, const Field &field, Transport *transport);
+  void render(std::string &out, Transport *transport, const FieldVec &format);
 
-  std::vector<FILE*> m_output;
+  OutputPtrVec m_output;
+  FieldVec m_defaultFields;
   class ThreadData {
   public:
     ThreadData() : log(NULL) {}
     FILE *log;
     int64 startTime;
+    std::string line;
   };
   bool m_initialized;
   ThreadLocal<ThreadData> m_threadData;
@@ -61,6 +115,11 @@ private:
 
   bool openFiles();
   Mutex m_initLock;
+
+  // flusher thread
+  bool m_stopped;
+  AsyncFunc<AccessLog> m_flusher;
+  void flushLoop();
 };
 
 ///////////////////////////////////////////////////////////////////////////////
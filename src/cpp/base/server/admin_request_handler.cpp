@@ -66,6 +66,7 @@ void AdminRequestHandler::handleRequest(Transport *transport) {
         "\n"
 
         "/check-load:      how many threads are actively handling requests\n"
+        "/check-queue:     request queue length and queuing time histogram\n"
         "/check-mem:       report memory quick statistics in log file\n"
         "/check-apc:       report APC quick statistics\n"
 
@@ -246,6 +247,11 @@ bool AdminRequestHandler::handleCheckRequest(const std::string &cmd,
     transport->sendString(lexical_cast<string>(count));
     return true;
   }
+  if (cmd == "check-queue") {
+    transport->sendString(HttpServer::Server->getPageServer()->
+                          getQueueStats());
+    return true;
+  }
   if (cmd == "check-mem") {
     return toggle_switch(transport, RuntimeOption::CheckMemory);
   }
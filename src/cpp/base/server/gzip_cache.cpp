@@ -0,0 +1,75 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#include <cpp/base/server/gzip_cache.h>
+#include <cpp/base/runtime_option.h>
+#include <util/lock.h>
+#include <util/hash.h>
+#include <zlib.h>
+
+using namespace std;
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+GzipCache GzipCache::TheCache;
+
+GzipCache::Key GzipCache::MakeKey(const char *data, int size) {
+  // two unrelated hashes plus the length, so a collision needs all three
+  Key key;
+  key.size = size;
+  key.crc = crc32(0L, (const Bytef *)data, size);
+  key.hash = hash_string(data, size);
+  return key;
+}
+
+GzipCache::GzipCache() : m_size(0) {
+}
+
+bool GzipCache::find(const Key &key, String &compressed) {
+  Lock lock(m_mutex, false);
+  hphp_hash_map<Key, EntryList::iterator, KeyHash, KeyEqual>::iterator iter =
+    m_entries.find(key);
+  if (iter == m_entries.end()) {
+    return false;
+  }
+  EntryList::iterator entry = iter->second;
+  m_lru.splice(m_lru.begin(), m_lru, entry);
+  compressed = String(entry->second.data(), entry->second.size(), CopyString);
+  return true;
+}
+
+void GzipCache::store(const Key &key, const char *compressed, int len) {
+  int64 limit = RuntimeOption::GzipCacheSize;
+  if (len > limit) return;
+
+  Lock lock(m_mutex, false);
+  if (m_entries.find(key) != m_entries.end()) {
+    return; // another request got here first
+  }
+  m_lru.push_front(Entry(key, string(compressed, len)));
+  m_entries[key] = m_lru.begin();
+  m_size += len;
+  while (m_size > limit) {
+    Entry &last = m_lru.back();
+    m_size -= last.second.size();
+    m_entries.erase(last.first);
+    m_lru.pop_back();
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,74 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef __GZIP_CACHE_H__
+#define __GZIP_CACHE_H__
+
+#include <cpp/base/type_string.h>
+#include <util/mutex.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Gzipped response bodies keyed by a hash of what they compress, so pages
+ * that keep producing the same bytes are only compressed once. Entries are
+ * evicted least recently used first once RuntimeOption::GzipCacheSize bytes
+ * are held. Only used for URLs a VirtualHost opts in with GzipCache.
+ */
+class GzipCache {
+public:
+  static GzipCache TheCache;
+
+  struct Key {
+    int size;
+    uint32 crc;
+    int64 hash;
+  };
+  static Key MakeKey(const char *data, int size);
+
+public:
+  GzipCache();
+
+  /**
+   * Copies out the gzipped body that was stored under this key.
+   */
+  bool find(const Key &key, String &compressed);
+
+  void store(const Key &key, const char *compressed, int len);
+
+private:
+  struct KeyHash {
+    size_t operator()(const Key &key) const { return key.hash;}
+  };
+  struct KeyEqual {
+    bool operator()(const Key &k1, const Key &k2) const {
+      return k1.hash == k2.hash && k1.crc == k2.crc && k1.size == k2.size;
+    }
+  };
+  typedef std::pair<Key, std::string> Entry;
+  typedef std::list<Entry> EntryList;
+
+  Mutex m_mutex;
+  EntryList m_lru; // most recently used first
+  hphp_hash_map<Key, EntryList::iterator, KeyHash, KeyEqual> m_entries;
+  int64 m_size;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // __GZIP_CACHE_H__
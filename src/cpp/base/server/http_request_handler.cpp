@@ -21,6 +21,7 @@
 #include <util/timer.h>
 #include <cpp/base/server/static_content_cache.h>
 #include <cpp/base/server/dynamic_content_cache.h>
+#include <cpp/base/server/mapped_file_cache.h>
 #include <cpp/base/server/server_stats.h>
 #include <util/network.h>
 #include <cpp/base/preg.h>
@@ -130,6 +131,9 @@ void HttpRequestHandler::handleRequest(Transport *transport) {
 
   // If this is not a php file, check the static cnd dynamic content caches
   if (ext == NULL || strcasecmp(ext, "php") != 0) {
+    // sampled before the lookup, so a file added by a load that finishes
+    // in between still gets served from disk
+    bool staticContentLoading = StaticContentCache::TheCache.isLoading();
     if (RuntimeOption::EnableStaticContentCache) {
       // check against static content cache
       if (StaticContentCache::TheCache.find(path, data, len, compressed)) {
@@ -141,7 +145,23 @@ void HttpRequestHandler::handleRequest(Transport *transport) {
       }
     }
 
-    if (ext && RuntimeOption::EnableStaticContentFromDisk &&
+    if (ext && RuntimeOption::EnableStaticContentMmap &&
+        RuntimeOption::StaticFileExtensions.find(ext) !=
+        RuntimeOption::StaticFileExtensions.end()) {
+      time_t mtime = 0;
+      MappedFilePtr file =
+        MappedFileCache::TheCache.find(absPath, compressed, mtime);
+      if (file) {
+        sendStaticContent(transport, file->data(), file->size(), mtime,
+                          compressed, path);
+        ServerStats::LogPage(path, 200);
+        return;
+      }
+    }
+
+    // while the cache is still loading, anything it misses comes from disk
+    if (ext && (RuntimeOption::EnableStaticContentFromDisk ||
+                staticContentLoading) &&
         RuntimeOption::StaticFileExtensions.find(ext) !=
         RuntimeOption::StaticFileExtensions.end()) {
       StringBuffer sb(absPath.c_str());
@@ -58,17 +58,26 @@ HttpServer::HttpServer()
   LockProfiler::s_pfunc_profile = server_stats_log_mutex;
 
   if (RuntimeOption::TakeoverFilename.empty()) {
-    m_pageServer = ServerPtr
+    LibEventServer* server =
       (new TypedServer<LibEventServer, HttpRequestHandler>
        (RuntimeOption::ServerIP, RuntimeOption::ServerPort,
         RuntimeOption::ServerThreadCount,
         RuntimeOption::RequestTimeoutSeconds));
+    server->setEventLoopCount(RuntimeOption::ServerEventLoopCount);
+    server->setMinThreadCount(RuntimeOption::ServerMinThreadCount,
+                              RuntimeOption::ServerThreadIdleTimeoutSeconds);
+    server->setQueueTimeout(RuntimeOption::ServerQueueTimeoutMilliSeconds);
+    m_pageServer = ServerPtr(server);
   } else {
     LibEventServerWithTakeover* server =
       (new TypedServer<LibEventServerWithTakeover, HttpRequestHandler>
        (RuntimeOption::ServerIP, RuntimeOption::ServerPort,
         RuntimeOption::ServerThreadCount,
         RuntimeOption::RequestTimeoutSeconds));
+    server->setEventLoopCount(RuntimeOption::ServerEventLoopCount);
+    server->setMinThreadCount(RuntimeOption::ServerMinThreadCount,
+                              RuntimeOption::ServerThreadIdleTimeoutSeconds);
+    server->setQueueTimeout(RuntimeOption::ServerQueueTimeoutMilliSeconds);
     server->setTransferFilename(RuntimeOption::TakeoverFilename);
     server->addTakeoverListener(this);
     m_pageServer = ServerPtr(server);
@@ -19,13 +19,25 @@
 #include <cpp/base/memory/memory_manager.h>
 #include <cpp/base/server/server_stats.h>
 #include <cpp/base/server/http_protocol.h>
+#include <util/util.h>
+#include <util/atomic.h>
 
 ///////////////////////////////////////////////////////////////////////////////
 // static handler
 
 static void on_request(struct evhttp_request *request, void *obj) {
   ASSERT(obj);
-  ((HPHP::LibEventServer*)obj)->onRequest(request);
+  ((HPHP::LibEventServer*)obj)->onRequest(request, 0);
+}
+
+static void on_loop_request(struct evhttp_request *request, void *obj) {
+  ASSERT(obj);
+  ((HPHP::LibEventLoop*)obj)->onRequest(request);
+}
+
+static void on_loop_command(int fd, short what, void *obj) {
+  ASSERT(obj);
+  ((HPHP::LibEventLoop*)obj)->onCommand();
 }
 
 static void on_response(int fd, short what, void *obj) {
@@ -41,25 +53,50 @@ static void on_thread_stop(int fd, short events, void *context) {
   event_base_loopbreak((struct event_base *)context);
 }
 
+static void dispatch_with_timeout(struct event_base *eventBase,
+                                  int timeoutSeconds) {
+  struct timeval timeout;
+  timeout.tv_sec = timeoutSeconds;
+  timeout.tv_usec = 0;
+
+  event eventTimeout;
+  event_set(&eventTimeout, -1, 0, on_timer, eventBase);
+  event_base_set(eventBase, &eventTimeout);
+  event_add(&eventTimeout, &timeout);
+
+  event_base_loop(eventBase, EVLOOP_ONCE);
+
+  event_del(&eventTimeout);
+}
+
 namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+static int s_statsQueuing = ServerStats::RegisterKey("page.wall.queuing");
+static int s_statsRejected = ServerStats::RegisterKey("page.queue.rejected");
+
+static int64 elapsed_usec(const timespec &start, const timespec &end) {
+  time_t dsec = end.tv_sec - start.tv_sec;
+  long dnsec = end.tv_nsec - start.tv_nsec;
+  return dsec * 1000000 + dnsec / 1000;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // LibEventJob
 
-LibEventJob::LibEventJob(evhttp_request *req) : request(req) {
-  if (RuntimeOption::EnableStats && RuntimeOption::EnableWebStats) {
-    clock_gettime(CLOCK_MONOTONIC, &start);
-  }
+LibEventJob::LibEventJob(evhttp_request *req, int l)
+  : request(req), loop(l) {
+  clock_gettime(CLOCK_MONOTONIC, &start);
 }
 
-void LibEventJob::stopTimer() {
+int64 LibEventJob::stopTimer() {
+  timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  int64 usec = elapsed_usec(start, end);
   if (RuntimeOption::EnableStats && RuntimeOption::EnableWebStats) {
-    timespec end;
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    time_t dsec = end.tv_sec - start.tv_sec;
-    long dnsec = end.tv_nsec - start.tv_nsec;
-    int64 dusec = dsec * 1000000 + dnsec / 1000;
-    ServerStats::Log("page.wall.queuing", dusec);
+    ServerStats::LogTime(s_statsQueuing, usec);
   }
+  return usec;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -72,17 +109,22 @@ LibEventWorker::~LibEventWorker() {
 }
 
 void LibEventWorker::doJob(LibEventJobPtr job) {
-  job->stopTimer();
+  int64 queueTime = job->stopTimer();
   evhttp_request *request = job->request;
   ASSERT(m_opaque);
   LibEventServer *server = (LibEventServer*)m_opaque;
 
+  LibEventTransport transport(server, request, m_id, job->loop);
+  if (!server->admit(queueTime)) {
+    // the client has most likely given up by now, so don't bother
+    transport.sendString("Service Unavailable", 503);
+    return;
+  }
+
   if (m_handler == NULL) {
     m_handler = server->createRequestHandler();
     ASSERT(m_handler);
   }
-
-  LibEventTransport transport(server, request, m_id);
   bool error = true;
   std::string errorMsg;
   try {
@@ -129,6 +171,10 @@ void LibEventWorker::onThreadExit() {
   MemoryManager::TheMemoryManager().get()->cleanup();
 }
 
+void LibEventWorker::onThreadIdle() {
+  MemoryManager::TheMemoryManager().get()->trim();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // constructor and destructor
 
@@ -138,12 +184,16 @@ LibEventServer::LibEventServer(const std::string &address, int port,
     m_accept_sock(-1),
     m_timeoutThreadData(thread, timeoutSeconds),
     m_timeoutThread(&m_timeoutThreadData, &TimeoutThread::run),
-    m_dispatcher(thread, this),
-    m_dispatcherThread(this, &LibEventServer::dispatch) {
+    m_dispatcher(thread, this, RuntimeOption::ServerThreadJobLIFO),
+    m_dispatcherThread(this, &LibEventServer::dispatch),
+    m_queueRejected(0), m_queueTimeoutMs(0) {
+  memset(m_queueTimes, 0, sizeof(m_queueTimes));
+  m_dispatcher.setDropCacheTimeout
+    (RuntimeOption::ServerThreadDropCacheTimeoutSeconds);
   m_eventBase = event_base_new();
   m_server = evhttp_new(m_eventBase);
   evhttp_set_gencb(m_server, on_request, this);
-  m_responseQueue.create(m_eventBase);
+  m_responseQueue.create(m_eventBase, 0);
 }
 
 LibEventServer::~LibEventServer() {
@@ -161,8 +211,39 @@ LibEventServer::~LibEventServer() {
 // implementing HttpServer
 
 int LibEventServer::getAcceptSocket() {
-  m_accept_sock = evhttp_bind_socket(m_server, m_address.c_str(), m_port);
-  return m_accept_sock;
+  // keeping the socket around, so other event loops can accept on it too
+  int ret = evhttp_bind_socket_with_fd(m_server, m_address.c_str(), m_port);
+  if (ret < 0) {
+    return -1;
+  }
+  m_accept_sock = ret;
+  return 0;
+}
+
+int LibEventServer::removeAcceptSocket() {
+  for (unsigned int i = 0; i < m_loops.size(); i++) {
+    m_loops[i]->removeAcceptSocket();
+  }
+  return evhttp_del_accept_socket(m_server, m_accept_sock);
+}
+
+void LibEventServer::waitForAcceptSocketRemoved() {
+  for (unsigned int i = 0; i < m_loops.size(); i++) {
+    m_loops[i]->waitForAcceptSocketRemoved();
+  }
+}
+
+void LibEventServer::setEventLoopCount(int count) {
+  ASSERT(getStatus() == NOT_YET_STARTED);
+  ASSERT(m_loops.empty());
+  for (int i = 1; i < count; i++) {
+    m_loops.push_back(LibEventLoopPtr(new LibEventLoop(this, i)));
+  }
+}
+
+void LibEventServer::setMinThreadCount(int count, int idleSeconds) {
+  ASSERT(getStatus() == NOT_YET_STARTED);
+  m_dispatcher.setMinThreadCount(count, idleSeconds);
 }
 
 void LibEventServer::start() {
@@ -171,6 +252,11 @@ void LibEventServer::start() {
   if (getAcceptSocket() != 0) {
     throw FailedToListenException(m_address, m_port);
   }
+  for (unsigned int i = 0; i < m_loops.size(); i++) {
+    if (!m_loops[i]->start(m_accept_sock)) {
+      throw FailedToListenException(m_address, m_port);
+    }
+  }
 
   setStatus(RUNNING);
   m_dispatcher.start();
@@ -185,21 +271,6 @@ void LibEventServer::waitForEnd() {
   m_timeoutThread.waitForEnd();
 }
 
-void LibEventServer::dispatchWithTimeout(int timeoutSeconds) {
-  struct timeval timeout;
-  timeout.tv_sec = timeoutSeconds;
-  timeout.tv_usec = 0;
-
-  event eventTimeout;
-  event_set(&eventTimeout, -1, 0, on_timer, m_eventBase);
-  event_base_set(m_eventBase, &eventTimeout);
-  event_add(&eventTimeout, &timeout);
-
-  event_base_loop(m_eventBase, EVLOOP_ONCE);
-
-  event_del(&eventTimeout);
-}
-
 void LibEventServer::dispatch() {
   m_pipeStop.open();
   event_set(&m_eventStop, m_pipeStop.getOut(), EV_READ|EV_PERSIST,
@@ -221,7 +292,8 @@ void LibEventServer::dispatch() {
 
   // flusing all remaining events
   if (RuntimeOption::ServerGracefulShutdownWait) {
-    dispatchWithTimeout(RuntimeOption::ServerGracefulShutdownWait);
+    dispatch_with_timeout(m_eventBase,
+                          RuntimeOption::ServerGracefulShutdownWait);
   }
 }
 
@@ -238,6 +310,9 @@ void LibEventServer::stop() {
   // stop event loop
   setStatus(STOPPED);
   write(m_pipeStop.getIn(), "", 1);
+  for (unsigned int i = 0; i < m_loops.size(); i++) {
+    m_loops[i]->stop();
+  }
   m_dispatcherThread.waitForEnd();
   evhttp_free(m_server);
   m_server = NULL;
@@ -251,39 +326,199 @@ void LibEventServer::onThreadEnter() {
     (&ThreadInfo::s_threadInfo->m_reqInjectionData);
 }
 
-void LibEventServer::onRequest(struct evhttp_request *request) {
+void LibEventServer::onRequest(struct evhttp_request *request, int loop) {
   if (getStatus() == RUNNING) {
-    m_dispatcher.enqueue(LibEventJobPtr(new LibEventJob(request)));
+    m_dispatcher.enqueue(LibEventJobPtr(new LibEventJob(request, loop)));
   } else {
     Logger::Error("throwing away one new request while shutting down");
   }
 }
 
-void LibEventServer::onResponse(int worker, evhttp_request *request,
+bool LibEventServer::admit(int64 queueTime) {
+  int bucket = 0;
+  for (int64 ms = queueTime / 1000; ms && bucket < QueueTimeBuckets - 1;
+       ms >>= 1) {
+    bucket++;
+  }
+  atomic_add(m_queueTimes[bucket], (int64)1);
+
+  if (m_queueTimeoutMs > 0 && queueTime > m_queueTimeoutMs * (int64)1000) {
+    atomic_add(m_queueRejected, (int64)1);
+    if (RuntimeOption::EnableStats && RuntimeOption::EnableWebStats) {
+      ServerStats::Log(s_statsRejected, 1);
+    }
+    return false;
+  }
+  return true;
+}
+
+std::string LibEventServer::getQueueStats() {
+  std::ostringstream out;
+  out << "queued: " << m_dispatcher.getQueuedJobs() << "\n";
+  out << "active: " << m_dispatcher.getActiveWorker() << "\n";
+  out << "allowed: " << std::min(m_dispatcher.getActiveLimit(), m_threadCount)
+      << "/" << m_threadCount << "\n";
+  out << "rejected: " << m_queueRejected << "\n";
+  out << "queuing time:\n";
+  for (int i = 0; i < QueueTimeBuckets; i++) {
+    if (i < QueueTimeBuckets - 1) {
+      out << "  < " << (1 << i) << "ms: ";
+    } else {
+      out << "  >= " << (1 << (i - 1)) << "ms: ";
+    }
+    out << m_queueTimes[i] << "\n";
+  }
+  return out.str();
+}
+
+PendingResponseQueue &LibEventServer::getResponseQueue(int loop) {
+  if (loop == 0) return m_responseQueue;
+  ASSERT(loop > 0 && loop <= (int)m_loops.size());
+  return m_loops[loop - 1]->getResponseQueue();
+}
+
+void LibEventServer::onResponse(int worker, int loop, evhttp_request *request,
                                 int code) {
   int nwritten = 0;
   if (RuntimeOption::LibEventSyncSend) {
     const char *reason = HttpProtocol::GetReasonString(code);
     nwritten = evhttp_send_reply_sync_begin(request, code, reason, NULL);
   }
-  m_responseQueue.enqueue(worker, request, code, nwritten);
+  getResponseQueue(loop).enqueue(worker, request, code, nwritten);
 }
 
-void LibEventServer::onChunkedResponse(int worker, evhttp_request *request,
+void LibEventServer::onChunkedResponse(int worker, int loop,
+                                       evhttp_request *request,
                                        int code, evbuffer *chunk,
                                        bool firstChunk) {
-  m_responseQueue.enqueue(worker, request, code, chunk, firstChunk);
+  getResponseQueue(loop).enqueue(worker, request, code, chunk, firstChunk);
 }
 
-void LibEventServer::onChunkedResponseEnd(int worker,
+void LibEventServer::onChunkedResponseEnd(int worker, int loop,
                                           evhttp_request *request) {
-  m_responseQueue.enqueue(worker, request);
+  getResponseQueue(loop).enqueue(worker, request);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// LibEventLoop
+
+// commands written to a loop's pipe
+static const char LoopStop = 's';
+static const char LoopRemoveAcceptSocket = 'r';
+
+LibEventLoop::LibEventLoop(LibEventServer *server, int index)
+  : m_server(server), m_index(index), m_acceptSock(-1),
+    m_removeRequested(false), m_acceptRemoved(false), m_thread(this, &LibEventLoop::run) {
+  m_eventBase = event_base_new();
+  m_http = evhttp_new(m_eventBase);
+  evhttp_set_gencb(m_http, on_loop_request, this);
+  m_responseQueue.create(m_eventBase, m_index);
+}
+
+LibEventLoop::~LibEventLoop() {
+  // same as ~LibEventServer(), the base may still be in use while stopping
+  if (m_server->getStatus() != Server::STOPPING) {
+    event_base_free(m_eventBase);
+  }
+}
+
+bool LibEventLoop::start(int acceptSock) {
+  if (evhttp_accept_socket(m_http, acceptSock) < 0) {
+    Logger::Error("event loop %d unable to accept: %s", m_index,
+                  Util::safe_strerror(errno).c_str());
+    return false;
+  }
+  m_acceptSock = acceptSock;
+
+  if (!m_pipeCommand.open()) {
+    throw FatalErrorException("unable to create pipe for event loop");
+  }
+  event_set(&m_eventCommand, m_pipeCommand.getOut(), EV_READ|EV_PERSIST,
+            on_loop_command, this);
+  event_base_set(m_eventBase, &m_eventCommand);
+  event_add(&m_eventCommand, NULL);
+
+  m_thread.start();
+  return true;
+}
+
+void LibEventLoop::stop() {
+  write(m_pipeCommand.getIn(), &LoopStop, 1);
+  m_thread.waitForEnd();
+  if (m_http) {
+    evhttp_free(m_http);
+    m_http = NULL;
+  }
+}
+
+void LibEventLoop::removeAcceptSocket() {
+  Lock lock(getMutex());
+  if (m_removeRequested) return;
+  m_removeRequested = true;
+  write(m_pipeCommand.getIn(), &LoopRemoveAcceptSocket, 1);
+}
+
+void LibEventLoop::waitForAcceptSocketRemoved() {
+  removeAcceptSocket();
+  Lock lock(getMutex());
+  while (!m_acceptRemoved) {
+    wait();
+  }
+}
+
+void LibEventLoop::onRequest(evhttp_request *request) {
+  m_server->onRequest(request, m_index);
+}
+
+void LibEventLoop::onCommand() {
+  char buf[16];
+  int n = read(m_pipeCommand.getOut(), buf, sizeof(buf));
+  for (int i = 0; i < n; i++) {
+    if (buf[i] == LoopRemoveAcceptSocket) {
+      if (evhttp_del_accept_socket(m_http, m_acceptSock) < 0) {
+        Logger::Error("event loop %d unable to delete accept socket",
+                      m_index);
+      }
+      Lock lock(getMutex());
+      m_acceptRemoved = true;
+      notifyAll();
+    } else {
+      event_base_loopbreak(m_eventBase);
+    }
+  }
+}
+
+void LibEventLoop::run() {
+  while (m_server->getStatus() != Server::STOPPED) {
+    event_base_loop(m_eventBase, EVLOOP_ONCE);
+  }
+
+  event_del(&m_eventCommand);
+  {
+    // nobody is left to answer a removal, don't keep anyone waiting for it
+    Lock lock(getMutex());
+    m_acceptRemoved = true;
+    notifyAll();
+  }
+
+  // flushing all responses
+  if (!m_responseQueue.empty()) {
+    m_responseQueue.process();
+  }
+  m_responseQueue.close();
+
+  // flusing all remaining events
+  if (RuntimeOption::ServerGracefulShutdownWait) {
+    dispatch_with_timeout(m_eventBase,
+                          RuntimeOption::ServerGracefulShutdownWait);
+  }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 // PendingResponseQueue
 
-PendingResponseQueue::PendingResponseQueue() {
+PendingResponseQueue::PendingResponseQueue()
+  : m_statsResponses(0), m_statsQueuing(0) {
   ASSERT(RuntimeOption::ResponseQueueCount > 0);
   for (int i = 0; i < RuntimeOption::ResponseQueueCount; i++) {
     m_responseQueues.push_back(ResponseQueuePtr(new ResponseQueue()));
@@ -299,7 +534,13 @@ bool PendingResponseQueue::empty() {
   return true;
 }
 
-void PendingResponseQueue::create(event_base *eventBase) {
+void PendingResponseQueue::create(event_base *eventBase, int loop) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "evloop.%d.", loop);
+  std::string prefix = buf;
+  m_statsResponses = ServerStats::RegisterKey(prefix + "responses");
+  m_statsQueuing = ServerStats::RegisterKey(prefix + "wall.queuing");
+
   if (!m_ready.open()) {
     throw FatalErrorException("unable to create pipe for ready signal");
   }
@@ -313,6 +554,9 @@ void PendingResponseQueue::close() {
 }
 
 void PendingResponseQueue::enqueue(int worker, ResponsePtr response) {
+  if (RuntimeOption::EnableStats && RuntimeOption::EnableWebStats) {
+    clock_gettime(CLOCK_MONOTONIC, &response->queued);
+  }
   {
     int i = worker % RuntimeOption::ResponseQueueCount;
     ResponseQueue &q = *m_responseQueues[i];
@@ -366,6 +610,21 @@ void PendingResponseQueue::process() {
     q.m_responses.clear();
   }
 
+  // How many responses each wakeup finds waiting, and how long they waited;
+  // both grow when this loop's thread can't keep up.
+  if (RuntimeOption::EnableStats && RuntimeOption::EnableWebStats &&
+      !responses.empty()) {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64 waited = 0;
+    for (unsigned int i = 0; i < responses.size(); i++) {
+      waited += elapsed_usec(responses[i]->queued, now);
+    }
+    ServerStats::Log(m_statsResponses, responses.size());
+    ServerStats::Log(m_statsQueuing, waited);
+    ServerStats::Flush();
+  }
+
   for (unsigned int i = 0; i < responses.size(); i++) {
     Response &res = *responses[i];
     evhttp_request *request = res.request;
@@ -393,6 +652,8 @@ void PendingResponseQueue::process() {
 PendingResponseQueue::Response::Response()
   : request(NULL), code(0), nwritten(0),
     chunked(false), firstChunk(false), chunk(NULL) {
+  queued.tv_sec = 0;
+  queued.tv_nsec = 0;
 }
 
 PendingResponseQueue::Response::~Response() {
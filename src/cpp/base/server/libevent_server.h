@@ -33,10 +33,11 @@ namespace HPHP {
 DECLARE_BOOST_TYPES(LibEventJob);
 class LibEventJob {
 public:
-  LibEventJob(evhttp_request *req);
-  void stopTimer();
+  LibEventJob(evhttp_request *req, int loop);
+  int64 stopTimer(); // returns queuing time in microseconds
 
   evhttp_request *request;
+  int loop; // which event loop the request came from
 
 private:
   timespec start;
@@ -62,6 +63,7 @@ public:
    */
   virtual void onThreadEnter();
   virtual void onThreadExit();
+  virtual void onThreadIdle();
 
 private:
   RequestHandler *m_handler;
@@ -75,7 +77,7 @@ public:
   PendingResponseQueue();
 
   bool empty();
-  void create(event_base *eventBase);
+  void create(event_base *eventBase, int loop);
   void enqueue(int worker, evhttp_request *request, int code, int nwritten);
   void enqueue(int worker, evhttp_request *request, int code, evbuffer *chunk,
                bool firstChunk);
@@ -96,6 +98,8 @@ private:
     bool chunked;
     bool firstChunk;
     evbuffer *chunk;
+
+    timespec queued; // only set when collecting stats
   };
   DECLARE_BOOST_TYPES(Response);
 
@@ -110,10 +114,68 @@ private:
   event m_event;
   CPipe m_ready;
   ResponseQueuePtrVec m_responseQueues;
+  int m_statsResponses;
+  int m_statsQueuing;
 
   void enqueue(int worker, ResponsePtr response);
 };
 
+/**
+ * An extra evhttp event loop on its own thread. A LibEventServer runs its
+ * first loop on the dispatcher thread; any more share its accept socket, and
+ * each answers the requests it accepted through its own response queue.
+ */
+class LibEventServer;
+DECLARE_BOOST_TYPES(LibEventLoop);
+class LibEventLoop : public Synchronizable {
+public:
+  LibEventLoop(LibEventServer *server, int index);
+  ~LibEventLoop();
+
+  PendingResponseQueue &getResponseQueue() { return m_responseQueue; }
+
+  /**
+   * Accepts on a socket the server has already bound, and starts the thread.
+   */
+  bool start(int acceptSock);
+  void stop();
+
+  /**
+   * Asks the loop's thread to stop accepting, leaving the socket open.
+   */
+  void removeAcceptSocket();
+
+  /**
+   * Blocks until the loop's thread has stopped accepting, asking it to first
+   * if nobody has. Must be called before the socket is closed.
+   */
+  void waitForAcceptSocketRemoved();
+
+  /**
+   * Called by evhttp and by the command pipe, on the loop's thread.
+   */
+  void onRequest(evhttp_request *request);
+  void onCommand();
+
+private:
+  LibEventServer *m_server;
+  int m_index;
+  int m_acceptSock;
+  bool m_removeRequested;
+  bool m_acceptRemoved; // or the thread has exited
+  event_base *m_eventBase;
+  evhttp *m_http;
+  PendingResponseQueue m_responseQueue;
+
+  // signal to stop the thread, or to remove the accept socket
+  event m_eventCommand;
+  CPipe m_pipeCommand;
+
+  AsyncFunc<LibEventLoop> m_thread;
+
+  void run();
+};
+
 /**
  * Implementing an evhttp based HTTP server with JobQueueDispatcher. This
  * server will have one dispather thread and multiple worker threads.
@@ -134,25 +196,64 @@ public:
   virtual int getActiveWorker() {
     return m_dispatcher.getActiveWorker();
   }
+  virtual std::string getQueueStats();
 
   void onThreadEnter();
 
   /**
-   * Request handler called by evhttp library.
+   * How many event loops accept and send responses. Loops beyond the first
+   * each get a thread of their own. Must be called before start().
    */
-  void onRequest(evhttp_request *request);
+  void setEventLoopCount(int count);
+
+  /**
+   * Lets only count workers take requests while load is light; more of them
+   * are let in when requests start queuing up, and they are parked again
+   * after idleSeconds without work. Must be called before start().
+   */
+  void setMinThreadCount(int count, int idleSeconds);
+
+  /**
+   * Requests that waited longer than timeoutMs for a worker are answered
+   * with a 503 instead of being handled. 0 means no limit.
+   */
+  void setQueueTimeout(int timeoutMs) { m_queueTimeoutMs = timeoutMs;}
+
+  /**
+   * Called by a worker with how long its request was queued. Returns false
+   * if the request should be turned away.
+   */
+  bool admit(int64 queueTime);
+
+  /**
+   * Request handler called by evhttp library, on the thread of the loop that
+   * accepted the connection.
+   */
+  void onRequest(evhttp_request *request, int loop);
 
   /**
    * Called by LibEventTransport when a response is fully prepared.
    */
-  void onResponse(int worker, evhttp_request *request, int code);
-  void onChunkedResponse(int worker, evhttp_request *request, int code,
-                         evbuffer *chunk, bool firstChunk);
-  void onChunkedResponseEnd(int worker, evhttp_request *request);
+  void onResponse(int worker, int loop, evhttp_request *request, int code);
+  void onChunkedResponse(int worker, int loop, evhttp_request *request,
+                         int code, evbuffer *chunk, bool firstChunk);
+  void onChunkedResponseEnd(int worker, int loop, evhttp_request *request);
 
 protected:
   virtual int getAcceptSocket();
 
+  /**
+   * Stops all event loops from accepting on m_accept_sock without closing
+   * it. Called on the dispatcher thread.
+   */
+  int removeAcceptSocket();
+
+  /**
+   * Waits for the other event loops to be done with m_accept_sock, so it can
+   * be closed.
+   */
+  void waitForAcceptSocketRemoved();
+
   int m_accept_sock;
   event_base *m_eventBase;
   evhttp *m_server;
@@ -169,11 +270,19 @@ private:
   AsyncFunc<LibEventServer> m_dispatcherThread;
 
   PendingResponseQueue m_responseQueue;
+  LibEventLoopPtrVec m_loops; // the ones after the first
+
+  // queuing time histogram, bucket i counting requests queued for less than
+  // 2^i ms, except for the last one that counts all the rest
+  static const int QueueTimeBuckets = 16;
+  int64 m_queueTimes[QueueTimeBuckets];
+  int64 m_queueRejected;
+  int m_queueTimeoutMs;
+
+  PendingResponseQueue &getResponseQueue(int loop);
 
   // dispatcher thread runs this function
   void dispatch();
-
-  void dispatchWithTimeout(int timeoutSeconds);
 };
 
 ///////////////////////////////////////////////////////////////////////////////
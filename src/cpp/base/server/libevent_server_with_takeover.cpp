@@ -101,7 +101,7 @@ int LibEventServerWithTakeover::afdtRequest(String request, String* response) {
     // shutdown request so that we can still serve AFDT requests (if the new
     // server crashes or something).  The downside is that it will take the LB
     // longer to figure out that we are broken.
-    ret = evhttp_del_accept_socket(m_server, m_accept_sock);
+    ret = removeAcceptSocket();
     if (ret < 0) {
       // This will fail if we get a second AFDT request, but the spurious
       // log message is not too harmful.
@@ -115,6 +115,8 @@ int LibEventServerWithTakeover::afdtRequest(String request, String* response) {
     // within the main libevent thread.
     int ret;
     *response = P_VERSION C_TERM_BAD;
+    // the other event loops drop the socket on their own threads
+    waitForAcceptSocketRemoved();
     ret = close(m_accept_sock);
     if (ret < 0) {
       Logger::Error("Unable to close accept socket");
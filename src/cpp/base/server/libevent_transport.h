@@ -27,7 +27,7 @@ class LibEventServer;
 class LibEventTransport : public Transport {
 public:
   LibEventTransport(LibEventServer *server, evhttp_request *request,
-                    int workerId);
+                    int workerId, int loop);
 
   /**
    * Implementing Transport...
@@ -52,6 +52,7 @@ private:
   LibEventServer *m_server;
   evhttp_request *m_request;
   int m_workerId;
+  int m_loop;
   std::string m_url;
   std::string m_remote_host;
   std::string m_http_version;
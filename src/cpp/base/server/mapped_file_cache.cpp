@@ -0,0 +1,149 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#include <cpp/base/server/mapped_file_cache.h>
+#include <cpp/base/runtime_option.h>
+#include <util/lock.h>
+#include <util/logger.h>
+#include <util/util.h>
+#include <fcntl.h>
+
+using namespace std;
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+MappedFilePtr MappedFile::Open(const std::string &path,
+                               const struct stat &st) {
+  if (!S_ISREG(st.st_mode) || st.st_size > INT_MAX) {
+    return MappedFilePtr();
+  }
+  if (st.st_size == 0) {
+    return MappedFilePtr(new MappedFile(NULL, st));
+  }
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return MappedFilePtr();
+  }
+  char *data = (char *)malloc(st.st_size);
+  int len = 0;
+  while (data && len < st.st_size) {
+    ssize_t n = read(fd, data + len, st.st_size - len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    len += n;
+  }
+  // a file being rewritten is left to the next request to read again
+  struct stat after;
+  bool same = fstat(fd, &after) == 0 && after.st_size == st.st_size &&
+    after.st_mtime == st.st_mtime;
+  close(fd);
+  if (!data || len != st.st_size || !same) {
+    if (!data) {
+      Logger::Error("unable to allocate %d bytes for %s", (int)st.st_size,
+                    path.c_str());
+    }
+    free(data);
+    return MappedFilePtr();
+  }
+  return MappedFilePtr(new MappedFile(data, st));
+}
+
+MappedFile::MappedFile(char *data, const struct stat &st)
+  : m_data(data), m_size(st.st_size), m_ino(st.st_ino), m_dev(st.st_dev),
+    m_mtime(st.st_mtime) {
+}
+
+MappedFile::~MappedFile() {
+  free(m_data);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+MappedFileCache MappedFileCache::TheCache;
+
+MappedFileCache::MappedFileCache() : m_bytes(0) {
+}
+
+void MappedFileCache::erase(EntryList::iterator entry) {
+  m_bytes -= entry->second->size();
+  m_files.erase(entry->first);
+  m_lru.erase(entry);
+}
+
+MappedFilePtr MappedFileCache::find(const std::string &path,
+                                    bool &compressed, time_t &mtime) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    return MappedFilePtr();
+  }
+  mtime = st.st_mtime;
+
+  if (compressed) {
+    string gz = path + ".gz";
+    struct stat gzst;
+    if (stat(gz.c_str(), &gzst) == 0 && gzst.st_mtime >= st.st_mtime) {
+      MappedFilePtr file = get(gz, gzst);
+      if (file) return file;
+    }
+  }
+  // a miss leaves compressed alone for the caches the caller tries next
+  MappedFilePtr file = get(path, st);
+  if (file) compressed = false;
+  return file;
+}
+
+MappedFilePtr MappedFileCache::get(const std::string &path,
+                                   const struct stat &st) {
+  {
+    Lock lock(m_mutex);
+    hphp_string_map<EntryList::iterator>::iterator iter = m_files.find(path);
+    if (iter != m_files.end()) {
+      EntryList::iterator entry = iter->second;
+      if (entry->second->isCurrent(st)) {
+        m_lru.splice(m_lru.begin(), m_lru, entry);
+        return entry->second;
+      }
+      erase(entry);
+    }
+  }
+
+  // read outside the lock, so one slow disk doesn't hold up every hit
+  MappedFilePtr file = MappedFile::Open(path, st);
+  if (!file || RuntimeOption::StaticContentMmapCacheSize <= 0) {
+    return file;
+  }
+
+  Lock lock(m_mutex);
+  hphp_string_map<EntryList::iterator>::iterator iter = m_files.find(path);
+  if (iter != m_files.end()) {
+    // someone else read it meanwhile; newer wins
+    erase(iter->second);
+  }
+  m_lru.push_front(Entry(path, file));
+  m_files[path] = m_lru.begin();
+  m_bytes += file->size();
+  while ((int)m_files.size() > RuntimeOption::StaticContentMmapCacheSize ||
+         (m_bytes > RuntimeOption::StaticContentMmapCacheBytes &&
+          m_files.size() > 1)) {
+    erase(--m_lru.end());
+  }
+  return file;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
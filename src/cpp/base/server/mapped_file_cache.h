@@ -0,0 +1,108 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef __MAPPED_FILE_CACHE_H__
+#define __MAPPED_FILE_CACHE_H__
+
+#include <util/base.h>
+#include <util/mutex.h>
+#include <sys/stat.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+DECLARE_BOOST_TYPES(MappedFile);
+/**
+ * A static file's contents, read into memory. Requests hold a pointer while
+ * sending, so a file evicted from MappedFileCache stays around until the
+ * last of them is done with it.
+ *
+ * Files aren't mmap-ed: one truncated in place while mapped (cp, rsync
+ * --inplace, an editor saving) would raise SIGBUS in whichever thread next
+ * touched the missing pages, and take the server down.
+ */
+class MappedFile {
+public:
+  /**
+   * Read a regular file that was just stat()-ed. Returns a null pointer if
+   * it can't be read, or changed while it was.
+   */
+  static MappedFilePtr Open(const std::string &path, const struct stat &st);
+
+  ~MappedFile();
+
+  const char *data() const { return m_data;}
+  int size() const { return m_size;}
+
+  /**
+   * Whether the file on disk is still the one we read.
+   */
+  bool isCurrent(const struct stat &st) const {
+    return st.st_ino == m_ino && st.st_dev == m_dev &&
+      st.st_mtime == m_mtime && st.st_size == m_size;
+  }
+
+private:
+  MappedFile(char *data, const struct stat &st);
+
+  char *m_data;
+  int m_size;
+  ino_t m_ino;
+  dev_t m_dev;
+  time_t m_mtime;
+};
+
+/**
+ * Serves static files from memory without loading all of them into
+ * StaticContentCache up front. Files are kept in an LRU bounded by
+ * RuntimeOption::StaticContentMmapCacheSize files and
+ * StaticContentMmapCacheBytes bytes, and revalidated with a stat() on every
+ * hit, so one that changed is read again.
+ */
+class MappedFileCache {
+public:
+  static MappedFileCache TheCache;
+
+public:
+  MappedFileCache();
+
+  /**
+   * Find a file by absolute path. If compressed is true and a ".gz" sibling
+   * that's no older than the file exists, that one is returned; when the
+   * plain file is returned instead, compressed is set to false. Nothing is
+   * changed on a miss. mtime is always the original file's.
+   */
+  MappedFilePtr find(const std::string &path, bool &compressed,
+                     time_t &mtime);
+
+private:
+  typedef std::pair<std::string, MappedFilePtr> Entry;
+  typedef std::list<Entry> EntryList;
+
+  Mutex m_mutex;
+  EntryList m_lru; // most recently used first
+  hphp_string_map<EntryList::iterator> m_files;
+  int64 m_bytes;   // of all files in m_lru
+
+  void erase(EntryList::iterator entry);
+
+  MappedFilePtr get(const std::string &path, const struct stat &st);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // __MAPPED_FILE_CACHE_H__
@@ -23,6 +23,7 @@
 #include <cpp/base/server/source_root_info.h>
 #include <cpp/base/server/request_uri.h>
 #include <cpp/ext/ext_json.h>
+#include <cpp/ext/ext_fb.h>
 
 using namespace std;
 
@@ -99,21 +100,49 @@ bool RPCRequestHandler::executePHPFunction(Transport *transport,
 
   bool error = false;
 
+  // "encoding=fb" switches both parameters and results from JSON to the
+  // binary format of fb_thrift_serialize(), with the parameter array sent
+  // as the post body
+  bool binary = false;
+  const char *encoding = transport->getRawParam("encoding");
+  if (encoding && *encoding) {
+    if (strcmp(encoding, "fb") == 0) {
+      binary = true;
+    } else if (strcmp(encoding, "json") != 0) {
+      error = true;
+    }
+  }
+
+  // all decoding reads straight from the transport's buffers
   Array params;
-  std::string sparams = transport->getParam("params");
-  if (!sparams.empty()) {
-    Variant jparams = f_json_decode(String(sparams));
+  const char *sparams = binary ? NULL : transport->getRawParam("params");
+  if (binary) {
+    int size;
+    const void *data = transport->getPostData(size);
+    if (data && size) {
+      Variant success;
+      Variant bparams =
+        f_fb_thrift_unserialize(String((char*)data, size, AttachLiteral),
+                                ref(success));
+      if (same(success, true) && bparams.isArray()) {
+        params = bparams.toArray();
+      } else {
+        error = true;
+      }
+    }
+  } else if (sparams && *sparams) {
+    Variant jparams = f_json_decode(String(sparams, AttachLiteral));
     if (jparams.isArray()) {
       params = jparams.toArray();
     } else {
       error = true;
     }
   } else {
-    vector<string> sparams;
+    vector<const char *> sparams;
     transport->getArrayParam("p", sparams);
     if (!sparams.empty()) {
       for (unsigned int i = 0; i < sparams.size(); i++) {
-        Variant jparams = f_json_decode(String(sparams[i]));
+        Variant jparams = f_json_decode(String(sparams[i], AttachLiteral));
         if (same(jparams, false)) {
           error = true;
           break;
@@ -151,18 +180,38 @@ bool RPCRequestHandler::executePHPFunction(Transport *transport,
     bool ret = hphp_invoke(context, rpcFunc, true, params, ref(funcRet),
                            warmupDoc, reqInitFunc, error, errorMsg);
     if (ret) {
-      String response;
-      switch (output) {
-      case 0: response = f_json_encode(funcRet);   break;
-      case 1: response = context->obGetContents(); break;
-      case 2:
-        response =
-          f_json_encode(CREATE_MAP2("output", context->obGetContents(),
-                                    "return", f_json_encode(funcRet)));
-        break;
+      Variant response = "";
+      if (binary) {
+        switch (output) {
+        case 0: response = f_fb_thrift_serialize(funcRet); break;
+        case 1: response = context->obGetContents();       break;
+        case 2:
+          response =
+            f_fb_thrift_serialize(CREATE_MAP2("output",
+                                              context->obGetContents(),
+                                              "return", funcRet));
+          break;
+        }
+      } else {
+        switch (output) {
+        case 0: response = f_json_encode(funcRet);   break;
+        case 1: response = context->obGetContents(); break;
+        case 2:
+          response =
+            f_json_encode(CREATE_MAP2("output", context->obGetContents(),
+                                      "return", f_json_encode(funcRet)));
+          break;
+        }
+      }
+      if (response.isString()) {
+        code = 200;
+        String sresponse = response.toString();
+        transport->sendRaw((void*)sresponse.data(), sresponse.size());
+      } else {
+        // fb_thrift_serialize() can't take objects
+        code = 500;
+        transport->sendString("Unable to serialize result", 500);
       }
-      code = 200;
-      transport->sendRaw((void*)response.data(), response.size());
     } else if (error) {
       code = 500;
       if (RuntimeOption::ServerErrorMessage) {
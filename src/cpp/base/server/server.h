@@ -155,6 +155,12 @@ public:
    */
   virtual int getActiveWorker() = 0;
 
+  /**
+   * Human readable report of request queue length and queuing time, for
+   * servers that queue requests up.
+   */
+  virtual std::string getQueueStats() { return "";}
+
   /**
    * This is for TypedServer to specialize a worker class to use.
    */
@@ -28,6 +28,63 @@ using namespace std;
 using namespace boost;
 
 namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+// histograms
+
+// values below 8 have a bucket each, then each power of two gets 8 buckets
+static int histogram_bucket(int64 value) {
+  if (value < 8) return value < 0 ? 0 : value;
+  int e = 63 - __builtin_clzll(value);
+  return ((e - 2) << 3) + (int)((value >> (e - 3)) & 7);
+}
+
+static int64 histogram_value(int bucket) {
+  if (bucket < 8) return bucket;
+  int e = (bucket >> 3) + 2;
+  int64 low = (int64)(8 + (bucket & 7)) << (e - 3);
+  return low + ((int64)1 << (e - 3)) / 2; // middle of the bucket
+}
+
+// reported for each histogram, as <name><suffix>
+static const struct {
+  const char *suffix;
+  int permille;
+} s_percentiles[] = {
+  { ".p50",  500 },
+  { ".p90",  900 },
+  { ".p99",  990 },
+  { ".p999", 999 },
+};
+static const int s_percentileCount =
+  sizeof(s_percentiles) / sizeof(s_percentiles[0]);
+
+void ServerStats::Histogram::add(int64 value) {
+  m_buckets[histogram_bucket(value)]++;
+  m_count++;
+}
+
+void ServerStats::Histogram::merge(const Histogram &src) {
+  for (map<int, int64>::const_iterator iter = src.m_buckets.begin();
+       iter != src.m_buckets.end(); ++iter) {
+    m_buckets[iter->first] += iter->second;
+  }
+  m_count += src.m_count;
+}
+
+int64 ServerStats::Histogram::percentile(int permille) const {
+  int64 rank = (m_count * permille + 999) / 1000; // 1-based
+  if (rank < 1) rank = 1;
+  int64 seen = 0;
+  for (map<int, int64>::const_iterator iter = m_buckets.begin();
+       iter != m_buckets.end(); ++iter) {
+    seen += iter->second;
+    if (seen >= rank) {
+      return histogram_value(iter->first);
+    }
+  }
+  return 0;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // helpers
 
@@ -39,6 +96,30 @@ void ServerStats::Merge(CounterMap &dest,
   }
 }
 
+void ServerStats::Merge(HistogramMap &dest, const HistogramMap &src) {
+  for (HistogramMap::const_iterator iter = src.begin();
+       iter != src.end(); ++iter) {
+    dest[iter->first].merge(iter->second);
+  }
+}
+
+void ServerStats::Merge(vector<int64> &dest, const vector<int64> &src) {
+  if (dest.size() < src.size()) {
+    dest.resize(src.size());
+  }
+  for (unsigned int i = 0; i < src.size(); i++) {
+    dest[i] += src[i];
+  }
+}
+
+void ServerStats::Merge(KeyedHistogramMap &dest,
+                        const KeyedHistogramMap &src) {
+  for (KeyedHistogramMap::const_iterator iter = src.begin();
+       iter != src.end(); ++iter) {
+    dest[iter->first].merge(iter->second);
+  }
+}
+
 void ServerStats::Merge(PageStatsMap &dest, const PageStatsMap &src) {
   for (PageStatsMap::const_iterator iter = src.begin();
        iter != src.end(); ++iter) {
@@ -54,6 +135,9 @@ void ServerStats::Merge(PageStatsMap &dest, const PageStatsMap &src) {
       ASSERT(d.m_code == s.m_code);
       d.m_hit += s.m_hit;
       Merge(d.m_values, s.m_values);
+      Merge(d.m_times, s.m_times);
+      Merge(d.m_keyedValues, s.m_keyedValues);
+      Merge(d.m_keyedTimes, s.m_keyedTimes);
     }
   }
 }
@@ -99,6 +183,12 @@ void ServerStats::GetAllKeys(set<string> &allKeys,
              ps.m_values.begin(); viter != ps.m_values.end(); ++viter) {
         allKeys.insert(viter->first->getString());
       }
+      for (HistogramMap::const_iterator hiter = ps.m_times.begin();
+           hiter != ps.m_times.end(); ++hiter) {
+        for (int i = 0; i < s_percentileCount; i++) {
+          allKeys.insert(hiter->first->getString() + s_percentiles[i].suffix);
+        }
+      }
     }
   }
 
@@ -187,6 +277,24 @@ void ServerStats::Filter(list<TimeSlot*> &slots, const std::string &keys,
             ++viter;
           }
         }
+
+        HistogramMap &times = ps.m_times;
+        for (HistogramMap::iterator hiter = times.begin();
+             hiter != times.end();) {
+          bool wanted = false;
+          for (int i = 0; i < s_percentileCount && !wanted; i++) {
+            wanted = wantedKeys.find(hiter->first->getString() +
+                                     s_percentiles[i].suffix) !=
+              wantedKeys.end();
+          }
+          if (!wanted) {
+            HistogramMap::iterator iterTemp = hiter;
+            ++hiter;
+            times.erase(iterTemp);
+          } else {
+            ++hiter;
+          }
+        }
       }
       ++piter;
     }
@@ -219,6 +327,7 @@ void ServerStats::Aggregate(list<TimeSlot*> &slots, const std::string &agg,
         psDest.m_url = url;
         psDest.m_code = code;
         Merge(psDest.m_values, ps.m_values);
+        Merge(psDest.m_times, ps.m_times);
       }
     }
     FreeSlots(slots);
@@ -258,6 +367,17 @@ void ServerStats::Aggregate(list<TimeSlot*> &slots, const std::string &agg,
         values["idle"] = idle;
       }
 
+      // percentiles are only meaningful once histograms are aggregated
+      for (HistogramMap::const_iterator hiter = ps.m_times.begin();
+           hiter != ps.m_times.end(); ++hiter) {
+        for (int i = 0; i < s_percentileCount; i++) {
+          string key = hiter->first->getString() + s_percentiles[i].suffix;
+          if (wantedKeys.empty() || wantedKeys.find(key) != wantedKeys.end()) {
+            values[key] = hiter->second.percentile(s_percentiles[i].permille);
+          }
+        }
+      }
+
       for (map<string, int>::const_iterator iter = udfKeys.begin();
            iter != udfKeys.end(); ++iter) {
         const string &key = iter->first;
@@ -469,6 +589,64 @@ private:
   }
 };
 
+///////////////////////////////////////////////////////////////////////////////
+// registered keys
+
+// constructed on first use, as keys are registered by static initializers
+static Mutex &key_lock() {
+  static Mutex s_keyLock;
+  return s_keyLock;
+}
+static vector<string> &key_names() {
+  static vector<string> s_keyNames;
+  return s_keyNames;
+}
+static hphp_string_map<int> &key_index() {
+  static hphp_string_map<int> s_keyIndex;
+  return s_keyIndex;
+}
+
+int ServerStats::RegisterKey(const string &name) {
+  Lock lock(key_lock(), false);
+  hphp_string_map<int> &index = key_index();
+  hphp_string_map<int>::const_iterator iter = index.find(name);
+  if (iter != index.end()) {
+    return iter->second;
+  }
+  int key = key_names().size();
+  key_names().push_back(name);
+  index[name] = key;
+  return key;
+}
+
+/**
+ * Turns keyed values and times of collected slots into named ones, so the
+ * rest of reporting doesn't need to know about keys.
+ */
+void ServerStats::NameKeys(list<TimeSlot*> &slots) {
+  Lock lock(key_lock(), false);
+  const vector<string> &names = key_names();
+  for (list<TimeSlot*>::const_iterator iter = slots.begin();
+       iter != slots.end(); ++iter) {
+    TimeSlot *s = *iter;
+    for (PageStatsMap::iterator piter = s->m_pages.begin();
+         piter != s->m_pages.end(); ++piter) {
+      PageStats &ps = piter->second;
+      for (unsigned int i = 0; i < ps.m_keyedValues.size(); i++) {
+        if (ps.m_keyedValues[i]) {
+          ps.m_values[names[i]] += ps.m_keyedValues[i];
+        }
+      }
+      for (KeyedHistogramMap::const_iterator hiter = ps.m_keyedTimes.begin();
+           hiter != ps.m_keyedTimes.end(); ++hiter) {
+        ps.m_times[names[hiter->first]].merge(hiter->second);
+      }
+      ps.m_keyedValues.clear();
+      ps.m_keyedTimes.clear();
+    }
+  }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // static
 
@@ -482,12 +660,33 @@ void ServerStats::LogPage(const string &url, int code) {
   }
 }
 
+void ServerStats::Flush() {
+  if (RuntimeOption::EnableStats && RuntimeOption::EnableWebStats) {
+    ServerStats::s_logger->logValues("", 0, 0);
+  }
+}
+
 void ServerStats::Log(const string &name, int64 value) {
   if (RuntimeOption::EnableStats && RuntimeOption::EnableWebStats) {
     ServerStats::s_logger->log(name, value);
   }
 }
 
+void ServerStats::Log(int key, int64 value) {
+  if (RuntimeOption::EnableStats && RuntimeOption::EnableWebStats) {
+    ServerStats::s_logger->keyed(key).m_value += value;
+  }
+}
+
+void ServerStats::LogTime(int key, int64 usec) {
+  if (RuntimeOption::EnableStats && RuntimeOption::EnableWebStats) {
+    KeyedValue &kv = ServerStats::s_logger->keyed(key);
+    kv.m_value += usec;
+    kv.m_time += usec;
+    kv.m_timed = true;
+  }
+}
+
 void ServerStats::LogBytes(int64 bytes) {
   if (RuntimeOption::EnableStats && RuntimeOption::EnableWebStats) {
     ServerStats::s_logger->logBytes(bytes);
@@ -526,10 +725,13 @@ void ServerStats::CollectSlots(list<TimeSlot*> &slots, int64 from, int64 to) {
   int tp1 = from / RuntimeOption::StatsSlotDuration;
   int tp2 = to / RuntimeOption::StatsSlotDuration;
 
-  Lock lock(s_lock, false);
-  for (unsigned int i = 0; i < s_loggers.size(); i++) {
-    s_loggers[i]->collect(slots, tp1, tp2);
+  {
+    Lock lock(s_lock, false);
+    for (unsigned int i = 0; i < s_loggers.size(); i++) {
+      s_loggers[i]->collect(slots, tp1, tp2);
+    }
   }
+  NameKeys(slots);
 }
 
 void ServerStats::GetKeys(string &out, int64 from, int64 to) {
@@ -787,15 +989,47 @@ void ServerStats::log(const string &name, int64 value) {
   m_values[name] += value;
 }
 
+ServerStats::KeyedValue &ServerStats::keyed(int key) {
+  ASSERT(key >= 0);
+  if (key >= (int)m_keyed.size()) {
+    m_keyed.resize(key + 1);
+  }
+  KeyedValue &kv = m_keyed[key];
+  if (!kv.m_logged) {
+    kv.m_logged = true;
+    m_loggedKeys.push_back(key);
+  }
+  return kv;
+}
+
 int64 ServerStats::get(const std::string &name) {
+  int64 ret = 0;
   CounterMap::const_iterator iter = m_values.find(name);
   if (iter != m_values.end()) {
-    return iter->second;
+    ret = iter->second;
   }
-  return 0;
+
+  int key = -1;
+  {
+    Lock lock(key_lock(), false);
+    hphp_string_map<int>::const_iterator kiter = key_index().find(name);
+    if (kiter != key_index().end()) {
+      key = kiter->second;
+    }
+  }
+  if (key >= 0 && key < (int)m_keyed.size()) {
+    ret += m_keyed[key].m_value;
+  }
+  return ret;
 }
 
 void ServerStats::logPage(const string &url, int code) {
+  logValues(url, code, 1);
+  m_threadStatus.m_mode = Idling;
+  m_threadStatus.m_done = time(0);
+}
+
+void ServerStats::logValues(const string &url, int code, int hit) {
   int64 now = time(NULL) / RuntimeOption::StatsSlotDuration;
   int slot = now % RuntimeOption::StatsMaxSlot;
 
@@ -819,11 +1053,28 @@ void ServerStats::logPage(const string &url, int code) {
     PageStats &ps = ts.m_pages[url + lexical_cast<string>(code)];
     ps.m_url = url;
     ps.m_code = code;
-    ps.m_hit++;
+    ps.m_hit += hit;
     Merge(ps.m_values, m_values);
+    if (!m_loggedKeys.empty() && ps.m_keyedValues.size() < m_keyed.size()) {
+      ps.m_keyedValues.resize(m_keyed.size());
+    }
+    for (unsigned int i = 0; i < m_loggedKeys.size(); i++) {
+      int key = m_loggedKeys[i];
+      const KeyedValue &kv = m_keyed[key];
+      ps.m_keyedValues[key] += kv.m_value;
+      if (kv.m_timed) {
+        ps.m_keyedTimes[key].add(kv.m_time);
+      }
+    }
   }
 
   m_values.clear();
+  for (unsigned int i = 0; i < m_loggedKeys.size(); i++) {
+    KeyedValue &kv = m_keyed[m_loggedKeys[i]];
+    kv.m_value = kv.m_time = 0;
+    kv.m_logged = kv.m_timed = false;
+  }
+  m_loggedKeys.clear();
   m_last = now;
   if (m_min == 0) {
     m_min = now;
@@ -831,9 +1082,6 @@ void ServerStats::logPage(const string &url, int code) {
   if (m_max < now) {
     m_max = now;
   }
-
-  m_threadStatus.m_mode = Idling;
-  m_threadStatus.m_done = time(0);
 }
 
 void ServerStats::clear() {
@@ -892,10 +1140,27 @@ void ServerStats::setThreadMode(ThreadMode mode) {
 
 ///////////////////////////////////////////////////////////////////////////////
 
+ServerStats::SectionKeys ServerStats::GetSectionKeys(const char *section) {
+  hphp_hash_map<intptr_t, SectionKeys> &cache = s_logger->m_sectionKeys;
+  hphp_hash_map<intptr_t, SectionKeys>::const_iterator iter =
+    cache.find((intptr_t)section);
+  if (iter != cache.end()) {
+    return iter->second;
+  }
+  SectionKeys &keys = cache[(intptr_t)section];
+  keys.wall = RegisterKey(string("page.wall.") + section);
+  keys.cpu = RegisterKey(string("page.cpu.") + section);
+  keys.mem = RegisterKey(string("mem.") + section);
+  return keys;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 ServerStatsHelper::ServerStatsHelper(const char *section,
                                      bool trackMem /* = false */)
   : m_section(section), m_trackMemory(trackMem) {
   if (RuntimeOption::EnableStats && RuntimeOption::EnableWebStats) {
+    m_keys = ServerStats::GetSectionKeys(section);
     clock_gettime(CLOCK_MONOTONIC, &m_wallStart);
     clock_gettime(CLOCK_THREAD_CPUTIME_ID, &m_cpuStart);
   }
@@ -907,23 +1172,21 @@ ServerStatsHelper::~ServerStatsHelper() {
     clock_gettime(CLOCK_MONOTONIC, &wallEnd);
     clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuEnd);
 
-    logTime("page.wall.", m_wallStart, wallEnd);
-    logTime("page.cpu.", m_cpuStart, cpuEnd);
+    ServerStats::LogTime(m_keys.wall, Elapsed(m_wallStart, wallEnd));
+    ServerStats::Log(m_keys.cpu, Elapsed(m_cpuStart, cpuEnd));
 
     if (m_trackMemory) {
       MemoryManager *mm = MemoryManager::TheMemoryManager().get();
       int64 mem = mm->getStats().peakUsage;
-      ServerStats::Log(string("mem.") + m_section, mem);
+      ServerStats::Log(m_keys.mem, mem);
     }
   }
 }
 
-void ServerStatsHelper::logTime(const std::string &prefix,
-                                const timespec &start, const timespec &end) {
+int64 ServerStatsHelper::Elapsed(const timespec &start, const timespec &end) {
   time_t dsec = end.tv_sec - start.tv_sec;
   long dnsec = end.tv_nsec - start.tv_nsec;
-  int64 dusec = dsec * 1000000 + dnsec / 1000;
-  ServerStats::Log(prefix + m_section, dusec);
+  return dsec * 1000000 + dnsec / 1000;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -41,9 +41,25 @@ public:
   };
 
 public:
+  /**
+   * Names logged on hot paths should be registered once, at startup, for a
+   * key. Logging by key is then only an add into a thread local array, and
+   * it's not until stats are collected that keys are turned back into names.
+   */
+  static int RegisterKey(const std::string &name);
+  static void Log(int key, int64 value);
+  static void LogTime(int key, int64 usec); // also keeps percentiles
+
   static void Log(const std::string &name, int64 value);
   static int64 Get(const std::string &name);
   static void LogPage(const std::string &url, int code);
+
+  /**
+   * For threads that log values but never serve a page: adds what this
+   * thread logged so far to the current time slot without counting a hit.
+   * It's reported under an empty url and code 0.
+   */
+  static void Flush();
   static void Clear();
   static void GetKeys(std::string &out, int64 from, int64 to);
   static void Report(std::string &out, Format format, int64 from, int64 to,
@@ -58,6 +74,18 @@ public:
   static void SetThreadMode(ThreadMode mode);
   static void ReportStatus(std::string &out, Format format);
 
+  /**
+   * ServerStatsHelper's keys for "page.wall.", "page.cpu." and "mem."
+   * followed by section, cached by section's address, as sections are
+   * expected to be string literals.
+   */
+  struct SectionKeys {
+    int wall;
+    int cpu;
+    int mem;
+  };
+  static SectionKeys GetSectionKeys(const char *section);
+
 public:
   ServerStats();
   ~ServerStats();
@@ -77,11 +105,37 @@ private:
 
   typedef hphp_shared_string_map<int64> CounterMap;
 
+  /**
+   * Log-linear histogram of per-request times in microseconds. Every power
+   * of two is split into 8 buckets, so a percentile is reported within 1/16
+   * of its real value. Buckets are kept sparse, as most of them are empty.
+   */
+  class Histogram {
+  public:
+    Histogram() : m_count(0) {}
+
+    void add(int64 value);
+    void merge(const Histogram &src);
+    int64 percentile(int permille) const;
+
+  private:
+    std::map<int, int64> m_buckets;
+    int64 m_count;
+  };
+  typedef hphp_shared_string_map<Histogram> HistogramMap;
+
+  typedef std::map<int, Histogram> KeyedHistogramMap;
+
   struct PageStats {
     std::string m_url; // which page
     int m_code;        // response code
     int m_hit;         // page hits
     CounterMap m_values; // name value pairs
+    HistogramMap m_times; // name to per-request time distribution
+
+    // same as above, by registered keys, until CollectSlots() names them
+    std::vector<int64> m_keyedValues;
+    KeyedHistogramMap m_keyedTimes;
   };
   typedef hphp_shared_string_map<PageStats> PageStatsMap;
   struct TimeSlot {
@@ -91,6 +145,9 @@ private:
 
   static void Merge(CounterMap &dest,
                     const CounterMap &src);
+  static void Merge(HistogramMap &dest, const HistogramMap &src);
+  static void Merge(std::vector<int64> &dest, const std::vector<int64> &src);
+  static void Merge(KeyedHistogramMap &dest, const KeyedHistogramMap &src);
   static void Merge(PageStatsMap &dest, const PageStatsMap &src);
   static void Merge(std::list<TimeSlot*> &dest,
                     const std::list<TimeSlot*> &src);
@@ -101,6 +158,7 @@ private:
                         std::map<std::string, int> &wantedKeys);
 
   static void CollectSlots(std::list<TimeSlot*> &slots, int64 from, int64 to);
+  static void NameKeys(std::list<TimeSlot*> &slots);
   static void FreeSlots(std::list<TimeSlot*> &slots);
 
   static void GetAllKeys(std::set<std::string> &allKeys,
@@ -116,9 +174,24 @@ private:
   int64 m_max;  // latest timepoint
   CounterMap m_values;  // current page's name value pairs
 
+  // current page's values by registered keys
+  struct KeyedValue {
+    int64 m_value;
+    int64 m_time;   // one histogram sample per page
+    bool m_logged;  // already on m_loggedKeys
+    bool m_timed;
+  };
+  std::vector<KeyedValue> m_keyed;
+  std::vector<int> m_loggedKeys;
+
+  // ServerStatsHelper's keys, by section name's address
+  hphp_hash_map<intptr_t, SectionKeys> m_sectionKeys;
+
+  KeyedValue &keyed(int key);
   void log(const std::string &name, int64 value);
   int64 get(const std::string &name);
   void logPage(const std::string &url, int code);
+  void logValues(const std::string &url, int code, int hit);
   void clear();
   void collect(std::list<TimeSlot*> &slots, int64 from, int64 to);
 
@@ -162,12 +235,12 @@ public:
 
 private:
   const char *m_section;
+  ServerStats::SectionKeys m_keys;
   timespec m_wallStart;
   timespec m_cpuStart;
   bool m_trackMemory;
 
-  void logTime(const std::string &prefix, const timespec &start,
-               const timespec &end);
+  static int64 Elapsed(const timespec &start, const timespec &end);
 };
 
 /**
@@ -18,19 +18,143 @@
 #include <cpp/base/runtime_option.h>
 #include <util/timer.h>
 #include <util/logger.h>
-#include <util/process.h>
 #include <util/util.h>
 #include <util/compression.h>
+#include <util/async_job.h>
+#include <util/lock.h>
+#include <dirent.h>
 
 using namespace std;
 
 namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+// scanning and loading jobs
+
+static bool is_static_file(const char *name) {
+  const char *ext = strrchr(name, '.');
+  return ext && RuntimeOption::StaticFileExtensions.find(ext + 1) !=
+    RuntimeOption::StaticFileExtensions.end();
+}
+
+/**
+ * Same as "find dir -type f", but only collecting registered static files.
+ * Subdirectories are returned in subdirs instead of being walked if it's
+ * not NULL.
+ */
+static void scan_dir(const string &dir, vector<string> &files,
+                     vector<string> *subdirs) {
+  DIR *d = opendir(dir.c_str());
+  if (d == NULL) {
+    Logger::Warning("unable to open directory %s: %s", dir.c_str(),
+                    Util::safe_strerror(errno).c_str());
+    return;
+  }
+  dirent *e;
+  while ((e = readdir(d))) {
+    if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) {
+      continue;
+    }
+    string path = dir + e->d_name;
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0) continue;
+    if (S_ISDIR(st.st_mode)) {
+      if (subdirs) {
+        subdirs->push_back(path + "/");
+      } else {
+        scan_dir(path + "/", files, NULL);
+      }
+    } else if (S_ISREG(st.st_mode) && is_static_file(e->d_name)) {
+      files.push_back(path);
+    }
+  }
+  closedir(d);
+}
+
+DECLARE_BOOST_TYPES(StaticContentJob);
+class StaticContentJob {
+public:
+  StaticContentJob(const string &path) : m_path(path) {}
+  string m_path;
+};
+
+class StaticContentScanWorker {
+public:
+  void doJob(StaticContentJobPtr job) {
+    scan_dir(job->m_path, m_files, NULL);
+  }
+  vector<string> m_files;
+};
+
+class StaticContentLoadWorker {
+public:
+  StaticContentLoadWorker() : m_compressed(0) {}
+  void doJob(StaticContentJobPtr job);
+  int m_compressed; // files we had to gzip again
+};
+
+void StaticContentLoadWorker::doJob(StaticContentJobPtr job) {
+  StaticContentCache &cache = StaticContentCache::TheCache;
+  const string &path = job->m_path;
+
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) return;
+  StringBufferPtr sb(new StringBuffer(path.c_str()));
+  if (!sb->valid() || sb->size() == 0) return;
+
+  StaticContentCache::ResourceFilePtr f(new StaticContentCache::ResourceFile());
+  f->file = sb;
+
+  // prepare gzipped content, skipping image and swf files
+  const char *ext = strrchr(path.c_str(), '.') + 1;
+  map<string, string>::const_iterator iter =
+    RuntimeOption::StaticFileExtensions.find(ext);
+  ASSERT(iter != RuntimeOption::StaticFileExtensions.end());
+  if (iter->second.find("image/") != 0 && strcmp(ext, "swf") != 0) {
+    bool found = false;
+    {
+      Lock lock(cache.m_gzipMutex, false);
+      StaticContentCache::CompressedFileMap::const_iterator it =
+        cache.m_gzipCache.find(path);
+      if (it != cache.m_gzipCache.end() &&
+          it->second.mtime == st.st_mtime && it->second.size == sb->size()) {
+        f->compressed = it->second.compressed;
+        found = true;
+      }
+    }
+    if (!found) {
+      int len = sb->size();
+      char *data = gzencode(sb->data(), len, 9, CODING_GZIP);
+      if (data) {
+        if (len < sb->size()) {
+          f->compressed = StringBufferPtr(new StringBuffer(data, len));
+        } else {
+          free(data);
+        }
+      }
+      ++m_compressed;
+
+      StaticContentCache::CompressedFile entry;
+      entry.mtime = st.st_mtime;
+      entry.size = sb->size();
+      entry.compressed = f->compressed;
+      Lock lock(cache.m_gzipMutex, false);
+      cache.m_gzipCache[path] = entry;
+      cache.m_gzipCacheDirty = true;
+    }
+  }
+
+  cache.add(path.substr(RuntimeOption::SourceRoot.size()), f, sb->size());
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 StaticContentCache StaticContentCache::TheCache;
 FileCachePtr StaticContentCache::TheFileCache;
 
-StaticContentCache::StaticContentCache() : m_totalSize(0) {
+StaticContentCache::StaticContentCache()
+  : m_totalSize(0), m_loading(false),
+    m_loader(this, &StaticContentCache::loadFiles),
+    m_gzipCacheDirty(false) {
 }
 
 void StaticContentCache::load() {
@@ -44,69 +168,88 @@ void StaticContentCache::load() {
     return;
   }
 
-  int rootSize = RuntimeOption::SourceRoot.size();
-  if (rootSize == 0) return;
+  if (RuntimeOption::EnableStaticContentMmap) {
+    Logger::Info("static content will be mapped from disk on demand");
+    return;
+  }
+
+  if (RuntimeOption::SourceRoot.empty()) return;
+
+  if (RuntimeOption::StaticContentLazyLoad) {
+    Logger::Info("loading static content in the background...");
+    m_loading = true;
+    m_loader.start();
+    return;
+  }
+  loadFiles();
+}
+
+void StaticContentCache::loadFiles() {
+  Timer timer(Timer::WallTime, "reading and compressing static content");
+  const string &root = RuntimeOption::SourceRoot;
+  int threads = RuntimeOption::StaticContentLoadThread;
+  if (threads < 1) threads = 1;
 
-  // get a list of all files, one for each extension
-  Logger::Info("searching all files under source root...");
-  int count = 0;
-  map<string, vector<string> > ext2files;
+  const string &gzipCache = RuntimeOption::StaticContentGzipCache;
+  if (!gzipCache.empty()) {
+    loadGzipCache(gzipCache);
+  }
+
+  // get a list of all static files, one job per top level directory
+  Logger::Info("searching static files under source root...");
+  vector<string> files;
   {
-    const char *argv[] = {"", (char*)RuntimeOption::SourceRoot.c_str(),
-                          "-type", "f", NULL};
-    string files;
-    vector<string> out;
-    Process::Exec("find", argv, NULL, files);
-    Util::split('\n', files.c_str(), out, true);
-    for (unsigned int i = 0; i < out.size(); i++) {
-      const string &name = out[i];
-      size_t pos = name.rfind('.');
-      if (pos != string::npos) {
-        ext2files[name.substr(pos+1)].push_back(name);
-        ++count;
-      }
+    vector<string> dirs;
+    scan_dir(root, files, &dirs);
+    StaticContentJobPtrVec jobs;
+    for (unsigned int i = 0; i < dirs.size(); i++) {
+      jobs.push_back(StaticContentJobPtr(new StaticContentJob(dirs[i])));
+    }
+    JobDispatcher<StaticContentJob, StaticContentScanWorker>
+      dispatcher(jobs, threads);
+    dispatcher.run();
+    for (unsigned int i = 0; i < dispatcher.getWorkerCount(); i++) {
+      vector<string> &found = dispatcher.getWorker(i)->m_files;
+      files.insert(files.end(), found.begin(), found.end());
     }
   }
 
-  Logger::Info("analyzing %d files under source root...", count);
-  for (map<string, string>::const_iterator iter =
-         RuntimeOption::StaticFileExtensions.begin();
-       iter != RuntimeOption::StaticFileExtensions.end(); ++iter) {
-    if (ext2files.find(iter->first) == ext2files.end()) {
-      continue;
+  Logger::Info("loading %d static files on %d threads...",
+               (int)files.size(), threads);
+  int compressed = 0;
+  {
+    StaticContentJobPtrVec jobs;
+    jobs.reserve(files.size());
+    for (unsigned int i = 0; i < files.size(); i++) {
+      jobs.push_back(StaticContentJobPtr(new StaticContentJob(files[i])));
     }
-    const vector<string> &out = ext2files[iter->first];
-
-    int total = 0;
-    for (unsigned int i = 0; i < out.size(); i++) {
-      ResourceFilePtr f(new ResourceFile());
-
-      StringBufferPtr sb(new StringBuffer(out[i].c_str()));
-      if (sb->valid() && sb->size() > 0) {
-        string url = out[i].substr(rootSize + 1);
-        f->file = sb;
-        m_files[url] = f;
-
-        // prepare gzipped content, skipping image and swf files
-        if (iter->second.find("image/") != 0 && iter->first != "swf") {
-          int len = sb->size();
-          char *data = gzencode(sb->data(), len, 9, CODING_GZIP);
-          if (data) {
-            if (len < sb->size()) {
-              f->compressed = StringBufferPtr(new StringBuffer(data, len));
-            } else {
-              free(data);
-            }
-          }
-        }
+    JobDispatcher<StaticContentJob, StaticContentLoadWorker>
+      dispatcher(jobs, threads);
+    dispatcher.run();
+    for (unsigned int i = 0; i < dispatcher.getWorkerCount(); i++) {
+      compressed += dispatcher.getWorker(i)->m_compressed;
+    }
+  }
 
-        total += sb->size();
-      }
+  if (!gzipCache.empty()) {
+    if (m_gzipCacheDirty) {
+      saveGzipCache(gzipCache);
     }
-    Logger::Info("..loaded %d bytes of %s files", total, iter->first.c_str());
-    m_totalSize += total;
+    m_gzipCache.clear();
   }
-  Logger::Info("loaded %d bytes of static content in total", m_totalSize);
+
+  Logger::Info("loaded %lld bytes of static content in total, "
+               "%d files compressed", m_totalSize, compressed);
+  // every add() has to be visible before request threads stop going to disk
+  __sync_synchronize();
+  m_loading = false;
+}
+
+void StaticContentCache::add(const std::string &url, ResourceFilePtr f,
+                             int size) {
+  WriteLock lock(m_mutex);
+  m_files[url] = f;
+  m_totalSize += size;
 }
 
 bool StaticContentCache::find(const std::string &name, const char *&data,
@@ -115,6 +258,7 @@ bool StaticContentCache::find(const std::string &name, const char *&data,
     return data = TheFileCache->read(name.c_str(), len, compressed);
   }
 
+  ReadLock lock(m_mutex);
   StringToResourceFilePtrMap::const_iterator iter = m_files.find(name);
   if (iter != m_files.end()) {
     if (compressed && iter->second->compressed) {
@@ -130,5 +274,98 @@ bool StaticContentCache::find(const std::string &name, const char *&data,
   return false;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// gzip cache: a record per file of
+//
+//   short name_len, name, int64 mtime, int64 size,
+//   int clen (0 if gzip didn't help), compressed data
+
+static bool read_bytes(FILE *f, void *buf, int len) {
+  return fread(buf, 1, len, f) == (size_t)len;
+}
+
+void StaticContentCache::loadGzipCache(const std::string &filename) {
+  FILE *f = fopen(filename.c_str(), "r");
+  if (f == NULL) return; // first run
+
+  while (true) {
+    short nameLen;
+    if (!read_bytes(f, &nameLen, sizeof(nameLen))) break;
+    CompressedFile entry;
+    int clen;
+    string name(nameLen > 0 ? nameLen : 0, '\0');
+    if (nameLen <= 0 || !read_bytes(f, &name[0], nameLen) ||
+        !read_bytes(f, &entry.mtime, sizeof(entry.mtime)) ||
+        !read_bytes(f, &entry.size, sizeof(entry.size)) ||
+        !read_bytes(f, &clen, sizeof(clen)) || clen < 0) {
+      Logger::Warning("ignoring corrupt gzip cache %s", filename.c_str());
+      m_gzipCache.clear();
+      break;
+    }
+    if (clen) {
+      char *data = (char*)malloc(clen + 1);
+      if (data == NULL) {
+        Logger::Warning("out of memory reading gzip cache %s",
+                        filename.c_str());
+        m_gzipCache.clear();
+        break;
+      }
+      if (!read_bytes(f, data, clen)) {
+        free(data);
+        Logger::Warning("ignoring truncated gzip cache %s", filename.c_str());
+        m_gzipCache.clear();
+        break;
+      }
+      entry.compressed = StringBufferPtr(new StringBuffer(data, clen));
+    }
+    m_gzipCache[name] = entry;
+  }
+  fclose(f);
+  Logger::Info("loaded %d entries from gzip cache %s",
+               (int)m_gzipCache.size(), filename.c_str());
+}
+
+void StaticContentCache::saveGzipCache(const std::string &filename) {
+  // write a new file and rename it over, so a crash never leaves half of one
+  string tmp = filename + ".tmp";
+  FILE *f = fopen(tmp.c_str(), "w");
+  if (f == NULL) {
+    Logger::Error("unable to write gzip cache %s: %s", tmp.c_str(),
+                  Util::safe_strerror(errno).c_str());
+    return;
+  }
+
+  bool ok = true;
+  for (CompressedFileMap::const_iterator iter = m_gzipCache.begin();
+       iter != m_gzipCache.end(); ++iter) {
+    // only keep files still there, so deleted ones don't pile up
+    if (iter->first.size() > SHRT_MAX ||
+        access(iter->first.c_str(), F_OK) != 0) {
+      continue;
+    }
+
+    short nameLen = iter->first.size();
+    const CompressedFile &entry = iter->second;
+    int clen = entry.compressed ? entry.compressed->size() : 0;
+    ok = ok &&
+      fwrite(&nameLen, sizeof(nameLen), 1, f) == 1 &&
+      fwrite(iter->first.data(), nameLen, 1, f) == 1 &&
+      fwrite(&entry.mtime, sizeof(entry.mtime), 1, f) == 1 &&
+      fwrite(&entry.size, sizeof(entry.size), 1, f) == 1 &&
+      fwrite(&clen, sizeof(clen), 1, f) == 1 &&
+      (clen == 0 || fwrite(entry.compressed->data(), clen, 1, f) == 1);
+  }
+  if (fclose(f) != 0) ok = false;
+
+  if (!ok || rename(tmp.c_str(), filename.c_str()) != 0) {
+    Logger::Error("unable to write gzip cache %s: %s", filename.c_str(),
+                  Util::safe_strerror(errno).c_str());
+    unlink(tmp.c_str());
+    return;
+  }
+  Logger::Info("saved %d entries to gzip cache %s",
+               (int)m_gzipCache.size(), filename.c_str());
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 }
@@ -19,6 +19,8 @@
 
 #include <cpp/base/util/string_buffer.h>
 #include <util/file_cache.h>
+#include <util/async_func.h>
+#include <util/mutex.h>
 
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
@@ -32,10 +34,19 @@ public:
   StaticContentCache();
 
   /**
-   * Load all registered static files from RuntimeOption::DocumentRoot.
+   * Load all registered static files from RuntimeOption::SourceRoot, reading
+   * and compressing them on RuntimeOption::StaticContentLoadThread threads.
+   * With RuntimeOption::StaticContentLazyLoad this returns right away and
+   * the cache fills in the background.
    */
   void load();
 
+  /**
+   * Whether a background load is still filling the cache, in which case
+   * misses should be served from disk.
+   */
+  bool isLoading() const { return m_loading;}
+
   /**
    * Find a file from cache.
    */
@@ -43,15 +54,40 @@ public:
             bool &compressed) const;
 
 private:
-  int m_totalSize;
-
   struct ResourceFile {
     StringBufferPtr file;
     StringBufferPtr compressed;
   };
   DECLARE_BOOST_TYPES(ResourceFile);
 
+  /**
+   * Gzipped content from an earlier run, keyed by full path and only good
+   * for as long as the file's mtime and size stay the same.
+   */
+  struct CompressedFile {
+    int64 mtime;
+    int64 size;
+    StringBufferPtr compressed; // null when gzip didn't make it smaller
+  };
+  typedef hphp_string_map<CompressedFile> CompressedFileMap;
+
+  friend class StaticContentLoadWorker;
+
+  mutable ReadWriteMutex m_mutex;
   StringToResourceFilePtrMap m_files;
+  int64 m_totalSize;
+  volatile bool m_loading; // read by request threads without m_mutex
+  AsyncFunc<StaticContentCache> m_loader;
+
+  CompressedFileMap m_gzipCache;
+  Mutex m_gzipMutex;
+  bool m_gzipCacheDirty;
+
+  void loadFiles();
+  void add(const std::string &url, ResourceFilePtr f, int size);
+
+  void loadGzipCache(const std::string &filename);
+  void saveGzipCache(const std::string &filename);
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -26,12 +26,21 @@
 #include <cpp/base/zend/zend_url.h>
 #include <cpp/base/runtime_option.h>
 #include <cpp/base/server/access_log.h>
+#include <cpp/base/server/gzip_cache.h>
+#include <cpp/base/server/virtual_host.h>
 
 using namespace std;
 
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 
+static int s_gzipCacheHit = ServerStats::RegisterKey("gzip.cache.hit");
+static int s_gzipCacheMiss = ServerStats::RegisterKey("gzip.cache.miss");
+static int s_networkUncompressed =
+  ServerStats::RegisterKey("network.uncompressed");
+static int s_networkCompressed =
+  ServerStats::RegisterKey("network.compressed");
+
 Transport::Transport()
   : m_url(NULL), m_postData(NULL), m_postDataParsed(false),
     m_chunkedEncoding(false), m_headerSent(false),
@@ -186,6 +195,12 @@ bool Transport::paramExists(const char *name, Method method /* = GET */) {
 }
 
 std::string Transport::getParam(const char *name,  Method method /* = GET */) {
+  const char *value = getRawParam(name, method);
+  return value ? value : "";
+}
+
+const char *Transport::getRawParam(const char *name,
+                                   Method method /* = GET */) {
   ASSERT(name && *name);
 
   if (method == GET || method == AUTO) {
@@ -208,7 +223,7 @@ std::string Transport::getParam(const char *name,  Method method /* = GET */) {
     }
   }
 
-  return "";
+  return NULL;
 }
 
 int Transport::getIntParam(const char *name, Method method /* = GET */) {
@@ -231,6 +246,14 @@ long long Transport::getInt64Param(const char *name,
 void Transport::getArrayParam(const char *name,
                               std::vector<std::string> &values,
                               Method method /* = GET */) {
+  vector<const char *> params;
+  getArrayParam(name, params, method);
+  values.insert(values.end(), params.begin(), params.end());
+}
+
+void Transport::getArrayParam(const char *name,
+                              std::vector<const char *> &values,
+                              Method method /* = GET */) {
   if (method == GET || method == AUTO) {
     if (m_url == NULL) {
       parseGetParams();
@@ -482,6 +505,23 @@ String Transport::prepareResponse(const void *data, int size, bool &compressed,
   // Ethernet packet (1500 bytes), unless we are doing chunked encoding,
   // where we don't really know if next chunk will benefit from compresseion.
   if (m_chunkedEncoding || size > 1000) {
+    // a whole body in one go can come from, or go to, the shared cache
+    bool useCache = !m_chunkedEncoding && m_compressor == NULL && last &&
+      RuntimeOption::GzipCacheSize > 0 &&
+      VirtualHost::GetCurrent()->useGzipCache(getCommand());
+    GzipCache::Key key;
+    if (useCache) {
+      key = GzipCache::MakeKey((const char*)data, size);
+      bool hit = GzipCache::TheCache.find(key, response);
+      if (RuntimeOption::EnableStats && RuntimeOption::EnableWebStats) {
+        ServerStats::Log(hit ? s_gzipCacheHit : s_gzipCacheMiss, 1);
+      }
+      if (hit) {
+        compressed = true;
+        return response;
+      }
+    }
+
     if (m_compressor == NULL) {
       m_compressor = new StreamCompressor(RuntimeOption::GzipCompressionLevel,
                                          CODING_GZIP, true);
@@ -493,6 +533,9 @@ String Transport::prepareResponse(const void *data, int size, bool &compressed,
       if (m_chunkedEncoding || len < size) {
         response = deleter;
         compressed = true;
+        if (useCache) {
+          GzipCache::TheCache.store(key, compressedData, len);
+        }
       }
     } else {
       Logger::Error("Unable to compress response: level=%d len=%d",
@@ -546,8 +589,8 @@ void Transport::sendRaw(void *data, int size, int code /* = 200 */,
 
   ServerStats::LogBytes(size);
   if (RuntimeOption::EnableStats && RuntimeOption::EnableWebStats) {
-    ServerStats::Log("network.uncompressed", size);
-    ServerStats::Log("network.compressed", response.size());
+    ServerStats::Log(s_networkUncompressed, size);
+    ServerStats::Log(s_networkCompressed, response.size());
   }
 }
 
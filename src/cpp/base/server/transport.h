@@ -205,6 +205,12 @@ public:
    */
   std::string getParam(const char *name, Method method = GET);
 
+  /**
+   * Same as getParam(), but pointing into the transport's own decoded copy
+   * of the parameter, or NULL if not present. Valid as long as the transport.
+   */
+  const char *getRawParam(const char *name, Method method = GET);
+
   /**
    * Turn a string parameter into an integer.
    */
@@ -222,6 +228,8 @@ public:
    */
   void getArrayParam(const char *name, std::vector<std::string> &values,
                      Method method = GET);
+  void getArrayParam(const char *name, std::vector<const char *> &values,
+                     Method method = GET);
 
   /**
    * Split a string parameter into multiple sub-strings.
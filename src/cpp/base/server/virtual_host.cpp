@@ -138,6 +138,11 @@ void VirtualHost::init(Hdf vh) {
     m_ipBlocks = IpBlockMapPtr(new IpBlockMap(ipblocks));
   }
 
+  vh["GzipCache"].get(m_gzipCachePatterns);
+  for (unsigned int i = 0; i < m_gzipCachePatterns.size(); i++) {
+    m_gzipCachePatterns[i] = format_pattern(m_gzipCachePatterns[i]);
+  }
+
   vh["ServerVariables"].get(m_serverVars);
   m_serverName = vh["ServerName"].getString();
   if (m_serverName.empty() && !m_prefix.empty() &&
@@ -209,6 +214,18 @@ bool VirtualHost::isBlocking(const std::string &command,
   return m_ipBlocks->isBlocking(command, ip);
 }
 
+bool VirtualHost::useGzipCache(const std::string &command) const {
+  for (unsigned int i = 0; i < m_gzipCachePatterns.size(); i++) {
+    const std::string &pattern = m_gzipCachePatterns[i];
+    Variant ret = preg_match(String(pattern.c_str(), pattern.size(),
+                                    AttachLiteral),
+                             String(command.c_str(), command.size(),
+                                    AttachLiteral));
+    if (ret.toInt64() > 0) return true;
+  }
+  return false;
+}
+
 const std::string &VirtualHost::serverName() const {
   if (m_serverName.empty()) {
     return RuntimeOption::Host;
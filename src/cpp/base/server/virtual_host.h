@@ -42,6 +42,7 @@ public:
   bool rewriteURL(CStrRef host, String &url, bool &qsa, int &redirect) const;
   bool disabled() const { return m_disabled; }
   bool isBlocking(const std::string &command, const std::string &ip) const;
+  bool useGzipCache(const std::string &command) const;
 
   const std::string &getPathTranslation() const { return m_pathTranslation;}
   const std::string &getDocumentRoot() const { return m_documentRoot;}
@@ -81,6 +82,7 @@ private:
   std::string m_pathTranslation;
   std::string m_documentRoot;
   bool m_disabled;
+  std::vector<std::string> m_gzipCachePatterns;
 };
 
 std::string format_pattern(const std::string &pattern);
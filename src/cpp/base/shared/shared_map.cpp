@@ -16,7 +16,6 @@
 
 #include <cpp/base/shared/shared_map.h>
 #include <cpp/base/array/map_variant.h>
-#include <cpp/base/array/zend_array.h>
 #include <cpp/base/runtime_option.h>
 
 namespace HPHP {
@@ -200,7 +199,7 @@ ArrayData *SharedMap::escalate() const {
     if (!elems.empty()) {
       ret = ArrayData::Create(elems);
     } else {
-      ret = StaticEmptyZendArray::Get()->copy();
+      ret = ArrayData::Create()->copy();
     }
   } else {
     ret = escalateToMapVariant();
@@ -50,18 +50,19 @@ public:
   }
 
   Variant getValue(ssize_t pos) const {
+    if (pos < 0) return null;
     SharedVariant* v = m_arr->getValue(pos);
     return v ? v->toLocal() : null;
   }
 
   bool exists(int64 k, int64 prehash = -1) const {
-    return exists(Variant(k), prehash);
+    return m_arr->getIndex(k) != -1;
   }
   bool exists(litstr k, int64 prehash = -1) const {
-    return exists(Variant(k), prehash);
+    return m_arr->getIndex(k, strlen(k), prehash) != -1;
   }
   bool exists(CStrRef k, int64 prehash = -1) const {
-    return exists(Variant(k), prehash);
+    return m_arr->getIndex(k.data(), k.size(), prehash) != -1;
   }
   bool exists(CVarRef k, int64 prehash = -1) const;
 
@@ -70,30 +71,26 @@ public:
   }
 
   Variant get(int64 k, int64 prehash = -1) const {
-    return get(Variant(k), prehash);
+    return getValue(m_arr->getIndex(k));
   }
   Variant get(litstr k, int64 prehash = -1) const {
-    return get(Variant(k), prehash);
+    return getValue(m_arr->getIndex(k, strlen(k), prehash));
   }
   Variant get(CStrRef k, int64 prehash = -1) const {
-    return get(Variant(k), prehash);
+    return getValue(m_arr->getIndex(k.data(), k.size(), prehash));
   }
   Variant get(CVarRef k, int64 prehash = -1) const {
-    SharedVariant* sv = m_arr->get(k);
-    if (sv) {
-      return sv->toLocal();
-    }
-    return null;
+    return getValue(m_arr->getIndex(k));
   }
 
   ssize_t getIndex(int64 k, int64 prehash = -1) const {
-    return getIndex(Variant(k), prehash);
+    return m_arr->getIndex(k);
   }
   ssize_t getIndex(litstr k, int64 prehash = -1) const {
-    return getIndex(Variant(k), prehash);
+    return m_arr->getIndex(k, strlen(k), prehash);
   }
   ssize_t getIndex(CStrRef k, int64 prehash = -1) const {
-    return getIndex(Variant(k), prehash);
+    return m_arr->getIndex(k.data(), k.size(), prehash);
   }
   ssize_t getIndex(CVarRef k, int64 prehash = -1) const {
     return m_arr->getIndex(k);
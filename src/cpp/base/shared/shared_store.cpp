@@ -26,6 +26,7 @@
 #include <util/lfu_table.h>
 #include <tbb/concurrent_hash_map.h>
 #include <queue>
+#include <sched.h>
 
 using namespace std;
 using namespace boost;
@@ -33,8 +34,28 @@ using namespace boost;
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 
+static int s_apcMiss = ServerStats::RegisterKey("apc.miss");
+static int s_apcHit = ServerStats::RegisterKey("apc.hit");
+static int s_apcUpdate = ServerStats::RegisterKey("apc.update");
+static int s_apcNew = ServerStats::RegisterKey("apc.new");
+static int s_apcInc = ServerStats::RegisterKey("apc.inc");
+static int s_apcCas = ServerStats::RegisterKey("apc.cas");
+static int s_apcErased = ServerStats::RegisterKey("apc.erased");
+static int s_apcErase = ServerStats::RegisterKey("apc.erase");
+
 size_t SharedStore::s_lockCount = 10000;
 
+static void append_dump_item(std::vector<SharedStore::DumpItem> &items,
+                             const char *key, int len, SharedVariant *var,
+                             const StoreValue &val) {
+  if (val.expired()) return;
+  var->incRef();
+  SharedStore::DumpItem item;
+  item.key.assign(key, len);
+  item.var = var;
+  item.expiry = val.expiry;
+  items.push_back(item);
+}
 
 ///////////////////////////////////////////////////////////////////////////////
 // LockedSharedStore
@@ -193,6 +214,16 @@ public:
     unlockMap();
   }
 
+  virtual void dump(std::vector<DumpItem> &items) {
+    readLockMap();
+    for (SharedMap::const_iterator iter = m_vars->begin();
+         iter != m_vars->end(); ++iter) {
+      append_dump_item(items, iter->first.c_str(), iter->first.size(),
+                       getVar(iter->second.var), iter->second);
+    }
+    readUnlockMap();
+  }
+
 private:
   typedef SharedMemoryMap<SharedMemoryString, StoreValue> SharedMap;
   ProcessSharedVariantLock* getLock(CStrRef key) {
@@ -350,6 +381,15 @@ public:
     }
     unlockMap();
   }
+  virtual void dump(std::vector<DumpItem> &items) {
+    readLockMap();
+    for (StringMap::const_iterator iter = m_vars.begin();
+         iter != m_vars.end(); ++iter) {
+      append_dump_item(items, iter->first->data(), iter->first->size(),
+                       iter->second.var, iter->second);
+    }
+    readUnlockMap();
+  }
   virtual void lockMap() {
     m_mlock.acquireWrite();
   }
@@ -519,6 +559,19 @@ public:
     CountBody body(reachable, expired, persistent);
     m_vars.atomicForeach(body);
   }
+  virtual void dump(std::vector<DumpItem> &items) {
+    class DumpBody : public Map::AtomicReader {
+    public:
+      DumpBody(std::vector<DumpItem> &i) : items(i) {}
+      void read(StringData* const &k, const StoreValue &val) {
+        append_dump_item(items, k->data(), k->size(), val.var, val);
+      }
+    private:
+      std::vector<DumpItem> &items;
+    };
+    DumpBody body(items);
+    m_vars.atomicForeach(body);
+  }
 
   virtual bool get(CStrRef key, Variant &value);
   virtual bool store(CStrRef key, CVarRef val, int64 ttl);
@@ -604,6 +657,14 @@ public:
       }
     }
   }
+  virtual void dump(std::vector<DumpItem> &items) {
+    WriteLock l(m_lock);
+    for (Map::const_iterator iter = m_vars.begin();
+         iter != m_vars.end(); ++iter) {
+      append_dump_item(items, iter->first->data(), iter->first->size(),
+                       iter->second.var, iter->second);
+    }
+  }
   virtual bool get(CStrRef key, Variant &value);
   virtual bool store(CStrRef key, CVarRef val, int64 ttl);
   virtual int64 inc(CStrRef key, int64 step, bool &found);
@@ -735,6 +796,552 @@ protected:
 
 };
 
+///////////////////////////////////////////////////////////////////////////////
+// ShardedTableSharedStore
+
+/**
+ * Keys are spread over RuntimeOption::ApcShardCount independently locked
+ * chained hash tables. A published node is never modified: writers hold the
+ * shard's mutex, build a replacement node and swing one pointer, so the
+ * fetch path takes no lock at all. Readers only bump one of two per-shard
+ * counters; before unlinked nodes are freed, a writer flips the active
+ * counter and waits for both generations of readers to drain.
+ */
+class ShardedTableSharedStore : public SharedStore,
+                                private ThreadSharedVariantFactory {
+public:
+  ShardedTableSharedStore(int id);
+  ~ShardedTableSharedStore();
+
+  virtual void clear();
+  virtual int size();
+  virtual void count(int &reachable, int &expired, int &persistent);
+  virtual bool get(CStrRef key, Variant &value);
+  virtual bool store(CStrRef key, CVarRef val, int64 ttl);
+  virtual int64 inc(CStrRef key, int64 step, bool &found);
+  virtual bool cas(CStrRef key, int64 old, int64 val);
+  virtual void prime(const std::vector<SharedStore::KeyValuePair> &vars);
+  virtual void dump(std::vector<DumpItem> &items);
+  virtual std::string reportStats(int &reachable, int indent);
+  virtual SharedVariant* construct(litstr str, int len, CStrRef v,
+                                   bool serialized) {
+    return create(str, len, v, serialized);
+  }
+  virtual SharedVariant* construct(litstr str, int len, CVarRef v) {
+    return create(str, len, v);
+  }
+protected:
+  virtual SharedVariant* construct(CStrRef key, CVarRef v) {
+    return create(key, v);
+  }
+  virtual bool eraseImpl(CStrRef key, bool expired);
+
+private:
+  // retired nodes are only freed in batches, to amortize grace periods
+  static const unsigned int RetireBatch = 32;
+  static const size_t InitialBuckets = 64;
+
+  struct Node {
+    Node(StringData *k, size_t h, SharedVariant *v, int64 e, Node *n)
+      : key(k), hash(h), next(n) {
+      value.var = v;
+      value.expiry = e;
+    }
+    StringData *key;
+    size_t hash;
+    StoreValue value;
+    Node * volatile next;
+  };
+  typedef Node * volatile NodePtr;
+
+  struct Table {
+    Table(size_t n) : mask(n - 1), count(0), ownsEntries(false) {
+      buckets = new NodePtr[n];
+      for (size_t i = 0; i < n; i++) buckets[i] = NULL;
+    }
+    ~Table();
+    Node *find(const char *key, int len, size_t hash) const {
+      for (Node *n = buckets[hash & mask]; n; n = n->next) {
+        if (n->hash == hash && n->key->size() == len &&
+            memcmp(n->key->data(), key, len) == 0) {
+          return n;
+        }
+      }
+      return NULL;
+    }
+    size_t mask;
+    volatile size_t count;
+    bool ownsEntries; // whether retiring this table releases keys and values
+    NodePtr *buckets;
+  };
+
+  typedef std::pair<StringData*, time_t> ExpirationPair;
+  class ExpirationCompare {
+  public:
+    bool operator()(const ExpirationPair &p1, const ExpirationPair &p2) {
+      return p1.second > p2.second;
+    }
+  };
+
+  struct Shard {
+    Shard() : table(new Table(InitialBuckets)), phase(0), purgeCounter(0),
+              reads(0), writes(0), contended(0), graceWaits(0) {
+      readers[0] = readers[1] = 0;
+    }
+    Mutex mutex;
+    Table * volatile table;
+    int readers[2];
+    volatile int phase;
+
+    // everything below is protected by mutex
+    std::vector<Node*> retiredNodes;
+    std::vector<StringData*> retiredKeys;
+    std::vector<Table*> retiredTables;
+    std::priority_queue<ExpirationPair, std::vector<ExpirationPair>,
+                        ExpirationCompare> expirationQueue;
+    uint64 purgeCounter;
+
+    // contention counters
+    uint64 reads;
+    uint64 writes;
+    uint64 contended;
+    uint64 graceWaits;
+  };
+
+  /**
+   * Marks a lock-free read of one shard. Nothing reachable from the shard's
+   * table when the section starts is freed until the section ends.
+   */
+  class ReadSection {
+  public:
+    ReadSection(Shard &shard) : m_shard(shard) {
+      m_phase = shard.phase & 1;
+      atomic_inc(shard.readers[m_phase]);
+    }
+    ~ReadSection() {
+      atomic_dec(m_shard.readers[m_phase]);
+    }
+  private:
+    Shard &m_shard;
+    int m_phase;
+  };
+
+  class ShardLock {
+  public:
+    ShardLock(Shard &shard, bool stats) : m_shard(shard) {
+      if (!shard.mutex.tryLock()) {
+        if (stats) atomic_add(shard.contended, (uint64)1);
+        shard.mutex.lock();
+      }
+      if (stats) ++shard.writes;
+    }
+    ~ShardLock() {
+      m_shard.mutex.unlock();
+    }
+  private:
+    Shard &m_shard;
+  };
+
+  int m_shardCount;
+  Shard *m_shards;
+
+  static size_t hashKey(CStrRef key) {
+    return hash_string(key.data(), key.size());
+  }
+  Shard &shardFor(size_t hash) {
+    return m_shards[hash % m_shardCount];
+  }
+
+  template<class T>
+  static void publish(T * volatile &slot, T *p) {
+    // p must be fully built before readers can reach it
+    __sync_synchronize();
+    slot = p;
+  }
+
+  NodePtr *findSlot(Table *t, CStrRef key, size_t hash);
+  bool upsertLocked(Shard &shard, CStrRef key, size_t hash,
+                    SharedVariant *var, int64 ttl);
+  void replaceLocked(Shard &shard, NodePtr *slot, SharedVariant *var,
+                     int64 expiry);
+  bool eraseLocked(Shard &shard, CStrRef key, size_t hash, bool expired);
+  void growLocked(Shard &shard);
+  void purgeExpiredLocked(Shard &shard);
+  void retireLocked(Shard &shard);
+  void synchronize(Shard &shard);
+  void reclaim(Shard &shard);
+};
+
+ShardedTableSharedStore::Table::~Table() {
+  for (size_t i = 0; i <= mask; i++) {
+    Node *n = buckets[i];
+    while (n) {
+      Node *next = n->next;
+      if (ownsEntries) {
+        n->value.var->decRef();
+        delete n->key;
+      }
+      delete n;
+      n = next;
+    }
+  }
+  delete [] buckets;
+}
+
+ShardedTableSharedStore::ShardedTableSharedStore(int id)
+  : SharedStore(id), m_shardCount(RuntimeOption::ApcShardCount) {
+  m_shards = new Shard[m_shardCount];
+}
+
+ShardedTableSharedStore::~ShardedTableSharedStore() {
+  clear();
+  for (int i = 0; i < m_shardCount; i++) {
+    delete m_shards[i].table;
+  }
+  delete [] m_shards;
+}
+
+ShardedTableSharedStore::NodePtr *
+ShardedTableSharedStore::findSlot(Table *t, CStrRef key, size_t hash) {
+  NodePtr *slot = &t->buckets[hash & t->mask];
+  for (Node *n = *slot; n; slot = &n->next, n = *slot) {
+    if (n->hash == hash && n->key->size() == key.size() &&
+        memcmp(n->key->data(), key.data(), key.size()) == 0) {
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+void ShardedTableSharedStore::replaceLocked(Shard &shard, NodePtr *slot,
+                                            SharedVariant *var,
+                                            int64 expiry) {
+  // the key moves over to the new node; the old value dies with the old node
+  Node *old = *slot;
+  publish(*slot, new Node(old->key, old->hash, var, expiry, old->next));
+  shard.retiredNodes.push_back(old);
+}
+
+bool ShardedTableSharedStore::upsertLocked(Shard &shard, CStrRef key,
+                                           size_t hash, SharedVariant *var,
+                                           int64 ttl) {
+  StoreValue sval;
+  sval.set(var, ttl);
+
+  Table *t = shard.table;
+  NodePtr *slot = findSlot(t, key, hash);
+  if (slot) {
+    replaceLocked(shard, slot, var, sval.expiry);
+    return true;
+  }
+  if (t->count >= t->mask + 1) {
+    growLocked(shard);
+    t = shard.table;
+  }
+  NodePtr &head = t->buckets[hash & t->mask];
+  publish(head, new Node(key.get()->copy(true), hash, var, sval.expiry,
+                         head));
+  t->count++;
+  return false;
+}
+
+bool ShardedTableSharedStore::eraseLocked(Shard &shard, CStrRef key,
+                                          size_t hash, bool expired) {
+  Table *t = shard.table;
+  NodePtr *slot = findSlot(t, key, hash);
+  if (!slot) return false;
+  Node *n = *slot;
+  if (expired && !n->value.expired()) {
+    return false;
+  }
+  *slot = n->next;
+  t->count--;
+  shard.retiredNodes.push_back(n);
+  shard.retiredKeys.push_back(n->key);
+  return true;
+}
+
+void ShardedTableSharedStore::growLocked(Shard &shard) {
+  // Nodes can't be relinked in place while readers may be walking them, so
+  // the new table gets its own copies sharing the same keys and values.
+  Table *old = shard.table;
+  Table *t = new Table((old->mask + 1) * 2);
+  for (size_t i = 0; i <= old->mask; i++) {
+    for (Node *n = old->buckets[i]; n; n = n->next) {
+      NodePtr &head = t->buckets[n->hash & t->mask];
+      head = new Node(n->key, n->hash, n->value.var, n->value.expiry, head);
+    }
+  }
+  t->count = old->count;
+  publish(shard.table, t);
+  shard.retiredTables.push_back(old);
+}
+
+void ShardedTableSharedStore::purgeExpiredLocked(Shard &shard) {
+  if (++shard.purgeCounter % RuntimeOption::ApcPurgeFrequency != 0) return;
+  time_t now = time(NULL);
+  while (!shard.expirationQueue.empty() &&
+         shard.expirationQueue.top().second < now) {
+    StringData *k = shard.expirationQueue.top().first;
+    shard.expirationQueue.pop();
+    String key(k->data(), k->size(), AttachLiteral);
+    eraseLocked(shard, key, hashKey(key), true);
+    delete k;
+  }
+}
+
+void ShardedTableSharedStore::retireLocked(Shard &shard) {
+  if (shard.retiredNodes.size() + shard.retiredTables.size() >= RetireBatch) {
+    synchronize(shard);
+    reclaim(shard);
+  }
+}
+
+void ShardedTableSharedStore::synchronize(Shard &shard) {
+  // Two flips: a reader may have sampled the phase just before a flip and
+  // counted itself in the generation we already waited for.
+  __sync_synchronize();
+  for (int i = 0; i < 2; i++) {
+    int old = shard.phase & 1;
+    shard.phase = old ^ 1;
+    __sync_synchronize();
+    while (shard.readers[old]) {
+      ++shard.graceWaits;
+      sched_yield();
+    }
+  }
+}
+
+void ShardedTableSharedStore::reclaim(Shard &shard) {
+  for (unsigned int i = 0; i < shard.retiredNodes.size(); i++) {
+    shard.retiredNodes[i]->value.var->decRef();
+    delete shard.retiredNodes[i];
+  }
+  for (unsigned int i = 0; i < shard.retiredKeys.size(); i++) {
+    delete shard.retiredKeys[i];
+  }
+  for (unsigned int i = 0; i < shard.retiredTables.size(); i++) {
+    delete shard.retiredTables[i];
+  }
+  shard.retiredNodes.clear();
+  shard.retiredKeys.clear();
+  shard.retiredTables.clear();
+}
+
+void ShardedTableSharedStore::clear() {
+  for (int i = 0; i < m_shardCount; i++) {
+    Shard &shard = m_shards[i];
+    ShardLock lock(shard, false);
+    Table *old = shard.table;
+    old->ownsEntries = true;
+    publish(shard.table, new Table(InitialBuckets));
+    shard.retiredTables.push_back(old);
+    while (!shard.expirationQueue.empty()) {
+      delete shard.expirationQueue.top().first;
+      shard.expirationQueue.pop();
+    }
+    synchronize(shard);
+    reclaim(shard);
+  }
+}
+
+int ShardedTableSharedStore::size() {
+  int ret = 0;
+  for (int i = 0; i < m_shardCount; i++) {
+    ReadSection rs(m_shards[i]);
+    ret += m_shards[i].table->count;
+  }
+  return ret;
+}
+
+void ShardedTableSharedStore::count(int &reachable, int &expired,
+                                    int &persistent) {
+  reachable = expired = persistent = 0;
+  int now = time(NULL);
+  for (int i = 0; i < m_shardCount; i++) {
+    ReadSection rs(m_shards[i]);
+    Table *t = m_shards[i].table;
+    for (size_t b = 0; b <= t->mask; b++) {
+      for (Node *n = t->buckets[b]; n; n = n->next) {
+        reachable += n->value.var->countReachable();
+
+        int64 expiration = n->value.expiry;
+        if (expiration == 0) {
+          persistent++;
+        } else if (expiration <= now) {
+          expired++;
+        }
+      }
+    }
+  }
+}
+
+void ShardedTableSharedStore::dump(std::vector<DumpItem> &items) {
+  for (int i = 0; i < m_shardCount; i++) {
+    ReadSection rs(m_shards[i]);
+    Table *t = m_shards[i].table;
+    for (size_t b = 0; b <= t->mask; b++) {
+      for (Node *n = t->buckets[b]; n; n = n->next) {
+        append_dump_item(items, n->key->data(), n->key->size(),
+                         n->value.var, n->value);
+      }
+    }
+  }
+}
+
+bool ShardedTableSharedStore::get(CStrRef key, Variant &value) {
+  bool stats = RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats;
+  if (key.isNull()) return false;
+
+  size_t hash = hashKey(key);
+  Shard &shard = shardFor(hash);
+  if (stats) atomic_add(shard.reads, (uint64)1);
+  bool found = false;
+  bool expired = false;
+  {
+    ReadSection rs(shard);
+    Node *n = shard.table->find(key.data(), key.size(), hash);
+    if (n) {
+      if (n->value.expired()) {
+        expired = true;
+      } else {
+        value = n->value.var->toLocal();
+        found = true;
+      }
+    }
+  }
+  if (!found) {
+    if (expired) {
+      erase(key, true);
+    }
+    value = false;
+    if (stats) ServerStats::Log(s_apcMiss, 1);
+    return false;
+  }
+  if (stats) ServerStats::Log(s_apcHit, 1);
+  return true;
+}
+
+bool ShardedTableSharedStore::store(CStrRef key, CVarRef val, int64 ttl) {
+  bool stats = RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats;
+  if (key.isNull()) return false;
+
+  SharedVariant* var = construct(key, val);
+  size_t hash = hashKey(key);
+  Shard &shard = shardFor(hash);
+  bool present;
+  {
+    ShardLock lock(shard, stats);
+    present = upsertLocked(shard, key, hash, var, ttl);
+    if (RuntimeOption::ApcExpireOnSets) {
+      if (ttl) {
+        shard.expirationQueue.push(ExpirationPair(key.get()->copy(true),
+                                                  time(NULL) + ttl));
+      }
+      purgeExpiredLocked(shard);
+    }
+    retireLocked(shard);
+  }
+  if (stats) {
+    if (present) {
+      ServerStats::Log(s_apcUpdate, 1);
+    } else {
+      ServerStats::Log(s_apcNew, 1);
+      if (RuntimeOption::EnableStats && RuntimeOption::EnableAPCKeyStats) {
+        string prefix = "apc.new.";
+        prefix += GetSkeleton(key);
+        ServerStats::Log(prefix, 1);
+      }
+    }
+  }
+  return true;
+}
+
+bool ShardedTableSharedStore::eraseImpl(CStrRef key, bool expired) {
+  if (key.isNull()) return false;
+  bool stats = RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats;
+  size_t hash = hashKey(key);
+  Shard &shard = shardFor(hash);
+  ShardLock lock(shard, stats);
+  bool success = eraseLocked(shard, key, hash, expired);
+  retireLocked(shard);
+  return success;
+}
+
+int64 ShardedTableSharedStore::inc(CStrRef key, int64 step, bool &found) {
+  bool stats = RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats;
+  found = false;
+  int64 ret = 0;
+  if (!key.isNull()) {
+    size_t hash = hashKey(key);
+    Shard &shard = shardFor(hash);
+    ShardLock lock(shard, stats);
+    NodePtr *slot = findSlot(shard.table, key, hash);
+    if (slot) {
+      Node *n = *slot;
+      if (n->value.expired()) {
+        eraseLocked(shard, key, hash, true);
+      } else {
+        Variant v = n->value.var->toLocal();
+        ret = v.toInt64() + step;
+        v = ret;
+        replaceLocked(shard, slot, construct(key, v), n->value.expiry);
+        found = true;
+      }
+    }
+    retireLocked(shard);
+  }
+
+  if (stats) {
+    ServerStats::Log(s_apcInc, 1);
+  }
+  return ret;
+}
+
+bool ShardedTableSharedStore::cas(CStrRef key, int64 old, int64 val) {
+  bool stats = RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats;
+  bool success = false;
+  if (!key.isNull()) {
+    size_t hash = hashKey(key);
+    Shard &shard = shardFor(hash);
+    ShardLock lock(shard, stats);
+    NodePtr *slot = findSlot(shard.table, key, hash);
+    if (slot) {
+      Node *n = *slot;
+      if (n->value.expired()) {
+        eraseLocked(shard, key, hash, true);
+      } else {
+        Variant v = n->value.var->toLocal();
+        if (v.toInt64() == old) {
+          v = val;
+          replaceLocked(shard, slot, construct(key, v), n->value.expiry);
+          success = true;
+        }
+      }
+    }
+    retireLocked(shard);
+  }
+
+  if (stats) {
+    ServerStats::Log(s_apcCas, 1);
+  }
+  return success;
+}
+
+void ShardedTableSharedStore::prime
+(const std::vector<SharedStore::KeyValuePair> &vars) {
+  // we are priming, so we are not checking expiration
+  for (unsigned int i = 0; i < vars.size(); i++) {
+    const SharedStore::KeyValuePair &item = vars[i];
+    String k(item.key, item.len, AttachLiteral);
+    size_t hash = hashKey(k);
+    Shard &shard = shardFor(hash);
+    ShardLock lock(shard, false);
+    upsertLocked(shard, k, hash, item.value, 0);
+    retireLocked(shard);
+  }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // SharedStore
 
@@ -783,13 +1390,13 @@ bool LockedSharedStore::get(CStrRef key, Variant &value) {
     }
     value = false;
     if (stats) {
-      ServerStats::Log("apc.miss", 1);
+      ServerStats::Log(s_apcMiss, 1);
     }
     return false;
   }
   value = getVar(val->var)->toLocal();
   readUnlockMap();
-  if (stats) ServerStats::Log("apc.hit", 1);
+  if (stats) ServerStats::Log(s_apcHit, 1);
   return true;
 }
 
@@ -802,7 +1409,7 @@ bool ConcurrentTableSharedStore::get(CStrRef key, Variant &value) {
  {
    Map::const_accessor acc;
    if (!m_vars.find(acc, key.get())) {
-     if (stats) ServerStats::Log("apc.miss", 1);
+     if (stats) ServerStats::Log(s_apcMiss, 1);
      return false;
    } else {
      val = &acc->second;
@@ -817,13 +1424,13 @@ bool ConcurrentTableSharedStore::get(CStrRef key, Variant &value) {
  }
  if (expired) {
    if (stats) {
-     ServerStats::Log("apc.miss", 1);
+     ServerStats::Log(s_apcMiss, 1);
    }
    eraseImpl(key, true);
    return false;
  }
  if (stats) {
-   ServerStats::Log("apc.hit", 1);
+   ServerStats::Log(s_apcHit, 1);
  }
  return true;
 }
@@ -847,10 +1454,10 @@ bool LfuTableSharedStore::get(CStrRef key, Variant &value) {
       erase(key, true);
     }
     value = false;
-    if (stats) ServerStats::Log("apc.miss", 1);
+    if (stats) ServerStats::Log(s_apcMiss, 1);
     return false;
   }
-  if (stats) ServerStats::Log("apc.hit", 1);
+  if (stats) ServerStats::Log(s_apcHit, 1);
   return true;
 }
 
@@ -864,11 +1471,11 @@ bool LockedSharedStore::store(CStrRef key, CVarRef val, int64 ttl) {
   if (find(key, sval, expired) || expired) {
     getVar(sval->var)->decRef();
     sval->set(putVar(var), ttl);
-    if (stats) ServerStats::Log("apc.update", 1);
+    if (stats) ServerStats::Log(s_apcUpdate, 1);
   } else {
     set(key, var, ttl);
     if (stats) {
-      ServerStats::Log("apc.new", 1);
+      ServerStats::Log(s_apcNew, 1);
       if (RuntimeOption::EnableStats && RuntimeOption::EnableAPCKeyStats) {
         string prefix = "apc.new.";
         prefix += GetSkeleton(key);
@@ -911,9 +1518,9 @@ bool ConcurrentTableSharedStore::store(CStrRef key, CVarRef val, int64 ttl) {
   }
   if (stats) {
     if (present) {
-      ServerStats::Log("apc.update", 1);
+      ServerStats::Log(s_apcUpdate, 1);
     } else {
-      ServerStats::Log("apc.new", 1);
+      ServerStats::Log(s_apcNew, 1);
       if (RuntimeOption::EnableStats && RuntimeOption::EnableAPCKeyStats) {
         string prefix = "apc.new.";
         prefix += GetSkeleton(key);
@@ -936,12 +1543,12 @@ bool LfuTableSharedStore::store(CStrRef key, CVarRef val, int64 ttl) {
       if (!newlyCreated) {
         val.var->decRef();
         val.set(var, ttl);
-        if (stats) ServerStats::Log("apc.update", 1);
+        if (stats) ServerStats::Log(s_apcUpdate, 1);
         delete newkey;
       } else {
         val.set(var, ttl);
         if (stats) {
-          ServerStats::Log("apc.new", 1);
+          ServerStats::Log(s_apcNew, 1);
           if (RuntimeOption::EnableStats && RuntimeOption::EnableAPCKeyStats) {
             string prefix = "apc.new.";
             prefix += GetSkeleton(key);
@@ -1003,7 +1610,7 @@ bool SharedStore::erase(CStrRef key, bool expired /* = false */) {
   bool success = eraseImpl(key, expired);
 
   if (RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats) {
-    ServerStats::Log(success ? "apc.erased" : "apc.erase", 1);
+    ServerStats::Log(success ? s_apcErased : s_apcErase, 1);
   }
   return success;
 }
@@ -1036,7 +1643,7 @@ int64 LockedSharedStore::inc(CStrRef key, int64 step, bool &found) {
   }
 
   if (RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats) {
-    ServerStats::Log("apc.inc", 1);
+    ServerStats::Log(s_apcInc, 1);
   }
   return ret;
 }
@@ -1066,7 +1673,7 @@ int64 ConcurrentTableSharedStore::inc(CStrRef key, int64 step, bool &found) {
   }
 
   if (RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats) {
-    ServerStats::Log("apc.inc", 1);
+    ServerStats::Log(s_apcInc, 1);
   }
   return ret;
 }
@@ -1104,7 +1711,7 @@ int64 LfuTableSharedStore::inc(CStrRef key, int64 step, bool &found) {
   m_vars.atomicUpdate(key.get(), updater, false);
 
   if (RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats) {
-    ServerStats::Log("apc.inc", 1);
+    ServerStats::Log(s_apcInc, 1);
   }
   return updater.ret;
 }
@@ -1130,7 +1737,7 @@ bool LockedSharedStore::cas(CStrRef key, int64 old, int64 val) {
   }
 
   if (RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats) {
-    ServerStats::Log("apc.cas", 1);
+    ServerStats::Log(s_apcCas, 1);
   }
   return success;
 }
@@ -1156,7 +1763,7 @@ bool ConcurrentTableSharedStore::cas(CStrRef key, int64 old, int64 val) {
   }
 
   if (RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats) {
-    ServerStats::Log("apc.cas", 1);
+    ServerStats::Log(s_apcCas, 1);
   }
   return success;
 }
@@ -1192,7 +1799,7 @@ bool LfuTableSharedStore::cas(CStrRef key, int64 old, int64 val) {
   m_vars.atomicUpdate(key.get(), updater, false);
 
   if (RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats) {
-    ServerStats::Log("apc.cas", 1);
+    ServerStats::Log(s_apcCas, 1);
   }
   return updater.success;
 }
@@ -1229,6 +1836,31 @@ std::string LfuTableSharedStore::reportStats(int &reachable, int indent) {
   return ret;
 }
 
+std::string ShardedTableSharedStore::reportStats(int &reachable,
+                                                 int indent) {
+  string ret = SharedStore::reportStats(reachable, indent);
+  ret += appendElement(indent, "Shards", m_shardCount);
+  for (int i = 0; i < m_shardCount; i++) {
+    Shard &shard = m_shards[i];
+    int keys;
+    {
+      ReadSection rs(shard);
+      keys = shard.table->count;
+    }
+    for (int j = 0; j < indent; j++) ret += "  ";
+    ret += "<Shard>\n";
+    ret += appendElement(indent + 1, "Index", i);
+    ret += appendElement(indent + 1, "Key", keys);
+    ret += appendElement(indent + 1, "Reads", shard.reads);
+    ret += appendElement(indent + 1, "Writes", shard.writes);
+    ret += appendElement(indent + 1, "ContendedWrites", shard.contended);
+    ret += appendElement(indent + 1, "GraceWaits", shard.graceWaits);
+    for (int j = 0; j < indent; j++) ret += "  ";
+    ret += "</Shard>\n";
+  }
+  return ret;
+}
+
 void StoreValue::set(SharedVariant *v, int64 ttl) {
   var = v;
   expiry = ttl ? time(NULL) + ttl : 0;
@@ -1278,6 +1910,9 @@ void SharedStores::create() {
       case RuntimeOption::ApcConcurrentTable:
         m_stores[i] = new ConcurrentTableSharedStore(i);
         break;
+      case RuntimeOption::ApcShardedTable:
+        m_stores[i] = new ShardedTableSharedStore(i);
+        break;
       default:
         ASSERT(false);
       }
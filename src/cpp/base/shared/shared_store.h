@@ -65,6 +65,14 @@ public:
   };
   virtual void prime(const std::vector<KeyValuePair> &vars) = 0;
 
+  // for apc_bin_dump; var is incRef-ed and has to be decRef-ed by caller
+  struct DumpItem {
+    std::string key;
+    SharedVariant *var;
+    int64 expiry;
+  };
+  virtual void dump(std::vector<DumpItem> &items) = 0;
+
   virtual std::string reportStats(int &reachable, int indent);
   virtual bool check() { return true; }
   static size_t s_lockCount;
@@ -0,0 +1,278 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+
+#include <cpp/base/shared/shared_store_snapshot.h>
+#include <cpp/base/builtin_functions.h>
+#include <cpp/base/util/string_buffer.h>
+#include <util/atomic.h>
+#include <util/logger.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+using namespace std;
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+const char SharedStoreSnapshot::Magic[8] = {'H','P','H','P','A','P','C','\0'};
+
+SharedStoreSnapshot::SharedStoreSnapshot() : m_pending(0) {
+}
+
+SharedStoreSnapshot::~SharedStoreSnapshot() {
+  clear();
+}
+
+SharedStoreSnapshot::Stripe &
+SharedStoreSnapshot::stripeFor(const char *key, int len) {
+  return m_stripes[(uint64)hash_string(key, len) % StripeCount];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// dumping
+
+String SharedStoreSnapshot::dump(SharedStore &store,
+                                 const std::set<std::string> *keys) {
+  vector<SharedStore::DumpItem> items;
+  store.dump(items);
+
+  // serialize outside of any store lock
+  vector<SnapshotEntry> entries;
+  vector<string> blobs;
+  set<string> dumped;
+  entries.reserve(items.size());
+  blobs.reserve(items.size() * 2);
+  for (unsigned int i = 0; i < items.size(); i++) {
+    SharedStore::DumpItem &item = items[i];
+    if (!keys || keys->find(item.key) != keys->end()) {
+      String value = f_serialize(item.var->toLocal());
+      SnapshotEntry entry;
+      entry.keyLen = item.key.size();
+      entry.valueLen = value.size();
+      entry.expiry = item.expiry;
+      entries.push_back(entry);
+      blobs.push_back(item.key);
+      blobs.push_back(string(value.data(), value.size()));
+      dumped.insert(item.key);
+    }
+    item.var->decRef();
+  }
+  for (int i = 0; i < StripeCount; i++) {
+    Lock lock(m_stripes[i].mutex);
+    PendingMap &values = m_stripes[i].values;
+    for (PendingMap::const_iterator iter = values.begin();
+         iter != values.end(); ++iter) {
+      if (dumped.find(iter->first) != dumped.end()) continue;
+      if (keys && keys->find(iter->first) == keys->end()) continue;
+      SnapshotEntry entry;
+      entry.keyLen = iter->first.size();
+      entry.valueLen = iter->second.len;
+      entry.expiry = iter->second.expiry;
+      entries.push_back(entry);
+      blobs.push_back(iter->first);
+      blobs.push_back(string(iter->second.data, iter->second.len));
+    }
+  }
+
+  SnapshotHeader header;
+  memcpy(header.magic, Magic, sizeof(header.magic));
+  header.version = Version;
+  header.count = entries.size();
+  header.created = time(NULL);
+
+  uint64 offset = sizeof(header) + sizeof(SnapshotEntry) * entries.size();
+  for (unsigned int i = 0; i < entries.size(); i++) {
+    entries[i].keyOffset = offset;
+    offset += entries[i].keyLen;
+    entries[i].valueOffset = offset;
+    offset += entries[i].valueLen;
+  }
+
+  StringBuffer sb(offset);
+  sb.append((const char *)&header, sizeof(header));
+  if (!entries.empty()) {
+    sb.append((const char *)&entries[0],
+              sizeof(SnapshotEntry) * entries.size());
+  }
+  for (unsigned int i = 0; i < blobs.size(); i++) {
+    sb.append(blobs[i].data(), blobs[i].size());
+  }
+  return sb.detach();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// loading
+
+bool SharedStoreSnapshot::load(const char *data, int64 size) {
+  Region region;
+  region.addr = malloc(size);
+  region.size = size;
+  region.mapped = false;
+  memcpy(region.addr, data, size);
+  if (!loadRegion(region)) {
+    free(region.addr);
+    return false;
+  }
+  return true;
+}
+
+bool SharedStoreSnapshot::loadFile(const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    Logger::Warning("Unable to open apc snapshot %s", filename);
+    return false;
+  }
+  struct stat sb;
+  if (fstat(fd, &sb) != 0 || sb.st_size == 0) {
+    close(fd);
+    Logger::Warning("Unable to read apc snapshot %s", filename);
+    return false;
+  }
+  Region region;
+  region.addr = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  region.size = sb.st_size;
+  region.mapped = true;
+  close(fd);
+  if (region.addr == MAP_FAILED) {
+    Logger::Warning("Unable to mmap apc snapshot %s", filename);
+    return false;
+  }
+  if (!loadRegion(region)) {
+    munmap(region.addr, region.size);
+    Logger::Warning("Invalid apc snapshot %s", filename);
+    return false;
+  }
+  return true;
+}
+
+bool SharedStoreSnapshot::loadRegion(const Region &region) {
+  const char *base = (const char *)region.addr;
+  if (region.size < sizeof(SnapshotHeader)) return false;
+  const SnapshotHeader *header = (const SnapshotHeader *)base;
+  if (memcmp(header->magic, Magic, sizeof(Magic)) != 0 ||
+      header->version != Version) {
+    return false;
+  }
+  uint64 indexEnd = sizeof(SnapshotHeader) +
+    (uint64)header->count * sizeof(SnapshotEntry);
+  if (indexEnd > region.size) return false;
+
+  // validate the whole index before publishing anything from it
+  const SnapshotEntry *entries =
+    (const SnapshotEntry *)(base + sizeof(SnapshotHeader));
+  for (uint32 i = 0; i < header->count; i++) {
+    const SnapshotEntry &entry = entries[i];
+    // offsets are checked first, so a corrupt one can't wrap the sums
+    if (entry.keyOffset < indexEnd || entry.keyOffset > region.size ||
+        entry.keyLen > region.size - entry.keyOffset ||
+        entry.valueOffset < indexEnd || entry.valueOffset > region.size ||
+        entry.valueLen > region.size - entry.valueOffset) {
+      return false;
+    }
+  }
+
+  // held throughout, so clear() can't release region under us
+  Lock regionLock(m_regionMutex);
+  m_regions.push_back(region);
+
+  time_t now = time(NULL);
+  for (uint32 i = 0; i < header->count; i++) {
+    const SnapshotEntry &entry = entries[i];
+    if (entry.expiry && entry.expiry <= now) continue;
+
+    const char *key = base + entry.keyOffset;
+    Stripe &stripe = stripeFor(key, entry.keyLen);
+    Lock lock(stripe.mutex);
+    pair<PendingMap::iterator, bool> res =
+      stripe.values.insert(PendingMap::value_type(string(key, entry.keyLen),
+                                                  PendingValue()));
+    if (res.second) atomic_inc(m_pending);
+    PendingValue &value = res.first->second;
+    value.data = base + entry.valueOffset;
+    value.len = entry.valueLen;
+    value.expiry = entry.expiry;
+  }
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// materializing
+
+bool SharedStoreSnapshot::materialize(SharedStore &store, CStrRef key,
+                                      Variant &value) {
+  if (!pending()) return false;
+
+  Stripe &stripe = stripeFor(key.data(), key.size());
+  // Held until the value is in store, so a concurrent forget() + store()
+  // of the same key can't be overwritten by this older value.
+  Lock lock(stripe.mutex);
+  PendingMap::iterator iter =
+    stripe.values.find(string(key.data(), key.size()));
+  if (iter == stripe.values.end()) return false;
+  PendingValue pv = iter->second;
+  stripe.values.erase(iter);
+  atomic_dec(m_pending);
+
+  int64 ttl = 0;
+  if (pv.expiry) {
+    ttl = pv.expiry - time(NULL);
+    if (ttl <= 0) return false;
+  }
+  // values aren't NUL-terminated in the snapshot
+  value = f_unserialize(String(pv.data, pv.len, CopyString));
+  store.store(key, value, ttl);
+  return true;
+}
+
+bool SharedStoreSnapshot::forget(CStrRef key) {
+  if (!pending()) return false;
+
+  Stripe &stripe = stripeFor(key.data(), key.size());
+  Lock lock(stripe.mutex);
+  if (stripe.values.erase(string(key.data(), key.size()))) {
+    atomic_dec(m_pending);
+    return true;
+  }
+  return false;
+}
+
+void SharedStoreSnapshot::clear() {
+  Lock regionLock(m_regionMutex);
+  for (int i = 0; i < StripeCount; i++) {
+    m_stripes[i].mutex.lock();
+  }
+  for (int i = 0; i < StripeCount; i++) {
+    m_stripes[i].values.clear();
+  }
+  m_pending = 0;
+  for (unsigned int i = 0; i < m_regions.size(); i++) {
+    Region &region = m_regions[i];
+    if (region.mapped) {
+      munmap(region.addr, region.size);
+    } else {
+      free(region.addr);
+    }
+  }
+  m_regions.clear();
+  for (int i = StripeCount - 1; i >= 0; i--) {
+    m_stripes[i].mutex.unlock();
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,132 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+
+#ifndef __HPHP_SHARED_STORE_SNAPSHOT_H__
+#define __HPHP_SHARED_STORE_SNAPSHOT_H__
+
+#include <cpp/base/shared/shared_store.h>
+#include <util/lock.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Binary APC snapshot written by apc_bin_dump(). The layout is a fixed-size
+ * header, an index of fixed-size entries, and then a blob of keys and
+ * serialized values:
+ *
+ *   SnapshotHeader
+ *   SnapshotEntry[count]
+ *   key and value bytes, addressed by offsets from the start of the buffer
+ *
+ * Loading only reads the index. Values stay serialized in the buffer, which
+ * is mmap-ed for files, until a key is first fetched, at which point it is
+ * unserialized and stored into the SharedStore.
+ */
+class SharedStoreSnapshot {
+public:
+  struct SnapshotHeader {
+    char magic[8];
+    uint32 version;
+    uint32 count;
+    int64 created;
+  };
+
+  struct SnapshotEntry {
+    uint64 keyOffset;
+    uint64 valueOffset;
+    uint32 keyLen;
+    uint32 valueLen;
+    int64 expiry; // absolute time; 0 for persistent keys
+  };
+
+  static const char Magic[8];
+  static const uint32 Version = 1;
+
+  /**
+   * Writes out everything in store, plus whatever is still pending in this
+   * snapshot, so a box that never touched some keys doesn't lose them on
+   * the next dump. If keys is not NULL, only those keys are written.
+   */
+  String dump(SharedStore &store, const std::set<std::string> *keys);
+
+public:
+  SharedStoreSnapshot();
+  ~SharedStoreSnapshot();
+
+  /**
+   * Loads a snapshot from memory (copied) or from a file (mmap-ed). Keys
+   * loaded later take precedence over pending keys from earlier loads.
+   */
+  bool load(const char *data, int64 size);
+  bool loadFile(const char *filename);
+
+  /**
+   * Whether any key is still waiting to be materialized. Cheap enough to
+   * guard every APC call with.
+   */
+  bool pending() const { return m_pending > 0; }
+
+  /**
+   * Stores key's snapshot value into store if it hasn't been fetched yet.
+   * Returns true and sets value if there was one.
+   */
+  bool materialize(SharedStore &store, CStrRef key, Variant &value);
+
+  /**
+   * Drops key's snapshot value, as it's being overwritten or deleted.
+   * Returns true if there was one.
+   */
+  bool forget(CStrRef key);
+
+  void clear();
+
+private:
+  struct PendingValue {
+    const char *data;
+    uint32 len;
+    int64 expiry;
+  };
+  typedef hphp_string_map<PendingValue> PendingMap;
+
+  // keys are striped so first fetches of different keys don't serialize
+  static const int StripeCount = 16;
+  struct Stripe {
+    Mutex mutex;
+    PendingMap values;
+  };
+
+  struct Region {
+    void *addr;
+    size_t size;
+    bool mapped;
+  };
+
+  Stripe m_stripes[StripeCount];
+  int m_pending;
+
+  Mutex m_regionMutex; // acquired before any stripe's mutex
+  std::vector<Region> m_regions;
+
+  Stripe &stripeFor(const char *key, int len);
+  bool loadRegion(const Region &region);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif /* __HPHP_SHARED_STORE_SNAPSHOT_H__ */
@@ -40,5 +40,13 @@ int SharedVariant::countReachable() {
   return count;
 }
 
+int SharedVariant::getIndex(int64 key) {
+  return getIndex(Variant(key));
+}
+
+int SharedVariant::getIndex(const char *key, int len, int64 prehash) {
+  return getIndex(Variant(String(key, len, AttachLiteral)));
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 }
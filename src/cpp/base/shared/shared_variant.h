@@ -54,6 +54,8 @@ public:
   virtual size_t arrSize() const = 0;
 
   virtual int getIndex(CVarRef key) = 0;
+  virtual int getIndex(int64 key);
+  virtual int getIndex(const char *key, int len, int64 prehash);
   virtual SharedVariant* get(CVarRef key) = 0;
   virtual bool exists(CVarRef key) = 0;
   virtual void loadElems(std::vector<ArrayElement *> &elems) = 0;
@@ -24,14 +24,36 @@ using namespace std;
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 
-ThreadSharedVariant::ThreadSharedVariant(StringData *source) : m_owner(false) {
-  m_type = KindOfString;
-  m_data.str = source;
+ThreadSharedVariantMapData::ThreadSharedVariantMapData(size_t n) : size(n) {
+  size_t cap = 1;
+  while (cap < n * 2) cap <<= 1;
+  mask = cap - 1;
+  keys = new SharedVariant*[n];
+  vals = new SharedVariant*[n];
+  hashes = new int64[n];
+  index = new int[cap];
+  for (size_t i = 0; i < cap; i++) index[i] = -1;
 }
 
-ThreadSharedVariant::ThreadSharedVariant(int64 num) : m_owner(false) {
-  m_type = KindOfInt64;
-  m_data.num = num;
+ThreadSharedVariantMapData::~ThreadSharedVariantMapData() {
+  for (size_t i = 0; i < size; i++) {
+    keys[i]->decRef();
+    vals[i]->decRef();
+  }
+  delete [] keys;
+  delete [] vals;
+  delete [] hashes;
+  delete [] index;
+}
+
+void ThreadSharedVariantMapData::add(size_t pos, SharedVariant *key,
+                                     SharedVariant *val, int64 hash) {
+  keys[pos] = key;
+  vals[pos] = val;
+  hashes[pos] = hash;
+  size_t i = hash & mask;
+  while (index[i] >= 0) i = (i + 1) & mask;
+  index[i] = pos;
 }
 
 ThreadSharedVariant::ThreadSharedVariant(CVarRef source, bool serialized)
@@ -74,10 +96,8 @@ ThreadSharedVariant::ThreadSharedVariant(CVarRef source, bool serialized)
     {
       m_type = KindOfArray;
       size_t size = source.getArrayData()->size();
-      ThreadSharedVariantMapData* mapData = new ThreadSharedVariantMapData();
-      ThreadSharedVariantToIntMap map;
-      SharedVariant** keys = new SharedVariant*[size];
-      SharedVariant** vals = new SharedVariant*[size];
+      ThreadSharedVariantMapData* mapData =
+        new ThreadSharedVariantMapData(size);
 
       uint i = 0;
       for (ArrayIterPtr it = source.begin(); !it->end(); it->next()) {
@@ -85,21 +105,16 @@ ThreadSharedVariant::ThreadSharedVariant(CVarRef source, bool serialized)
           = createAnother(it->first(), false);
         ThreadSharedVariant* val
           = createAnother(it->second(), false);
-        keys[i] = key;
-        vals[i] = val;
-        map[key] = i++;
+        mapData->add(i++, key, val, key->hash());
       }
       m_data.map = mapData;
-      mapData->map.swap(map);
-      mapData->keys = keys;
-      mapData->vals = vals;
       break;
     }
   default:
     {
       m_type = KindOfObject;
       String s = f_serialize(source);
-      m_data.str = new StringData(s.data(), s.size(), CopyString);
+      m_data.str = s->copy(true);
       break;
     }
   }
@@ -179,18 +194,8 @@ ThreadSharedVariant::~ThreadSharedVariant() {
     }
     break;
   case KindOfArray:
-    {
-      ASSERT(m_owner);
-      ThreadSharedVariantMapData* map = m_data.map;
-      size_t size = map->map.size();
-      for (size_t i = 0; i < size; i++) {
-        map->keys[i]->decRef();
-        map->vals[i]->decRef();
-      }
-      delete [] map->keys;
-      delete [] map->vals;
-      delete map;
-    }
+    ASSERT(m_owner);
+    delete m_data.map;
     break;
   default:
     break;
@@ -243,9 +248,6 @@ size_t ThreadSharedVariant::stringLength() const {
   return m_data.str->size();
 }
 
-const ThreadSharedVariantToIntMap &ThreadSharedVariant::map() const {
-  return m_data.map->map;
-}
 SharedVariant** ThreadSharedVariant::keys() const {
   return m_data.map->keys;
 }
@@ -254,16 +256,61 @@ SharedVariant** ThreadSharedVariant::vals() const {
 }
 
 size_t ThreadSharedVariant::arrSize() const {
-  return map().size();
+  return m_data.map->size;
 }
 
-int ThreadSharedVariant::getIndex(CVarRef key) {
+int ThreadSharedVariant::getIndex(int64 key) {
+  ASSERT(is(KindOfArray));
+  ThreadSharedVariantMapData *map = m_data.map;
+  int64 hash = hash_int64(key);
+  for (size_t i = hash & map->mask; ; i = (i + 1) & map->mask) {
+    int pos = map->index[i];
+    if (pos < 0) return -1;
+    if (map->hashes[pos] == hash) {
+      ThreadSharedVariant *k = (ThreadSharedVariant*)map->keys[pos];
+      if (k->m_type == KindOfInt64 && k->m_data.num == key) {
+        return pos;
+      }
+    }
+  }
+}
+
+int ThreadSharedVariant::getIndex(const char *key, int len, int64 prehash) {
   ASSERT(is(KindOfArray));
-  ThreadSharedVariantToIntMap::const_iterator it = lookup(key);
-  if (it == map().end()) {
+  ThreadSharedVariantMapData *map = m_data.map;
+  int64 hash = prehash < 0 ? hash_string(key, len) : prehash;
+  for (size_t i = hash & map->mask; ; i = (i + 1) & map->mask) {
+    int pos = map->index[i];
+    if (pos < 0) return -1;
+    if (map->hashes[pos] == hash) {
+      ThreadSharedVariant *k = (ThreadSharedVariant*)map->keys[pos];
+      if (k->m_type == KindOfString && k->m_data.str->size() == len &&
+          memcmp(k->m_data.str->data(), key, len) == 0) {
+        return pos;
+      }
+    }
+  }
+}
+
+int ThreadSharedVariant::getIndex(CVarRef key) {
+  switch (key.getType()) {
+  case KindOfString: {
+    StringData *sd = key.getStringData();
+    return getIndex(sd->data(), sd->size(), -1);
+  }
+  case LiteralString: {
+    litstr s = key.getLiteralString();
+    return getIndex(s, strlen(s), -1);
+  }
+  case KindOfByte:
+  case KindOfInt16:
+  case KindOfInt32:
+  case KindOfInt64:
+    return getIndex(key.getNumData());
+  default:
+    // No other types are legitimate keys
     return -1;
   }
-  return it->second;
 }
 
 SharedVariant* ThreadSharedVariant::get(CVarRef key) {
@@ -276,15 +323,14 @@ SharedVariant* ThreadSharedVariant::get(CVarRef key) {
 
 bool ThreadSharedVariant::exists(CVarRef key) {
   ASSERT(is(KindOfArray));
-  ThreadSharedVariantToIntMap::const_iterator it = lookup(key);
-  return it != map().end();
+  return getIndex(key) != -1;
 }
 
 void ThreadSharedVariant::loadElems(std::vector<ArrayElement *> &elems) {
   ASSERT(is(KindOfArray));
   SharedVariant** ks = keys();
   SharedVariant** vs = vals();
-  uint count = map().size();
+  uint count = arrSize();
   elems.reserve(count);
   for (uint i = 0; i < count; i++) {
     elems.push_back(NEW(ArrayElement)(ks[i]->toLocal(),
@@ -292,42 +338,6 @@ void ThreadSharedVariant::loadElems(std::vector<ArrayElement *> &elems) {
   }
 }
 
-ThreadSharedVariantToIntMap::const_iterator
-ThreadSharedVariant::lookup(CVarRef key) {
-  ThreadSharedVariantToIntMap::const_iterator it;
-  switch (key.getType()) {
-  case KindOfString: {
-    ThreadSharedVariant svk(key.getStringData());
-    it = map().find(&svk);
-    break;
-  }
-  case LiteralString: {
-    StringData sd(key.getLiteralString(), AttachLiteral);
-    ThreadSharedVariant svk(&sd);
-    it = map().find(&svk);
-    break;
-  }
-  case KindOfByte:
-  case KindOfInt16:
-  case KindOfInt32:
-  case KindOfInt64: {
-    int64 num = key.getNumData();
-    ThreadSharedVariant svk(num);
-    it = map().find(&svk);
-    break;
-  }
-  default:
-    // No other types are legitimate keys
-    it = map().end();
-    break;
-  }
-  return it;
-}
-
-size_t ThreadSharedVariantHash::operator()(ThreadSharedVariant* v) const {
-  return v->hash();
-}
-
 ThreadSharedVariant *ThreadSharedVariant::createAnother
 (CVarRef source, bool serialized) {
   return new ThreadSharedVariant(source, serialized);
@@ -27,27 +27,6 @@ namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 
 class ThreadSharedVariantMapData;
-class ThreadSharedVariant;
-struct ThreadSharedVariantHash;
-
-template<class T>
-class ptreq {
-public:
-  bool operator()(const T& x, const T& y) const {
-    if (x && y) {
-      return *x == *y;
-    }
-    return x == y;
-  }
-};
-
-class ThreadSharedVariantHash {
-public:
-  size_t operator()(ThreadSharedVariant* v) const;
-};
-
-typedef hphp_hash_map<ThreadSharedVariant*, int, ThreadSharedVariantHash,
-                      ptreq<ThreadSharedVariant*> > ThreadSharedVariantToIntMap;
 
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -76,6 +55,8 @@ class ThreadSharedVariant : public SharedVariant {
 
   size_t arrSize() const;
   int getIndex(CVarRef key);
+  int getIndex(int64 key);
+  int getIndex(const char *key, int len, int64 prehash);
   SharedVariant* get(CVarRef key);
   bool exists(CVarRef key);
 
@@ -105,20 +86,28 @@ private:
   } m_data;
   bool m_owner;
 
-  const ThreadSharedVariantToIntMap &map() const;
   SharedVariant** keys() const;
   SharedVariant** vals() const;
-
-  ThreadSharedVariant(StringData *source);
-  ThreadSharedVariant(int64 num);
-  ThreadSharedVariantToIntMap::const_iterator lookup(CVarRef key);
 };
 
+/**
+ * Immutable array layout: keys and values by position, plus an
+ * open-addressed index of positions keyed by each key's precomputed hash,
+ * so a lookup hashes the probe key once and allocates nothing.
+ */
 class ThreadSharedVariantMapData {
 public:
-  ThreadSharedVariantToIntMap map;
+  ThreadSharedVariantMapData(size_t n);
+  ~ThreadSharedVariantMapData();
+
+  void add(size_t pos, SharedVariant *key, SharedVariant *val, int64 hash);
+
+  size_t size;
   SharedVariant** keys;
   SharedVariant** vals;
+  int64 *hashes; // by position
+  int *index;    // positions by hash slot, -1 if empty
+  size_t mask;
 };
 
 class ThreadSharedVariantLockedRefs : public ThreadSharedVariant {
@@ -23,6 +23,7 @@
 #include <cpp/base/zend/zend_strtod.h>
 #include <cpp/base/type_string.h>
 #include <cpp/base/runtime_option.h>
+#include <cpp/base/memory/memory_manager.h>
 
 namespace HPHP {
 
@@ -46,12 +47,50 @@ StringData::StringData(const char *data, int len, StringDataMode mode)
   assign(data, len, mode);
 }
 
+StringData::StringData(const char *s1, int len1, const char *s2, int len2)
+  : m_len(0), m_data(NULL), m_shared(NULL) {
+  ASSERT(len1 >= 0 && len2 >= 0);
+  int len = len1 + len2;
+  if (len == 0) {
+    m_len = IsLiteral;
+    m_data = "";
+    return;
+  }
+  if (len < 0 || (len & IsMask)) {
+    throw InvalidArgumentException("len", len);
+  }
+  char *buf = allocData(len);
+  memcpy(buf, s1, len1);
+  memcpy(buf + len1, s2, len2);
+  buf[len] = '\0';
+  m_data = buf;
+}
+
 StringData::~StringData() {
   releaseData();
 }
 
+/**
+ * Allocates len + 1 bytes for m_data, setting m_len to len. Memory comes from
+ * MemoryManager's RequestArena whenever possible, so it doesn't need to be
+ * freed. Only call this on smart allocated StringData, since shared ones
+ * outlive the request.
+ */
+char *StringData::allocData(int len) {
+  RequestArena *arena = MemoryManager::TheMemoryManager()->getArena();
+  if (arena) {
+    char *buf = arena->alloc(len + 1);
+    if (buf) {
+      m_len = len | IsArena;
+      return buf;
+    }
+  }
+  m_len = len;
+  return (char*)malloc(len + 1);
+}
+
 void StringData::releaseData() {
-  if ((m_len & (IsLinear | IsLiteral)) == 0) {
+  if ((m_len & (IsLinear | IsLiteral | IsArena)) == 0) {
     if (isShared()) {
       m_shared->decRef();
     } else if (m_data) {
@@ -81,7 +120,7 @@ void StringData::assign(const char *data, int len, StringDataMode mode) {
     switch (mode) {
     case CopyString:
       {
-        char *buf = (char*)malloc(len + 1);
+        char *buf = allocData(len);
         buf[len] = '\0';
         memcpy(buf, data, len);
         m_data = buf;
@@ -127,13 +166,32 @@ void StringData::append(const char *s, int len) {
     throw InvalidArgumentException("len", len);
   }
 
+  int dataLen = size();
+  if (isArena()) {
+    // old memory stays valid in the arena, even if s points into it
+    RequestArena *arena = MemoryManager::TheMemoryManager()->getArena();
+    ASSERT(arena);
+    char *buf = arena->realloc((char*)m_data, dataLen + 1, dataLen + len + 1);
+    if (buf) {
+      memcpy(buf + dataLen, s, len);
+      m_len = (dataLen + len) | IsArena;
+      buf[dataLen + len] = '\0';
+      m_data = buf;
+      return;
+    }
+  }
+
   if (!isMalloced()) {
-    int newlen;
-    m_data = string_concat(data(), size(), s, len, newlen);
-    if (isShared()) {
-      m_shared->decRef();
+    const char *oldData = m_data;
+    SharedVariant *shared = isShared() ? m_shared : NULL;
+    char *buf = allocData(dataLen + len);
+    memcpy(buf, oldData, dataLen);
+    memcpy(buf + dataLen, s, len);
+    buf[dataLen + len] = '\0';
+    m_data = buf;
+    if (shared) {
+      shared->decRef();
     }
-    m_len = newlen;
   } else if (m_data == s) {
     int newlen;
     char *newdata = string_concat(data(), size(), s, len, newlen);
@@ -141,7 +199,6 @@ void StringData::append(const char *s, int len) {
     m_data = newdata;
     m_len = newlen;
   } else {
-    int dataLen = size();
     ASSERT((m_data > s && m_data - s > len) ||
            (m_data < s && s - m_data > dataLen)); // no overlapping
     m_len = len + dataLen;
@@ -156,7 +213,12 @@ StringData *StringData::copy(bool sharedMemory /* = false */) const {
     if (isLiteral()) {
       return new StringData(m_data, size(), AttachLiteral);
     }
-    return new StringData(m_data, size(), CopyString);
+    // shared memory outlives the request, so it can't use RequestArena
+    int len = size();
+    char *buf = (char*)malloc(len + 1);
+    memcpy(buf, m_data, len);
+    buf[len] = '\0';
+    return new StringData(buf, len, AttachString);
   } else {
     if (isLiteral()) {
       return NEW(StringData)(m_data, size(), AttachLiteral);
@@ -171,10 +233,10 @@ void StringData::escalate() {
   int len = size();
   ASSERT(len);
 
-  char *buf = (char*)malloc(len+1);
-  memcpy(buf, data(), len);
+  const char *oldData = m_data;
+  char *buf = allocData(len);
+  memcpy(buf, oldData, len);
   buf[len] = '\0';
-  m_len = len;
   m_data = buf;
 }
 
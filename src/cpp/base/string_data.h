@@ -38,8 +38,9 @@ private:
     IsLiteral = (1 << 31), // literal string
     IsShared  = (1 << 30), // shared memory string
     IsLinear  = (1 << 29), // linear allocator's memory
+    IsArena   = (1 << 28), // request arena's memory
 
-    IsMask = IsLiteral | IsShared | IsLinear,
+    IsMask = IsLiteral | IsShared | IsLinear | IsArena,
     LenMask = ~IsMask,
   };
 
@@ -54,6 +55,7 @@ public:
   StringData(const char *data, StringDataMode mode = AttachLiteral);
   StringData(const char *data, int len, StringDataMode mode);
   StringData(SharedVariant *shared);
+  StringData(const char *s1, int len1, const char *s2, int len2); // concat
   void assign(const char *data, StringDataMode mode);
   void assign(const char *data, int len, StringDataMode mode);
   void assign(SharedVariant *shared);
@@ -71,6 +73,7 @@ public:
   bool isLiteral() const { return m_len & IsLiteral;}
   bool isShared() const { return m_len & IsShared;}
   bool isLinear() const { return m_len & IsLinear;}
+  bool isArena() const { return m_len & IsArena;}
   bool isMalloced() const { return (m_len & IsMask) == 0 && m_data;}
   bool isImmutable() const { return m_len & (IsLiteral | IsShared | IsLinear);}
   bool isNumeric() const;
@@ -122,6 +125,7 @@ public:
   SharedVariant *m_shared;
 
   void releaseData();
+  char *allocData(int len);
 
   /**
    * Helpers.
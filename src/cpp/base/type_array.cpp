@@ -42,7 +42,8 @@ namespace HPHP {
 
 const Array Array::s_nullArray = Array();
 
-IMPLEMENT_SMART_ALLOCATION_NOCALLBACKS(Array);
+// rarely allocated on their own
+IMPLEMENT_SMART_ALLOCATION_NOCALLBACKS_ITEMS(Array, 128);
 ///////////////////////////////////////////////////////////////////////////////
 // constructors
 
@@ -284,9 +284,8 @@ String &String::operator+=(litstr s) {
       int len = strlen(s);
       m_px->append(s, len);
     } else {
-      int len;
-      char *ret = string_concat(data(), size(), s, strlen(s), len);
-      SmartPtr<StringData>::operator=(NEW(StringData)(ret, len, AttachString));
+      SmartPtr<StringData>::operator=
+        (NEW(StringData)(data(), size(), s, strlen(s)));
     }
   }
   return *this;
@@ -299,9 +298,8 @@ String &String::operator+=(CStrRef str) {
     } else if (m_px->getCount() == 1) {
       m_px->append(str.data(), str.size());
     } else {
-      int len;
-      char *ret = string_concat(data(), size(), str.data(), str.size(), len);
-      SmartPtr<StringData>::operator=(NEW(StringData)(ret, len, AttachString));
+      SmartPtr<StringData>::operator=
+        (NEW(StringData)(data(), size(), str.data(), str.size()));
     }
   }
   return *this;
@@ -312,9 +310,7 @@ String String::operator+(litstr str) const {
 
   if (!str || !*str) return *this;
 
-  int len;
-  char *ret = string_concat(data(), size(), str, strlen(str), len);
-  return NEW(StringData)(ret, len, AttachString);
+  return NEW(StringData)(data(), size(), str, strlen(str));
 }
 
 String String::operator+(CStrRef str) const {
@@ -322,9 +318,7 @@ String String::operator+(CStrRef str) const {
 
   if (str.empty()) return *this;
 
-  int len;
-  char *ret = string_concat(data(), size(), str.data(), str.size(), len);
-  return NEW(StringData)(ret, len, AttachString);
+  return NEW(StringData)(data(), size(), str.data(), str.size());
 }
 
 String String::operator~() const {
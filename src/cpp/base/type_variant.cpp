@@ -33,7 +33,8 @@ namespace HPHP {
 
 const Variant Variant::s_nullVariant = Variant();
 
-IMPLEMENT_SMART_ALLOCATION_NOCALLBACKS(Variant);
+// rarely allocated on their own
+IMPLEMENT_SMART_ALLOCATION_NOCALLBACKS_ITEMS(Variant, 128);
 ///////////////////////////////////////////////////////////////////////////////
 // private implementations
 
@@ -0,0 +1,45 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#include <cpp/base/util/hphp_vector.h>
+#include <cpp/base/type_variant.h>
+
+namespace HPHP {
+namespace HphpVectorFuncs {
+///////////////////////////////////////////////////////////////////////////////
+// HphpVector<Variant>: elements are stored inline, and copying one keeps
+// strong bindings, just like copying a PHP array does.
+
+void deallocate(Variant *data, int count) {
+  for (int i = 0; i < count; i++) {
+    data[i].~Variant();
+  }
+}
+
+void reset(Variant *data, int count) {
+  memset(data, 0, count * sizeof(Variant));
+}
+
+void copy(Variant *dest, Variant *src, int count) {
+  for (int i = 0; i < count; i++) {
+    if (src[i].isReferenced()) src[i].setContagious();
+    dest[i] = src[i];
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
+}
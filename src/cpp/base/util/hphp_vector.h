@@ -52,6 +52,14 @@ inline void copy(String *dest, String *src, int count) {
   }
 }
 
+// HphpVector<Variant>, defined in hphp_vector.cpp so this header doesn't
+// need type_variant.h
+inline void allocate(Variant *data, int count) {}
+void deallocate(Variant *data, int count);
+void reset(Variant *data, int count);
+inline void sweep(Variant *data, int count) {}
+void copy(Variant *dest, Variant *src, int count);
+
 // HphpVector<T*>
 template<typename T> inline void allocate(T **data, int count) {}
 template<typename T> inline void deallocate(T **data, int count) {}
@@ -3,6 +3,7 @@
 #include <cpp/eval/runtime/variant_stack.h>
 #include <cpp/base/base_includes.h>
 #include <cpp/eval/runtime/variable_environment.h>
+#include <util/hash.h>
 
 namespace HPHP {
 namespace Eval {
@@ -29,117 +30,340 @@ void ByteCode::toString(ostringstream &res) const {
 #undef OPERATION
 }
 
+/**
+ * Threaded dispatch: every operation jumps straight to the next one's handler
+ * instead of going back through a single switch, which gives the branch
+ * predictor one indirect jump per operation to learn from. Build with
+ * NO_COMPUTED_GOTO to get only the plain switch.
+ */
+#if defined(__GNUC__) && !defined(NO_COMPUTED_GOTO)
+#define BYTECODE_COMPUTED_GOTO
+#endif
+
+static String nameArg(const ByteCode &bc) {
+  return (StringData*)bc.arg();
+}
+
+static inline bool is_int(CVarRef v) {
+  return v.getType() == KindOfInt64;
+}
+
+static inline Variant add_int(CVarRef v, int64 n) {
+  if (is_int(v)) return v.toInt64() + n;
+  return v + Variant(n);
+}
+
+static bool compare(ByteCode::Operation op, CVarRef v1, CVarRef v2) {
+  if (is_int(v1) && is_int(v2)) {
+    int64 n1 = v1.toInt64();
+    int64 n2 = v2.toInt64();
+    switch (op) {
+    case ByteCode::EqualJmpIfNot:    return n1 == n2;
+    case ByteCode::NotEqualJmpIfNot: return n1 != n2;
+    case ByteCode::LTJmpIfNot:       return n1 < n2;
+    case ByteCode::LEQJmpIfNot:      return n1 <= n2;
+    case ByteCode::GTJmpIfNot:       return n1 > n2;
+    case ByteCode::GEQJmpIfNot:      return n1 >= n2;
+    default:
+      break;
+    }
+  }
+  switch (op) {
+  case ByteCode::EqualJmpIfNot:    return equal(v1, v2);
+  case ByteCode::NotEqualJmpIfNot: return !equal(v1, v2);
+  case ByteCode::LTJmpIfNot:       return less(v1, v2);
+  case ByteCode::LEQJmpIfNot:      return not_more(v1, v2);
+  case ByteCode::GTJmpIfNot:       return more(v1, v2);
+  case ByteCode::GEQJmpIfNot:      return not_less(v1, v2);
+  default:
+    ASSERT(false);
+  }
+  return false;
+}
+
+/**
+ * Quickening rewrites m_op in place. A PhpFile, and so its program, is shared
+ * by every request running that file, so threads may race on the same slot.
+ * That is harmless: the store is a single aligned word, and both the generic
+ * and the quickened form produce the right result for any operands; the
+ * quickened one checks its guard and hands the slot back to the generic one.
+ */
 void ByteCodeProgram::execute(VariantStack &stack, VariableEnvironment &env) {
+#ifdef BYTECODE_COMPUTED_GOTO
+  run<true>(stack, env);
+#else
+  run<false>(stack, env);
+#endif
+}
+
+void ByteCodeProgram::execute(VariantStack &stack, VariableEnvironment &env,
+                              bool threaded) {
+#ifdef BYTECODE_COMPUTED_GOTO
+  if (threaded) {
+    run<true>(stack, env);
+    return;
+  }
+#endif
+  run<false>(stack, env);
+}
+
+/**
+ * Both dispatch modes share the handlers: each one is labeled as a case of
+ * the switch and, with computed goto, as a jump target of its own. Threaded
+ * is a constant, so either way only one of the two jumps is compiled in.
+ */
+template<bool Threaded>
+void ByteCodeProgram::run(VariantStack &stack, VariableEnvironment &env) {
+  ASSERT(!empty() && back().m_op == ByteCode::Halt);
 #define PUSH stack.push
 #define PUSHTMP stack.pushSwap
 #define POP stack.topPop
-  for (uint pc = 0; pc < size(); ++pc) {
-    const ByteCode &bc = operator[](pc);
-    switch (bc.operation()) {
-    case ByteCode::Nop: break;
-    case ByteCode::Var: PUSH(env.getIdx(bc.intArg())); break;
-    case ByteCode::VarInd:
-      {
-        Variant &val = env.get(stack.top());
-        stack.pop();
-        PUSH(val);
-      }
-      break;
-    case ByteCode::SetVar:
-      {
-        Variant val(POP());
-        env.getIdx(bc.intArg()) = val;
-        PUSHTMP(val);
-      }
-      break;
-    case ByteCode::SetVarInd:
-      {
-        Variant &r = env.get(stack.top(0)) = stack.top(1);
-        stack.pop(); stack.pop();
-        PUSH(r);
+  ByteCode *code = &operator[](0);
+  ByteCode *bc = code;
+
+#ifdef BYTECODE_COMPUTED_GOTO
+  static void * const dispatchTable[] = {
+#define OPERATION(name, arg) &&op_##name,
+    OPERATIONS
+#undef OPERATION
+  };
+#define OP(name) case ByteCode::name: op_##name
+#define DISPATCH() do {                                                 \
+    if (Threaded) goto *dispatchTable[bc->m_op]; else goto dispatch;    \
+  } while (0)
+#else
+#define OP(name) case ByteCode::name
+#define DISPATCH() goto dispatch
+#endif
+  DISPATCH();
+ dispatch:
+  switch (bc->m_op) {
+  default:
+    throw FatalErrorException("Unsupported bytecode %d", bc->m_op);
+#define NEXT(n) do { bc += (n); DISPATCH(); } while (0)
+#define JUMP(target) do { bc = code + (target); DISPATCH(); } while (0)
+
+  OP(Nop): NEXT(1);
+  OP(Halt): return;
+  OP(Var): PUSH(env.getIdx(bc->intArg())); NEXT(1);
+  OP(VarInd):
+    {
+      Variant &val = env.get(stack.top());
+      stack.pop();
+      PUSH(val);
+    }
+    NEXT(1);
+  OP(SetVar):
+    {
+      Variant val(POP());
+      env.getIdx(bc->intArg()) = val;
+      PUSHTMP(val);
+    }
+    NEXT(1);
+  OP(SetVarInd):
+    {
+      Variant &r = env.get(stack.top(0)) = stack.top(1);
+      stack.pop(); stack.pop();
+      PUSH(r);
+    }
+    NEXT(1);
+  OP(Int): PUSH(bc->intArg()); NEXT(1);
+  OP(String):
+    {
+      Variant s(stringArg(*bc));
+      PUSHTMP(s);
+    }
+    NEXT(1);
+  OP(Double): PUSH(bc->dblArg()); NEXT(1);
+  OP(Bool): PUSH((bool)bc->intArg()); NEXT(1);
+  OP(Null): PUSH(null_variant); NEXT(1);
+  OP(Echo): echo(POP()); NEXT(1);
+
+  OP(LogXor):
+  OP(BitOr):
+  OP(BitAnd):
+  OP(BitXor):
+  OP(Concat):
+  OP(Add):
+  OP(Sub):
+  OP(Mul):
+  OP(Div):
+  OP(Mod):
+  OP(Sl):
+  OP(Sr):
+  OP(Same):
+  OP(NotSame):
+  OP(Equal):
+  OP(NotEqual):
+  OP(LT):
+  OP(LEQ):
+  OP(GT):
+  OP(GEQ):
+    {
+      Variant &v2 = stack.top(0);
+      Variant &v1 = stack.top(1);
+      Variant r;
+      switch (bc->m_op) {
+      case ByteCode::LogXor:   r = logical_xor(v1, v2); break;
+      case ByteCode::BitOr:    r = bitwise_or(v1, v2); break;
+      case ByteCode::BitAnd:   r = bitwise_and(v1, v2); break;
+      case ByteCode::BitXor:   r = bitwise_xor(v1, v2); break;
+      case ByteCode::Concat:
+        r = concat(v1, v2);
+        if (v1.isString() && v2.isString()) bc->m_op = ByteCode::ConcatStr;
+        break;
+      case ByteCode::Add:
+        r = v1 + v2;
+        if (is_int(v1) && is_int(v2)) bc->m_op = ByteCode::AddInt;
+        break;
+      case ByteCode::Sub:      r = v1 - v2; break;
+      case ByteCode::Mul:      r = multiply(v1, v2); break;
+      case ByteCode::Div:      r = divide(v1, v2); break;
+      case ByteCode::Mod:      r = modulo(v1, v2); break;
+      case ByteCode::Sl:       r = v1.toInt64() << v2.toInt64(); break;
+      case ByteCode::Sr:       r = v1.toInt64() >> v2.toInt64(); break;
+      case ByteCode::Same:     r = same(v1, v2); break;
+      case ByteCode::NotSame:  r = !same(v1, v2); break;
+      case ByteCode::Equal:    r = equal(v1, v2); break;
+      case ByteCode::NotEqual: r = !equal(v1, v2); break;
+      case ByteCode::LT:
+        r = less(v1, v2);
+        if (is_int(v1) && is_int(v2)) bc->m_op = ByteCode::LTInt;
+        break;
+      case ByteCode::LEQ:      r = not_more(v1, v2); break;
+      case ByteCode::GT:       r = more(v1, v2); break;
+      case ByteCode::GEQ:      r = not_less(v1, v2); break;
+      default:
+        ASSERT(false);
       }
-      break;
-    case ByteCode::Int: PUSH(bc.intArg()); break;
-    case ByteCode::String:
-      {
-        Variant s(stringArg(bc));
-        PUSHTMP(s);
+      stack.pop();
+      stack.pop();
+      PUSHTMP(r);
+    }
+    NEXT(1);
+  OP(Jmp): JUMP(bc->intArg());
+  OP(JmpIf):
+    if (POP()) {
+      JUMP(bc->intArg());
+    }
+    NEXT(1);
+  OP(JmpIfNot):
+    if (!POP()) {
+      JUMP(bc->intArg());
+    }
+    NEXT(1);
+  OP(Discard): stack.pop(); NEXT(1);
+
+  // superinstructions, see finalize() for the sequences they stand for
+  OP(VarStr):
+    {
+      Variant &val = env.get(nameArg(*bc), bc[1].intArg());
+      PUSH(val);
+    }
+    NEXT(2);
+  OP(SetVarStr):
+    {
+      Variant &r = env.get(nameArg(*bc), bc[1].intArg()) = stack.top();
+      stack.pop();
+      PUSH(r);
+    }
+    NEXT(2);
+  OP(SetVarDiscard):
+    env.getIdx(bc->intArg()) = stack.top();
+    stack.pop();
+    NEXT(2);
+  OP(SetVarStrDiscard):
+    env.get(nameArg(*bc), bc[1].intArg()) = stack.top();
+    stack.pop();
+    NEXT(3);
+  OP(VarIntAddSetVar):
+    {
+      Variant val(add_int(env.getIdx(bc->intArg()), bc[1].intArg()));
+      env.getIdx(bc[3].intArg()) = val;
+      PUSHTMP(val);
+    }
+    NEXT(4);
+  OP(VarStrIntAddSetVarStr):
+    {
+      Variant val(add_int(env.get(nameArg(*bc), bc[1].intArg()),
+                          bc[2].intArg()));
+      env.get(nameArg(bc[4]), bc[5].intArg()) = val;
+      PUSHTMP(val);
+    }
+    NEXT(6);
+  OP(EqualJmpIfNot):
+  OP(NotEqualJmpIfNot):
+  OP(LTJmpIfNot):
+  OP(LEQJmpIfNot):
+  OP(GTJmpIfNot):
+  OP(GEQJmpIfNot):
+    {
+      bool r = compare(bc->m_op, stack.top(1), stack.top(0));
+      stack.pop();
+      stack.pop();
+      if (!r) {
+        JUMP(bc->intArg());
       }
-      break;
-    case ByteCode::Double: PUSH(bc.dblArg()); break;
-    case ByteCode::Bool: PUSH((bool)bc.intArg()); break;
-    case ByteCode::Null: PUSH(null_variant); break;
-    case ByteCode::Echo: echo(POP()); break;
-
-    case ByteCode::LogXor:
-    case ByteCode::BitOr:
-    case ByteCode::BitAnd:
-    case ByteCode::BitXor:
-    case ByteCode::Concat:
-    case ByteCode::Add:
-    case ByteCode::Sub:
-    case ByteCode::Mul:
-    case ByteCode::Div:
-    case ByteCode::Mod:
-    case ByteCode::Sl:
-    case ByteCode::Sr:
-    case ByteCode::Same:
-    case ByteCode::NotSame:
-    case ByteCode::Equal:
-    case ByteCode::NotEqual:
-    case ByteCode::LT:
-    case ByteCode::LEQ:
-    case ByteCode::GT:
-    case ByteCode::GEQ:
-      {
-        Variant &v2 = stack.top(0);
-        Variant &v1 = stack.top(1);
-        Variant r;
-        switch (bc.operation()) {
-        case ByteCode::LogXor:   r = logical_xor(v1, v2); break;
-        case ByteCode::BitOr:    r = bitwise_or(v1, v2); break;
-        case ByteCode::BitAnd:   r = bitwise_and(v1, v2); break;
-        case ByteCode::BitXor:   r = bitwise_xor(v1, v2); break;
-        case ByteCode::Concat:   r = concat(v1, v2); break;
-        case ByteCode::Add:      r = v1 + v2; break;
-        case ByteCode::Sub:      r = v1 - v2; break;
-        case ByteCode::Mul:      r = multiply(v1, v2); break;
-        case ByteCode::Div:      r = divide(v1, v2); break;
-        case ByteCode::Mod:      r = modulo(v1, v2); break;
-        case ByteCode::Sl:       r = v1.toInt64() << v2.toInt64(); break;
-        case ByteCode::Sr:       r = v1.toInt64() >> v2.toInt64(); break;
-        case ByteCode::Same:     r = same(v1, v2); break;
-        case ByteCode::NotSame:  r = !same(v1, v2); break;
-        case ByteCode::Equal:    r = equal(v1, v2); break;
-        case ByteCode::NotEqual: r = !equal(v1, v2); break;
-        case ByteCode::LT:       r = less(v1, v2); break;
-        case ByteCode::LEQ:      r = not_more(v1, v2); break;
-        case ByteCode::GT:       r = more(v1, v2); break;
-        case ByteCode::GEQ:      r = not_less(v1, v2); break;
-        default:
-          ASSERT(false);
-        }
-        stack.pop();
-        stack.pop();
-        PUSHTMP(r);
+    }
+    NEXT(2);
+
+  // quickened forms, falling back to the generic operation on a guard miss
+  OP(AddInt):
+    {
+      Variant &v2 = stack.top(0);
+      Variant &v1 = stack.top(1);
+      if (!is_int(v1) || !is_int(v2)) {
+        bc->m_op = ByteCode::Add;
+        DISPATCH();
       }
-      break;
-    case ByteCode::Jmp: pc = bc.intArg() - 1; break;
-    case ByteCode::JmpIf:
-      if (POP()) {
-        pc = bc.intArg() - 1;
+      int64 r = v1.toInt64() + v2.toInt64();
+      stack.pop();
+      stack.pop();
+      PUSH(r);
+    }
+    NEXT(1);
+  OP(LTInt):
+    {
+      Variant &v2 = stack.top(0);
+      Variant &v1 = stack.top(1);
+      if (!is_int(v1) || !is_int(v2)) {
+        bc->m_op = ByteCode::LT;
+        DISPATCH();
       }
-      break;
-    case ByteCode::JmpIfNot:
-      if (!POP()) {
-        pc = bc.intArg() - 1;
+      bool r = v1.toInt64() < v2.toInt64();
+      stack.pop();
+      stack.pop();
+      PUSH(r);
+    }
+    NEXT(1);
+  OP(ConcatStr):
+    {
+      Variant &v2 = stack.top(0);
+      Variant &v1 = stack.top(1);
+      if (!v1.isString() || !v2.isString()) {
+        bc->m_op = ByteCode::Concat;
+        DISPATCH();
       }
-      break;
-    case ByteCode::Discard: stack.pop(); break;
-    default:
-      throw FatalErrorException("Unsupported bytecode %d", bc.operation());
+      Variant r(concat(v1.toString(), v2.toString()));
+      stack.pop();
+      stack.pop();
+      PUSHTMP(r);
     }
+    NEXT(1);
+
+  OP(VarRef):
+  OP(VarRefInd):
+  OP(Bind):
+  OP(BindRef):
+    throw FatalErrorException("Unsupported bytecode %d", bc->m_op);
   }
+#undef JUMP
+#undef NEXT
+#undef DISPATCH
+#undef OP
+#undef POP
+#undef PUSHTMP
+#undef PUSH
 }
 
 void ByteCodeProgram::add(ByteCode::Operation op, void *arg /* = NULL */) {
@@ -179,6 +403,94 @@ void ByteCodeProgram::bindJumpTag(JumpTag t, Label l /* = -1 */) {
   operator[](t).m_arg.num = l;
 }
 
+static ByteCode::Operation op_at(const vector<ByteCode> &code, uint pc) {
+  return pc < code.size() ? code[pc].operation() : ByteCode::Halt;
+}
+
+void ByteCodeProgram::finalize(bool optimize /* = true */) {
+  ASSERT(empty() || back().m_op != ByteCode::Halt);
+  add(ByteCode::Halt);
+  if (!optimize) return;
+
+  // Named lookups first, so the longer sequences below can match on them.
+  // String n, VarInd => VarStr n, with n's hash stashed in the VarInd slot
+  for (uint pc = 0; pc + 1 < size(); ++pc) {
+    ByteCode &bc = operator[](pc);
+    ByteCode &next = operator[](pc + 1);
+    if (bc.m_op != ByteCode::String) continue;
+    if (next.m_op == ByteCode::VarInd) {
+      bc.m_op = ByteCode::VarStr;
+    } else if (next.m_op == ByteCode::SetVarInd) {
+      bc.m_op = ByteCode::SetVarStr;
+    } else {
+      continue;
+    }
+    StringData *name = (StringData*)bc.arg();
+    next.m_arg.num = hash_string(name->data(), name->size());
+  }
+  for (uint pc = 0; pc < size(); ++pc) {
+    fuse(pc);
+  }
+}
+
+void ByteCodeProgram::fuse(uint pc) {
+  const vector<ByteCode> &code = *this;
+  ByteCode &bc = operator[](pc);
+  switch (bc.m_op) {
+  case ByteCode::Var:
+    // Var a, Int n, Add, SetVar b
+    if (op_at(code, pc + 1) == ByteCode::Int &&
+        op_at(code, pc + 2) == ByteCode::Add &&
+        op_at(code, pc + 3) == ByteCode::SetVar) {
+      bc.m_op = ByteCode::VarIntAddSetVar;
+    }
+    break;
+  case ByteCode::VarStr:
+    // VarStr a, VarInd, Int n, Add, SetVarStr b, SetVarInd
+    if (op_at(code, pc + 2) == ByteCode::Int &&
+        op_at(code, pc + 3) == ByteCode::Add &&
+        op_at(code, pc + 4) == ByteCode::SetVarStr) {
+      bc.m_op = ByteCode::VarStrIntAddSetVarStr;
+    }
+    break;
+  case ByteCode::SetVar:
+    // SetVar a, Discard
+    if (op_at(code, pc + 1) == ByteCode::Discard) {
+      bc.m_op = ByteCode::SetVarDiscard;
+    }
+    break;
+  case ByteCode::SetVarStr:
+    // SetVarStr a, SetVarInd, Discard
+    if (op_at(code, pc + 2) == ByteCode::Discard) {
+      bc.m_op = ByteCode::SetVarStrDiscard;
+    }
+    break;
+  case ByteCode::Equal:
+  case ByteCode::NotEqual:
+  case ByteCode::LT:
+  case ByteCode::LEQ:
+  case ByteCode::GT:
+  case ByteCode::GEQ:
+    // compare, JmpIfNot l => compareJmpIfNot l
+    if (op_at(code, pc + 1) == ByteCode::JmpIfNot) {
+      switch (bc.m_op) {
+      case ByteCode::Equal:    bc.m_op = ByteCode::EqualJmpIfNot; break;
+      case ByteCode::NotEqual: bc.m_op = ByteCode::NotEqualJmpIfNot; break;
+      case ByteCode::LT:       bc.m_op = ByteCode::LTJmpIfNot; break;
+      case ByteCode::LEQ:      bc.m_op = ByteCode::LEQJmpIfNot; break;
+      case ByteCode::GT:       bc.m_op = ByteCode::GTJmpIfNot; break;
+      case ByteCode::GEQ:      bc.m_op = ByteCode::GEQJmpIfNot; break;
+      default:
+        ASSERT(false);
+      }
+      bc.m_arg.num = code[pc + 1].intArg();
+    }
+    break;
+  default:
+    break;
+  }
+}
+
 string ByteCodeProgram::toString() const {
   ostringstream res;
   int pos = 0;
@@ -19,6 +19,13 @@ enum ArgType {
   StrArg
 };
 
+/**
+ * Everything from Halt on is never emitted by the AST. Halt terminates every
+ * finalized program; the fused operations are written by the peephole pass in
+ * ByteCodeProgram::finalize() over the head of the sequence they replace, and
+ * AddInt, LTInt and ConcatStr are quickened forms that execute() swaps in for
+ * Add, LT and Concat once it has seen the operand types.
+ */
 #define OPERATIONS \
   OPERATION(Nop, NoArg) \
   OPERATION(Var, IntArg) \
@@ -59,6 +66,22 @@ enum ArgType {
   OPERATION(JmpIf, IntArg) \
   OPERATION(JmpIfNot, IntArg) \
   OPERATION(Discard, NoArg) \
+  OPERATION(Halt, NoArg) \
+  OPERATION(VarStr, StrArg) \
+  OPERATION(SetVarStr, StrArg) \
+  OPERATION(SetVarDiscard, IntArg) \
+  OPERATION(SetVarStrDiscard, StrArg) \
+  OPERATION(VarIntAddSetVar, IntArg) \
+  OPERATION(VarStrIntAddSetVarStr, StrArg) \
+  OPERATION(EqualJmpIfNot, IntArg) \
+  OPERATION(NotEqualJmpIfNot, IntArg) \
+  OPERATION(LTJmpIfNot, IntArg) \
+  OPERATION(LEQJmpIfNot, IntArg) \
+  OPERATION(GTJmpIfNot, IntArg) \
+  OPERATION(GEQJmpIfNot, IntArg) \
+  OPERATION(AddInt, NoArg) \
+  OPERATION(LTInt, NoArg) \
+  OPERATION(ConcatStr, NoArg) \
 
 class ByteCode {
 public:
@@ -122,8 +145,29 @@ public:
   JumpTag jumpIfNot();
   Label here() const;
   void bindJumpTag(JumpTag t, Label l = - 1);
+
+  /**
+   * Must be called once the whole program has been added and all jump tags
+   * are bound, before execute(). Appends Halt and, unless told otherwise,
+   * fuses common sequences into superinstructions. The fused operation only
+   * overwrites the head of its sequence, so jumps into the middle of one
+   * still land on the original operations.
+   */
+  void finalize(bool optimize = true);
   void execute(VariantStack &stack, VariableEnvironment &env);
+
+  /**
+   * Same, picking threaded dispatch or the plain switch instead of whichever
+   * the build prefers, so the two can be compared. Without computed goto
+   * there's only the switch.
+   */
+  void execute(VariantStack &stack, VariableEnvironment &env, bool threaded);
   std::string toString() const;
+
+private:
+  void fuse(uint pc);
+  template<bool Threaded>
+  void run(VariantStack &stack, VariableEnvironment &env);
 };
 
 
@@ -39,6 +39,7 @@ PhpFile::PhpFile(StatementPtr tree, const vector<StaticStatementPtr> &statics,
 {
   if (RuntimeOption::EvalBytecodeInterpreter) {
     m_tree->byteCode(m_byteCode);
+    m_byteCode.finalize();
     if (RuntimeOption::DumpBytecode) {
       cout << m_byteCode.toString();
     }
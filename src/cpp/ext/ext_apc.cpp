@@ -19,6 +19,7 @@
 #include <cpp/ext/ext_variable.h>
 #include <cpp/ext/ext_fb.h>
 #include <cpp/base/runtime_option.h>
+#include <cpp/base/shared/shared_store_snapshot.h>
 #include <util/async_job.h>
 #include <util/timer.h>
 #include <dlfcn.h>
@@ -29,6 +30,17 @@ using namespace std;
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 
+// keys loaded by apc_bin_load() that haven't been fetched yet
+static SharedStoreSnapshot s_apc_snapshot[MAX_SHARED_STORE];
+
+static bool apc_get(int64 cache_id, CStrRef key, Variant &value) {
+  if (s_apc_store[cache_id].get(key, value)) {
+    return true;
+  }
+  return s_apc_snapshot[cache_id].materialize(s_apc_store[cache_id], key,
+                                              value);
+}
+
 bool f_apc_store(CStrRef key, CVarRef var, int64 ttl /* = 0 */,
                  int64 cache_id /* = 0 */) {
   if (!RuntimeOption::EnableApc) return false;
@@ -36,6 +48,7 @@ bool f_apc_store(CStrRef key, CVarRef var, int64 ttl /* = 0 */,
   if (cache_id < 0 || cache_id >= MAX_SHARED_STORE) {
     throw InvalidArgumentException("cache_id", cache_id);
   }
+  s_apc_snapshot[cache_id].forget(key);
   return s_apc_store[cache_id].store(key, var, ttl);
 }
 
@@ -46,10 +59,9 @@ bool f_apc_add(CStrRef key, CVarRef var, int64 ttl /* = 0 */,
   if (cache_id < 0 || cache_id >= MAX_SHARED_STORE) {
     throw InvalidArgumentException("cache_id", cache_id);
   }
-  SharedStore &sharedStore = s_apc_store[cache_id];
   Variant value;
-  if (!sharedStore.get(key, value)) {
-    sharedStore.store(key, var, ttl);
+  if (!apc_get(cache_id, key, value)) {
+    s_apc_store[cache_id].store(key, var, ttl);
     return true;
   }
   return false;
@@ -74,7 +86,7 @@ Variant f_apc_fetch(CVarRef key, Variant success /* = null */,
       if (!k.isString()) {
         throw InvalidArgumentException("apc key", "(not a string)");
       }
-      if (s_apc_store[cache_id].get(k.toString(), v)) {
+      if (apc_get(cache_id, k.toString(), v)) {
         tmp = true;
         ret.set(k, v);
       }
@@ -83,7 +95,7 @@ Variant f_apc_fetch(CVarRef key, Variant success /* = null */,
     return ret;
   }
 
-  if (s_apc_store[cache_id].get(key.toString(), v)) {
+  if (apc_get(cache_id, key.toString(), v)) {
     success = true;
   } else {
     success = false;
@@ -107,14 +119,20 @@ Variant f_apc_delete(CVarRef key, int64 cache_id /* = 0 */) {
       if (!k.isString()) {
         Logger::Warning("apc key is not a string");
         ret.append(k);
-      } else if (!s_apc_store[cache_id].erase(k.toString())) {
-        ret.append(k);
+      } else {
+        String sk = k.toString();
+        bool forgotten = s_apc_snapshot[cache_id].forget(sk);
+        if (!s_apc_store[cache_id].erase(sk) && !forgotten) {
+          ret.append(k);
+        }
       }
     }
     return ret;
   }
 
-  return s_apc_store[cache_id].erase(key.toString());
+  String sk = key.toString();
+  bool forgotten = s_apc_snapshot[cache_id].forget(sk);
+  return s_apc_store[cache_id].erase(sk) || forgotten;
 }
 
 bool f_apc_clear_cache(int64 cache_id /* = 0 */) {
@@ -123,6 +141,7 @@ bool f_apc_clear_cache(int64 cache_id /* = 0 */) {
   if (cache_id < 0 || cache_id >= MAX_SHARED_STORE) {
     throw InvalidArgumentException("cache_id", cache_id);
   }
+  s_apc_snapshot[cache_id].clear();
   s_apc_store[cache_id].clear();
   return true;
 }
@@ -134,6 +153,8 @@ Variant f_apc_inc(CStrRef key, int64 step /* = 1 */,
   if (cache_id < 0 || cache_id >= MAX_SHARED_STORE) {
     throw InvalidArgumentException("cache_id", cache_id);
   }
+  Variant v;
+  s_apc_snapshot[cache_id].materialize(s_apc_store[cache_id], key, v);
   bool found = false;
   int64 newValue = s_apc_store[cache_id].inc(key, step, found);
   success = found;
@@ -147,6 +168,8 @@ Variant f_apc_dec(CStrRef key, int64 step /* = 1 */,
   if (cache_id < 0 || cache_id >= MAX_SHARED_STORE) {
     throw InvalidArgumentException("cache_id", cache_id);
   }
+  Variant v;
+  s_apc_snapshot[cache_id].materialize(s_apc_store[cache_id], key, v);
   bool found = false;
   int64 newValue = s_apc_store[cache_id].inc(key, -step, found);
   success = found;
@@ -160,6 +183,8 @@ bool f_apc_cas(CStrRef key, int64 old_cas, int64 new_cas,
   if (cache_id < 0 || cache_id >= MAX_SHARED_STORE) {
     throw InvalidArgumentException("cache_id", cache_id);
   }
+  Variant v;
+  s_apc_snapshot[cache_id].materialize(s_apc_store[cache_id], key, v);
   return s_apc_store[cache_id].cas(key, old_cas, new_cas);
 }
 
@@ -167,6 +192,83 @@ Variant f_apc_cache_info(int64 cache_id /* = 0 */, bool limited /* = false */) {
   return CREATE_MAP1("start_time", start_time());
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// binary snapshots
+
+static bool apc_bin_filter(CVarRef filter, set<string> &keys) {
+  // same shape as APC's: array('user' => array(key, ...))
+  if (!filter.isArray()) return false;
+  Array user = filter.toArray()["user"].toArray();
+  for (ArrayIter iter(user); iter; ++iter) {
+    keys.insert(iter.second().toString().data());
+  }
+  return true;
+}
+
+Variant f_apc_bin_dump(int64 cache_id /* = 0 */,
+                       CVarRef filter /* = null_variant */) {
+  if (!RuntimeOption::EnableApc) return null;
+
+  if (cache_id < 0 || cache_id >= MAX_SHARED_STORE) {
+    throw InvalidArgumentException("cache_id", cache_id);
+  }
+  set<string> keys;
+  bool filtered = apc_bin_filter(filter, keys);
+  return s_apc_snapshot[cache_id].dump(s_apc_store[cache_id],
+                                       filtered ? &keys : NULL);
+}
+
+bool f_apc_bin_load(CStrRef data, int64 flags /* = 0 */,
+                    int64 cache_id /* = 0 */) {
+  if (!RuntimeOption::EnableApc) return false;
+
+  if (cache_id < 0 || cache_id >= MAX_SHARED_STORE) {
+    throw InvalidArgumentException("cache_id", cache_id);
+  }
+  return s_apc_snapshot[cache_id].load(data.data(), data.size());
+}
+
+Variant f_apc_bin_dumpfile(int64 cache_id, CVarRef filter,
+                           CStrRef filename, int64 flags /* = 0 */,
+                           CObjRef context /* = null */) {
+  if (!RuntimeOption::EnableApc) return false;
+
+  if (cache_id < 0 || cache_id >= MAX_SHARED_STORE) {
+    throw InvalidArgumentException("cache_id", cache_id);
+  }
+  set<string> keys;
+  bool filtered = apc_bin_filter(filter, keys);
+  String data = s_apc_snapshot[cache_id].dump(s_apc_store[cache_id],
+                                              filtered ? &keys : NULL);
+
+  // written aside and renamed, so a server loading the file on startup
+  // never sees a partial snapshot
+  string tmp = string(filename.data()) + ".tmp";
+  FILE *f = fopen(tmp.c_str(), "w");
+  if (!f) {
+    Logger::Warning("Unable to write apc snapshot %s", tmp.c_str());
+    return false;
+  }
+  bool ok = fwrite(data.data(), 1, data.size(), f) == (size_t)data.size();
+  ok = (fclose(f) == 0) && ok;
+  if (!ok || rename(tmp.c_str(), filename.data()) != 0) {
+    Logger::Warning("Unable to write apc snapshot %s", filename.data());
+    unlink(tmp.c_str());
+    return false;
+  }
+  return data.size();
+}
+
+bool f_apc_bin_loadfile(CStrRef filename, CObjRef context /* = null */,
+                        int64 flags /* = 0 */, int64 cache_id /* = 0 */) {
+  if (!RuntimeOption::EnableApc) return false;
+
+  if (cache_id < 0 || cache_id >= MAX_SHARED_STORE) {
+    throw InvalidArgumentException("cache_id", cache_id);
+  }
+  return s_apc_snapshot[cache_id].loadFile(filename.data());
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // loading APC from archive files
 
@@ -203,6 +305,13 @@ public:
 };
 
 void apc_load(int thread) {
+  static bool snapshotLoaded = false;
+  if (!snapshotLoaded && !RuntimeOption::ApcPrimeSnapshot.empty() &&
+      RuntimeOption::EnableApc) {
+    snapshotLoaded = true;
+    s_apc_snapshot[0].loadFile(RuntimeOption::ApcPrimeSnapshot.c_str());
+  }
+
   static void *handle = NULL;
   if (handle ||
       RuntimeOption::ApcPrimeLibrary.empty() ||
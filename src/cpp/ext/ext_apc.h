@@ -58,21 +58,13 @@ inline Array f_apc_filehits() {
 inline Variant f_apc_delete_file(CVarRef keys, int64 cache_id = 0) {
   throw NotSupportedException(__func__, "feature not supported");
 }
-inline Variant f_apc_bin_dump(int64 cache_id = 0, CVarRef filter = null_variant) {
-  throw NotSupportedException(__func__, "feature not supported");
-}
-inline bool f_apc_bin_load(CStrRef data, int64 flags = 0, int64 cache_id = 0) {
-  throw NotSupportedException(__func__, "feature not supported");
-}
-inline Variant f_apc_bin_dumpfile(int64 cache_id, CVarRef filter,
-                                  CStrRef filename, int64 flags = 0,
-                                  CObjRef context = null) {
-  throw NotSupportedException(__func__, "feature not supported");
-}
-inline bool f_apc_bin_loadfile(CStrRef filename, CObjRef context = null,
-                               int64 flags = 0, int64 cache_id = 0) {
-  throw NotSupportedException(__func__, "feature not supported");
-}
+Variant f_apc_bin_dump(int64 cache_id = 0, CVarRef filter = null_variant);
+bool f_apc_bin_load(CStrRef data, int64 flags = 0, int64 cache_id = 0);
+Variant f_apc_bin_dumpfile(int64 cache_id, CVarRef filter,
+                           CStrRef filename, int64 flags = 0,
+                           CObjRef context = null);
+bool f_apc_bin_loadfile(CStrRef filename, CObjRef context = null,
+                        int64 flags = 0, int64 cache_id = 0);
 
 ///////////////////////////////////////////////////////////////////////////////
 // loading APC from archive files
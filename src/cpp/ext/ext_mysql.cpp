@@ -30,6 +30,13 @@ using namespace std;
 
 namespace HPHP {
 
+static int s_sqlConn = ServerStats::RegisterKey("sql.conn");
+static int s_sqlReconnNew = ServerStats::RegisterKey("sql.reconn_new");
+static int s_sqlReconnOk = ServerStats::RegisterKey("sql.reconn_ok");
+static int s_sqlReconnOld = ServerStats::RegisterKey("sql.reconn_old");
+static int s_sqlQuery = ServerStats::RegisterKey("sql.query");
+static int s_sqlQueryUnknown = ServerStats::RegisterKey("sql.query.unknown");
+
 IMPLEMENT_OBJECT_ALLOCATION_NO_DEFAULT_SWEEP(MySQLResult);
 
 MySQLResult::~MySQLResult() {
@@ -224,7 +231,7 @@ bool MySQL::connect(CStrRef host, int port, CStrRef socket, CStrRef username,
     MySQLUtil::set_mysql_timeout(m_conn, MySQLUtil::ConnectTimeout, connect_timeout);
   }
   if (RuntimeOption::EnableStats && RuntimeOption::EnableSQLStats) {
-    ServerStats::Log("sql.conn", 1);
+    ServerStats::Log(s_sqlConn, 1);
   }
   return mysql_real_connect(m_conn, host.data(), username.data(),
                             password.data(), NULL, port, socket.data(),
@@ -240,7 +247,7 @@ bool MySQL::reconnect(CStrRef host, int port, CStrRef socket, CStrRef username,
       MySQLUtil::set_mysql_timeout(m_conn, MySQLUtil::ConnectTimeout, connect_timeout);
     }
     if (RuntimeOption::EnableStats && RuntimeOption::EnableSQLStats) {
-      ServerStats::Log("sql.reconn_new", 1);
+      ServerStats::Log(s_sqlReconnNew, 1);
     }
     return mysql_real_connect(m_conn, host.data(), username.data(),
                               password.data(), NULL, port, socket.data(),
@@ -249,7 +256,7 @@ bool MySQL::reconnect(CStrRef host, int port, CStrRef socket, CStrRef username,
 
   if (!mysql_ping(m_conn)) {
     if (RuntimeOption::EnableStats && RuntimeOption::EnableSQLStats) {
-      ServerStats::Log("sql.reconn_ok", 1);
+      ServerStats::Log(s_sqlReconnOk, 1);
     }
     return true;
   }
@@ -258,7 +265,7 @@ bool MySQL::reconnect(CStrRef host, int port, CStrRef socket, CStrRef username,
     MySQLUtil::set_mysql_timeout(m_conn, MySQLUtil::ConnectTimeout, connect_timeout);
   }
   if (RuntimeOption::EnableStats && RuntimeOption::EnableSQLStats) {
-    ServerStats::Log("sql.reconn_old", 1);
+    ServerStats::Log(s_sqlReconnOld, 1);
   }
   return mysql_real_connect(m_conn, host.data(), username.data(),
                             password.data(), NULL, port, socket.data(),
@@ -661,7 +668,7 @@ static Variant php_mysql_do_query_general(CStrRef query, CVarRef link_id,
   if (!conn || !rconn) return false;
 
   if (RuntimeOption::EnableStats && RuntimeOption::EnableSQLStats) {
-    ServerStats::Log("sql.query", 1);
+    ServerStats::Log(s_sqlQuery, 1);
 
     Variant matches;
     f_preg_match("/^(?:(?:\\/\\*.*?\\*\\/)|\\(|\\s)*(?:"
@@ -689,7 +696,7 @@ static Variant php_mysql_do_query_general(CStrRef query, CVarRef link_id,
         ServerStats::Log(string("sql.query.") + verb, 1);
       } else {
         Logger::Error("Unable to record MySQL stats with: %s", query.data());
-        ServerStats::Log("sql.query.unknown", 1);
+        ServerStats::Log(s_sqlQueryUnknown, 1);
       }
     }
   }
@@ -16,6 +16,7 @@
 
 #include <cpp/base/type_variant.h>
 #include <cpp/base/type_object.h>
+#include <cpp/base/externals.h>
 
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
@@ -37,6 +38,10 @@ Variant invoke(const char *function, CArrRef params, int64 hash,
   return true;
 }
 
+InvokeFewArgsFunc get_invoke_few_args(const char *s, int64 hash) {
+  return NULL;
+}
+
 Variant invoke_static_method(const char* cls, const char *function,
                              CArrRef params, bool fatal /* = true */) {
   return null;
@@ -20,6 +20,7 @@
 #include <boost/program_options/parsers.hpp>
 
 #include <lib/package.h>
+#include <lib/build_manifest.h>
 #include <lib/analysis/analysis_result.h>
 #include <lib/analysis/dependency_graph.h>
 #include <lib/analysis/code_error.h>
@@ -707,6 +708,8 @@ int cppTarget(const ProgramOptions &po, AnalysisResultPtr ar,
 
   {
     Timer timer(Timer::WallTime, "creating CPP files");
+    BuildManifest manifest(po.outputDir);
+    manifest.load();
     if (po.syncDir.empty()) {
       ar->setOutputPath(po.outputDir);
       ar->outputAllCPP(format, clusterCount, NULL);
@@ -716,6 +719,7 @@ int cppTarget(const ProgramOptions &po, AnalysisResultPtr ar,
       Util::syncdir(po.outputDir, po.syncDir);
       boost::filesystem::remove_all(po.syncDir);
     }
+    manifest.update();
   }
 
   return ret;
@@ -51,9 +51,11 @@ AnalysisResult::AnalysisResult()
     m_package(NULL), m_parseOnDemand(false), m_phase(AnalyzeInclude),
     m_newlyInferred(0), m_dynamicClass(false), m_dynamicFunction(false),
     m_classForcedVariants(false), m_optCounter(0),
-    m_scalarArraysCounter(0), m_paramRTTICounter(0),
+    m_scalarArraysCounter(0), m_paramRTTICounter(0), m_invokeCacheCount(0),
     m_scalarArraySortedAvgLen(0), m_scalarArraySortedIndex(0),
-    m_scalarArraySortedSumLen(0), m_scalarArrayCompressedTextSize(0) {
+    m_scalarArraySortedSumLen(0), m_scalarArrayCompressedTextSize(0),
+    m_inferTracking(false), m_inferChangedAll(false), m_inferPasses(0),
+    m_inferVisits(0), m_inferVisitsSaved(0) {
   m_dependencyGraph = DependencyGraphPtr(new DependencyGraph());
   m_insideScalarArray = false;
 }
@@ -158,6 +160,11 @@ FunctionScopePtr AnalysisResult::findFunction(const std::string &funcName) {
   StringToFunctionScopePtrVecMap::const_iterator iter =
     m_functionDecs.find(funcName);
   if (iter != m_functionDecs.end()) {
+    if (m_inferTracking) {
+      BOOST_FOREACH(FunctionScopePtr func, iter->second) {
+        addInferenceRead(func->getFileScope());
+      }
+    }
     return iter->second.back();
   }
   return FunctionScopePtr();
@@ -175,7 +182,10 @@ FunctionScopePtr AnalysisResult::findHelperFunction(const std::string &funcName)
 BlockScopePtr AnalysisResult::findConstantDeclarer(const std::string &name) {
   if (getConstants()->isPresent(name)) return shared_from_this();
   StringToFileScopePtrMap::const_iterator iter = m_constDecs.find(name);
-  if (iter != m_constDecs.end()) return iter->second;
+  if (iter != m_constDecs.end()) {
+    addInferenceRead(iter->second);
+    return iter->second;
+  }
   return BlockScopePtr();
 }
 
@@ -212,6 +222,11 @@ ClassScopePtr AnalysisResult::findClass(const std::string &name,
 
     StringToClassScopePtrVecMap::const_iterator iter = m_classDecs.find(name);
     if (iter != m_classDecs.end()) {
+      if (m_inferTracking) {
+        BOOST_FOREACH(ClassScopePtr cls, iter->second) {
+          addInferenceRead(cls->getFileScope());
+        }
+      }
       return iter->second.back();
     }
   }
@@ -219,7 +234,13 @@ ClassScopePtr AnalysisResult::findClass(const std::string &name,
 }
 
 const ClassScopePtrVec &AnalysisResult::findClasses(const std::string &name) {
-  return m_classDecs[name];
+  const ClassScopePtrVec &classes = m_classDecs[name];
+  if (m_inferTracking) {
+    BOOST_FOREACH(ClassScopePtr cls, classes) {
+      addInferenceRead(cls->getFileScope());
+    }
+  }
+  return classes;
 }
 
 bool AnalysisResult::classMemberExists(const std::string &name,
@@ -497,35 +518,119 @@ void AnalysisResult::analyzeProgramFinal() {
   }
 }
 
+/**
+ * The first two passes and the last one behave differently from the others,
+ * so they visit every file. In between, a file is revisited only when a
+ * type it declares, or one declared by a file it looked up, has changed
+ * since its last visit. Once that runs dry, a full pass confirms nothing
+ * changes anymore; that pass is where the old loop would have stopped too,
+ * so LastInference starts from the same fixpoint.
+ */
 void AnalysisResult::inferTypes(int maxPass /* = 100 */) {
-  AnalysisResultPtr ar = shared_from_this();
+  int fileCount = m_fileScopes.size();
+  vector<bool> dirty(fileCount, true);
+  m_inferReaders.clear();
+  m_inferReaders.resize(fileCount);
+  m_inferTracking = true;
+
   setPhase(FirstInference);
-  int lastInferred = 0;
-  bool lastInference = false;
+  bool full = true;
   for (int i = 0; i < maxPass; i++) {
     m_newlyInferred = 0;
-    for (StringToFileScopePtrMap::const_iterator iter = m_files.begin();
-         iter != m_files.end(); ++iter) {
-      FileScopePtr file = iter->second;
-      pushScope(file);
-      file->inferTypes(ar);
-      popScope();
-    }
-    if (lastInference) {
+    int visits = inferTypesPass(dirty, full || m_phase != MoreInference);
+    m_inferPasses++;
+    m_inferVisits += visits;
+    m_inferVisitsSaved += fileCount - visits;
+    Logger::Verbose("newly inferred types: %d from %d of %d files",
+                    m_newlyInferred, visits, fileCount);
+
+    switch (m_phase) {
+    case FirstInference:
+      setPhase(SecondInference);
+      break;
+    case SecondInference:
+      setPhase(MoreInference);
+      full = false;
+      break;
+    case MoreInference:
+      if (m_newlyInferred == 0) {
+        if (full) {
+          setPhase(LastInference);
+        }
+        full = true;
+      } else {
+        full = false;
+      }
+      break;
+    default:
+      m_inferTracking = false;
+      m_inferReaders.clear();
       return;
     }
-    if (i > 1 && m_newlyInferred == 0 /* lastInferred */) {
-      lastInference = true;
+  }
+  ASSERT(false);
+}
+
+int AnalysisResult::inferTypesPass(vector<bool> &dirty, bool full) {
+  AnalysisResultPtr ar = shared_from_this();
+  int visits = 0;
+  for (StringToFileScopePtrMap::const_iterator iter = m_files.begin();
+       iter != m_files.end(); ++iter) {
+    FileScopePtr file = iter->second;
+    int id = file->vertex();
+    if (!full && !dirty[id]) continue;
+    dirty[id] = false;
+    visits++;
+
+    m_inferChanged.clear();
+    m_inferChangedAll = false;
+    pushScope(file);
+    file->inferTypes(ar);
+    popScope();
+
+    if (m_inferChangedAll) {
+      dirty.assign(dirty.size(), true);
+      continue;
     }
-    lastInferred = m_newlyInferred;
-    Logger::Verbose("newly inferred types: %d", m_newlyInferred);
-    if (lastInference) {
-      setPhase(LastInference);
-    } else {
-      setPhase(i == 0 ? SecondInference : MoreInference);
+    for (set<int>::const_iterator it = m_inferChanged.begin();
+         it != m_inferChanged.end(); ++it) {
+      dirty[*it] = true;
+      const set<int> &readers = m_inferReaders[*it];
+      for (set<int>::const_iterator r = readers.begin(); r != readers.end();
+           ++r) {
+        dirty[*r] = true;
+      }
     }
   }
-  ASSERT(false);
+  return visits;
+}
+
+void AnalysisResult::incNewlyInferred(BlockScope *scope /* = NULL */) {
+  m_newlyInferred++;
+  if (!m_inferTracking) return;
+
+  FileScopePtr file;
+  if (scope) {
+    if (scope->is(BlockScope::FileScope)) {
+      file = dynamic_pointer_cast<HPHP::FileScope>(scope->shared_from_this());
+    } else if (scope->is(BlockScope::FunctionScope)) {
+      file = static_cast<HPHP::FunctionScope*>(scope)->getFileScope();
+    } else if (scope->is(BlockScope::ClassScope)) {
+      file = static_cast<HPHP::ClassScope*>(scope)->getFileScope();
+    }
+  }
+  if (file) {
+    m_inferChanged.insert(file->vertex());
+  } else {
+    // globals, constants and builtins: no way to tell who reads them
+    m_inferChangedAll = true;
+  }
+}
+
+void AnalysisResult::addInferenceRead(FileScopePtr provider) {
+  if (m_inferTracking && provider && m_file && provider != m_file) {
+    m_inferReaders[provider->vertex()].insert(m_file->vertex());
+  }
 }
 
 static void dumpVisitor(AnalysisResultPtr ar, StatementPtr s, void *data)
@@ -734,6 +839,29 @@ void AnalysisResult::getTrueDeps(FileScopePtr f,
   }
 }
 
+/**
+ * Names a new cluster after its first file. Two first files can hash to the
+ * same name, so later ones probe for a free name instead of merging into an
+ * earlier cluster.
+ */
+static string new_cluster_name(const StringToFileScopePtrVecMap &clusters,
+                               const string &firstFile) {
+  for (int probe = 0; ; probe++) {
+    string name = Option::FormatClusterFile(firstFile, probe);
+    if (clusters.find(name) == clusters.end()) return name;
+  }
+}
+
+/**
+ * Files are taken in name order, and a cluster may only end before a file
+ * whose name hashes to a boundary, once it has grown past half the target
+ * size. Where clusters split then depends on file names, not on the sizes
+ * of every file before them, so editing, adding or removing one file
+ * rewrites its own cluster and leaves the others byte-identical; with
+ * --sync-dir, they are not recompiled. For the same reason, the target size
+ * is rounded up to a power of two, and clusters are named after their first
+ * file instead of being numbered.
+ */
 void AnalysisResult::clusterByFileSizes(StringToFileScopePtrVecMap &clusters,
                                         int clusterCount) {
   ASSERT(clusterCount > 0);
@@ -745,29 +873,38 @@ void AnalysisResult::clusterByFileSizes(StringToFileScopePtrVecMap &clusters,
     sortedFiles[f->getName()] = f;
   }
 
-  const int FUZZYNESS = 1024; // 1kB
+  long clusterSize = 1;
+  while (clusterSize < totalSize / clusterCount) clusterSize <<= 1;
+  // one in every "boundary" files may start a cluster, so that half a
+  // cluster's worth of files comes after the first chance to end it
+  int boundary = 1;
+  while (boundary * 4 <= (int)sortedFiles.size() / clusterCount) {
+    boundary <<= 1;
+  }
 
-  int clusterSize = totalSize / clusterCount;
-  int size = 0;
-  int count = 1;
-  string clusterName = Option::FormatClusterFile(count);
+  long size = 0;
+  string clusterName;
   FileScopePtrVec largeFiles;
   for (std::map<std::string, FileScopePtr>::const_iterator iter =
          sortedFiles.begin(); iter != sortedFiles.end(); ++iter) {
     FileScopePtr f = iter->second;
     if (f->getSize() > clusterSize) {
       largeFiles.push_back(f);
-    } else {
-      size += f->getSize();
-      if ((size / FUZZYNESS) > (clusterSize / FUZZYNESS)) {
-        clusterName = Option::FormatClusterFile(++count);
-        size = f->getSize();
-      }
-      clusters[clusterName].push_back(f);
+      continue;
+    }
+    const string &name = f->getName();
+    uint64 h = hash_string(name.c_str(), name.size());
+    if (clusterName.empty() ||
+        (size >= clusterSize / 2 && h % boundary == 0)) {
+      clusterName = new_cluster_name(clusters, name);
+      size = 0;
     }
+    size += f->getSize();
+    clusters[clusterName].push_back(f);
   }
   for (unsigned int i = 0; i < largeFiles.size(); i++) {
-    clusters[Option::FormatClusterFile(++count)].push_back(largeFiles[i]);
+    clusters[new_cluster_name(clusters, largeFiles[i]->getName())].
+      push_back(largeFiles[i]);
   }
 }
 
@@ -850,7 +987,9 @@ void AnalysisResult::repartitionLargeCPP(const vector<string> &filenames,
       count++;
     }
   }
-  int64 averageSize = totalSize / count;
+  // rounded, so one file changing doesn't move every cut point
+  int64 averageSize = 1;
+  while (averageSize * 2 <= totalSize / count) averageSize <<= 1;
   for (unsigned int i = 0; i < filenames.size(); i++) {
     repartitionCPP(filenames[i], averageSize, true);
   }
@@ -1190,6 +1329,14 @@ void AnalysisResult::outputRTTIMetaData(const char *filename) {
                     Util::safe_strerror(errno).c_str());
   }
   fprintf(f, "%d\n", m_paramRTTICounter);
+  vector<const char *> names(m_paramRTTICounter);
+  for (map<string, int>::const_iterator
+       iter = m_paramRTTIs.begin(); iter != m_paramRTTIs.end(); ++iter) {
+    names[iter->second] = iter->first.c_str();
+  }
+  for (int i = 0; i < m_paramRTTICounter; i++) {
+    fprintf(f, "%s\n", names[i]);
+  }
   for (set<string>::const_iterator
        iter = m_rttiFuncs.begin(); iter != m_rttiFuncs.end(); ++iter) {
     fprintf(f, "%s\n", iter->c_str());
@@ -1302,6 +1449,19 @@ void AnalysisResult::outputCPPDynamicTables(CodeGenerator::Output output) {
       }
     }
 
+    vector<const char *> fewArgsFuncs;
+    if (canUseInvokeCaches(cg)) {
+      for (StringToFunctionScopePtrVecMap::const_iterator iter =
+             m_functionDecs.begin(); iter != m_functionDecs.end(); ++iter) {
+        FunctionScopePtr func = iter->second[0];
+        if (func->hasInvokeFewArgs()) {
+          func->outputCPPInvokeFewArgsDecl(cg, iter->first.c_str());
+          cg.printf(";\n");
+          fewArgsFuncs.push_back(iter->first.c_str());
+        }
+      }
+    }
+
     cg.printSection("Function Invoke Table");
     if (system) {
       outputCPPJumpTable(cg, ar);
@@ -1364,6 +1524,21 @@ void AnalysisResult::outputCPPDynamicTables(CodeGenerator::Output output) {
       }
       cg.indentEnd("}\n");
 
+      cg.indentBegin("InvokeFewArgsFunc get_invoke_few_args(const char *s, "
+                     "int64 hash) {\n");
+      for (JumpTable jt(cg, fewArgsFuncs, true, true, false); jt.ready();
+           jt.next()) {
+        const char *name = jt.key();
+        cg.printf("HASH_GUARD(0x%016llXLL, %s) return &%s%s;\n",
+                  hash_string_i(name), name, Option::InvokeFewArgsPrefix,
+                  name);
+      }
+      cg.printf("return NULL;\n");
+      cg.indentEnd("}\n");
+      if (m_invokeCacheCount > 0) {
+        cg.printf("InvokeCache invokeCaches[%d];\n", m_invokeCacheCount);
+      }
+
       outputCPPEvalInvokeTable(cg, ar);
     }
     cg.namespaceEnd();
@@ -2607,6 +2782,14 @@ int AnalysisResult::getLiteralStringId(const std::string &s) {
   return -1;
 }
 
+bool AnalysisResult::canUseInvokeCaches(CodeGenerator &cg) const {
+  // renamed and eval'd functions have to be looked up on every call
+  return Option::InvokeCaches &&
+    cg.getOutput() != CodeGenerator::SystemCPP &&
+    Option::DynamicInvokeFunctions.empty() &&
+    Option::EnableEval != Option::FullEval;
+}
+
 string AnalysisResult::getFuncId(ClassScopePtr cls, FunctionScopePtr func) {
   if (cls) {
     return cls->getId() + "::" + func->getId();
@@ -2620,20 +2803,73 @@ string AnalysisResult::getParamRTTIEntryKey(ClassScopePtr cls,
   return getFuncId(cls, func) + "::" + paramName;
 }
 
+void AnalysisResult::addRTTIEntry(const std::string &key) {
+  if (m_paramRTTIs.find(key) == m_paramRTTIs.end()) {
+    m_paramRTTIs[key] = m_paramRTTICounter++;
+  }
+}
+
+int AnalysisResult::getRTTIEntryId(const std::string &key) {
+  map<string, int>::const_iterator it = m_paramRTTIs.find(key);
+  if (it == m_paramRTTIs.end()) return -1;
+  return it->second;
+}
+
 void AnalysisResult::addParamRTTIEntry(ClassScopePtr cls,
                                        FunctionScopePtr func,
                                        const std::string &paramName) {
-  string key = getParamRTTIEntryKey(cls, func, paramName);
-  m_paramRTTIs[key] = m_paramRTTICounter++;
+  addRTTIEntry(getParamRTTIEntryKey(cls, func, paramName));
 }
 
 int AnalysisResult::getParamRTTIEntryId(ClassScopePtr cls,
                                         FunctionScopePtr func,
                                         const std::string &paramName) {
-  string key = getParamRTTIEntryKey(cls, func, paramName);
-  map<string, int>::const_iterator it = m_paramRTTIs.find(key);
-  if (it == m_paramRTTIs.end()) return -1;
-  return it->second;
+  return getRTTIEntryId(getParamRTTIEntryKey(cls, func, paramName));
+}
+
+void AnalysisResult::addCallRTTIEntry(ClassScopePtr cls,
+                                      FunctionScopePtr func) {
+  addRTTIEntry(getParamRTTIEntryKey(cls, func, "()"));
+}
+
+int AnalysisResult::getCallRTTIEntryId(ClassScopePtr cls,
+                                       FunctionScopePtr func) {
+  return getRTTIEntryId(getParamRTTIEntryKey(cls, func, "()"));
+}
+
+string AnalysisResult::getBranchRTTIEntryName(ConstructPtr branch) {
+  FunctionScopePtr func = getFunctionScope();
+  LocationPtr loc = branch->getLocation();
+  if (!func || !loc) return "";
+  char name[64];
+  snprintf(name, sizeof(name), "@%d:%d", loc->line0, loc->char0);
+  return getParamRTTIEntryKey(getClassScope(), func, name);
+}
+
+void AnalysisResult::addBranchRTTIEntry(ConstructPtr branch) {
+  string key = getBranchRTTIEntryName(branch);
+  if (!key.empty()) addRTTIEntry(key);
+}
+
+int AnalysisResult::getBranchRTTIEntryId(ConstructPtr branch) {
+  string key = getBranchRTTIEntryName(branch);
+  if (key.empty()) return -1;
+  return getRTTIEntryId(key);
+}
+
+int AnalysisResult::getBranchHint(ConstructPtr branch) {
+  string key = getBranchRTTIEntryName(branch);
+  if (key.empty()) return 0;
+  const unsigned int *counter =
+    RTTIInfo::TheRTTIInfo.getProfData(key.c_str());
+  if (!counter) return 0;
+  // too few samples to tell, or not lopsided enough to be worth a hint
+  unsigned int taken = counter[0];
+  unsigned int total = taken + counter[1];
+  if (total < 100) return 0;
+  if (taken >= total / 100 * 99) return 1;
+  if (taken <= total / 100) return -1;
+  return 0;
 }
 
 void AnalysisResult::addRTTIFunction(const std::string &id) {
@@ -2655,13 +2891,41 @@ void AnalysisResult::cloneRTTIFuncs
   }
 }
 
+void AnalysisResult::markHotFunctions
+(ClassScopePtr cls, const StringToFunctionScopePtrVecMap &functions,
+ vector<pair<unsigned int, FunctionScopePtr> > &calls) {
+  for (StringToFunctionScopePtrVecMap::const_iterator iter =
+       functions.begin(); iter != functions.end(); ++iter) {
+    for (unsigned int j = 0; j < iter->second.size(); j++) {
+      FunctionScopePtr func = iter->second[j];
+      string key = getParamRTTIEntryKey(cls, func, "()");
+      const unsigned int *counter =
+        RTTIInfo::TheRTTIInfo.getProfData(key.c_str());
+      if (!counter) continue;
+      if (counter[0]) {
+        calls.push_back(pair<unsigned int, FunctionScopePtr>(counter[0],
+                                                             func));
+      } else {
+        func->setCold();
+      }
+    }
+  }
+}
+
+static bool more_calls(const pair<unsigned int, FunctionScopePtr> &a,
+                       const pair<unsigned int, FunctionScopePtr> &b) {
+  return a.first > b.first;
+}
+
 void AnalysisResult::cloneRTTIFuncs(const char *RTTIDirectory) {
   RTTIInfo::TheRTTIInfo.loadMetaData(Option::RTTIOutputFile.c_str());
   RTTIInfo::TheRTTIInfo.loadProfData(RTTIDirectory);
 
+  vector<pair<unsigned int, FunctionScopePtr> > calls;
   for (unsigned int i = 0; i < m_fileScopes.size(); i++) {
     // standalone rtti functions
     cloneRTTIFuncs(ClassScopePtr(), m_fileScopes[i]->getFunctions());
+    markHotFunctions(ClassScopePtr(), m_fileScopes[i]->getFunctions(), calls);
 
     // class rtti methods
     for (StringToClassScopePtrVecMap::const_iterator iter =
@@ -2670,9 +2934,25 @@ void AnalysisResult::cloneRTTIFuncs(const char *RTTIDirectory) {
       for (unsigned int j = 0; j < iter->second.size(); j++) {
         ClassScopePtr cls = iter->second[j];
         cloneRTTIFuncs(cls, cls->getFunctions());
+        markHotFunctions(cls, cls->getFunctions(), calls);
       }
     }
   }
+
+  // the most called functions that together take 90% of all calls are hot
+  uint64 total = 0;
+  for (unsigned int i = 0; i < calls.size(); i++) {
+    total += calls[i].first;
+  }
+  sort(calls.begin(), calls.end(), more_calls);
+  uint64 sum = 0;
+  unsigned int hot = 0;
+  for (; hot < calls.size() && sum * 10 < total * 9; hot++) {
+    calls[hot].second->setHot();
+    sum += calls[hot].first;
+  }
+  Logger::Info("%d hot functions take %lld of %lld calls",
+               hot, (long long)sum, (long long)total);
 }
 
 void AnalysisResult::outputCPPLiteralStringPrecomputation() {
@@ -148,11 +148,19 @@ public:
 
   /**
    * When types are newly inferred, we need more passes, until no new types
-   * are inferred.
+   * are inferred. The scope whose types changed decides which files those
+   * passes revisit: the file declaring it and every file that looked it up.
+   * NULL means it can't be told, and every file is revisited.
    */
-  void incNewlyInferred() {
-    m_newlyInferred++;
-  }
+  void incNewlyInferred(BlockScope *scope = NULL);
+
+  /**
+   * Type inference stats: passes run, files visited, and file visits a
+   * full pass each time would have made on top of that.
+   */
+  int getInferencePasses() const { return m_inferPasses;}
+  int getInferenceVisits() const { return m_inferVisits;}
+  int getInferenceVisitsSaved() const { return m_inferVisitsSaved;}
 
   void containsDynamicFunctionCall() { m_dynamicFunction = true;}
   void containsDynamicClass() { m_dynamicClass = true;}
@@ -288,6 +296,13 @@ public:
   int getLiteralStringId(const std::string &s);
   void getLiteralStringCompressed(std::string &zsdata, std::string &zldata);
 
+  /**
+   * Inline caches of $f(...) call sites, one InvokeCache each in the
+   * generated invokeCaches[] array.
+   */
+  int addInvokeCache() { return m_invokeCacheCount++;}
+  bool canUseInvokeCaches(CodeGenerator &cg) const;
+
   /**
    * Profiling runtime parameter type
    */
@@ -304,6 +319,18 @@ public:
   void addRTTIFunction(const std::string &id);
   void cloneRTTIFuncs(const char *RTTIDirectory);
 
+  /**
+   * Profiling function call counts and if-branch outcomes, in the same
+   * counters as parameter types. getBranchHint() returns 1 for a branch
+   * that is almost always taken, -1 for one almost never taken, 0 otherwise.
+   */
+  void addCallRTTIEntry(ClassScopePtr cls, FunctionScopePtr func);
+  int getCallRTTIEntryId(ClassScopePtr cls, FunctionScopePtr func);
+  std::string getBranchRTTIEntryName(ConstructPtr branch);
+  void addBranchRTTIEntry(ConstructPtr branch);
+  int getBranchRTTIEntryId(ConstructPtr branch);
+  int getBranchHint(ConstructPtr branch);
+
   /**
    * For global state output
    */
@@ -339,6 +366,17 @@ private:
   BlockScopePtrVec m_scopes;
   BlockScopePtr m_scope;
 
+  // worklist type inference, files are indexed by their vertex
+  bool m_inferTracking;
+  std::vector<std::set<int> > m_inferReaders; // file => files looking it up
+  std::set<int> m_inferChanged; // files whose types the current visit changed
+  bool m_inferChangedAll;       // ... or a program-wide type changed
+  int m_inferPasses;
+  int m_inferVisits;
+  int m_inferVisitsSaved;
+  void addInferenceRead(FileScopePtr provider);
+  int inferTypesPass(std::vector<bool> &dirty, bool full);
+
   StatementPtrVec m_callees;
   StatementPtrSet m_calleesAdded;
   std::string m_outputPath;
@@ -350,6 +388,7 @@ private:
   std::map<std::string, int> m_paramRTTIs;
   std::set<std::string> m_rttiFuncs;
   int m_paramRTTICounter;
+  int m_invokeCacheCount;
 
   bool m_insideScalarArray;
 
@@ -454,6 +493,12 @@ private:
                        const char *buf, int len);
   void outputCPPLiteralStringPrecomputation();
 
+  void addRTTIEntry(const std::string &key);
+  int getRTTIEntryId(const std::string &key);
+  void markHotFunctions(ClassScopePtr cls,
+                        const StringToFunctionScopePtrVecMap &functions,
+                        std::vector<std::pair<unsigned int,
+                                              FunctionScopePtr> > &calls);
   void cloneRTTIFuncs(ClassScopePtr cls,
                       const StringToFunctionScopePtrVecMap &functions);
 
@@ -89,6 +89,13 @@ void FunctionContainer::outputCPPJumpTableSupport
       const char *name = iter->first.c_str();
       if (funcs) funcs->push_back(name);
 
+      if (ar->canUseInvokeCaches(cg) && func->hasInvokeFewArgs()) {
+        func->outputCPPInvokeFewArgsDecl(cg, name);
+        cg.indentBegin(" {\n");
+        func->outputCPPDynamicInvoke(cg, ar, funcPrefix, name, false, true);
+        cg.printf("return null;\n");
+        cg.indentEnd("}\n");
+      }
       if (!systemcpp) {
         vector<const char *> &bucket = ar->getFuncTableBucket(func);
         if (bucket.size() == 1) {
@@ -50,7 +50,8 @@ FunctionScope::FunctionScope(AnalysisResultPtr ar, bool method,
     m_virtual(false), m_overriding(false), m_redeclaring(-1),
     m_volatile(false), m_ignored(false), m_pseudoMain(inPseudoMain),
     m_magicMethod(false), m_system(false), m_inlineable(false),
-    m_containsThis(false), m_callTempCountMax(0), m_callTempCountCurrent(0) {
+    m_containsThis(false), m_hotness(0), m_callTempCountMax(0),
+    m_callTempCountCurrent(0) {
   bool canInline = true;
   if (inPseudoMain) {
     canInline = false;
@@ -126,7 +127,8 @@ FunctionScope::FunctionScope(bool method, const std::string &name,
     m_virtual(false), m_overriding(false), m_redeclaring(-1),
     m_volatile(false), m_ignored(false),
     m_pseudoMain(false), m_magicMethod(false), m_system(true),
-    m_inlineable(false), m_callTempCountMax(0), m_callTempCountCurrent(0) {
+    m_inlineable(false), m_hotness(0),
+    m_callTempCountMax(0), m_callTempCountCurrent(0) {
   m_dynamic = Option::isDynamicFunction(method, m_name);
 }
 
@@ -323,7 +325,7 @@ TypePtr FunctionScope::setParamType(AnalysisResultPtr ar, int index,
   if (!paramType) paramType = NEW_TYPE(Some);
   type = Type::Coerce(ar, paramType, type);
   if (type && !Type::SameType(paramType, type)) {
-    ar->incNewlyInferred();
+    ar->incNewlyInferred(this);
     if (!ar->isFirstPass()) {
       Logger::Verbose("Corrected paramter type %s -> %s",
                       paramType->toString().c_str(), type->toString().c_str());
@@ -385,7 +387,7 @@ void FunctionScope::setReturnType(AnalysisResultPtr ar, TypePtr type) {
   if (m_returnType) {
     type = Type::Coerce(ar, m_returnType, type);
     if (type && !Type::SameType(m_returnType, type)) {
-      ar->incNewlyInferred();
+      ar->incNewlyInferred(this);
       if (!ar->isFirstPass()) {
         Logger::Verbose("Corrected function return type %s -> %s",
                         m_returnType->toString().c_str(),
@@ -434,6 +436,14 @@ void FunctionScope::outputCPP(CodeGenerator &cg, AnalysisResultPtr ar) {
   BlockScope::outputCPP(cg, ar);
 }
 
+void FunctionScope::outputCPPHotness(CodeGenerator &cg) {
+  if (isHot()) {
+    cg.printf("HOT_FUNCTION ");
+  } else if (isCold()) {
+    cg.printf("COLD_FUNCTION ");
+  }
+}
+
 void FunctionScope::outputCPPParamsDecl(CodeGenerator &cg,
                                         AnalysisResultPtr ar,
                                         ExpressionListPtr params,
@@ -723,6 +733,20 @@ void FunctionScope::outputCPPDynamicInvoke(CodeGenerator &cg,
   }
 }
 
+bool FunctionScope::hasInvokeFewArgs() const {
+  return m_dynamic && m_redeclaring < 0 && !m_pseudoMain &&
+    m_minParam <= Option::InvokeFewArgsCount;
+}
+
+void FunctionScope::outputCPPInvokeFewArgsDecl(CodeGenerator &cg,
+                                               const char *name) {
+  cg.printf("Variant %s%s(int count", Option::InvokeFewArgsPrefix, name);
+  for (int i = 0; i < Option::InvokeFewArgsCount; i++) {
+    cg.printf(", CVarRef a%d", i);
+  }
+  cg.printf(")");
+}
+
 void FunctionScope::outputCPPEvalInvoke(CodeGenerator &cg,
                                         AnalysisResultPtr ar,
                                         const char *funcPrefix,
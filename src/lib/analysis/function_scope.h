@@ -264,6 +264,13 @@ public:
                            const char *funcPrefix, const char *name,
                            bool profile, const char *extraArg = NULL);
 
+  /**
+   * The few-args invoke proxy get_invoke_few_args() hands to call site
+   * caches, which takes arguments one by one instead of in an Array.
+   */
+  bool hasInvokeFewArgs() const;
+  void outputCPPInvokeFewArgsDecl(CodeGenerator &cg, const char *name);
+
   /**
    * ...so ClassStatement can call them for classes that don't have
    * constructors defined
@@ -310,6 +317,16 @@ public:
     m_stmtCloned = stmt;
   }
 
+  /**
+   * From call counts in RTTI profile data: hot functions take most of the
+   * calls, cold ones were never called.
+   */
+  void setHot() { m_hotness = 1;}
+  bool isHot() const { return m_hotness > 0;}
+  void setCold() { m_hotness = -1;}
+  bool isCold() const { return m_hotness < 0;}
+  void outputCPPHotness(CodeGenerator &cg);
+
 private:
   bool m_method;
   FileScopeWeakPtr m_file;
@@ -333,6 +350,7 @@ private:
   bool m_system;
   bool m_inlineable;
   bool m_containsThis; // contains a usage of $this?
+  int m_hotness; // 1: hot, -1: cold, 0: unknown
   int m_callTempCountMax;
   int m_callTempCountCurrent;
   StatementPtr m_stmtCloned; // cloned method body stmt
@@ -139,7 +139,7 @@ TypePtr SymbolTable::setType(AnalysisResultPtr ar, const std::string &name,
     TypePtr newType = getType(name, true);
     if (!newType) newType = NEW_TYPE(Some);
     if (!Type::SameType(oldType, newType)) {
-      ar->incNewlyInferred();
+      ar->incNewlyInferred(&m_blockScope);
     }
     return newType;
   }
@@ -792,7 +792,8 @@ void VariableTable::outputCPPGlobalVariablesImpl(CodeGenerator &cg,
   bool system = (cg.getOutput() == CodeGenerator::SystemCPP);
 
   if (!system) {
-    cg.printf("IMPLEMENT_SMART_ALLOCATION_NOCALLBACKS(GlobalVariables);\n");
+    cg.printf("IMPLEMENT_SMART_ALLOCATION_NOCALLBACKS_ITEMS"
+              "(GlobalVariables, 1);\n");
   }
 
   const char *clsname = system ? "SystemGlobals" : "GlobalVariables";
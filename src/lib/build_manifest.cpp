@@ -0,0 +1,162 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#include <lib/build_manifest.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <utime.h>
+#include <util/logger.h>
+#include <util/util.h>
+#include <cpp/base/zend/zend_string.h>
+
+using namespace HPHP;
+using namespace std;
+
+#define MANIFEST_FILE ".hphp_manifest"
+
+///////////////////////////////////////////////////////////////////////////////
+
+static bool is_source(const char *name) {
+  const char *ext = strrchr(name, '.');
+  return ext && (strcmp(ext, ".cpp") == 0 || strcmp(ext, ".h") == 0 ||
+                 strcmp(ext, ".c") == 0);
+}
+
+static bool hash_file(const string &path, string &hash) {
+  ifstream f(path.c_str());
+  if (!f) return false;
+  string content((istreambuf_iterator<char>(f)), istreambuf_iterator<char>());
+  int len;
+  char *md5 = string_md5(content.data(), content.size(), false, len);
+  hash.assign(md5, len);
+  free(md5);
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+BuildManifest::BuildManifest(const std::string &dir) : m_dir(dir) {
+  if (!m_dir.empty() && m_dir[m_dir.size() - 1] != '/') m_dir += '/';
+}
+
+void BuildManifest::load() {
+  m_entries.clear();
+  ifstream f((m_dir + MANIFEST_FILE).c_str());
+  string line;
+  while (getline(f, line)) {
+    // hash, mtime and then the path, which may contain spaces
+    size_t pos1 = line.find(' ');
+    if (pos1 == string::npos) continue;
+    size_t pos2 = line.find(' ', pos1 + 1);
+    if (pos2 == string::npos) continue;
+    string path = line.substr(pos2 + 1);
+
+    Entry entry;
+    entry.hash = line.substr(0, pos1);
+    entry.mtime = atol(line.substr(pos1 + 1, pos2 - pos1 - 1).c_str());
+
+    // something else has written the file since, and whatever was built
+    // from it can't be trusted to match what the last run generated
+    struct stat sb;
+    if (stat((m_dir + path).c_str(), &sb) || sb.st_mtime != entry.mtime) {
+      continue;
+    }
+    m_entries[path] = entry;
+  }
+}
+
+int BuildManifest::update() {
+  vector<string> files;
+  collect("", files);
+
+  EntryMap entries;
+  int changed = 0;
+  for (unsigned int i = 0; i < files.size(); i++) {
+    const string &path = files[i];
+    string fullPath = m_dir + path;
+    Entry entry;
+    struct stat sb;
+    if (!hash_file(fullPath, entry.hash) || stat(fullPath.c_str(), &sb)) {
+      continue;
+    }
+    entry.mtime = sb.st_mtime;
+
+    EntryMap::const_iterator iter = m_entries.find(path);
+    if (iter != m_entries.end() && iter->second.hash == entry.hash) {
+      if (entry.mtime != iter->second.mtime) {
+        struct utimbuf ut;
+        ut.actime = sb.st_atime;
+        ut.modtime = iter->second.mtime;
+        if (utime(fullPath.c_str(), &ut) == 0) {
+          entry.mtime = iter->second.mtime;
+        }
+      }
+    } else {
+      changed++;
+    }
+    entries[path] = entry;
+  }
+  m_entries.swap(entries);
+
+  string manifest = m_dir + MANIFEST_FILE;
+  string temp = manifest + ".tmp";
+  {
+    ofstream f(temp.c_str());
+    for (EntryMap::const_iterator iter = m_entries.begin();
+         iter != m_entries.end(); ++iter) {
+      f << iter->second.hash << ' ' << (int64)iter->second.mtime << ' '
+        << iter->first << '\n';
+    }
+    f.close();
+    if (!f) {
+      Logger::Error("Unable to write %s", temp.c_str());
+      unlink(temp.c_str());
+      return changed;
+    }
+  }
+  if (rename(temp.c_str(), manifest.c_str())) {
+    Logger::Error("Unable to write %s: %s", manifest.c_str(),
+                  Util::safe_strerror(errno).c_str());
+  }
+
+  Logger::Info("%d of %d generated files changed", changed,
+               (int)files.size());
+  return changed;
+}
+
+void BuildManifest::collect(const std::string &path,
+                            std::vector<std::string> &files) {
+  string fullPath = m_dir + path;
+  DIR *dir = opendir(fullPath.c_str());
+  if (dir == NULL) return;
+
+  dirent *e;
+  while ((e = readdir(dir))) {
+    const char *ename = e->d_name;
+    if (ename[0] == '.') continue; // ., .. and the manifest itself
+
+    string fe = path + ename;
+    struct stat sb;
+    if (lstat((m_dir + fe).c_str(), &sb)) continue;
+    if (S_ISDIR(sb.st_mode)) {
+      collect(fe + "/", files);
+    } else if (S_ISREG(sb.st_mode) && is_source(ename)) {
+      files.push_back(fe);
+    }
+  }
+  closedir(dir);
+}
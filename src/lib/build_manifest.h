@@ -0,0 +1,65 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef __BUILD_MANIFEST_H__
+#define __BUILD_MANIFEST_H__
+
+#include <lib/hphp.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Content hashes and timestamps of the C++ files generated into an output
+ * directory, saved there between runs. Every run still rewrites all of them;
+ * the ones that come out identical to what the last run wrote get their old
+ * timestamps back, so make only rebuilds the files whose content changed,
+ * plus whatever includes a changed header.
+ */
+class BuildManifest {
+public:
+  BuildManifest(const std::string &dir);
+
+  /**
+   * Reads what the last run saved. Must be called before generating files,
+   * so that files touched by anything else since then are left alone.
+   */
+  void load();
+
+  /**
+   * Puts back the old timestamp of every generated file whose content is
+   * unchanged, then saves the new hashes and timestamps. Returns how many
+   * files changed.
+   */
+  int update();
+
+private:
+  struct Entry {
+    std::string hash;
+    time_t mtime;
+  };
+  typedef std::map<std::string, Entry> EntryMap;
+
+  std::string m_dir;
+  EntryMap m_entries; // by path relative to m_dir
+
+  void collect(const std::string &path, std::vector<std::string> &files);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // __BUILD_MANIFEST_H__
@@ -34,7 +34,7 @@ DynamicFunctionCall::DynamicFunctionCall
 (EXPRESSION_CONSTRUCTOR_PARAMETERS,
  ExpressionPtr name, ExpressionListPtr params, const std::string *classname)
   : FunctionCall(EXPRESSION_CONSTRUCTOR_PARAMETER_VALUES,
-                 name, "", params, classname) {
+                 name, "", params, classname), m_invokeCacheId(-1) {
 }
 
 ExpressionPtr DynamicFunctionCall::clone() {
@@ -57,6 +57,11 @@ void DynamicFunctionCall::analyzeProgram(AnalysisResultPtr ar) {
     m_params->controlOrder();
     m_params->analyzeProgram(ar);
   }
+  if (ar->getPhase() == AnalysisResult::AnalyzeFinal &&
+      m_className.empty() && m_invokeCacheId < 0 &&
+      (!m_params || m_params->getCount() <= Option::InvokeFewArgsCount)) {
+    m_invokeCacheId = ar->addInvokeCache();
+  }
 }
 
 ExpressionPtr DynamicFunctionCall::preOptimize(AnalysisResultPtr ar) {
@@ -134,6 +139,8 @@ void DynamicFunctionCall::outputPHP(CodeGenerator &cg, AnalysisResultPtr ar) {
 void DynamicFunctionCall::outputCPPImpl(CodeGenerator &cg,
                                         AnalysisResultPtr ar) {
   bool linemap = outputLineMap(cg, ar);
+  bool cached = m_className.empty() && m_invokeCacheId >= 0 &&
+    ar->canUseInvokeCaches(cg);
   if (m_params) m_params->outputCPPControlledEvalOrderPre(cg, ar);
   if (!m_className.empty()) {
     if (m_validClass) {
@@ -149,6 +156,8 @@ void DynamicFunctionCall::outputCPPImpl(CodeGenerator &cg,
       cg.printf(")");
       return;
     }
+  } else if (cached) {
+    cg.printf("invokeCaches[%d].invoke(", m_invokeCacheId);
   } else {
     cg.printf("invoke(");
   }
@@ -159,13 +168,24 @@ void DynamicFunctionCall::outputCPPImpl(CodeGenerator &cg,
     m_nameExp->outputCPP(cg, ar);
     cg.printf(")");
   }
-  cg.printf(", ");
-  if (m_params && m_params->getCount() > 0) {
-    FunctionScope::outputCPPArguments(m_params, cg, ar, -1, false);
+  if (cached) {
+    // arguments are passed one by one, not in an Array
+    if (m_params && m_params->getCount() > 0) {
+      cg.printf(", %d, ", m_params->getCount());
+      FunctionScope::outputCPPArguments(m_params, cg, ar, 0, false);
+    } else {
+      cg.printf(", 0");
+    }
+    cg.printf(")");
   } else {
-    cg.printf("Array()");
+    cg.printf(", ");
+    if (m_params && m_params->getCount() > 0) {
+      FunctionScope::outputCPPArguments(m_params, cg, ar, -1, false);
+    } else {
+      cg.printf("Array()");
+    }
+    cg.printf(", -1)");
   }
-  cg.printf(", -1)");
   if (m_params) m_params->outputCPPControlledEvalOrderPost(cg, ar);
   if (linemap) cg.printf(")");
 }
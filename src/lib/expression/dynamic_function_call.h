@@ -31,6 +31,9 @@ public:
                       const std::string *classname);
 
   DECLARE_BASE_EXPRESSION_VIRTUAL_FUNCTIONS;
+
+private:
+  int m_invokeCacheId; // index into invokeCaches[], or -1
 };
 
 ///////////////////////////////////////////////////////////////////////////////
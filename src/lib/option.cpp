@@ -33,6 +33,7 @@
 #include <util/db_query.h>
 #include <boost/algorithm/string/trim.hpp>
 #include <util/util.h>
+#include <util/hash.h>
 
 using namespace HPHP;
 using namespace std;
@@ -132,6 +133,7 @@ string Option::Tab = "  ";
 const char *Option::FunctionPrefix = "f_";
 const char *Option::BuiltinFunctionPrefix = "x_";
 const char *Option::InvokePrefix = "i_";
+const char *Option::InvokeFewArgsPrefix = "ifa_";
 const char *Option::CreateObjectPrefix = "co_";
 const char *Option::PseudoMainPrefix = "pm_";
 const char *Option::VariablePrefix = "v_";
@@ -215,6 +217,7 @@ bool Option::EnableXHP = false;
 int Option::InvokeFewArgsCount = 6;
 bool Option::PrecomputeLiteralStrings = false;
 bool Option::FlattenInvoke = true;
+bool Option::InvokeCaches = true;
 int Option::InlineFunctionThreshold = -1;
 bool Option::ControlEvalOrder = true;
 
@@ -618,8 +621,15 @@ std::string Option::mangleFilename(const std::string &name, bool id) {
   return ret;
 }
 
-std::string Option::FormatClusterFile(int index) {
+std::string Option::FormatClusterFile(const std::string &firstFile,
+                                      int probe /* = 0 */) {
   char buf[PATH_MAX];
-  snprintf(buf, sizeof(buf), "%s%03d", ClusterPrefix, index);
+  unsigned int hash =
+    (unsigned int)hash_string(firstFile.c_str(), firstFile.size());
+  if (probe) {
+    snprintf(buf, sizeof(buf), "%s%08x_%d", ClusterPrefix, hash, probe);
+  } else {
+    snprintf(buf, sizeof(buf), "%s%08x", ClusterPrefix, hash);
+  }
   return buf;
 }
@@ -163,6 +163,7 @@ public:
   static const char *FunctionPrefix;
   static const char *BuiltinFunctionPrefix;
   static const char *InvokePrefix;
+  static const char *InvokeFewArgsPrefix;
   static const char *CreateObjectPrefix;
   static const char *PseudoMainPrefix;
   static const char *VariablePrefix;
@@ -248,9 +249,12 @@ public:
   static std::string mangleFilename(const std::string &name, bool id);
 
   /**
-   * Returns a name for a clustered .cpp file.
+   * Returns a name for a clustered .cpp file, given the first PHP file in
+   * it, so the name stays put when other clusters change. A non-zero probe
+   * gives an alternative name, for when two first files hash the same.
    */
-  static std::string FormatClusterFile(int index);
+  static std::string FormatClusterFile(const std::string &firstFile,
+                                       int probe = 0);
 
   static bool GenerateFFI;
 
@@ -285,6 +289,7 @@ public:
   static int InvokeFewArgsCount;
   static bool PrecomputeLiteralStrings;
   static bool FlattenInvoke;
+  static bool InvokeCaches; // inline caches at $f(...) call sites
   static int InlineFunctionThreshold;
   static bool ControlEvalOrder;
 
@@ -31,6 +31,7 @@
 #include <util/db_query.h>
 #include <util/exception.h>
 #include <util/preprocess.h>
+#include <util/timer.h>
 
 using namespace HPHP;
 using namespace std;
@@ -46,7 +47,7 @@ void (*Package::m_hookHandler)(Package *package, const char *path,
 Package::Package(const char *root, bool bShortTags /* = true */,
                  bool bAspTags /* = false */)
   : m_bShortTags(bShortTags), m_bAspTags(bAspTags), m_files(4000),
-    m_lineCount(0), m_charCount(0) {
+    m_lineCount(0), m_charCount(0), m_parseTime(0) {
   m_root = root;
   if (!m_root.empty() && m_root[m_root.size() - 1] != '/') m_root += "/";
   m_ar = AnalysisResultPtr(new AnalysisResult());
@@ -318,15 +319,18 @@ FileCachePtr Package::getFileCache() {
 ///////////////////////////////////////////////////////////////////////////////
 
 bool Package::parse() {
+  Timer timer(Timer::WallTime);
   hphp_const_char_set files;
-  for (unsigned int i = 0; i < m_files.size(); i++) {
+  bool ret = true;
+  for (unsigned int i = 0; ret && i < m_files.size(); i++) {
     const char *fileName = m_files.at(i);
     if (files.find(fileName) == files.end()) {
       files.insert(fileName);
-      if (!parseImpl(fileName)) return false;
+      ret = parseImpl(fileName);
     }
   }
-  return true;
+  m_parseTime += timer.getMicroSeconds();
+  return ret;
 }
 
 bool Package::parse(const char *fileName) {
@@ -397,7 +401,12 @@ void Package::saveStatsToFile(const char *filename, int totalSeconds) const {
       << "var CharCount = " << getCharCount() << ";\n"
       << "var FunctionCount = " << m_ar->getFunctionCount() << ";\n"
       << "var ClassCount = " << m_ar->getClassCount() << ";\n"
-      << "var TotalTime = " << totalSeconds << ";\n";
+      << "var TotalTime = " << totalSeconds << ";\n"
+      << "var ParseTime = " << (m_parseTime / 1000) << ";\n"
+      << "var InferencePasses = " << m_ar->getInferencePasses() << ";\n"
+      << "var InferenceVisits = " << m_ar->getInferenceVisits() << ";\n"
+      << "var InferenceVisitsSaved = " << m_ar->getInferenceVisitsSaved()
+      << ";\n";
 
     if (getLineCount()) {
       f << "var AvgCharPerLine = " << (getCharCount()/getLineCount()) << ";\n";
@@ -58,6 +58,7 @@ public:
   int getFileCount() const { return m_files.size();}
   int getLineCount() const { return m_lineCount;}
   int getCharCount() const { return m_charCount;}
+  int64 getParseTime() const { return m_parseTime;}
   void getFiles(std::vector<std::string> &files) const;
 
   void saveStatsToFile(const char *filename, int totalSeconds) const;
@@ -82,6 +83,7 @@ private:
   AnalysisResultPtr m_ar;
   int m_lineCount;
   int m_charCount;
+  int64 m_parseTime; // usec spent in parse()
 
   FileCachePtr m_fileCache;
   std::set<std::string> m_directories;
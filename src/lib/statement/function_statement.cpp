@@ -186,6 +186,7 @@ void FunctionStatement::outputCPP(CodeGenerator &cg, AnalysisResultPtr ar) {
   }
 
   if (funcScope->isInlined()) cg.printf("inline ");
+  funcScope->outputCPPHotness(cg);
 
   TypePtr type = funcScope->getReturnType();
   if (type) {
@@ -228,6 +229,10 @@ void FunctionStatement::outputCPP(CodeGenerator &cg, AnalysisResultPtr ar) {
       } else {
         cg.printf("FUNCTION_INJECTION(%s);\n",
                   funcScope->getOriginalName().c_str());
+        if (Option::GenRTTIProfileData) {
+          int id = ar->getCallRTTIEntryId(ClassScopePtr(), funcScope);
+          if (id != -1) cg.printf("RTTI_CALL_INJECTION(%d);\n", id);
+        }
         if (Option::GenRTTIProfileData && m_params) {
           for (int i = 0; i < m_params->getCount(); i++) {
             ParameterExpressionPtr param =
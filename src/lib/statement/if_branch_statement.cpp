@@ -16,6 +16,8 @@
 
 #include <lib/statement/if_branch_statement.h>
 #include <lib/expression/constant_expression.h>
+#include <lib/analysis/analysis_result.h>
+#include <lib/option.h>
 
 using namespace HPHP;
 using namespace std;
@@ -45,7 +47,13 @@ StatementPtr IfBranchStatement::clone() {
 // static analysis functions
 
 void IfBranchStatement::analyzeProgram(AnalysisResultPtr ar) {
-  if (m_condition) m_condition->analyzeProgram(ar);
+  if (m_condition) {
+    m_condition->analyzeProgram(ar);
+    if (Option::GenRTTIProfileData &&
+        ar->getPhase() == AnalysisResult::AnalyzeFinal) {
+      ar->addBranchRTTIEntry(shared_from_this());
+    }
+  }
   if (m_stmt) m_stmt->analyzeProgram(ar);
 }
 
@@ -116,9 +124,21 @@ void IfBranchStatement::outputPHP(CodeGenerator &cg, AnalysisResultPtr ar) {
 
 void IfBranchStatement::outputCPP(CodeGenerator &cg, AnalysisResultPtr ar) {
   if (m_condition) {
-    cg.printf("if (");
+    int id = -1, hint = 0;
+    if (Option::GenRTTIProfileData) {
+      id = ar->getBranchRTTIEntryId(shared_from_this());
+    } else if (Option::UseRTTIProfileData) {
+      hint = ar->getBranchHint(shared_from_this());
+    }
+    if (id != -1) {
+      cg.printf("if (RTTI_BRANCH(%d, ", id);
+    } else if (hint) {
+      cg.printf("if (%s(", hint > 0 ? "LIKELY" : "UNLIKELY");
+    } else {
+      cg.printf("if (");
+    }
     m_condition->outputCPP(cg, ar);
-    cg.printf(") ");
+    cg.printf(id != -1 || hint ? ")) " : ") ");
   }
   if (m_stmt) {
     m_stmt->outputCPP(cg, ar);
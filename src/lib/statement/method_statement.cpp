@@ -275,6 +275,11 @@ void MethodStatement::analyzeProgram(AnalysisResultPtr ar) {
 
   funcScope->setIncludeLevel(ar->getIncludeLevel());
   ar->pushScope(funcScope);
+  if (Option::GenRTTIProfileData && m_stmt &&
+      ar->getPhase() == AnalysisResult::AnalyzeFinal &&
+      !funcScope->inPseudoMain()) {
+    ar->addCallRTTIEntry(ar->getClassScope(), funcScope);
+  }
   if (m_params) {
     m_params->analyzeProgram(ar);
     if (Option::GenRTTIProfileData &&
@@ -456,6 +461,7 @@ void MethodStatement::outputCPP(CodeGenerator &cg, AnalysisResultPtr ar) {
     break;
   case CodeGenerator::CppImplementation:
     if (m_stmt) {
+      funcScope->outputCPPHotness(cg);
       TypePtr type = funcScope->getReturnType();
       if (type) {
         type->outputCPPDecl(cg, ar);
@@ -489,6 +495,10 @@ void MethodStatement::outputCPP(CodeGenerator &cg, AnalysisResultPtr ar) {
                   scope->getOriginalName(), scope->getOriginalName(),
                   m_originalName.c_str());
       }
+      if (Option::GenRTTIProfileData) {
+        int id = ar->getCallRTTIEntryId(ar->getClassScope(), funcScope);
+        if (id != -1) cg.printf("RTTI_CALL_INJECTION(%d);\n", id);
+      }
       if (Option::GenRTTIProfileData && m_params) {
         for (int i = 0; i < m_params->getCount(); i++) {
           ParameterExpressionPtr param =
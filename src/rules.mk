@@ -348,6 +348,9 @@ endif
 ifdef STACK_FRAME_INJECTION
 CPPFLAGS += -DSTACK_FRAME_INJECTION
 endif
+ifdef NO_COMPUTED_GOTO
+CPPFLAGS += -DNO_COMPUTED_GOTO
+endif
 
 ifdef GOOGLE_CPU_PROFILER
 CPPFLAGS += -DGOOGLE_CPU_PROFILER
@@ -2829,6 +2829,20 @@ bool TestCodeRun::TestDynamicFunctions() {
       "$goo(foo());"
       "bar(foo());");
 
+  // one call site seeing more names than its inline cache holds, in
+  // different cases, including a builtin that goes through invoke()
+  MVCR("<?php "
+      "function f1($a) { return 'f1'.$a;} "
+      "function f2($a, $b = 'x') { return 'f2'.$a.$b;} "
+      "function f3(&$a) { $a = 'f3'; return $a;} "
+      "function f4() { return implode(',', func_get_args());} "
+      "$v = 'v';"
+      "foreach (array('f1', 'F2', 'f2', 'strcmp', 'f3', 'f4', 'F1', 'f1') "
+      "         as $f) {"
+      "  var_dump($f($v, 'y'));"
+      "}"
+      "var_dump($v);");
+
   Option::DynamicInvokeFunctions.insert("test1");
   Option::DynamicInvokeFunctions.insert("test2");
   VCR("<?php "
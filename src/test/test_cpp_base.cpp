@@ -19,6 +19,7 @@
 #include <util/logger.h>
 #include <cpp/base/memory/memory_manager.h>
 #include <cpp/base/builtin_functions.h>
+#include <cpp/base/array/zend_array.h>
 #include <cpp/ext/ext_variable.h>
 #include <cpp/ext/ext_apc.h>
 #include <cpp/ext/ext_mysql.h>
@@ -41,6 +42,10 @@ bool TestCppBase::RunTests(const std::string &which) {
   RUN_TEST(TestSmartAllocator);
   RUN_TEST(TestString);
   RUN_TEST(TestArray);
+  RUN_TEST(TestArrayPointer);
+  RUN_TEST(TestArrayReferences);
+  RUN_TEST(TestDenseArray);
+  RUN_TEST(TestVariantArrays);
   RUN_TEST(TestObject);
   RUN_TEST(TestVariant);
   RUN_TEST(TestListAssignment);
@@ -92,6 +97,15 @@ public:
 typedef SmartAllocator<SomeClass, -1, SmartAllocatorImpl::NoCallbacks>
         SomeClassAlloc;
 
+class SomeSmallClass {
+public:
+  int64 m_data1;
+  int64 m_data2;
+
+  DECLARE_SMART_ALLOCATION_NOCALLBACKS(SomeSmallClass);
+};
+IMPLEMENT_SMART_ALLOCATION_NOCALLBACKS(SomeSmallClass);
+
 bool TestCppBase::TestSmartAllocator() {
   int iMax = 1000000;
   int64 time1, time2;
@@ -119,6 +133,30 @@ bool TestCppBase::TestSmartAllocator() {
       printf("malloc/free: %lld us\n", time2);
     }
   }
+  {
+    // same sized classes share one size-class allocator
+    VERIFY(sizeof(SomeSmallClass) == sizeof(Variant));
+    VERIFY((SmartAllocatorImpl*)SomeSmallClass::Allocator.get() ==
+           (SmartAllocatorImpl*)Variant::Allocator.get());
+
+    const MemoryUsageStats &stats =
+      MemoryManager::TheMemoryManager()->getStats();
+    int index = SmartAllocatorImpl::SizeClassIndex(sizeof(SomeSmallClass));
+    int64 usage = stats.sizeClassUsage[index];
+    SomeSmallClass *obj = NEW(SomeSmallClass)();
+    VERIFY(stats.sizeClassUsage[index] == usage + sizeof(SomeSmallClass));
+    DELETE(SomeSmallClass)(obj);
+    VERIFY(stats.sizeClassUsage[index] == usage);
+  }
+  {
+    // the biggest per slab item count asked for wins
+    VERIFY(Array::Allocator.get()->getItemCount() >= 128);
+    VERIFY(Variant::Allocator.get()->getItemCount() ==
+           SizeClassAllocatorBase::DefaultSlabItems(sizeof(SomeSmallClass)));
+    VERIFY(ZendArray::Bucket::Allocator.get()->getItemCount() ==
+           4 * SizeClassAllocatorBase::DefaultSlabItems(
+             sizeof(ZendArray::Bucket)));
+  }
   return Count(true);
 }
 
@@ -623,6 +661,135 @@ bool TestCppBase::TestArray() {
   return Count(true);
 }
 
+bool TestCppBase::TestArrayPointer() {
+  // internal pointer follows removals and resumes on appends
+  {
+    Variant arr = CREATE_MAP3("a", 1, "b", 2, "c", 3);
+    VS(arr.array_iter_current(), 1);
+    VS(arr.array_iter_next(), 2);
+    VS(arr.array_iter_key(), "b");
+    arr.remove("b");
+    VS(arr.array_iter_current(), 3);
+    VS(arr.array_iter_next(), false);
+    arr.set("d", 4);
+    VS(arr.array_iter_current(), 4);
+    VS(arr.array_iter_prev(), 3);
+    VS(arr.array_iter_prev(), 1);
+    VS(arr.array_iter_end(), 4);
+    VS(arr.array_iter_reset(), 1);
+  }
+
+  // order and lookups survive removals followed by growth
+  {
+    Array arr = Array::Create();
+    for (int i = 0; i < 100; i++) arr.set(i * 2, i);
+    for (int i = 0; i < 100; i += 2) arr.remove(i * 2);
+    for (int i = 100; i < 200; i++) arr.set(i * 2, i);
+    VERIFY(arr.size() == 150);
+    VERIFY(!arr.exists(196));
+    VS(arr[198], 99);
+    VS(arr[200], 100);
+    int i = 1;
+    for (ArrayIter iter = arr.begin(); iter; ++iter) {
+      VS(iter.second(), i);
+      i = i < 99 ? i + 2 : (i == 99 ? 100 : i + 1);
+    }
+    VERIFY(i == 200);
+  }
+
+  // stack and queue operations renumber integer keys
+  {
+    Array arr = CREATE_VECTOR3(1, 2, 3);
+    arr.insert(0, 0);
+    VS(arr, CREATE_VECTOR4(0, 1, 2, 3));
+    VS(arr.pop(), 3);
+    VS(arr.dequeue(), 0);
+    VS(arr, CREATE_VECTOR2(1, 2));
+    arr.append(9);
+    VS(arr, CREATE_VECTOR3(1, 2, 9));
+  }
+
+  return Count(true);
+}
+
+bool TestCppBase::TestArrayReferences() {
+  // references into an array stay bound while it grows
+  {
+    Array arr = CREATE_MAP1("a", 1);
+    Variant v = arr.refvalAt("a");
+    for (int i = 0; i < 100; i++) arr.append(i);
+    v = 5;
+    VS(arr["a"], 5);
+  }
+  {
+    Array arr = CREATE_VECTOR2(1, "a");
+    Variant v = arr.refvalAt(0);
+    for (int i = 0; i < 100; i++) arr.append(i);
+    v = 5;
+    VS(arr[0], 5);
+  }
+
+  // copying an array keeps elements bound to references
+  {
+    Array arr = CREATE_MAP1("k", 1);
+    Variant v = arr.refvalAt("k");
+    Array copy = arr;
+    arr.set("x", 2);
+    v = 5;
+    VS(arr["k"], 5);
+    VS(copy["k"], 5);
+    copy.set("k", 6);
+    VS(v, 6);
+    VS(arr["k"], 6);
+  }
+  {
+    Array arr = CREATE_VECTOR2(1, "a");
+    Variant v = arr.refvalAt(0);
+    Array copy = arr;
+    arr.append(2);
+    v = 5;
+    VS(arr[0], 5);
+    VS(copy[0], 5);
+    copy.set(0, 6);
+    VS(v, 6);
+    VS(arr[0], 6);
+  }
+
+  return Count(true);
+}
+
+static void bind_two(Variant &a, Variant &b) {
+  a = 1;
+  b = 2;
+}
+
+bool TestCppBase::TestDenseArray() {
+  RuntimeOption::UseDenseArray = true;
+  bool ret = TestArray() && TestArrayPointer() && TestArrayReferences();
+
+  // f($a['new1'], $a['new2']) with by-ref params: the first slot has to
+  // survive the second insert, whatever size the array is at
+  for (int n = 0; ret && n < 40; n++) {
+    Array arr = Array::Create();
+    for (int i = 0; i < n; i++) arr.append(i);
+    bind_two(arr.lvalAt("new1"), arr.lvalAt("new2"));
+    VS(arr.size(), n + 2);
+    VS(arr["new1"], 1);
+    VS(arr["new2"], 2);
+  }
+
+  RuntimeOption::UseDenseArray = false;
+  return ret;
+}
+
+bool TestCppBase::TestVariantArrays() {
+  // VectorVariant and MapVariant are only used without ZendArray
+  RuntimeOption::UseZendArray = false;
+  bool ret = TestArrayReferences();
+  RuntimeOption::UseZendArray = true;
+  return ret;
+}
+
 bool TestCppBase::TestObject() {
   {
     String s = "O:1:\"B\":1:{s:3:\"obj\";O:1:\"A\":1:{s:1:\"a\";i:10;}}";
@@ -860,7 +1027,7 @@ public:
   DECLARE_SMART_ALLOCATION_NOCALLBACKS(TestGlobals);
   void dump() {}
 };
-IMPLEMENT_SMART_ALLOCATION_NOCALLBACKS(TestGlobals);
+IMPLEMENT_SMART_ALLOCATION_NOCALLBACKS_ITEMS(TestGlobals, 1);
 
 bool TestCppBase::TestMemoryManager() {
   s_apc_store.reset();
@@ -936,6 +1103,21 @@ bool TestCppBase::TestMemoryManager() {
     globals->m_string++; // mutating m_data internally
     VS(globals->m_string, "appleorangf");
 
+    // request strings are allocated from RequestArena
+    {
+      String s = String("apple") + "pie";
+      VERIFY(s->isArena());
+      s += "s";
+      VS(s, "applepies");
+      VERIFY(s->isArena());
+
+      // shrinking in place, then growing again
+      s->setChar(0, String(""));
+      s += "!";
+      VS(s, "pplepies!");
+      VERIFY(s->isArena());
+    }
+
     globals->m_array.set("a", "pear");
     globals->m_array.set("c", "banana");
     VS(globals->m_array["a"], "pear");
@@ -55,6 +55,10 @@ class TestCppBase : public TestBase {
    */
   bool TestString();
   bool TestArray();
+  bool TestArrayPointer();
+  bool TestArrayReferences();
+  bool TestDenseArray();
+  bool TestVariantArrays();
   bool TestObject();
   bool TestVariant();
   bool TestListAssignment();
@@ -19,6 +19,7 @@
 #include <cpp/base/shared/shared_store.h>
 #include <cpp/base/runtime_option.h>
 #include <cpp/base/program_functions.h>
+#include <util/async_func.h>
 
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -122,6 +123,38 @@ bool TestExtApc::RunTests(const std::string &which) {
   RUN_TEST(test_apc_bin_dumpfile);
   RUN_TEST(test_apc_bin_loadfile);
 
+  RuntimeOption::ApcTableType = RuntimeOption::ApcShardedTable;
+  s_apc_store.reset();
+  printf("\nNon shared-memory sharded version:\n");
+  RUN_TEST(test_apc_add);
+  RUN_TEST(test_apc_store);
+  RUN_TEST(test_apc_fetch);
+  RUN_TEST(test_apc_delete);
+  RUN_TEST(test_apc_compile_file);
+  RUN_TEST(test_apc_cache_info);
+  RUN_TEST(test_apc_clear_cache);
+  RUN_TEST(test_apc_define_constants);
+  RUN_TEST(test_apc_load_constants);
+  RUN_TEST(test_apc_sma_info);
+  RUN_TEST(test_apc_filehits);
+  RUN_TEST(test_apc_delete_file);
+  RUN_TEST(test_apc_inc);
+  RUN_TEST(test_apc_dec);
+  RUN_TEST(test_apc_cas);
+  RUN_TEST(test_apc_bin_dump);
+  RUN_TEST(test_apc_bin_load);
+  RUN_TEST(test_apc_bin_dumpfile);
+  RUN_TEST(test_apc_bin_loadfile);
+
+  // with one shard every write lands on the same retire lists, so batches
+  // are freed while other threads are still reading
+  int shardCount = RuntimeOption::ApcShardCount;
+  RuntimeOption::ApcShardCount = 1;
+  s_apc_store.reset();
+  printf("\nNon shared-memory sharded version with one shard:\n");
+  RUN_TEST(test_apc_concurrent);
+  RuntimeOption::ApcShardCount = shardCount;
+
   s_apc_store.clear();
   RuntimeOption::ApcTableType = RuntimeOption::ApcHashTable;
   RuntimeOption::ApcUseLockedRefs = true;
@@ -366,37 +399,153 @@ bool TestExtApc::test_apc_cas() {
 }
 
 bool TestExtApc::test_apc_bin_dump() {
-  try {
-    f_apc_bin_dump();
-  } catch (NotSupportedException e) {
-    return Count(true);
-  }
-  return Count(false);
+  f_apc_clear_cache();
+  f_apc_store("bs", "TestString");
+  f_apc_store("ba", CREATE_MAP2("a", 1, "b", CREATE_VECTOR1("c")));
+  f_apc_store("bt", 10, 100);
+  String data = f_apc_bin_dump().toString();
+  VERIFY(data.size() > 0);
+
+  String filtered =
+    f_apc_bin_dump(0, CREATE_MAP1("user", CREATE_VECTOR1("bs"))).toString();
+  VERIFY(filtered.size() < data.size());
+  f_apc_clear_cache();
+  VERIFY(f_apc_bin_load(filtered));
+  VS(f_apc_fetch("bs"), "TestString");
+  VS(f_apc_fetch("ba"), false);
+  return Count(true);
 }
 
 bool TestExtApc::test_apc_bin_load() {
-  try {
-    f_apc_bin_load("");
-  } catch (NotSupportedException e) {
-    return Count(true);
-  }
-  return Count(false);
+  f_apc_clear_cache();
+  f_apc_store("bs", "TestString");
+  f_apc_store("ba", CREATE_MAP2("a", 1, "b", CREATE_VECTOR1("c")));
+  f_apc_store("bi", 10);
+  String data = f_apc_bin_dump().toString();
+  f_apc_clear_cache();
+  VS(f_apc_fetch("bs"), false);
+
+  VERIFY(!f_apc_bin_load("not a snapshot"));
+  VERIFY(f_apc_bin_load(data));
+  VS(f_apc_fetch("bs"), "TestString");
+  VS(f_apc_fetch("bs"), "TestString");
+  VS(f_apc_fetch("ba"), CREATE_MAP2("a", 1, "b", CREATE_VECTOR1("c")));
+  VS(f_apc_inc("bi"), 11);
+
+  // keys still pending from a snapshot are dumped again
+  f_apc_clear_cache();
+  VERIFY(f_apc_bin_load(data));
+  f_apc_delete("ba");
+  f_apc_store("bs", "NewValue");
+  String again = f_apc_bin_dump().toString();
+  f_apc_clear_cache();
+  VERIFY(f_apc_bin_load(again));
+  VS(f_apc_fetch("bs"), "NewValue");
+  VS(f_apc_fetch("ba"), false);
+  VS(f_apc_fetch("bi"), 10);
+  return Count(true);
 }
 
 bool TestExtApc::test_apc_bin_dumpfile() {
-  try {
-    f_apc_bin_dumpfile(0, null, "");
-  } catch (NotSupportedException e) {
-    return Count(true);
-  }
-  return Count(false);
+  f_apc_clear_cache();
+  f_apc_store("bs", "TestString");
+  Variant size = f_apc_bin_dumpfile(0, null, "/tmp/test_apc_bin_dumpfile");
+  VERIFY(size.toInt64() > 0);
+  VERIFY(same(f_apc_bin_dumpfile(0, null, "/no/such/dir/file"), false));
+  unlink("/tmp/test_apc_bin_dumpfile");
+  return Count(true);
 }
 
 bool TestExtApc::test_apc_bin_loadfile() {
-  try {
-    f_apc_bin_loadfile("");
-  } catch (NotSupportedException e) {
-    return Count(true);
+  f_apc_clear_cache();
+  f_apc_store("bs", "TestString");
+  f_apc_store("ba", CREATE_VECTOR2(1, 2));
+  f_apc_bin_dumpfile(0, null, "/tmp/test_apc_bin_loadfile");
+  f_apc_clear_cache();
+
+  VERIFY(!f_apc_bin_loadfile("/no/such/file"));
+  VERIFY(f_apc_bin_loadfile("/tmp/test_apc_bin_loadfile"));
+  VS(f_apc_fetch("bs"), "TestString");
+  VS(f_apc_fetch("ba"), CREATE_VECTOR2(1, 2));
+  unlink("/tmp/test_apc_bin_loadfile");
+  return Count(true);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Stores, fetches and deletes values over a small set of keys shared with
+ * other threads. Every value holds its own key, so a fetch that sees a
+ * freed or half built value shows up as a mismatch.
+ */
+class ApcStressor {
+public:
+  static const int KeyCount = 256;
+  static const int Iterations = 20000;
+
+  ApcStressor(unsigned int seed) : m_seed(seed), m_errors(0) {}
+
+  void run() {
+    for (int i = 0; i < Iterations; i++) {
+      int r = rand_r(&m_seed);
+      String key = String("ck") + String(r % KeyCount);
+      switch ((r >> 16) % 4) {
+      case 0:
+        f_apc_store(key, CREATE_VECTOR2(key, i));
+        break;
+      case 1:
+        f_apc_delete(key);
+        break;
+      default: {
+        Variant v = f_apc_fetch(key);
+        if (!same(v, false) && (!v.isArray() || !equal(v[0], key))) {
+          m_errors++;
+        }
+        break;
+      }
+      }
+    }
   }
-  return Count(false);
+
+  int getErrors() const { return m_errors;}
+
+private:
+  unsigned int m_seed;
+  int m_errors;
+};
+
+bool TestExtApc::test_apc_concurrent() {
+  const int ThreadCount = 8;
+  typedef AsyncFunc<ApcStressor> StressorFunc;
+
+  f_apc_clear_cache();
+  std::vector<ApcStressor*> stressors;
+  std::vector<StressorFunc*> funcs;
+  for (int i = 0; i < ThreadCount; i++) {
+    stressors.push_back(new ApcStressor(i + 1));
+    funcs.push_back(new StressorFunc(stressors[i], &ApcStressor::run));
+  }
+  for (int i = 0; i < ThreadCount; i++) {
+    funcs[i]->start();
+  }
+  int errors = 0;
+  for (int i = 0; i < ThreadCount; i++) {
+    funcs[i]->waitForEnd();
+    errors += stressors[i]->getErrors();
+    delete funcs[i];
+    delete stressors[i];
+  }
+  VS(errors, 0);
+
+  // whatever is left must still be intact
+  for (int i = 0; i < ApcStressor::KeyCount; i++) {
+    String key = String("ck") + String(i);
+    Variant v = f_apc_fetch(key);
+    if (!same(v, false)) {
+      VS(v[0], key);
+    }
+  }
+  f_apc_clear_cache();
+  VS(f_apc_fetch("ck0"), false);
+  return Count(true);
 }
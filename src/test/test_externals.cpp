@@ -271,6 +271,10 @@ Variant invoke(const char *function, CArrRef params, int64 hash,
   return true;
 }
 
+InvokeFewArgsFunc get_invoke_few_args(const char *s, int64 hash) {
+  return NULL;
+}
+
 Variant invoke_static_method(const char* cls, const char *function,
                              CArrRef params, bool fatal) {
   return null;
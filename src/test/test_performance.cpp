@@ -16,8 +16,17 @@
 
 #include <test/test_performance.h>
 #include <util/util.h>
+#include <util/timer.h>
+#include <cpp/eval/bytecode/bytecode.h>
+#include <cpp/eval/runtime/variant_stack.h>
+#include <cpp/eval/runtime/variable_environment.h>
+#include <cpp/eval/analysis/block.h>
+#include <cpp/base/array/array_funcs.h>
+#include <cpp/base/shared/thread_shared_variant.h>
+#include <lib/option.h>
 
 using namespace std;
+using namespace HPHP::Eval;
 
 #define PERF_LOOP_COUNT "500"
 
@@ -48,11 +57,38 @@ bool TestPerformance::RunTests(const std::string &which) {
   bool ret = true;
   RUN_TEST(TestBasicOperations);
   RUN_TEST(TestMemoryUsage);
+  RUN_TEST(TestAPCArrayLookup);
   RUN_TEST(TestAdHocFile);
   RUN_TEST(TestAdHoc);
+  RUN_TEST(TestBytecodeDispatch);
+  RUN_TEST(TestArrayLayout);
+  RUN_TEST(TestInvokeCache);
   return ret;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// timing the same work two ways
+
+/**
+ * Prints both timings and how many times faster the second one is, under a
+ * printf-style description of the work.
+ */
+static void report_timing(const char *name1, int64 us1,
+                          const char *name2, int64 us2,
+                          const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  printf("----------------------------------------------------------\n");
+  vprintf(fmt, ap);
+  va_end(ap);
+  printf("\n\n"
+         "  %10s  %10s\n"
+         "===========================================\n"
+         "  %7d ms  %7d ms   =   %2.4gx\n\n",
+         name1, name2, (int)(us1 / 1000), (int)(us2 / 1000),
+         us2 ? (double)us1 / us2 : 0.0);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // performance testing
 
@@ -135,6 +171,42 @@ bool TestPerformance::TestBasicOperations() {
       "\n\n/* Taking an object's property */"
       PERF_END);
 
+  VCR(PERF_START
+      "$a = array();\n"
+      "for ($i = 0; $i < 50000; $i++) { $a['key'.$i] = $i;}\n"
+      "apc_store('perf', $a);\n"
+      "for ($i = 0; $i < " PERF_LOOP_COUNT "; $i++) {"
+      " $b = apc_fetch('perf');"
+      " for ($j = 0; $j < 100; $j++) { $c = $b['key'.$j];}}"
+      "\n\n/* Fetching an APC array and taking 100 elements */"
+      PERF_END);
+
+  // Mixed values keep these arrays in VectorVariant when Server.UseZendArray
+  // is off; TestArrayLayout compares its element layouts directly.
+  VCR(PERF_START
+      "$a = array();\n"
+      "for ($i = 0; $i < 10000; $i++) { $a[] = $i % 2 ? $i : 'v'.$i;}\n"
+      "for ($i = 0; $i < " PERF_LOOP_COUNT "; $i++) {"
+      " foreach ($a as $v) { $b = $v;}}"
+      "\n\n/* Iterating a 10k element mixed array with foreach */"
+      PERF_END);
+
+  VCR(PERF_START
+      "function perf_id($v) { return $v;}\n"
+      "$a = array();\n"
+      "for ($i = 0; $i < 10000; $i++) { $a[] = $i % 2 ? $i : 'v'.$i;}\n"
+      "for ($i = 0; $i < 50; $i++) { $b = array_map('perf_id', $a);}"
+      "\n\n/* Mapping a 10k element mixed array with array_map */"
+      PERF_END);
+
+  VCR(PERF_START
+      "$a = array();\n"
+      "for ($i = 0; $i < 10000; $i++) {"
+      " $a[] = $i % 2 ? ($i * 7919) % 10007 : (($i * 7919) % 10007).'';}\n"
+      "for ($i = 0; $i < 50; $i++) { $b = $a; sort($b);}"
+      "\n\n/* Sorting a 10k element mixed array */"
+      PERF_END);
+
   return true;
 }
 
@@ -146,6 +218,295 @@ bool TestPerformance::TestMemoryUsage() {
   return true;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// APC array lookups
+
+struct SharedKeyHash {
+  size_t operator()(ThreadSharedVariant *v) const { return v->hash(); }
+};
+
+struct SharedKeyEqual {
+  bool operator()(ThreadSharedVariant *x, ThreadSharedVariant *y) const {
+    return *x == *y;
+  }
+};
+
+typedef hphp_hash_map<ThreadSharedVariant*, int, SharedKeyHash,
+                      SharedKeyEqual> SharedKeyToIntMap;
+
+/**
+ * What APC arrays did before the flat index: ThreadSharedVariantToIntMap,
+ * keyed by each element's shared key and probed with a ThreadSharedVariant
+ * wrapping the lookup key. The probes are built before the timer starts, so
+ * this leaves out the wrapper the old lookup() constructed on every call.
+ */
+static int64 time_shared_key_map(const vector<string> &keys, int rounds,
+                                 int64 &found) {
+  SharedKeyToIntMap map;
+  vector<ThreadSharedVariant*> probes;
+  for (unsigned int i = 0; i < keys.size(); i++) {
+    map[new ThreadSharedVariant(String(keys[i]), false)] = i;
+    probes.push_back(new ThreadSharedVariant(String(keys[i]), false));
+  }
+
+  Timer timer(Timer::UserCPU);
+  for (int n = 0; n < rounds; n++) {
+    for (unsigned int i = 0; i < probes.size(); i++) {
+      SharedKeyToIntMap::const_iterator iter = map.find(probes[i]);
+      if (iter != map.end()) found += iter->second;
+    }
+  }
+  int64 us = timer.getMicroSeconds();
+
+  for (SharedKeyToIntMap::iterator iter = map.begin(); iter != map.end();
+       ++iter) {
+    iter->first->decRef();
+  }
+  for (unsigned int i = 0; i < probes.size(); i++) {
+    probes[i]->decRef();
+  }
+  return us;
+}
+
+static int64 time_flat_index(const vector<string> &keys, int rounds,
+                             int64 &found) {
+  Array arr = Array::Create();
+  for (unsigned int i = 0; i < keys.size(); i++) {
+    arr.set(String(keys[i]), (int64)i);
+  }
+  ThreadSharedVariant *tsv = new ThreadSharedVariant(arr, false);
+
+  Timer timer(Timer::UserCPU);
+  for (int n = 0; n < rounds; n++) {
+    for (unsigned int i = 0; i < keys.size(); i++) {
+      int index = tsv->getIndex(keys[i].data(), keys[i].size(), -1);
+      if (index >= 0) found += index;
+    }
+  }
+  int64 us = timer.getMicroSeconds();
+  tsv->decRef();
+  return us;
+}
+
+bool TestPerformance::TestAPCArrayLookup() {
+  // the same lookups over the same 50k keys, without and then with the
+  // flat index; TestBasicOperations times the full apc_fetch() path
+  int count = 50000;
+  int rounds = 100;
+  vector<string> keys;
+  for (int i = 0; i < count; i++) {
+    keys.push_back("key" + boost::lexical_cast<string>(i));
+  }
+  int64 found1 = 0, found2 = 0;
+  int64 us1 = time_shared_key_map(keys, rounds, found1);
+  int64 us2 = time_flat_index(keys, rounds, found2);
+  VS(found1, found2);
+  VS(found2, (int64)rounds * count * (count - 1) / 2);
+
+  report_timing("Key map", us1, "Flat index", us2,
+                "looking up %d APC array keys %d times", count, rounds);
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// bytecode interpreter dispatch
+
+static StaticString s_i("i");
+static StaticString s_j("j");
+
+static void add_var(ByteCodeProgram &code, CStrRef name) {
+  code.add(ByteCode::String, (void*)name.get());
+  code.add(ByteCode::VarInd);
+}
+
+static void add_set_var(ByteCodeProgram &code, CStrRef name) {
+  code.add(ByteCode::String, (void*)name.get());
+  code.add(ByteCode::SetVarInd);
+  code.add(ByteCode::Discard);
+}
+
+/**
+ * What the AST emits at file scope for
+ *
+ *   $j = 0;
+ *   for ($i = 0; $i < count; $i = $i + 1) { $j = $j + $i; }
+ *
+ * Every operation in the loop either fuses or quickens on integers, so the
+ * time measured is mostly dispatch rather than the work of the statements.
+ */
+static void build_loop(ByteCodeProgram &code, int count) {
+  code.add(ByteCode::Int, 0);
+  add_set_var(code, s_j);
+  code.add(ByteCode::Int, 0);
+  add_set_var(code, s_i);
+  ByteCodeProgram::Label loop = code.here();
+  add_var(code, s_i);
+  code.add(ByteCode::Int, count);
+  code.add(ByteCode::LT);
+  ByteCodeProgram::JumpTag done = code.jumpIfNot();
+  add_var(code, s_j);
+  add_var(code, s_i);
+  code.add(ByteCode::Add);
+  add_set_var(code, s_j);
+  add_var(code, s_i);
+  code.add(ByteCode::Int, 1);
+  code.add(ByteCode::Add);
+  add_set_var(code, s_i);
+  code.bindJumpTag(code.jump(), loop);
+  code.bindJumpTag(done);
+}
+
+static int64 time_loop(ByteCodeProgram &code, bool threaded, Variant &j) {
+  LVariableTable vars;
+  Block blk;
+  NestedVariableEnvironment env(&vars, blk);
+  VariantStack stack;
+  Timer timer(Timer::UserCPU);
+  code.execute(stack, env, threaded);
+  int64 us = timer.getMicroSeconds();
+  j = env.get(s_j);
+  return us;
+}
+
+bool TestPerformance::TestBytecodeDispatch() {
+  // The same program through the switch and then with threaded dispatch,
+  // first as the AST emits it and then with superinstructions. Without
+  // computed goto both columns are the switch.
+  int count = 1000000;
+  for (int optimize = 0; optimize < 2; optimize++) {
+    ByteCodeProgram code;
+    build_loop(code, count);
+    code.finalize(optimize);
+
+    Variant j1, j2;
+    int64 us1 = time_loop(code, false, j1);
+    int64 us2 = time_loop(code, true, j2);
+    VS(j1, j2);
+    VS(j2, (int64)count * (count - 1) / 2);
+
+    report_timing("Switch", us1, "Threaded", us2,
+                  "%s bytecode loop of %d iterations",
+                  optimize ? "optimized" : "plain", count);
+  }
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// array element layout
+
+static Variant make_value(int i) {
+  if (i % 2) return i;
+  return String((int64)i);
+}
+
+/**
+ * What VectorVariant and MapVariant did before values were stored inline:
+ * one smart-allocated Variant per element. Each round copies the array, then
+ * walks and frees the copy, like "$b = $a; foreach ($b as $v) ..." does.
+ */
+static int64 time_boxed(int count, int rounds, int64 &ints) {
+  HphpVector<Variant*> elems;
+  for (int i = 0; i < count; i++) {
+    elems.push_back(NEW(Variant)(make_value(i)));
+  }
+
+  Timer timer(Timer::UserCPU);
+  for (int n = 0; n < rounds; n++) {
+    HphpVector<Variant*> copy;
+    copy.reserve(count);
+    for (int i = 0; i < count; i++) {
+      copy.push_back(NEW(Variant)(*elems[i]));
+    }
+    for (int i = 0; i < count; i++) {
+      if (copy[i]->isInteger()) ints++;
+      DELETE(Variant)(copy[i]);
+    }
+  }
+  int64 us = timer.getMicroSeconds();
+
+  for (int i = 0; i < count; i++) {
+    DELETE(Variant)(elems[i]);
+  }
+  return us;
+}
+
+static int64 time_inline(int count, int rounds, int64 &ints) {
+  HphpVector<Variant> elems;
+  for (int i = 0; i < count; i++) {
+    elems.push_back(make_value(i));
+  }
+
+  Timer timer(Timer::UserCPU);
+  for (int n = 0; n < rounds; n++) {
+    HphpVector<Variant> copy;
+    ArrayFuncs::append(copy, elems);
+    for (int i = 0; i < count; i++) {
+      if (copy[i].isInteger()) ints++;
+    }
+  }
+  return timer.getMicroSeconds();
+}
+
+bool TestPerformance::TestArrayLayout() {
+  int count = 10000;
+  int rounds = 1000;
+  int64 ints1 = 0, ints2 = 0;
+  int64 us1 = time_boxed(count, rounds, ints1);
+  int64 us2 = time_inline(count, rounds, ints2);
+  VS(ints1, ints2);
+  VS(ints2, (int64)rounds * count / 2);
+
+  report_timing("Boxed", us1, "Inline", us2,
+                "copying and iterating %d elements %d times", count, rounds);
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// dynamic function calls
+
+bool TestPerformance::TestInvokeCache() {
+  // The same call sites without and then with inline caches, so each pair of
+  // timings compares invoke()'s function table with a cache hit that also
+  // skips packing arguments into an Array.
+  for (int i = 0; i < 2; i++) {
+    Option::InvokeCaches = (i == 1);
+    printf("InvokeCaches = %s\n", Option::InvokeCaches ? "true" : "false");
+
+    VCR(PERF_START
+        "function func($a, $b) { return $a;}\n"
+        "$f = 'func';\n"
+        "for ($i = 0; $i < " PERF_LOOP_COUNT "; $i++) { $f($i, $i);}"
+        "\n\n/* Calling one function dynamically */"
+        PERF_END);
+
+    VCR(PERF_START
+        "function func1($a) { return $a;}\n"
+        "function func2($a) { return $a;}\n"
+        "function func3($a) { return $a;}\n"
+        "$fs = array('func1', 'func2', 'func3');\n"
+        "for ($i = 0; $i < " PERF_LOOP_COUNT "; $i++) {"
+        " $f = $fs[$i % 3]; $f($i);}"
+        "\n\n/* Calling three functions dynamically from one call site */"
+        PERF_END);
+
+    VCR(PERF_START
+        "function func($a) { return $a;}\n"
+        "for ($i = 0; $i < " PERF_LOOP_COUNT "; $i++) {"
+        " call_user_func('func', $i);}"
+        "\n\n/* Calling a function with call_user_func() */"
+        PERF_END);
+
+    VCR(PERF_START
+        "class A { function func($a) { return $a;}} $obj = new A();\n"
+        "$m = 'func';\n"
+        "for ($i = 0; $i < " PERF_LOOP_COUNT "; $i++) { $obj->$m($i);}"
+        "\n\n/* Calling a method dynamically */"
+        PERF_END);
+  }
+  Option::InvokeCaches = true;
+  return true;
+}
+
 bool TestPerformance::TestAdHocFile() {
   string input;
   FILE *f = fopen("test/perf_ad_hoc.php", "r");
@@ -32,8 +32,12 @@ class TestPerformance : public TestCodeRun {
 
   bool TestBasicOperations();
   bool TestMemoryUsage();
+  bool TestAPCArrayLookup();
   bool TestAdHocFile();
   bool TestAdHoc();
+  bool TestBytecodeDispatch();
+  bool TestArrayLayout();
+  bool TestInvokeCache();
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -20,6 +20,8 @@
 #include <cpp/base/type_string.h>
 #include <util/logger.h>
 #include <cpp/base/shared/shared_string.h>
+#include <util/file_cache.h>
+#include <util/job_queue.h>
 
 using namespace std;
 
@@ -44,6 +46,9 @@ bool TestUtil::RunTests(const std::string &which) {
   RUN_TEST(TestHphpVector);
   RUN_TEST(TestLFUTable);
   RUN_TEST(TestSharedString);
+  RUN_TEST(TestFileCache);
+  RUN_TEST(TestSynchronizableMulti);
+  RUN_TEST(TestJobQueue);
   return ret;
 }
 
@@ -489,3 +494,156 @@ bool TestUtil::TestSharedString() {
 
   return Count(true);
 }
+
+bool TestUtil::TestFileCache() {
+  string text;
+  for (int i = 0; i < 100; i++) text += "compress me ";
+  string image = "not really a gif";
+
+  char dir[] = "/tmp/test_file_cache.XXXXXX";
+  VERIFY(mkdtemp(dir));
+  string txtPath = string(dir) + "/a.txt";
+  string gifPath = string(dir) + "/b.gif";
+  string archive = string(dir) + "/archive";
+  FILE *f = fopen(txtPath.c_str(), "w");
+  fwrite(text.data(), text.size(), 1, f);
+  fclose(f);
+  f = fopen(gifPath.c_str(), "w");
+  fwrite(image.data(), image.size(), 1, f);
+  fclose(f);
+
+  {
+    FileCache fc;
+    fc.write("d/a.txt", txtPath.c_str());
+    fc.write("d/b.gif", gifPath.c_str());
+    fc.write("d/e/index.php");
+    fc.save(archive.c_str());
+  }
+
+  FileCache fc;
+  fc.load(archive.c_str());
+  VERIFY(fc.fileExists("d/a.txt"));
+  VERIFY(fc.fileExists("d/e/index.php"));
+  VERIFY(!fc.fileExists("d/e"));
+  VERIFY(fc.dirExists("d/e"));
+  VERIFY(fc.dirExists("d"));
+  VERIFY(!fc.exists("d/c.txt"));
+  VERIFY(!fc.exists("c"));
+
+  int len;
+  bool compressed = true;
+  const char *data = fc.read("d/a.txt", len, compressed);
+  VERIFY(data && compressed && len < (int)text.size());
+
+  for (int i = 0; i < 2; i++) { // second time from the uncompressed copy
+    compressed = false;
+    data = fc.read("d/a.txt", len, compressed);
+    VERIFY(data && !compressed);
+    VERIFY(string(data, len) == text);
+  }
+
+  compressed = true;
+  data = fc.read("d/b.gif", len, compressed);
+  VERIFY(data && !compressed);
+  VERIFY(string(data, len) == image);
+
+  VERIFY(fc.read("d/missing.txt", len, compressed) == NULL);
+
+  unlink(txtPath.c_str());
+  unlink(gifPath.c_str());
+  unlink(archive.c_str());
+  rmdir(dir);
+  return Count(true);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// threading
+
+struct WakeOrder {
+  WakeOrder(bool lifo) : sync(3, lifo), waiting(0), woke(0) {}
+  SynchronizableMulti sync;
+  int waiting;
+  int woke;
+  vector<int> order;
+};
+
+struct WakeOrderArg {
+  WakeOrder *wake;
+  int id;
+};
+
+static void *wait_to_wake(void *p) {
+  WakeOrderArg *arg = (WakeOrderArg*)p;
+  WakeOrder *wake = arg->wake;
+  Lock lock(wake->sync.getMutex());
+  wake->waiting++;
+  wake->sync.wait(arg->id);
+  wake->order.push_back(arg->id);
+  wake->woke++;
+  return NULL;
+}
+
+static void wait_for_count(WakeOrder &wake, int &count, int value) {
+  while (true) {
+    {
+      Lock lock(wake.sync.getMutex());
+      if (count == value) return;
+    }
+    usleep(1000);
+  }
+}
+
+/**
+ * Threads 0, 1 and 2 start waiting in that order, then get notified one at a
+ * time. Returns the order they woke up in.
+ */
+static vector<int> wake_in_order(bool lifo) {
+  WakeOrder wake(lifo);
+  WakeOrderArg args[3];
+  pthread_t threads[3];
+  for (int i = 0; i < 3; i++) {
+    args[i].wake = &wake;
+    args[i].id = i;
+    pthread_create(&threads[i], NULL, wait_to_wake, &args[i]);
+    wait_for_count(wake, wake.waiting, i + 1);
+  }
+  for (int i = 0; i < 3; i++) {
+    {
+      Lock lock(wake.sync.getMutex());
+      wake.sync.notify();
+    }
+    wait_for_count(wake, wake.woke, i + 1);
+  }
+  for (int i = 0; i < 3; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  return wake.order;
+}
+
+bool TestUtil::TestSynchronizableMulti() {
+  vector<int> order = wake_in_order(true);
+  VERIFY(order.size() == 3);
+  VERIFY(order[0] == 2 && order[1] == 1 && order[2] == 0);
+
+  order = wake_in_order(false);
+  VERIFY(order.size() == 3);
+  VERIFY(order[0] == 0 && order[1] == 1 && order[2] == 2);
+  return Count(true);
+}
+
+bool TestUtil::TestJobQueue() {
+  // an idle worker at the minimum active count still gets to drop caches,
+  // even when parking checks come around more often than that
+  JobQueue<int> queue(1, true);
+  queue.setActiveLimit(1, 2, 1);
+  queue.setDropCacheTimeout(2);
+  bool dropped = false;
+  try {
+    queue.dequeue(0, true);
+  } catch (JobQueue<int>::DropCacheSignal) {
+    dropped = true;
+  }
+  VERIFY(dropped);
+  VERIFY(queue.getActiveLimit() == 1);
+  return Count(true);
+}
@@ -32,6 +32,9 @@ class TestUtil : public TestBase {
   bool TestHphpVector();
   bool TestLFUTable();
   bool TestSharedString();
+  bool TestFileCache();
+  bool TestSynchronizableMulti();
+  bool TestJobQueue();
 };
 
 ///////////////////////////////////////////////////////////////////////////////
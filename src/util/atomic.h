@@ -34,6 +34,11 @@ inline int atomic_dec(int &count) {
   return __gnu_cxx::__exchange_and_add(&count, -1) - 1;
 }
 
+template<class T>
+inline bool atomic_cas(T &mem, T oldval, T newval) {
+  return __sync_bool_compare_and_swap(&mem, oldval, newval);
+}
+
 template<class T>
 inline T atomic_add(T &mem, T val) {
   T r;
@@ -18,6 +18,10 @@
 #include "exception.h"
 #include "compression.h"
 #include "util.h"
+#include "atomic.h"
+#include "logger.h"
+#include <sys/mman.h>
+#include <fcntl.h>
 
 using namespace std;
 
@@ -38,8 +42,21 @@ static bool read_bytes(FILE *f, char *buf, int len) {
   return nread;
 }
 
+// can't be the start of an old archive, whose first short is a name length
+static const char s_magic[8] = {'\xff', '\xff', 'F', 'C', 'A', 'C', 'H', 'E'};
+
+struct path_less {
+  bool operator()(const char *s1, const char *s2) const {
+    return strcmp(s1, s2) < 0;
+  }
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 
+FileCache::FileCache()
+  : m_mapped(NULL), m_mappedSize(0), m_index(NULL), m_count(0) {
+}
+
 FileCache::~FileCache() {
   for (FileMap::iterator iter = m_files.begin(); iter != m_files.end();
        ++iter) {
@@ -51,6 +68,14 @@ FileCache::~FileCache() {
       free(buffer.cdata);
     }
   }
+  if (m_mapped) {
+    munmap(m_mapped, m_mappedSize);
+  }
+  for (unsigned int i = 0; i < m_uncompressed.size(); i++) {
+    if (m_uncompressed[i]) {
+      free(m_uncompressed[i]);
+    }
+  }
 }
 
 void FileCache::writeDirectories(const char *name) {
@@ -148,6 +173,7 @@ void FileCache::write(const char *name, const char *fullpath) {
 
 void FileCache::save(const char *filename) {
   ASSERT(filename && *filename);
+  ASSERT(m_mapped == NULL);
 
   FILE *f = fopen(filename, "w");
   if (f == NULL) {
@@ -155,43 +181,95 @@ void FileCache::save(const char *filename) {
                     Util::safe_strerror(errno).c_str());
   }
 
+  // sorted, so load() can binary search the mapped index
+  vector<const char *> names;
+  names.reserve(m_files.size());
   for (FileMap::const_iterator iter = m_files.begin(); iter != m_files.end();
        ++iter) {
-    short name_len = iter->first.size();
-    const char *name = iter->first.data();
-    ASSERT(name_len);
-    fwrite(&name_len, sizeof(short), 1, f);
-    fwrite(name, name_len, 1, f);
-
-    const Buffer &buffer = iter->second;
-    char c = buffer.cdata ? 1 : 0;
-    fwrite(&c, 1, 1, f);
-    if (c) {
+    ASSERT(!iter->first.empty());
+    names.push_back(iter->first.c_str());
+  }
+  sort(names.begin(), names.end(), path_less());
+
+  Header header;
+  memcpy(header.magic, s_magic, sizeof(header.magic));
+  header.version = ArchiveVersion;
+  header.count = names.size();
+
+  vector<IndexEntry> index(names.size());
+  uint64 offset = sizeof(Header) + sizeof(IndexEntry) * names.size();
+  for (unsigned int i = 0; i < names.size(); i++) {
+    index[i].nameOffset = offset;
+    offset += strlen(names[i]) + 1;
+  }
+  for (unsigned int i = 0; i < names.size(); i++) {
+    const Buffer &buffer = m_files.find(names[i])->second;
+    IndexEntry &entry = index[i];
+    entry.offset = offset;
+    entry.len = buffer.len;
+    if (buffer.cdata) {
       ASSERT(buffer.clen > 0);
-      fwrite(&buffer.clen, sizeof(int), 1, f);
-      ASSERT(buffer.cdata);
-      fwrite(buffer.cdata, buffer.clen, 1, f);
+      entry.clen = buffer.clen;
+      offset += buffer.clen;
     } else {
-      fwrite(&buffer.len, sizeof(int), 1, f);
-      if (buffer.len > 0) {
-        ASSERT(buffer.data);
-        fwrite(buffer.data, buffer.len, 1, f);
-      }
+      entry.clen = -1;
+      if (buffer.len > 0) offset += buffer.len;
     }
   }
 
-  fclose(f);
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+    (index.empty() ||
+     fwrite(&index[0], sizeof(IndexEntry), index.size(), f) == index.size());
+  for (unsigned int i = 0; ok && i < names.size(); i++) {
+    ok = fwrite(names[i], strlen(names[i]) + 1, 1, f) == 1;
+  }
+  for (unsigned int i = 0; ok && i < names.size(); i++) {
+    const Buffer &buffer = m_files.find(names[i])->second;
+    if (buffer.cdata) {
+      ok = fwrite(buffer.cdata, buffer.clen, 1, f) == 1;
+    } else if (buffer.len > 0) {
+      ASSERT(buffer.data);
+      ok = fwrite(buffer.data, buffer.len, 1, f) == 1;
+    }
+  }
+  if (fclose(f) != 0) ok = false;
+  if (!ok) {
+    throw Exception("Unable to write %s: %s", filename,
+                    Util::safe_strerror(errno).c_str());
+  }
 }
 
 void FileCache::load(const char *filename) {
   ASSERT(filename && *filename);
 
+  ASSERT(m_files.empty() && m_mapped == NULL);
+
   FILE *f = fopen(filename, "r");
   if (f == NULL) {
     throw Exception("Unable to open %s: %s", filename,
                     Util::safe_strerror(errno).c_str());
   }
 
+  char magic[sizeof(s_magic)];
+  if (read_bytes(f, magic, sizeof(magic)) &&
+      memcmp(magic, s_magic, sizeof(magic)) == 0) {
+    struct stat sb;
+    if (fstat(fileno(f), &sb) != 0) {
+      fclose(f);
+      throw Exception("Unable to stat %s: %s", filename,
+                      Util::safe_strerror(errno).c_str());
+    }
+    try {
+      loadMapped(filename, fileno(f), sb.st_size);
+    } catch (...) {
+      fclose(f);
+      throw;
+    }
+    fclose(f); // the mapping stays valid
+    return;
+  }
+  rewind(f);
+
   while (true) {
     short name_len;
     if (!read_bytes(f, (char*)&name_len, sizeof(short)) || name_len <= 0) {
@@ -242,12 +320,107 @@ void FileCache::load(const char *filename) {
       }
     }
   }
+  fclose(f);
+}
+
+void FileCache::loadMapped(const char *filename, int fd, size_t size) {
+  if (size < sizeof(Header)) {
+    throw Exception("Bad header in archive %s", filename);
+  }
+  char *mapped = (char *)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (mapped == MAP_FAILED) {
+    throw Exception("Unable to mmap %s: %s", filename,
+                    Util::safe_strerror(errno).c_str());
+  }
+
+  // check every offset once here, so lookups never have to
+  const Header *header = (const Header *)mapped;
+  const char *error = NULL;
+  if (header->version != ArchiveVersion) {
+    error = "Unsupported version %d of archive %s";
+  } else if (header->count < 0 ||
+             sizeof(Header) + sizeof(IndexEntry) * (uint64)header->count >
+             size) {
+    error = "Bad index in archive %s";
+  } else {
+    const IndexEntry *index = (const IndexEntry *)(mapped + sizeof(Header));
+    for (int i = 0; i < header->count && !error; i++) {
+      const IndexEntry &entry = index[i];
+      uint64 stored = entry.clen >= 0 ? entry.clen :
+        (entry.len > 0 ? entry.len : 0);
+      if (entry.nameOffset >= size ||
+          memchr(mapped + entry.nameOffset, '\0',
+                 size - entry.nameOffset) == NULL ||
+          entry.offset > size || stored > size - entry.offset ||
+          entry.len < -2 || (entry.clen >= 0 && entry.len <= 0)) {
+        error = "Bad index entry in archive %s";
+      }
+    }
+  }
+  if (error) {
+    int version = header->version;
+    munmap(mapped, size);
+    if (version != ArchiveVersion) {
+      throw Exception(error, version, filename);
+    }
+    throw Exception(error, filename);
+  }
+
+  m_mapped = mapped;
+  m_mappedSize = size;
+  m_index = (const IndexEntry *)(mapped + sizeof(Header));
+  m_count = header->count;
+  m_uncompressed.resize(m_count);
+  Logger::Verbose("mapped %d files from archive %s", m_count, filename);
+}
+
+const FileCache::IndexEntry *FileCache::find(const char *name) const {
+  ASSERT(m_mapped);
+  int lo = 0;
+  int hi = m_count - 1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    int cmp = strcmp(name, m_mapped + m_index[mid].nameOffset);
+    if (cmp == 0) return &m_index[mid];
+    if (cmp < 0) {
+      hi = mid - 1;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return NULL;
+}
+
+char *FileCache::uncompress(const IndexEntry *entry) const {
+  int i = entry - m_index;
+  char *data = *(char * volatile *)&m_uncompressed[i];
+  if (data) return data;
+
+  // Threads missing at the same time all decode it, and the first one to
+  // publish its copy wins. Copies are kept until the cache is destroyed.
+  int len = entry->clen;
+  data = gzdecode(m_mapped + entry->offset, len);
+  if (data == NULL || len != entry->len) {
+    Logger::Error("Bad compressed data for %s in file cache",
+                  m_mapped + entry->nameOffset);
+    if (data) free(data);
+    return NULL;
+  }
+  if (!atomic_cas(m_uncompressed[i], (char *)NULL, data)) {
+    free(data);
+    data = m_uncompressed[i];
+  }
+  return data;
 }
 
 bool FileCache::fileExists(const char *name,
                            bool isRelative /* = true */) const {
   if (isRelative) {
     if (name && *name) {
+      if (m_mapped) {
+        const IndexEntry *entry = find(name);
+        return entry && entry->len >= -1;
+      }
       FileMap::const_iterator iter = m_files.find(name);
       if (iter != m_files.end() && iter->second.len >= -1) {
         return true;
@@ -262,6 +435,10 @@ bool FileCache::dirExists(const char *name,
                           bool isRelative /* = true */) const {
   if (isRelative) {
     if (name && *name) {
+      if (m_mapped) {
+        const IndexEntry *entry = find(name);
+        return entry && entry->len == -2;
+      }
       FileMap::const_iterator iter = m_files.find(name);
       if (iter != m_files.end() && iter->second.len == -2) {
         return true;
@@ -276,6 +453,7 @@ bool FileCache::exists(const char *name,
                        bool isRelative /* = true */) const {
   if (isRelative) {
     if (name && *name) {
+      if (m_mapped) return find(name) != NULL;
       return m_files.find(name) != m_files.end();
     }
     return false;
@@ -284,6 +462,26 @@ bool FileCache::exists(const char *name,
 }
 
 char *FileCache::read(const char *name, int &len, bool &compressed) const {
+  if (name && *name && m_mapped) {
+    const IndexEntry *entry = find(name);
+    if (entry == NULL) return NULL;
+    char *data = m_mapped + entry->offset;
+    if (entry->clen >= 0 && compressed) {
+      len = entry->clen;
+      return data;
+    }
+    compressed = false;
+    len = entry->len;
+    if (len <= 0) {
+      return len == 0 ? (char *)"" : NULL;
+    }
+    if (entry->clen < 0) {
+      return data;
+    }
+    data = uncompress(entry);
+    if (data == NULL) len = -1;
+    return data;
+  }
   if (name && *name) {
     FileMap::const_iterator iter = m_files.find(name);
     if (iter != m_files.end()) {
@@ -25,6 +25,12 @@ namespace HPHP {
 /**
  * Stores file contents in memory. Used by web server for faster static
  * content serving.
+ *
+ * Archives are saved with an index sorted by name, so load() can mmap them
+ * read-only and share the pages with every other server process. read()
+ * then returns pointers into the mapping, and a file stored compressed is
+ * only gunzipped the first time someone asks for it uncompressed. Archives
+ * in the older format are still read into memory as before.
  */
 DECLARE_BOOST_TYPES(FileCache);
 class FileCache {
@@ -32,6 +38,7 @@ public:
   static std::string SourceRoot;
 
 public:
+  FileCache();
   ~FileCache();
 
   /**
@@ -62,7 +69,33 @@ private:
 
   FileMap m_files;
 
+  /**
+   * Mapped archive layout: Header, IndexEntry[count] sorted by name, then
+   * NUL terminated names and file contents, all located by file offsets.
+   */
+  static const int32 ArchiveVersion = 1;
+  struct Header {
+    char magic[8];
+    int32 version;
+    int32 count;
+  };
+  struct IndexEntry {
+    uint64 nameOffset;
+    uint64 offset;  // of the contents, compressed if clen >= 0
+    int32 len;      // uncompressed len     -1: PHP file, -2: directories
+    int32 clen;     // compressed len       -1: stored uncompressed
+  };
+
+  char *m_mapped;
+  size_t m_mappedSize;
+  const IndexEntry *m_index;
+  int m_count;
+  mutable std::vector<char *> m_uncompressed; // by index entry, set once
+
   void writeDirectories(const char *name);
+  void loadMapped(const char *filename, int fd, size_t size);
+  const IndexEntry *find(const char *name) const;
+  char *uncompress(const IndexEntry *entry) const;
 
 };
 
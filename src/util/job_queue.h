@@ -19,7 +19,9 @@
 
 #include "async_func.h"
 #include <vector>
-#include "synchronizable.h"
+#include <climits>
+#include <time.h>
+#include "synchronizable_multi.h"
 #include "lock.h"
 #include "atomic.h"
 
@@ -60,6 +62,18 @@ namespace HPHP {
  * store prepared jobs. With JobQueueDispatcher, job queue is normally empty
  * initially and new jobs are pushed into the queue over time. Also, workers
  * can be stopped individually.
+ *
+ * All worker threads are created by start(), but setMinThreadCount() can
+ * limit how many of them pick up jobs at the same time. The limit grows by
+ * one whenever a job is queued while every allowed worker is busy, and drops
+ * by one whenever an allowed worker sits idle for the given timeout, never
+ * going below the minimum. Workers over the limit stay parked on the queue.
+ *
+ * With lifo set, a new job goes to the worker that became idle most recently,
+ * instead of the one that has been idle the longest. Under moderate load this
+ * keeps jobs on a small set of threads whose caches are still warm, and
+ * lets the others sit idle long enough for setDropCacheTimeout() to have
+ * them give back thread local memory through onThreadIdle().
  */
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -68,16 +82,44 @@ namespace HPHP {
  * A job queue that's suitable for multiple threads to work on.
  */
 template<typename TJob>
-class JobQueue : public Synchronizable {
+class JobQueue : public SynchronizableMulti {
 public:
   // trial class for signaling queue stop
   class StopSignal {};
 
+  // trial class for signaling a worker that has been idle for a while
+  class DropCacheSignal {};
+
 public:
   /**
    * Constructor.
    */
-  JobQueue() : m_stopped(false), m_workerCount(0) {
+  JobQueue(int threadCount, bool lifo)
+    : SynchronizableMulti(threadCount, lifo),
+      m_stopped(false), m_workerCount(0), m_running(0),
+      m_activeLimit(INT_MAX), m_minActive(INT_MAX), m_maxActive(INT_MAX),
+      m_idleSeconds(0), m_dropCacheSeconds(0) {
+  }
+
+  /**
+   * Lets between minActive and maxActive workers take jobs at the same time,
+   * starting with minActive. Must be called before any worker starts.
+   */
+  void setActiveLimit(int minActive, int maxActive, int idleSeconds) {
+    ASSERT(minActive >= 1 && minActive <= maxActive);
+    Lock lock(getMutex());
+    m_activeLimit = m_minActive = minActive;
+    m_maxActive = maxActive;
+    m_idleSeconds = idleSeconds;
+  }
+
+  /**
+   * After waiting this many seconds for a job, a worker that asks for it
+   * gets a DropCacheSignal. 0 turns it off.
+   */
+  void setDropCacheTimeout(int seconds) {
+    Lock lock(getMutex());
+    m_dropCacheSeconds = seconds;
   }
 
   /**
@@ -86,36 +128,86 @@ public:
   void enqueue(TJob job) {
     Lock lock(getMutex());
     m_jobs.push_back(job);
+    if (m_activeLimit < m_maxActive &&
+        m_running + (int)m_jobs.size() > m_activeLimit) {
+      ++m_activeLimit; // every allowed worker is busy: unpark one more
+    }
     notify();
   }
 
   /**
    * Grab a job from the queue for processing. Since the job was not created
    * by this queue class, it's up to a worker class on whether to deallocate
-   * the job object correctly.
+   * the job object correctly. With dropCache set, a worker that has waited
+   * longer than the drop cache timeout gets a DropCacheSignal instead.
    */
-  TJob dequeue() {
+  TJob dequeue(int id, bool dropCache = false) {
     Lock lock(getMutex());
-    while (m_jobs.empty()) {
-      if (m_stopped) {
+    time_t idleSince = time(NULL);
+    while (m_jobs.empty() || m_running >= m_activeLimit) {
+      if (m_stopped && m_jobs.empty()) {
         throw StopSignal();
       }
-      wait();
+      // at the minimum there is no worker left to park
+      bool parking = isAdaptive() && m_idleSeconds > 0 &&
+        m_running < m_activeLimit && m_activeLimit > m_minActive;
+      bool dropping = dropCache && m_dropCacheSeconds > 0;
+      if (!parking && !dropping) {
+        wait(id);
+        continue;
+      }
+
+      int seconds = parking ? m_idleSeconds : INT_MAX;
+      if (dropping) {
+        // measured from when we got here, as waits end early for parking
+        // or for jobs another worker takes first
+        int left = m_dropCacheSeconds - (int)(time(NULL) - idleSince);
+        if (left <= 0) {
+          throw DropCacheSignal();
+        }
+        if (left < seconds) seconds = left;
+      }
+      if (wait(id, seconds)) continue;
+      if (parking && m_jobs.empty() && m_activeLimit > m_minActive) {
+        --m_activeLimit; // nothing to do for a while: park one worker
+      }
     }
     TJob job = m_jobs.front();
     m_jobs.pop_front();
+    atomic_inc(m_running); // finish() decrements it without the lock
     return job;
   }
 
+  /**
+   * Called by a worker after it finished a job it dequeued. It will come
+   * back to dequeue() right away, so nobody else needs to be woken up.
+   */
+  void finish() {
+    atomic_dec(m_running);
+  }
+
   /**
    * Purely for making sure no new jobs are queued when we are stopping.
    */
   void stop() {
     Lock lock(getMutex());
     m_stopped = true;
+    m_activeLimit = m_maxActive; // so parked workers help draining the queue
     notifyAll(); // so all waiting threads can find out queue is stopped
   }
 
+  /**
+   * How many jobs are waiting for a worker, and how many workers may take
+   * jobs right now.
+   */
+  int getQueuedJobs() {
+    Lock lock(getMutex());
+    return m_jobs.size();
+  }
+  int getActiveLimit() {
+    return m_activeLimit;
+  }
+
   /**
    * Keeps track of how many active workers are working on the queue.
    */
@@ -133,6 +225,16 @@ public:
   std::deque<TJob> m_jobs;
   bool m_stopped;
   int m_workerCount;
+  int m_running;     // jobs dequeued but not finished yet
+  int m_activeLimit; // how many workers may run jobs at the same time
+  int m_minActive;
+  int m_maxActive;
+  int m_idleSeconds; // how long a worker waits before parking itself
+  int m_dropCacheSeconds;
+
+  bool isAdaptive() const {
+    return m_minActive < m_maxActive;
+  }
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -170,18 +272,30 @@ public:
   virtual void onThreadEnter() {}
   virtual void onThreadExit() {}
 
+  /**
+   * Called once a worker has waited the queue's drop cache timeout for a
+   * job, so it can give back memory it only keeps around to run jobs faster.
+   */
+  virtual void onThreadIdle() {}
+
   /**
    * Start this worker thread.
    */
   void start() {
     ASSERT(m_queue);
     onThreadEnter();
+    bool idle = false; // caches already dropped since last job
     while (!m_stopped) {
       try {
-        TJob job = m_queue->dequeue();
+        TJob job = m_queue->dequeue(m_id, !idle);
+        idle = false;
         if (countActive) m_queue->incActiveWorker();
         doJob(job);
         if (countActive) m_queue->decActiveWorker();
+        m_queue->finish();
+      } catch (typename JobQueue<TJob>::DropCacheSignal) {
+        onThreadIdle();
+        idle = true;
       } catch (typename JobQueue<TJob>::StopSignal) {
         m_stopped = true; // queue is empty and queue is stopped, so we are done
       }
@@ -217,7 +331,8 @@ public:
   /**
    * Constructor.
    */
-  JobQueueDispatcher(int threadCount, void *opaque) : m_stopped(true) {
+  JobQueueDispatcher(int threadCount, void *opaque, bool lifo = false)
+    : m_stopped(true), m_queue(threadCount, lifo) {
     ASSERT(threadCount >= 1);
     m_workers.resize(threadCount);
     m_funcs.resize(threadCount);
@@ -241,6 +356,33 @@ public:
   int getActiveWorker() {
     return m_queue.getActiveWorker();
   }
+  int getQueuedJobs() {
+    return m_queue.getQueuedJobs();
+  }
+  int getActiveLimit() {
+    return m_queue.getActiveLimit();
+  }
+
+  /**
+   * Lets only minThreadCount workers take jobs at first, and more of them
+   * as load goes up. Must be called before start().
+   */
+  void setMinThreadCount(int minThreadCount, int idleSeconds) {
+    ASSERT(m_stopped);
+    int count = m_workers.size();
+    if (minThreadCount > 0 && minThreadCount < count) {
+      m_queue.setActiveLimit(minThreadCount, count, idleSeconds);
+    }
+  }
+
+  /**
+   * Has workers that waited this many seconds for a job call their
+   * onThreadIdle(). Must be called before start().
+   */
+  void setDropCacheTimeout(int seconds) {
+    ASSERT(m_stopped);
+    m_queue.setDropCacheTimeout(seconds);
+  }
 
   /**
    * Creates worker threads and start running them. This is non-blocking.
@@ -0,0 +1,111 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#include "synchronizable_multi.h"
+#include "base.h"
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+SynchronizableMulti::SynchronizableMulti(int size, bool lifo)
+  : m_lifo(lifo) {
+  ASSERT(size > 0);
+  m_conds.resize(size);
+  for (int i = 0; i < size; i++) {
+    pthread_cond_init(&m_conds[i], NULL);
+  }
+  m_waiting.reserve(size);
+}
+
+SynchronizableMulti::~SynchronizableMulti() {
+  for (unsigned int i = 0; i < m_conds.size(); i++) {
+    pthread_cond_destroy(&m_conds[i]);
+  }
+}
+
+bool SynchronizableMulti::isWaiting(int id) const {
+  for (unsigned int i = 0; i < m_waiting.size(); i++) {
+    if (m_waiting[i] == id) return true;
+  }
+  return false;
+}
+
+void SynchronizableMulti::wait(int id) {
+  ASSERT(id >= 0 && id < (int)m_conds.size());
+  ASSERT(!isWaiting(id));
+  m_waiting.push_back(id);
+  // notify() takes us off m_waiting, anything else is a spurious wakeup
+  do {
+    int ret = pthread_cond_wait(&m_conds[id], &m_mutex.getRaw());
+    ASSERT(ret != EPERM); // did you lock the mutex?
+  } while (isWaiting(id));
+}
+
+bool SynchronizableMulti::wait(int id, long long seconds) {
+  return wait(id, seconds, 0);
+}
+
+bool SynchronizableMulti::wait(int id, long long seconds,
+                               long long nanosecs) {
+  ASSERT(id >= 0 && id < (int)m_conds.size());
+  ASSERT(!isWaiting(id));
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += seconds;
+  ts.tv_nsec += nanosecs;
+  if (ts.tv_nsec >= 1000000000) {
+    ts.tv_sec += ts.tv_nsec / 1000000000;
+    ts.tv_nsec %= 1000000000;
+  }
+
+  m_waiting.push_back(id);
+  do {
+    int ret = pthread_cond_timedwait(&m_conds[id], &m_mutex.getRaw(), &ts);
+    ASSERT(ret != EPERM); // did you lock the mutex?
+    if (ret == ETIMEDOUT) break;
+  } while (isWaiting(id));
+
+  for (unsigned int i = 0; i < m_waiting.size(); i++) {
+    if (m_waiting[i] == id) {
+      m_waiting.erase(m_waiting.begin() + i);
+      return false;
+    }
+  }
+  return true; // notified, even if we timed out right after that
+}
+
+void SynchronizableMulti::notify() {
+  if (m_waiting.empty()) return;
+  int id;
+  if (m_lifo) {
+    id = m_waiting.back();
+    m_waiting.pop_back();
+  } else {
+    id = m_waiting.front();
+    m_waiting.erase(m_waiting.begin());
+  }
+  pthread_cond_signal(&m_conds[id]);
+}
+
+void SynchronizableMulti::notifyAll() {
+  for (unsigned int i = 0; i < m_waiting.size(); i++) {
+    pthread_cond_signal(&m_conds[m_waiting[i]]);
+  }
+  m_waiting.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,59 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef __SYNCHRONIZABLE_MULTI_H__
+#define __SYNCHRONIZABLE_MULTI_H__
+
+#include "mutex.h"
+#include <pthread.h>
+#include <vector>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Same as Synchronizable, except each waiting thread has a condition of its
+ * own, so notify() gets to pick which one to wake up: with lifo set, it is
+ * the one that started waiting most recently, otherwise the one that has
+ * been waiting the longest. Threads are identified by an id between 0 and
+ * size - 1, and only one thread may wait with the same id at a time.
+ */
+class SynchronizableMulti {
+ public:
+  SynchronizableMulti(int size, bool lifo);
+  virtual ~SynchronizableMulti();
+
+  void wait(int id);
+  bool wait(int id, long long seconds); // false if timed out
+  bool wait(int id, long long seconds, long long nanosecs);
+  void notify();
+  void notifyAll();
+
+  Mutex &getMutex() { return m_mutex;}
+
+ private:
+  Mutex m_mutex;
+  std::vector<pthread_cond_t> m_conds;
+  std::vector<int> m_waiting; // ids, in the order they started waiting
+  bool m_lifo;
+
+  bool isWaiting(int id) const;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // __SYNCHRONIZABLE_MULTI_H__